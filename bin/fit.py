@@ -8,8 +8,6 @@ Currently only the multijet analysis is supported.
 import argparse
 import json
 
-import jecfit
-
 
 if __name__ == '__main__':
 
@@ -39,18 +37,81 @@ if __name__ == '__main__':
         '-v', '--verbosity', type=int, default=3,
         help='Verbosity level to be used in the fit'
     )
+    arg_parser.add_argument(
+        '--minos', action='store_true',
+        help='Compute asymmetric MINOS errors for all parameters; not '
+        'supported with --server'
+    )
+    arg_parser.add_argument(
+        '-j', '--threads', type=int, default=1,
+        help='Number of threads for the gradient and MINOS; 0 to use all '
+        'hardware threads'
+    )
+    arg_parser.add_argument(
+        '--server',
+        help='Socket of a fit server to use instead of constructing the '
+        'loss function locally'
+    )
+    arg_parser.add_argument(
+        '--telemetry',
+        help='File or named pipe to which progress of the fit is appended '
+        'as JSON lines; not supported with --server'
+    )
+    arg_parser.add_argument(
+        '--telemetry-interval', type=float, default=1.,
+        help='Minimal interval between records about iterations, in seconds'
+    )
+    arg_parser.add_argument(
+        '--trace',
+        help='Name for JSON file with a trace of the fit in the Chrome '
+        'trace-event format; not supported with --server'
+    )
     args = arg_parser.parse_args()
     
     if not args.multijet:
         raise RuntimeError('No inputs provided.')
     
     
-    loss_func = jecfit.MultijetChi2(
-        args.multijet, args.method, corr_form=args.corr,
-        constraint_option=args.constraint
-    )
+    if args.server and (args.trace or args.telemetry or args.minos):
+        raise RuntimeError(
+            'Tracing, telemetry, and MINOS are not supported with a fit '
+            'server.'
+        )
+    
+    
+    if args.server:
+        from fitclient import RemoteMultijetChi2
+        loss_func = RemoteMultijetChi2(
+            args.multijet, args.method, corr_form=args.corr,
+            constraint_option=args.constraint, socket_path=args.server
+        )
+    else:
+        import jecfit
+
+        if args.trace:
+            jecfit.start_trace(args.trace)
+
+        loss_func = jecfit.MultijetChi2(
+            args.multijet, args.method, corr_form=args.corr,
+            constraint_option=args.constraint, num_threads=args.threads
+        )
+
     loss_func.set_pt_range(0., 1.6e3)
-    fit_results = loss_func.fit(args.verbosity)
+
+    telemetry = None
+
+    if args.telemetry:
+        label = '{} {}'.format(args.period, args.method).strip()
+        telemetry = jecfit.MinuitTelemetry(
+            args.telemetry, args.telemetry_interval, label
+        )
+
+    if args.minos:
+        fit_results = loss_func.minos(args.verbosity, telemetry=telemetry)
+    elif telemetry:
+        fit_results = loss_func.fit(args.verbosity, telemetry=telemetry)
+    else:
+        fit_results = loss_func.fit(args.verbosity)
 
 
     results_to_store = fit_results.serialize()
@@ -66,3 +127,6 @@ if __name__ == '__main__':
     with open(args.output, 'w') as out_file:
         json.dump(results_to_store, out_file, indent=2)
 
+    if args.trace:
+        jecfit.stop_trace()
+
@@ -14,7 +14,6 @@ mpl.use('agg')
 from matplotlib import pyplot as plt
 
 from config import Config
-import jecfit
 from utils import mpl_style
 
 
@@ -31,6 +30,11 @@ if __name__ == '__main__':
         '-o', '--output', default='fig/multijet_residuals.pdf',
         help='Name for output figure file'
     )
+    arg_parser.add_argument(
+        '--server',
+        help='Socket of a fit server to use instead of constructing the '
+        'loss function locally'
+    )
     args = arg_parser.parse_args()
 
     fig_dir = os.path.dirname(args.output)
@@ -78,10 +82,20 @@ if __name__ == '__main__':
             nuisances[param['name']] = param['value']
 
 
-    measurement = jecfit.MultijetChi2(
-        args.inputs, args.method, corr_form=corr_form,
-        constraint_option=fit.get('constraint', None)
-    )
+    if args.server:
+        from fitclient import RemoteMultijetChi2
+        measurement = RemoteMultijetChi2(
+            args.inputs, args.method, corr_form=corr_form,
+            constraint_option=fit.get('constraint', None),
+            socket_path=args.server
+        )
+    else:
+        import jecfit
+        measurement = jecfit.MultijetChi2(
+            args.inputs, args.method, corr_form=corr_form,
+            constraint_option=fit.get('constraint', None)
+        )
+
     max_pt = 1.6e3
     measurement.set_pt_range(0., max_pt)
 
@@ -0,0 +1,164 @@
+#!/usr/bin/env python
+
+"""Plots results of the scaling benchmark.
+
+Reads the CSV file produced by program benchmark and plots the parallel
+efficiency in the strong- and weak-scaling sweeps as a function of the
+number of threads, as well as the single-thread throughput and the peak
+memory as a function of the size of the problem.
+"""
+
+import argparse
+import csv
+import os
+from collections import defaultdict
+
+import matplotlib as mpl
+mpl.use('agg')
+from matplotlib import pyplot as plt
+
+from utils import mpl_style
+
+
+def read_results(path):
+    """Read results of the benchmark from a CSV file.
+
+    Return value:
+        List of dictionaries, one per configuration, with numeric values
+        converted to int or float.
+    """
+
+    int_columns = {'chi2_bins', 'jet_bins', 'nuisances', 'params', 'threads', 'batch_size'}
+    results = []
+
+    with open(path) as f:
+        for row in csv.DictReader(f):
+            for key, value in row.items():
+                if key in int_columns:
+                    row[key] = int(value)
+                elif key != 'mode':
+                    row[key] = float(value)
+
+            results.append(row)
+
+    return results
+
+
+def plot_efficiency(results, fig_name):
+    """Plot parallel efficiency versus the number of threads."""
+
+    fig = plt.figure()
+    fig.patch.set_alpha(0.)
+    axes = fig.add_subplot(111)
+
+    series = defaultdict(list)
+
+    for row in results:
+        if row['mode'] == 'strong':
+            label = 'Strong, {} $\\chi^2$ bins, {} jet bins, {} nuis.'.format(
+                row['chi2_bins'], row['jet_bins'], row['nuisances']
+            )
+        else:
+            label = 'Weak, {} $\\chi^2$ bins, {} jet bins'.format(
+                row['chi2_bins'], row['jet_bins']
+            )
+
+        series[row['mode'] == 'weak', label].append(
+            (row['threads'], row['efficiency'])
+        )
+
+    for (weak, label), points in sorted(series.items()):
+        points.sort()
+        axes.plot(
+            [p[0] for p in points], [p[1] for p in points],
+            marker='o', ls='dashed' if weak else 'solid', label=label
+        )
+
+    axes.axhline(1., c='black', ls='dotted', lw=0.8)
+    axes.set_xscale('log', base=2)
+    axes.set_ylim(0., 1.2)
+    axes.set_xlabel('Number of threads')
+    axes.set_ylabel('Parallel efficiency')
+    axes.legend(fontsize='x-small')
+
+    fig.savefig(fig_name)
+    plt.close(fig)
+
+
+def plot_size_scaling(results, fig_name):
+    """Plot single-thread throughput and peak memory versus problem size.
+
+    The size is measured with the number of elements in the main loop
+    of the computation, which is the product of the numbers of chi^2
+    bins and jet bins.
+    """
+
+    fig = plt.figure(figsize=(6.4, 7.))
+    fig.patch.set_alpha(0.)
+    gs = mpl.gridspec.GridSpec(2, 1, hspace=0.)
+    axes_rate = fig.add_subplot(gs[0, 0])
+    axes_rss = fig.add_subplot(gs[1, 0], sharex=axes_rate)
+
+    min_threads = min(row['threads'] for row in results)
+    series = defaultdict(list)
+
+    for row in results:
+        if row['mode'] != 'strong' or row['threads'] != min_threads:
+            continue
+
+        series[row['nuisances']].append((
+            row['chi2_bins'] * row['jet_bins'],
+            row['evals_per_s'], row['peak_rss_mb']
+        ))
+
+    for nuisances, points in sorted(series.items()):
+        points.sort()
+        label = '{} nuisances'.format(nuisances)
+        axes_rate.plot(
+            [p[0] for p in points], [p[1] for p in points],
+            marker='o', label=label
+        )
+        axes_rss.plot(
+            [p[0] for p in points], [p[2] for p in points],
+            marker='o', label=label
+        )
+
+    axes_rate.set_xscale('log')
+    axes_rate.set_yscale('log')
+    axes_rate.set_ylabel('Evaluations / s ({} thread{})'.format(
+        min_threads, '' if min_threads == 1 else 's'
+    ))
+    axes_rate.legend()
+    plt.setp(axes_rate.get_xticklabels(), visible=False)
+
+    axes_rss.set_xlabel('$\\chi^2$ bins $\\times$ jet bins')
+    axes_rss.set_ylabel('Peak RSS [MiB]')
+
+    fig.savefig(fig_name)
+    plt.close(fig)
+
+
+if __name__ == '__main__':
+
+    arg_parser = argparse.ArgumentParser(__doc__)
+    arg_parser.add_argument(
+        'results', nargs='?', default='benchmark.csv',
+        help='CSV file produced by program benchmark'
+    )
+    arg_parser.add_argument(
+        '--fig-dir', default='fig/benchmark', help='Directory to store plots'
+    )
+    args = arg_parser.parse_args()
+
+    try:
+        os.makedirs(args.fig_dir)
+    except FileExistsError:
+        pass
+
+    plt.style.use(mpl_style)
+
+
+    results = read_results(args.results)
+
+    plot_efficiency(results, os.path.join(args.fig_dir, 'efficiency.pdf'))
+    plot_size_scaling(results, os.path.join(args.fig_dir, 'size.pdf'))
@@ -0,0 +1,50 @@
+#!/usr/bin/env python
+
+"""Runs a campaign of fits described in a YAML file.
+
+Jobs that have already been completed in the working directory of the
+campaign are not rerun, unless their description has changed.  Thus, an
+interrupted campaign can be resumed by running this script again.
+"""
+
+import argparse
+import sys
+
+from campaign import Campaign
+
+
+if __name__ == '__main__':
+
+    arg_parser = argparse.ArgumentParser(description=__doc__)
+    arg_parser.add_argument('config', help='YAML file describing the campaign')
+    arg_parser.add_argument(
+        '-w', '--workdir',
+        help='Working directory for outputs and state of the campaign'
+    )
+    arg_parser.add_argument(
+        '-j', '--workers', type=int, help='Number of worker processes'
+    )
+    arg_parser.add_argument(
+        '-n', '--dry-run', action='store_true',
+        help='Only list jobs that would be run'
+    )
+    args = arg_parser.parse_args()
+
+
+    campaign = Campaign(args.config, args.workdir, args.workers)
+
+    if args.dry_run:
+        for name in campaign.plan():
+            print(name)
+
+        sys.exit(0)
+
+    outcome = campaign.run()
+    num_failed = sum(1 for status in outcome.values() if status != 'done')
+
+    print('{} jobs run, {} failed or skipped.'.format(
+        len(outcome), num_failed
+    ))
+
+    if num_failed > 0:
+        sys.exit(1)
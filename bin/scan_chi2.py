@@ -1,6 +1,10 @@
 #!/usr/bin/env python
 
-"""Plots 1D and 2D chi^2 scans around the minimum."""
+"""Plots 1D and 2D chi^2 scans around the minimum.
+
+Computed points are saved in record files in the output directory.  If
+the script is interrupted, running it again resumes the scans.
+"""
 
 import argparse
 import itertools
@@ -13,11 +17,8 @@ import matplotlib as mpl
 mpl.use('agg')
 from matplotlib import pyplot as plt
 
-import ROOT
-ROOT.PyConfig.IgnoreCommandLineOptions = True
-
 from config import Config
-import jecfit
+from records import RecordFile, grid_signature
 from utils import mpl_style
 
 
@@ -33,10 +34,46 @@ def find_bin_edges(centres):
     return edges
 
 
+def compute_chi2(loss_func, points, record_path):
+    """Compute chi^2 at given points, resuming previous computation.
+
+    Values of chi^2 are appended to the given record file as they are
+    computed, and points already present in the file are skipped.  This
+    allows an interrupted scan to be resumed.
+
+    Arguments:
+        loss_func:  Loss function to evaluate.
+        points:  Array of shape (n, 2) with values of POI.
+        record_path:  Path to the record file.
+
+    Return value:
+        NumPy array with values of chi^2 at all points.
+    """
+
+    signature = grid_signature(
+        points.ravel(), definition=loss_func.definition
+    )
+
+    with RecordFile(record_path, 1, signature=signature) as records:
+        completed = records.completed()
+
+        if completed:
+            print('Resuming scan with {} of {} points computed.'.format(
+                len(completed), len(points)
+            ))
+
+        for i in range(len(points)):
+            if i not in completed:
+                records.append(i, [loss_func(points[i])])
+
+        values = records.read()
+
+    return np.array([values[i][0] for i in range(len(points))])
+
+
 if __name__ == '__main__':
     
     plt.style.use(mpl_style)
-    ROOT.gROOT.SetBatch(True)
     
     arg_parser = argparse.ArgumentParser(__doc__)
     arg_parser.add_argument(
@@ -51,6 +88,11 @@ if __name__ == '__main__':
         '-o', '--output', default='fig/scans',
         help='Directory for produced plots'
     )
+    arg_parser.add_argument(
+        '--server',
+        help='Socket of a fit server to use instead of constructing the '
+        'loss function locally'
+    )
     args = arg_parser.parse_args()
     
     if not args.multijet:
@@ -69,7 +111,19 @@ if __name__ == '__main__':
     config = Config('config/plot_config.yaml')
     
     
-    loss_func = jecfit.MultijetChi2(args.multijet, args.method)
+    if args.server:
+        from fitclient import RemoteMultijetChi2
+        loss_func = RemoteMultijetChi2(
+            args.multijet, args.method, socket_path=args.server
+        )
+    else:
+        import ROOT
+        ROOT.PyConfig.IgnoreCommandLineOptions = True
+        ROOT.gROOT.SetBatch(True)
+
+        import jecfit
+        loss_func = jecfit.MultijetChi2(args.multijet, args.method)
+
     loss_func.set_pt_range(0., 1.6e3)
     fit_results = loss_func.fit()
     
@@ -84,10 +138,10 @@ if __name__ == '__main__':
         )
         x[:, 1 - ivar] = fit_results.parameters[1 - ivar].value
         
-        chi2 = np.empty(len(x))
-        
-        for i in range(len(x)):
-            chi2[i] = loss_func(x[i])
+        chi2 = compute_chi2(
+            loss_func, x,
+            os.path.join(args.output, 'scan_p{:d}.rec'.format(ivar))
+        )
         
         fig = plt.figure()
         fig.patch.set_alpha(0.)
@@ -123,10 +177,10 @@ if __name__ == '__main__':
     p0_values = np.linspace(v.value - error_sf * v.error, v.value + error_sf * v.error, num=51)
     v = fit_results.parameters[1]
     p1_values = np.linspace(v.value - error_sf * v.error, v.value + error_sf * v.error, num=51)
-    chi2 = np.empty((len(p0_values), len(p1_values)))
-    
-    for i, j in itertools.product(range(len(p0_values)), range(len(p1_values))):
-        chi2[i, j] = loss_func([p0_values[i], p1_values[j]])
+    points = np.array(list(itertools.product(p0_values, p1_values)))
+    chi2 = compute_chi2(
+        loss_func, points, os.path.join(args.output, 'scan_2d.rec')
+    ).reshape((len(p0_values), len(p1_values)))
     
     
     fig = plt.figure()
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+
+class JetCorrBase;
+
+
+/**
+ * \class CorrectionTable
+ * \brief Values of a jet correction at fixed points in pt shared among several consumers
+ *
+ * Consumers, such as measurements included in a loss function, register sets of values of pt at
+ * which they need the jet correction. The sets are merged, and duplicate values are evaluated only
+ * once. Method Update evaluates the correction at all distinct points with a single batched call,
+ * and each consumer then reads the values for its own set, in the order in which the points were
+ * registered.
+ *
+ * The update is incremental in the same way as in MultijetCrawlingBins::JetCache: if the
+ * correction has the same configuration as in the previous update, only points in the range of pt
+ * affected by the parameters that have changed, as reported by JetCorrBase::GetParamSupport, are
+ * reevaluated. The values for all points are always valid for the last correction given to
+ * Update.
+ */
+class CorrectionTable
+{
+public:
+    /// Constructs an empty table
+    CorrectionTable();
+
+public:
+    /**
+     * \brief Registers a set of values of pt and returns its index
+     *
+     * The values must be finite. An empty set is allowed. Registering a set invalidates all
+     * values, and they are recomputed in full at the next update.
+     */
+    unsigned AddPoints(std::vector<double> const &pts);
+
+    /**
+     * \brief Returns values of the correction for the set with the given index
+     *
+     * The returned array follows the order of the values of pt given to AddPoints. It is only
+     * valid after a call to Update and until the next registration of a set.
+     */
+    double const *GetCorrections(unsigned set) const;
+
+    /// Returns the number of distinct values of pt among all sets
+    unsigned GetNumDistinctPoints() const;
+
+    /// Returns the total number of values of pt in all sets, including duplicates
+    unsigned GetNumPoints() const;
+
+    /// Evaluates the given correction at all registered points
+    void Update(JetCorrBase const &corrector);
+
+private:
+    /// Values of pt from all sets, concatenated in the order of registration
+    std::vector<double> points;
+
+    /// Indices of the first points of all sets in vector points, followed by its size
+    std::vector<unsigned> setOffsets;
+
+    /// Distinct values of pt, sorted in the increasing order
+    std::vector<double> distinctPoints;
+
+    /// Index in distinctPoints for each element of points
+    std::vector<unsigned> pointIndices;
+
+    /// Corrections evaluated at distinctPoints
+    std::vector<double> distinctCorrections;
+
+    /// Corrections for all elements of points
+    std::vector<double> corrections;
+
+    /**
+     * \brief Configuration identifier and parameters of the correction used in the last update
+     *
+     * A zero identifier, which is never assigned to a correction, forces a full update.
+     */
+    std::uint64_t corrConfigId;
+    std::vector<double> corrParams;
+};
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <CorrectionTable.hpp>
 #include <Nuisances.hpp>
 
+#include <cstdint>
 #include <memory>
 #include <ostream>
+#include <utility>
 #include <vector>
 
 
@@ -26,9 +29,38 @@ public:
     /// Applies the correction to the given jet pt, returning the corrected pt
     double Apply(double pt) const;
     
+    /**
+     * \brief Creates a copy of this correction
+     * 
+     * The copy can be used independently of the original object, for instance, in a different
+     * thread. Derived classes should reimplement this method. The default implementation throws
+     * an exception.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const;
+    
+    /**
+     * \brief Returns identifier of the fixed configuration of this object
+     *
+     * Every constructed object receives a unique identifier, which is also assigned to its copies.
+     * A new identifier is assigned whenever a fixed (non-parameter) setting of the correction is
+     * changed. Two objects with the same identifier and the same values of the parameters compute
+     * the same correction, which allows to cache values of the correction.
+     */
+    std::uint64_t GetConfigId() const;
+
     /// Returns number of parameters of the correction
     unsigned GetNumParams() const;
     
+    /**
+     * \brief Returns range in pt in which the correction depends on the given parameter
+     *
+     * Outside of the returned range, the correction does not change when only the given parameter
+     * is varied. This allows to recompute only the affected part of cached values of the
+     * correction. The range refers to uncorrected pt, and its boundaries are included. The default
+     * implementation returns the full range (0, +inf), which is always valid.
+     */
+    virtual std::pair<double, double> GetParamSupport(unsigned index) const;
+
     /// Returns set values for parameters of the correction
     std::vector<double> const &GetParams() const;
     
@@ -39,6 +71,15 @@ public:
      */
     virtual double Eval(double pt) const = 0;
     
+    /**
+     * \brief Evaluates the correction for an array of jet pt
+     * 
+     * Writes the correction for pt[i] into corrections[i]. The two arrays may coincide. The
+     * default implementation calls Eval for each value. A derived class can reimplement this
+     * method to share computations among the values and to allow their vectorization.
+     */
+    virtual void EvalBatch(double const *pt, double *corrections, unsigned n) const;
+    
     /**
      * \brief Updates parameters of the correction
      * 
@@ -64,6 +105,13 @@ public:
     virtual double UndoCorr(double pt, double tolerance = 1e-10) const;
 
 protected:
+    /**
+     * \brief Assigns a new configuration identifier
+     *
+     * Must be called by derived classes whenever they change a fixed setting of the correction.
+     */
+    void ConfigChanged();
+
     /**
      * \brief Hook that is called each time after parameters have been updated via SetParams
      *
@@ -76,6 +124,10 @@ protected:
 protected:
     /// Current parameters of the correction
     std::vector<double> parameters;
+
+private:
+    /// Identifier of the fixed configuration, as returned by GetConfigId
+    std::uint64_t configId;
 };
 
 
@@ -98,6 +150,27 @@ public:
     virtual ~MeasurementBase() = default;
     
 public:
+    /**
+     * \brief Creates a copy of this measurement
+     * 
+     * The copy must be usable independently of the original object, in particular, its method
+     * Eval can be called concurrently with that of the original object. Inputs that are not
+     * modified after construction can be shared between the copies. Derived classes should
+     * reimplement this method. The default implementation throws an exception.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const;
+    
+    /**
+     * \brief Returns values of pt at which the measurement evaluates the jet correction
+     * 
+     * Only values that are fixed at construction and do not depend on the parameters of the
+     * correction nor on nuisances can be reported. When the measurement is added to a
+     * CombLossFunction, the values are registered in a CorrectionTable shared with other
+     * measurements, and the loss function then evaluates the deviation with EvalWithCorrections.
+     * The default implementation returns an empty vector.
+     */
+    virtual std::vector<double> GetCorrectionPoints() const;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
@@ -113,6 +186,29 @@ public:
      * To be implemented in a derived class.
      */
     virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const = 0;
+    
+    /**
+     * \brief Evaluates the deviation for several points at once
+     * 
+     * Parameters of the jet correction for point i are read from
+     * corrParams + i * corrector.GetNumParams(), and the deviation computed with them and
+     * nuisances[i] is written into results[i]. The given corrector is used to evaluate the
+     * correction, and its parameters are left in an unspecified state. The default implementation
+     * calls Eval for each point. A derived class can reimplement this method to share
+     * computations among the points.
+     */
+    virtual void EvalMany(JetCorrBase &corrector, double const *corrParams,
+      Nuisances const *nuisances, unsigned numPoints, double *results) const;
+    
+    /**
+     * \brief Evaluates the deviation using precomputed values of the jet correction
+     * 
+     * The array corrections contains values of the given correction at the points returned by
+     * GetCorrectionPoints, in the same order. The result must be the same as computed by Eval.
+     * The default implementation ignores the precomputed values and calls Eval.
+     */
+    virtual double EvalWithCorrections(JetCorrBase const &corrector, Nuisances const &nuisances,
+      double const *corrections) const;
 };
 
 
@@ -149,10 +245,29 @@ public:
     /**
      * \brief Adds a new measurement that will contribute to the loss function
      * 
-     * Provided object is not owned by this.
+     * Provided object is not owned by this. Points in pt reported by
+     * MeasurementBase::GetCorrectionPoints are registered in the shared table of corrections.
      */
     void AddMeasurement(MeasurementBase const *measurement);
     
+    /**
+     * \brief Creates an independent copy of this loss function
+     * 
+     * The jet correction and all measurements are cloned, and the new object owns the copies.
+     * This allows evaluating the loss function concurrently in several threads, using a separate
+     * copy in each of them. Throws an exception if the correction or one of the measurements does
+     * not support cloning.
+     */
+    virtual std::unique_ptr<CombLossFunction> Clone() const;
+    
+    /**
+     * \brief Returns the table of corrections shared by the measurements
+     * 
+     * Values in the table correspond to the last evaluation of the loss function with
+     * EvalRawInput or Eval.
+     */
+    CorrectionTable const &GetCorrectionTable() const;
+    
     /**
      * \brief Returns the number of degrees of freedom
      * 
@@ -185,10 +300,32 @@ public:
      * 
      * Evaluates the combined loss function for the given point. The argument is a pointer to an
      * array, which contains values of the parameters of the jet correction followed by
-     * marginalized nuisances. 
+     * marginalized nuisances. The correction is evaluated once at the merged points of all
+     * measurements, see MeasurementBase::GetCorrectionPoints.
      */
     virtual double EvalRawInput(double const *x) const;
     
+    /**
+     * \brief Evaluates the combined loss function at several points
+     * 
+     * The array x contains numPoints consecutive points, each in the format expected by
+     * EvalRawInput, and the values of the loss function are written into results. Points are
+     * passed to MeasurementBase::EvalMany in groups of up to maxBatchSize. The results agree with
+     * EvalRawInput up to rounding errors. The shared CorrectionTable is not used here, since each
+     * point has its own parameters of the correction; measurements evaluate the correction
+     * themselves.
+     */
+    virtual void EvalRawInputMany(double const *x, unsigned numPoints, double *results) const;
+    
+public:
+    /**
+     * \brief Maximal number of points evaluated together in EvalRawInputMany
+     * 
+     * Matches the width of tiles in the matrix product used by the multijet measurements, see
+     * matrixProductTileWidth.
+     */
+    static constexpr unsigned maxBatchSize = 8;
+    
 protected:
     /// Jet corrector object
     std::unique_ptr<JetCorrBase> corrector;
@@ -198,5 +335,29 @@ protected:
     
     /// Non-owning pointers to individual contributing measurements
     std::vector<MeasurementBase const *> measurements;
+    
+    /**
+     * \brief Measurements owned by this
+     * 
+     * Only filled in objects created with method Clone. Pointers to these measurements are also
+     * included in the vector measurements.
+     */
+    std::vector<std::unique_ptr<MeasurementBase>> ownedMeasurements;
+    
+    /// Values of the correction at points requested by all measurements
+    mutable CorrectionTable correctionTable;
+    
+    /// Index of the set in correctionTable for each measurement
+    std::vector<unsigned> correctionSets;
+    
+private:
+    /// Buffer for parameters of the jet correction for points evaluated by EvalRawInputMany
+    mutable std::vector<double> batchCorrParams;
+    
+    /// Nuisances for points evaluated by EvalRawInputMany
+    mutable std::vector<Nuisances> batchNuisances;
+    
+    /// Buffer for deviations computed by individual measurements in EvalRawInputMany
+    mutable std::vector<double> batchResults;
 };
 
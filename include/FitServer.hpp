@@ -0,0 +1,203 @@
+#pragma once
+
+#include <FitBase.hpp>
+#include <JetCorrConstraint.hpp>
+#include <MultijetCrawlingBins.hpp>
+#include <Nuisances.hpp>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * \class FitServer
+ * \brief Server that keeps loss functions loaded and evaluates them on request
+ *
+ * The server listens on a UNIX-domain socket. Clients load named configurations of the loss
+ * function, which are built once and then shared by all clients, and request evaluations, fits,
+ * scans, and residuals for them. Each connection is served in a separate thread. Requests that
+ * evaluate the loss function use copies of it obtained with CombLossFunction::Clone, so that
+ * requests for the same configuration are also executed concurrently. Since ROOT objects are
+ * then created and read from several threads, the constructor enables thread safety in ROOT.
+ *
+ * Messages in both directions consist of a 32-bit length followed by a payload of that length.
+ * All numbers are little-endian. A request starts with an 8-bit code from enum Request, which is
+ * followed by the name of the configuration and request-specific fields. A response starts with
+ * an 8-bit status, which is 0 on success and 1 on failure. In the latter case it is followed by
+ * the error message. Strings are encoded as their 32-bit length followed by the characters, and
+ * arrays of numbers as their 32-bit length followed by 64-bit values. The layout of each request
+ * and response is documented in the Python client, python/fitclient.py.
+ */
+class FitServer
+{
+public:
+    /// Codes of supported requests
+    enum class Request: unsigned char
+    {
+        Load = 1,
+        Eval = 2,
+        EvalBatch = 3,
+        Fit = 4,
+        Scan = 5,
+        Residuals = 6
+    };
+
+    /**
+     * \brief Definition of a configuration of the loss function
+     *
+     * The loss function includes the multijet measurement and optionally a constraint.
+     */
+    struct ConfigurationSpec
+    {
+        /// Path to the file with inputs for the multijet analysis
+        std::string inputPath;
+
+        /// Method for the multijet analysis, "PtBal" or "MPF"
+        std::string method;
+
+        /**
+         * \brief Functional form of the jet correction
+         *
+         * Same labels as in function create_correction in python/jecfit.py: "2p", "spline",
+         * "bspline", or "expr:<formula>".
+         */
+        std::string corrForm;
+
+        /**
+         * \brief Constraint for the jet correction
+         *
+         * Given in the form "[ptRef,]correction,relUnc". Empty string means no constraint.
+         */
+        std::string constraint;
+
+        /// Storage for inputs, "double", "float", or "scaled-float"
+        std::string storage;
+
+        /// Systematic uncertainties to ignore
+        std::set<std::string> excludedSysts;
+
+        /// Range in pt of the leading jet
+        double minPtLead, maxPtLead;
+
+        bool operator==(ConfigurationSpec const &other) const;
+    };
+
+private:
+    /// Loaded configuration of the loss function
+    struct Configuration
+    {
+        ConfigurationSpec spec;
+        NuisanceDefinitions nuisanceDefs;
+
+        /**
+         * \brief Original measurements and loss function
+         *
+         * They are never evaluated, only cloned, and therefore can be accessed concurrently.
+         */
+        std::unique_ptr<MultijetCrawlingBins> measurement;
+        std::unique_ptr<JetCorrConstraint> constraint;
+        std::unique_ptr<CombLossFunction> lossFunc;
+
+        /// Separate copy of the measurement and jet correction to compute residuals
+        std::unique_ptr<MultijetCrawlingBins> residualMeasurement;
+        std::unique_ptr<JetCorrBase> residualCorrector;
+
+        /**
+         * \brief Copies of the loss function not used by any request at the moment
+         *
+         * New copies are created when all existing ones are in use.
+         */
+        std::vector<std::unique_ptr<CombLossFunction>> freeContexts;
+
+        /// Mutex that protects freeContexts
+        std::mutex contextsMutex;
+
+        /// Mutex that protects residualMeasurement and residualCorrector
+        std::mutex residualsMutex;
+    };
+
+    class Context;
+
+public:
+    /**
+     * \brief Creates a socket at the given path and starts listening
+     *
+     * Throws an exception if another server is already listening on the same path. A stale socket
+     * file left by a server that has terminated is replaced.
+     */
+    FitServer(std::string const &socketPath);
+
+    FitServer(FitServer const &) = delete;
+
+    /// Closes the socket and removes the socket file
+    ~FitServer() noexcept;
+
+    FitServer &operator=(FitServer const &) = delete;
+
+public:
+    /**
+     * \brief Loads a configuration in advance
+     *
+     * Clients can then use it by name. If a configuration with the same name has already been
+     * loaded, the specification must be identical.
+     */
+    void Load(std::string const &name, ConfigurationSpec const &spec);
+
+    /**
+     * \brief Accepts and serves connections until Stop is called
+     *
+     * Waits for all connections to be closed before returning.
+     */
+    void Run();
+
+    /**
+     * \brief Requests the server to stop
+     *
+     * Can be called from any thread. Open connections are shut down.
+     */
+    void Stop();
+
+private:
+    /// Constructs a configuration of the loss function from its specification
+    static std::unique_ptr<Configuration> CreateConfiguration(ConfigurationSpec const &spec);
+
+    /// Finds a configuration by name, or throws an exception if it has not been loaded
+    Configuration &GetConfiguration(std::string const &name);
+
+    /// Reads requests from a connection and answers them until the client disconnects
+    void ServeConnection(int fd);
+
+    /// Executes a request and returns the payload of the response
+    std::string HandleRequest(std::string const &request);
+
+private:
+    /// Path to the socket file
+    std::string socketPath;
+
+    /// Descriptor of the listening socket
+    int listenFd;
+
+    /// Flag indicating that the server has been requested to stop
+    std::atomic<bool> stopping;
+
+    /// Loaded configurations
+    std::map<std::string, std::unique_ptr<Configuration>> configurations;
+
+    /// Mutex that protects the map of configurations
+    std::mutex configurationsMutex;
+
+    /// Threads serving connections and flags indicating that they have finished
+    std::vector<std::pair<std::thread, std::shared_ptr<std::atomic<bool>>>> connectionThreads;
+
+    /// Descriptors of open connections
+    std::set<int> connectionFds;
+
+    /// Mutex that protects connectionThreads and connectionFds
+    std::mutex connectionsMutex;
+};
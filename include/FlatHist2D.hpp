@@ -0,0 +1,151 @@
+#pragma once
+
+#include <TH2.h>
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * \struct StoragePrecision
+ * \brief Summary of the loss of precision due to a compact storage of inputs
+ *
+ * Measurements that support compact storage compare the results obtained with the full and compact
+ * storage when they are constructed, and this structure reports the deviations. Deviations are
+ * computed with method Deviation, so that a zero reference value, such as in an empty bin, does
+ * not produce an infinite or undefined result.
+ */
+struct StoragePrecision
+{
+    /**
+     * \brief Computes the deviation of a value from a reference
+     *
+     * Returns the relative deviation if the reference is not zero and the absolute one otherwise.
+     */
+    static double Deviation(double value, double reference);
+
+    /// Maximal relative deviation in the mean value of the balance observable among all bins
+    double maxRelErrorBalance;
+
+    /// Relative deviation in the total chi^2
+    double relErrorChi2;
+};
+
+
+/**
+ * \class FlatHist2D
+ * \brief Dense copy of the contents of a two-dimensional histogram
+ *
+ * Bin contents are stored in a contiguous row-major array, with rows corresponding to bins along
+ * the x axis. This allows sums over bins along the y axis, which are the innermost loops in the
+ * computation of the balance observables, to be performed with vectorized kernels. Under- and
+ * overflow bins are not stored. Bin indices in the interface follow the ROOT convention, i.e. start
+ * from 1.
+ *
+ * Optionally, bin contents can be stored in single precision, which halves the memory footprint.
+ * Sums are still accumulated in double precision, using the compensated summation.
+ */
+class FlatHist2D
+{
+public:
+    /// Supported ways to store bin contents
+    enum class Storage
+    {
+        /// Double precision
+        Double,
+
+        /// Single precision
+        Float,
+
+        /**
+         * Single precision, relative to a per-row scale factor
+         *
+         * The scale factor is given by the maximal absolute value in the row. This protects
+         * against the limited exponent range of single-precision numbers.
+         */
+        ScaledFloat
+    };
+
+public:
+    /// Constructs an empty object
+    FlatHist2D();
+
+    /// Copies contents of the given histogram
+    FlatHist2D(TH2 const &hist, Storage storage = Storage::Double);
+
+public:
+    /**
+     * \brief Computes a weighted sum of bin contents in the given row
+     *
+     * Returns sum_{binY = firstBinY}^{lastBinY} content(binX, binY) * weights[binY - 1]. Both
+     * boundaries of the range are included. If lastBinY < firstBinY, returns zero.
+     */
+    double Dot(unsigned binX, double const *weights, unsigned firstBinY, unsigned lastBinY) const;
+
+    /**
+     * \brief Computes two weighted sums of bin contents in the given row in a single pass
+     *
+     * The result is equivalent to {Dot(binX, weights1, ...), Dot(binX, weights2, ...)}, but the
+     * bin contents are read only once.
+     */
+    std::array<double, 2> DotPair(unsigned binX, double const *weights1, double const *weights2,
+      unsigned firstBinY, unsigned lastBinY) const;
+
+    /// Returns content of the given bin
+    double GetBinContent(unsigned binX, unsigned binY) const;
+
+    /// Returns the number of bytes used to store bin contents
+    std::size_t GetMemorySize() const;
+
+    /// Returns number of bins along the x axis
+    unsigned GetNbinsX() const;
+
+    /// Returns number of bins along the y axis
+    unsigned GetNbinsY() const;
+
+    /// Returns the current storage mode
+    Storage GetStorage() const;
+
+    /**
+     * \brief Computes weighted sums of bin contents in a range of rows for several sets of
+     * weights
+     *
+     * The weights form a matrix with numColumns columns, which is stored by rows and whose row
+     * index is binY - 1. For each binX in [firstBinX, lastBinX] and column j, computes
+     *   results[(binX - firstBinX) * numColumns + j] = sum_{binY = firstBinY}^{lastBinY}
+     *     content(binX, binY) * weights[(binY - 1) * numColumns + j],
+     * i.e. the product of a block of the histogram and the matrix of weights. With a single
+     * column, the result is equivalent to calling Dot for each row, up to rounding errors, but
+     * with single-precision storage modes the summation is not compensated. If lastBinY <
+     * firstBinY, the sums are zero.
+     */
+    void MultiplyRows(unsigned firstBinX, unsigned lastBinX, double const *weights,
+      unsigned numColumns, unsigned firstBinY, unsigned lastBinY, double *results) const;
+
+    /**
+     * \brief Converts bin contents to the given storage mode
+     *
+     * The precision lost when converting to a single-precision mode is not recovered when
+     * converting back to Storage::Double.
+     */
+    void SetStorage(Storage storage);
+
+private:
+    /// Numbers of bins along the two axes
+    unsigned numBinsX, numBinsY;
+
+    /// Current storage mode
+    Storage storage;
+
+    /**
+     * \brief Bin contents in row-major order
+     *
+     * Depending on the storage mode, only one of the two vectors is filled.
+     */
+    std::vector<double> contents;
+    std::vector<float> compactContents;
+
+    /// Per-row scale factors for Storage::ScaledFloat
+    std::vector<double> rowScales;
+};
@@ -18,6 +18,13 @@ public:
     JetCorrConstraint(double ptRef, double targetCorrection, double relUncertainty);
     
 public:
+    /**
+     * \brief Creates a copy of this measurement
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
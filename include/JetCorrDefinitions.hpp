@@ -34,6 +34,13 @@ public:
     JetCorrStableLogLin(double ptMin = 15.);
     
 public:
+    /**
+     * \brief Creates a copy of this correction
+     * 
+     * Reimplemented from JetCorrBase.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    
     /**
      * \brief Computes correction for a jet with given pt
      * 
@@ -73,6 +80,13 @@ public:
     JetCorrStd2P();
     
 public:
+    /**
+     * \brief Creates a copy of this correction
+     * 
+     * Reimplemented from JetCorrBase.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    
     /**
      * \brief Computes correction for a jet with given pt
      * 
@@ -80,6 +94,13 @@ public:
      */
     virtual double Eval(double pt) const override;
     
+    /**
+     * \brief Computes correction for an array of jet pt
+     * 
+     * Reimplemented from JetCorrBase.
+     */
+    virtual void EvalBatch(double const *pt, double *corrections, unsigned n) const override;
+    
     /// Sets parameters of the single-pion response
     void SetParamsSPR(std::initializer_list<double> paramsSPR);
     
@@ -92,6 +113,9 @@ protected:
      */
     double fSPR(double pt) const;
     
+    /// Computes single-pion response given precomputed pt^paramsSPR[2]
+    double fSPRFromPower(double power) const;
+    
 protected:
     /// Reference pt scale
     double ptRef;
@@ -128,6 +152,13 @@ public:
     JetCorrStd3P();
     
 public:
+    /**
+     * \brief Creates a copy of this correction
+     * 
+     * Reimplemented from JetCorrStd2P.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    
     /**
      * \brief Computes correction for a jet with given pt
      * 
@@ -135,6 +166,13 @@ public:
      */
     virtual double Eval(double pt) const override;
     
+    /**
+     * \brief Computes correction for an array of jet pt
+     * 
+     * Reimplemented from JetCorrStd2P.
+     */
+    virtual void EvalBatch(double const *pt, double *corrections, unsigned n) const override;
+    
     /// Sets parameters related to L1 corrections
     void SetParamsL1(std::initializer_list<double> paramsL1);
     
@@ -147,6 +185,9 @@ private:
      */
     double fL1(double pt) const;
     
+    /// Computes fL1 given precomputed log(pt)
+    double fL1FromLog(double pt, double logPt) const;
+    
 private:
     /// (Fixed) parameters describing L1 corrections
     std::array<double, 2> paramsL1;
@@ -174,7 +215,17 @@ public:
      */
     JetCorrSpline(std::vector<double> const &ptKnots);
 
+    /// Copy constructor
+    JetCorrSpline(JetCorrSpline const &src);
+
 public:
+    /**
+     * \brief Creates a copy of this correction
+     *
+     * Reimplemented from JetCorrBase.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+
     /**
      * \brief Evaluates correction at given pt
      *
@@ -185,6 +236,13 @@ public:
      */
     virtual double Eval(double pt) const override;
 
+    /**
+     * \brief Evaluates correction for an array of jet pt
+     *
+     * Reimplemented from JetCorrBase.
+     */
+    virtual void EvalBatch(double const *pt, double *corrections, unsigned n) const override;
+
 protected:
     /**
      * \brief Remakes the spline from updated parameters
@@ -193,6 +251,10 @@ protected:
      */
     virtual void ParamsUpdatedHook() override;
 
+private:
+    /// Evaluates correction at given log(pt)
+    double EvalLog(double logPt) const;
+
 private:
     /// Knots in log(pt)
     std::vector<double> knots;
@@ -201,3 +263,83 @@ private:
     std::unique_ptr<TSpline3> corrSpline;
 };
 
+
+
+/**
+ * \class JetCorrBSpline
+ * \brief Correction described with a cubic B-spline
+ *
+ * The spline is a function of log(pt). It is defined by a sorted list of breakpoints, which are
+ * extended into a clamped knot vector by repeating the first and the last breakpoints. With m + 1
+ * breakpoints, there are m + 3 basis functions. Parameters are the coefficients of the basis
+ * functions in the expansion of the correction minus 1, so that setting all of them to zero gives
+ * a unit correction. At the first and the last breakpoints the correction minus 1 equals the first
+ * and the last parameters respectively. Outside of the range of the breakpoints, the correction is
+ * extrapolated linearly in log(pt).
+ *
+ * In contrast to JetCorrSpline, each basis function is non-zero only between four consecutive
+ * knots. A parameter therefore only affects the correction in a limited range in pt, which is
+ * reported by method GetParamSupport. Only the first two and the last two parameters affect the
+ * extrapolation.
+ */
+class JetCorrBSpline: public JetCorrBase
+{
+public:
+    /// Constructor from a uniform grid of breakpoints in log(pt)
+    JetCorrBSpline(double minPt, double maxPt, unsigned numBreakpoints);
+
+    /**
+     * \brief Constructor from a list of breakpoints in pt
+     *
+     * The list must be sorted and contain at least two distinct values.
+     */
+    JetCorrBSpline(std::vector<double> const &ptBreakpoints);
+
+public:
+    /**
+     * \brief Creates a copy of this correction
+     *
+     * Reimplemented from JetCorrBase.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+
+    /**
+     * \brief Evaluates correction at given pt
+     *
+     * Implemented from JetCorrBase.
+     */
+    virtual double Eval(double pt) const override;
+
+    /**
+     * \brief Evaluates correction for an array of jet pt
+     *
+     * Reimplemented from JetCorrBase.
+     */
+    virtual void EvalBatch(double const *pt, double *corrections, unsigned n) const override;
+
+    /**
+     * \brief Returns range in pt in which the correction depends on the given parameter
+     *
+     * The range is given by the support of the corresponding basis function, extended to zero or
+     * infinity for parameters that affect the extrapolation. It is widened slightly to protect
+     * against rounding errors in the computation of log(pt).
+     *
+     * Reimplemented from JetCorrBase.
+     */
+    virtual std::pair<double, double> GetParamSupport(unsigned index) const override;
+
+private:
+    /// Checks breakpoints and constructs the clamped knot vector
+    void BuildKnots(std::vector<double> const &logBreakpoints);
+
+    /// Evaluates correction at given log(pt)
+    double EvalLog(double logPt) const;
+
+private:
+    /**
+     * Clamped knot vector in log(pt)
+     *
+     * The first and the last breakpoints are repeated four times each.
+     */
+    std::vector<double> knots;
+};
@@ -0,0 +1,200 @@
+/**
+ * \file JetCorrExpression.hpp
+ *
+ * This file defines a jet correction whose functional form is given by a formula.
+ */
+
+#pragma once
+
+#include <FitBase.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class JetCorrExpression
+ * \brief Correction whose functional form is defined by a formula
+ *
+ * The formula gives the full multiplicative correction. It can refer to the logarithm of jet pt as
+ * "x", to jet pt as "pt", and to numeric constants. All other identifiers, except for names of
+ * functions, are names of parameters. The formula can use binary operators +, -, *, /, and ^
+ * (exponentiation, right-associative), unary minus, parentheses, and functions exp, log, sqrt, and
+ * pow. For instance, a log-linear correction can be written as "1 + a + b * x".
+ *
+ * The formula is parsed once at construction. Constant subexpressions are folded, trivial
+ * operations (such as additions of zero and multiplications by one) are removed, and integer
+ * powers are replaced by repeated multiplications. The result is compiled into bytecode for a
+ * stack machine. Values of parameters are read when the bytecode is executed, so updating them
+ * does not require a recompilation. The batched evaluation runs each instruction over a chunk of
+ * values, which amortizes the interpretation and allows the compiler to vectorize the arithmetics.
+ * Logarithms are computed with mathLog.
+ *
+ * Derivatives of the correction with respect to the parameters are computed symbolically at
+ * construction and compiled in the same way.
+ */
+class JetCorrExpression: public JetCorrBase
+{
+public:
+    /**
+     * \brief Constructor from a formula
+     *
+     * Parameters are identified automatically and ordered according to their first appearance in
+     * the formula. Throws an exception if the formula cannot be parsed.
+     */
+    JetCorrExpression(std::string const &formula);
+
+    /**
+     * \brief Constructor from a formula and an explicit list of names of parameters
+     *
+     * The order of the parameters is given by the list. Throws an exception if the formula refers
+     * to a parameter not included in the list. Parameters that do not appear in the formula are
+     * allowed.
+     */
+    JetCorrExpression(std::string const &formula, std::vector<std::string> const &paramNames);
+
+public:
+    /**
+     * \brief Creates a copy of this correction
+     *
+     * Reimplemented from JetCorrBase.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+
+    /**
+     * \brief Evaluates correction at given pt
+     *
+     * Implemented from JetCorrBase.
+     */
+    virtual double Eval(double pt) const override;
+
+    /**
+     * \brief Evaluates correction for an array of jet pt
+     *
+     * Reimplemented from JetCorrBase.
+     */
+    virtual void EvalBatch(double const *pt, double *corrections, unsigned n) const override;
+
+    /// Evaluates derivative of the correction with respect to the given parameter at given pt
+    double EvalParamDerivative(unsigned index, double pt) const;
+
+    /**
+     * \brief Evaluates derivative of the correction with respect to the given parameter for an
+     * array of jet pt
+     *
+     * The two arrays may coincide.
+     */
+    void EvalParamDerivativeBatch(unsigned index, double const *pt, double *derivatives,
+      unsigned n) const;
+
+    /// Returns the formula given at construction
+    std::string const &GetFormula() const;
+
+    /// Returns names of parameters in the order in which they are indexed
+    std::vector<std::string> const &GetParamNames() const;
+
+private:
+    /// Operation codes for nodes of the expression tree and instructions of the bytecode
+    enum class OpCode
+    {
+        Const,
+        Param,
+        LogPt,
+        Pt,
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Neg,
+        Pow,
+        PowInt,
+        Exp,
+        Log,
+        Sqrt
+    };
+
+    /**
+     * \struct Instruction
+     * \brief A single instruction of the stack machine
+     *
+     * Instructions with codes Const, Param, LogPt, and Pt push a value onto the stack. Unary
+     * operations replace the value on the top of the stack. Binary operations pop two values and
+     * push the result.
+     */
+    struct Instruction
+    {
+        /// Operation
+        OpCode op;
+
+        /// Value of the constant for Const and the exponent for PowInt
+        double value;
+
+        /// Index of the parameter for Param
+        unsigned index;
+    };
+
+    /**
+     * \struct Program
+     * \brief Compiled expression
+     */
+    struct Program
+    {
+        /// Instructions in the order of execution
+        std::vector<Instruction> instructions;
+
+        /// Maximal depth of the stack reached during the execution
+        unsigned stackDepth;
+
+        /// Indicates whether the program uses log(pt)
+        bool usesLogPt;
+    };
+
+    struct Node;
+    class Parser;
+
+private:
+    /// Parses the formula and compiles the correction and its derivatives
+    void Compile(bool registerParams);
+
+    /// Compiles an expression tree into bytecode
+    static Program CompileTree(std::shared_ptr<Node const> const &tree);
+
+    /// Constructs the derivative of an expression tree with respect to the given parameter
+    static std::shared_ptr<Node const> Differentiate(std::shared_ptr<Node const> const &tree,
+      unsigned index);
+
+    /// Executes the program for a single value of pt
+    double Execute(Program const &program, double pt) const;
+
+    /// Executes the program for an array of pt
+    void ExecuteBatch(Program const &program, double const *pt, double *results, unsigned n)
+      const;
+
+    /**
+     * \brief Creates a node, simplifying it if possible
+     *
+     * Operations on constants are folded, and trivial operations are removed.
+     */
+    static std::shared_ptr<Node const> MakeNode(OpCode op, std::shared_ptr<Node const> left,
+      std::shared_ptr<Node const> right = nullptr);
+
+private:
+    /// Maximal allowed depth of the stack
+    static constexpr unsigned maxStackDepth = 32;
+
+    /// Number of values processed together in the batched evaluation
+    static constexpr unsigned chunkSize = 16;
+
+    /// Formula given at construction
+    std::string formula;
+
+    /// Names of parameters
+    std::vector<std::string> paramNames;
+
+    /// Compiled correction
+    Program program;
+
+    /// Compiled derivatives with respect to all parameters
+    std::vector<Program> derivativePrograms;
+};
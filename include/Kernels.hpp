@@ -0,0 +1,185 @@
+/**
+ * \file Kernels.hpp
+ *
+ * Numerical kernels used in the innermost loops of the computation of the loss function.
+ *
+ * Each kernel is compiled for several instruction sets. The most advanced instruction set
+ * supported by the CPU is detected at runtime, so that the same binary can run optimally on
+ * different machines. A scalar implementation is always available and serves as the reference.
+ * The selection can be overridden with environment variable JECFIT_SIMD, which accepts values
+ * "scalar", "avx2", and "avx512".
+ */
+
+#pragma once
+
+#include <array>
+
+
+/// Instruction sets for which vectorized kernels are provided
+enum class SimdLevel
+{
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+
+/**
+ * \brief Returns the most advanced instruction set supported by the CPU
+ *
+ * The environment variable JECFIT_SIMD is not taken into account.
+ */
+SimdLevel detectSimdLevel();
+
+
+/// Returns the instruction set currently used by the kernels
+SimdLevel getSimdLevel();
+
+
+/**
+ * \brief Checks if kernels for the given instruction set can be executed on this CPU
+ *
+ * The scalar implementation is always supported.
+ */
+bool isSimdLevelSupported(SimdLevel level);
+
+
+/**
+ * \brief Forces the kernels to use the given instruction set
+ *
+ * Throws an exception if the instruction set is not supported by the CPU. This function is not
+ * thread-safe and should only be called when no kernels are being executed.
+ */
+void setSimdLevel(SimdLevel level);
+
+
+/// Returns a human-readable label for the given instruction set
+char const *simdLevelName(SimdLevel level);
+
+
+/**
+ * \brief Computes the dot product of two arrays of the given length
+ *
+ * Uses the instruction set selected at runtime. The order of the summation depends on the
+ * instruction set, and thus results can differ at the level of rounding errors.
+ */
+double dotProduct(double const *a, double const *b, unsigned n);
+
+
+/**
+ * \brief Computes the dot product using kernels for the given instruction set
+ *
+ * Intended for tests. The caller must make sure the instruction set is supported.
+ */
+double dotProduct(SimdLevel level, double const *a, double const *b, unsigned n);
+
+
+/**
+ * \brief Computes the dot product of an array of floats and an array of doubles
+ *
+ * The products are accumulated in double precision using the compensated (Kahan) summation, so
+ * that the result is limited by the precision of the inputs rather than by rounding errors in the
+ * sum. Uses the instruction set selected at runtime.
+ */
+double dotProductCompensated(float const *a, double const *b, unsigned n);
+
+
+/**
+ * \brief Computes the compensated dot product using kernels for the given instruction set
+ *
+ * Intended for tests. The caller must make sure the instruction set is supported.
+ */
+double dotProductCompensated(SimdLevel level, float const *a, double const *b, unsigned n);
+
+
+/**
+ * \brief Computes dot products of an array with two other arrays in a single pass
+ *
+ * The result is equivalent to {dotProduct(a, b1, n), dotProduct(a, b2, n)} up to rounding errors,
+ * but array a is only read once. Uses the instruction set selected at runtime.
+ */
+std::array<double, 2> dotProductPair(double const *a, double const *b1, double const *b2,
+  unsigned n);
+
+
+/**
+ * \brief Computes the paired dot products using kernels for the given instruction set
+ *
+ * Intended for tests. The caller must make sure the instruction set is supported.
+ */
+std::array<double, 2> dotProductPair(SimdLevel level, double const *a, double const *b1,
+  double const *b2, unsigned n);
+
+
+/**
+ * \brief Computes compensated dot products of an array of floats with two arrays of doubles
+ *
+ * Paired version of dotProductCompensated, which reads array a only once. Uses the instruction
+ * set selected at runtime.
+ */
+std::array<double, 2> dotProductCompensatedPair(float const *a, double const *b1,
+  double const *b2, unsigned n);
+
+
+/**
+ * \brief Computes the paired compensated dot products using kernels for the given instruction
+ * set
+ *
+ * Intended for tests. The caller must make sure the instruction set is supported.
+ */
+std::array<double, 2> dotProductCompensatedPair(SimdLevel level, float const *a,
+  double const *b1, double const *b2, unsigned n);
+
+
+/**
+ * \brief Number of columns of the second matrix processed together by matrixProduct
+ *
+ * Corresponds to a single AVX-512 register or two AVX2 registers of doubles.
+ */
+constexpr unsigned matrixProductTileWidth = 8;
+
+
+/**
+ * \brief Computes the product of a matrix and a matrix with a small number of columns
+ *
+ * Computes C = A B, where A is an m x n matrix stored by rows with a stride of lda, B is an n x k
+ * matrix, and C is an m x k matrix. Matrices B and C are stored by rows without gaps. The kernels
+ * are blocked in registers for tiles of several rows of A and matrixProductTileWidth columns of
+ * B, so that each element of A is loaded once for all columns within a tile. Uses the instruction
+ * set selected at runtime.
+ *
+ * If the library is built with option JECFIT_BLAS, the product is delegated to the BLAS routine
+ * dgemm instead.
+ */
+void matrixProduct(double const *a, unsigned lda, double const *b, double *c, unsigned m,
+  unsigned n, unsigned k);
+
+
+/**
+ * \brief Computes the matrix product using kernels for the given instruction set
+ *
+ * Intended for tests. The caller must make sure the instruction set is supported. BLAS is never
+ * used.
+ */
+void matrixProduct(SimdLevel level, double const *a, unsigned lda, double const *b, double *c,
+  unsigned m, unsigned n, unsigned k);
+
+
+/**
+ * \brief Computes the product of a matrix of floats and a matrix of doubles
+ *
+ * Same as the double-precision version, but the elements of A are stored in single precision.
+ * The products are accumulated in double precision without compensation. Uses the instruction set
+ * selected at runtime.
+ */
+void matrixProduct(float const *a, unsigned lda, double const *b, double *c, unsigned m,
+  unsigned n, unsigned k);
+
+
+/**
+ * \brief Computes the mixed-precision matrix product using kernels for the given instruction set
+ *
+ * Intended for tests. The caller must make sure the instruction set is supported.
+ */
+void matrixProduct(SimdLevel level, float const *a, unsigned lda, double const *b, double *c,
+  unsigned m, unsigned n, unsigned k);
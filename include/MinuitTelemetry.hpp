@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Minuit2/Minuit2Minimizer.h>
+#include <Minuit2/MnTraceObject.h>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+
+
+/**
+ * \class MinuitTelemetry
+ * \brief Writes progress of a minimization with Minuit2 as a stream of JSON records
+ *
+ * An object of this class is attached to the minimizer with
+ * Minuit2Minimizer::SetTraceObject. It appends one JSON object per line to the given file, which
+ * can also be a named pipe, and flushes it after each record, so that the progress can be
+ * followed with tail -f. Records are distinguished by field "event":
+ *   - "start" is written when the minimization starts and lists names of parameters;
+ *   - "iteration" reports the number of the iteration, the value of the loss function, the
+ *     estimated distance to the minimum (EDM), the number of calls to the loss function, and the
+ *     current values of all parameters;
+ *   - "end" is written by Finish and contains the same fields as "iteration" together with the
+ *     status of the minimization.
+ * All records contain the time in seconds since the object was constructed and, if given, a label
+ * that identifies the fit. To keep the overhead low in long fits, iterations are only written if
+ * at least the given interval has passed since the previous iteration record. The first
+ * iteration is always written.
+ */
+class MinuitTelemetry: public ROOT::Minuit2::MnTraceObject
+{
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param fileName  Name of the output file, which is opened for appending.
+     * \param minInterval  Minimal interval between iteration records, in seconds.
+     * \param label  Label included in every record; omitted if empty.
+     */
+    MinuitTelemetry(std::string const &fileName, double minInterval = 1.,
+      std::string const &label = "");
+
+public:
+    /// Writes the record with the final state of the minimization
+    void Finish(ROOT::Minuit2::Minuit2Minimizer const &minimizer);
+
+    /// Writes the start record; called by Minuit2 before the minimization
+    virtual void Init(ROOT::Minuit2::MnUserParameterState const &state) override;
+
+    /// Writes an iteration record if allowed by the rate limit; called by Minuit2
+    virtual void operator()(int iteration, ROOT::Minuit2::MinimumState const &state) override;
+
+private:
+    /// Starts a new record with the given event type and writes common fields
+    void BeginRecord(char const *event);
+
+    /// Returns the time since construction, in seconds
+    double GetElapsed() const;
+
+private:
+    /// Output stream
+    std::ofstream out;
+
+    /// Label for all records
+    std::string label;
+
+    /// Minimal interval between iteration records, in seconds
+    double minInterval;
+
+    /// Time of construction and time of the last iteration record
+    std::chrono::steady_clock::time_point startTime, lastRecordTime;
+
+    /// Indicates whether an iteration has been written since the last call to Init
+    bool iterationWritten;
+};
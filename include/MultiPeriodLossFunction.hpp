@@ -0,0 +1,291 @@
+#pragma once
+
+#include <FitBase.hpp>
+#include <Nuisances.hpp>
+#include <ThreadPool.hpp>
+
+#include <Math/IFunction.h>
+
+#include <memory>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * \class MultiPeriodLossFunction
+ * \brief Loss function for a simultaneous fit of corrections in several data-taking periods
+ *
+ * Each period has its own jet correction, its own set of measurements, and its own nuisance
+ * parameters, as registered by these measurements. Nuisances whose names match one of the patterns
+ * given at construction (regular expressions that must match the full name) are shared among all
+ * periods that register them. Other nuisances are specific to their periods and are renamed to
+ * "<name>_<period>". The loss function is the sum of losses in all periods, with the penalty term
+ * for every nuisance included only once.
+ *
+ * Parameters are ordered in blocks. The block for each period contains parameters of its jet
+ * correction followed by its specific nuisances. The blocks are followed by the shared nuisances.
+ * Since losses in different periods depend on disjoint sets of parameters apart from the shared
+ * nuisances, the Hessian matrix has an arrowhead structure, with the blocks of individual periods
+ * only coupled through the shared nuisances. This structure is exploited in the computation of the
+ * gradient, in which only the loss of the affected periods is reevaluated for a variation of a
+ * parameter, and in the computation of the covariance matrix.
+ *
+ * Periods are evaluated in parallel. Each worker thread uses its own copies of the jet corrections
+ * and measurements, so with more than one thread they must support cloning. The measurements given
+ * to AddPeriod are not owned by this object. An object of this class must not be used concurrently
+ * from several threads, but separate objects obtained with method Clone can.
+ */
+class MultiPeriodLossFunction: public ROOT::Math::IMultiGradFunction
+{
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param sharedNuisances  Regular expressions for names of nuisances shared among periods.
+     * \param numThreads  Number of threads to use. If zero, the number of hardware threads is
+     *     used.
+     */
+    MultiPeriodLossFunction(std::vector<std::string> const &sharedNuisances = {},
+      unsigned numThreads = 1);
+
+public:
+    /**
+     * \brief Adds a data-taking period
+     *
+     * \param name  Name of the period, which is used to label its parameters.
+     * \param corrector  Jet correction for this period. The object is owned by this.
+     * \param nuisanceDefs  Nuisance parameters registered by the measurements for this period.
+     * \param measurements  Measurements for this period. They are not owned by this.
+     *
+     * Parameters of periods added earlier keep their order, but the shared nuisances are always
+     * placed after all periods, and thus their indices change. Throws an exception if a period with
+     * the same name has already been added.
+     */
+    void AddPeriod(std::string const &name, std::unique_ptr<JetCorrBase> &&corrector,
+      NuisanceDefinitions const &nuisanceDefs,
+      std::vector<MeasurementBase const *> const &measurements);
+
+    /**
+     * \brief Creates a copy with separate evaluation contexts
+     *
+     * Jet corrections and measurements are cloned, and the new object owns the copies. Since no
+     * state is shared, the copy can be used concurrently with this object. Throws an exception if
+     * a correction or a measurement does not support cloning. Implemented from
+     * ROOT::Math::IMultiGradFunction.
+     */
+    virtual ROOT::Math::IMultiGenFunction *Clone() const override;
+
+    /**
+     * \brief Computes the covariance matrix of the parameters at the given point
+     *
+     * The loss function is assumed to be a chi^2. The covariance matrix is computed as twice the
+     * inverse of the Hessian. Only the blocks of the Hessian that can be non-zero are computed
+     * with finite differences, and each of them only involves evaluations of the loss in a single
+     * period. The matrix is inverted using the Schur complement for the shared nuisances, which
+     * only requires inversions of matrices of the size of individual blocks. Returns the full
+     * matrix stored in the row-major order. Throws an exception if the Hessian is not
+     * positive-definite.
+     */
+    std::vector<double> ComputeCovariance(double const *x) const;
+
+    /// Evaluates the loss function for the given point
+    double EvalRawInput(double const *x) const;
+
+    /**
+     * \brief Computes the value of the loss function and its gradient
+     *
+     * Reimplemented from ROOT::Math::IMultiGradFunction.
+     */
+    virtual void FdF(double const *x, double &f, double *grad) const override;
+
+    /**
+     * \brief Returns the number of degrees of freedom
+     *
+     * Computed as the sum of dimensionalities of all measurements minus the number of parameters.
+     */
+    unsigned GetNDF() const;
+
+    /// Returns number of periods added so far
+    unsigned GetNumPeriods() const;
+
+    /// Returns number of threads used
+    unsigned GetNumThreads() const;
+
+    /**
+     * \brief Returns the name of the parameter with the given index
+     *
+     * Parameters of jet corrections are named "p<i>_<period>".
+     */
+    std::string const &GetParamName(unsigned index) const;
+
+    /// Returns index of the first parameter of the jet correction for the given period
+    unsigned GetPeriodOffset(unsigned period) const;
+
+    /**
+     * \brief Computes the gradient of the loss function
+     *
+     * The gradient is computed with central finite differences. For each period, only parameters
+     * on which its loss depends are varied, and the derivative of the penalty terms for nuisances
+     * is computed analytically. Reimplemented from ROOT::Math::IMultiGradFunction.
+     */
+    virtual void Gradient(double const *x, double *grad) const override;
+
+    /// Checks whether a nuisance with the given name is shared among periods
+    bool IsShared(std::string const &nuisanceName) const;
+
+    /**
+     * \brief Returns the number of parameters of the loss function
+     *
+     * Implemented from ROOT::Math::IMultiGradFunction.
+     */
+    virtual unsigned int NDim() const override;
+
+    /**
+     * \brief Sets the relative step for finite differences in the gradient
+     *
+     * The step for a parameter x is computed as relStep * max(|x|, 1). The default value is the
+     * cubic root of the machine epsilon. The step for the Hessian is computed in the same way with
+     * the fourth root of the machine epsilon.
+     */
+    void SetRelStep(double relStep);
+
+private:
+    /**
+     * \struct Period
+     * \brief Description of a data-taking period
+     */
+    struct Period
+    {
+        /// Name of the period
+        std::string name;
+
+        /// Definitions of nuisances for this period, as given to AddPeriod
+        NuisanceDefinitions nuisanceDefs;
+
+        /// Non-owning pointers to measurements
+        std::vector<MeasurementBase const *> measurements;
+
+        /// Index of the first parameter of the jet correction
+        unsigned offset;
+
+        /// Number of parameters of the jet correction
+        unsigned numCorrParams;
+
+        /// Number of parameters in the block of this period, which starts at offset
+        unsigned blockSize;
+
+        /// Indices of parameters corresponding to local nuisances of the period
+        std::vector<unsigned> nuisanceIndices;
+
+        /**
+         * \brief Indices of all parameters on which the loss in this period depends
+         *
+         * Contains parameters of the jet correction followed by nuisanceIndices.
+         */
+        std::vector<unsigned> paramIndices;
+    };
+
+    /**
+     * \struct Context
+     * \brief Objects needed to evaluate the loss in a period in a single thread
+     */
+    struct Context
+    {
+        /// Constructor from the definitions of nuisances
+        Context(NuisanceDefinitions const &nuisanceDefs);
+
+        /// Jet correction
+        std::unique_ptr<JetCorrBase> corrector;
+
+        /// Measurements used in the evaluation
+        std::vector<MeasurementBase const *> measurements;
+
+        /// Copies of measurements owned by this, if any
+        std::vector<std::unique_ptr<MeasurementBase>> ownedMeasurements;
+
+        /// Values of local nuisances
+        Nuisances nuisances;
+    };
+
+private:
+    /**
+     * \brief Computes the derivative with respect to a single parameter
+     *
+     * Implemented from ROOT::Math::IMultiGradFunction.
+     */
+    virtual double DoDerivative(double const *x, unsigned int icoord) const override;
+
+    /**
+     * \brief Evaluates the loss function
+     *
+     * Implemented from ROOT::Math::IMultiGradFunction.
+     */
+    virtual double DoEval(double const *x) const override;
+
+    /**
+     * \brief Evaluates the loss in the given period, not including the penalty for nuisances
+     *
+     * Uses the context of the given worker.
+     */
+    double EvalPeriod(unsigned period, unsigned worker, double const *x) const;
+
+    /// Evaluates the penalty for nuisances
+    double EvalPenalty(double const *x) const;
+
+    /// Computes indices of all parameters and their names
+    void UpdateLayout();
+
+private:
+    /// Regular expressions for names of shared nuisances
+    std::vector<std::regex> sharedPatterns;
+
+    /// Patterns for shared nuisances as given at construction
+    std::vector<std::string> sharedPatternStrings;
+
+    /// Relative steps for finite differences in the gradient and the Hessian
+    double relStep, hessianRelStep;
+
+    /// Pool of threads
+    mutable ThreadPool threadPool;
+
+    /// Periods added so far
+    std::vector<Period> periods;
+
+    /// Evaluation contexts, indexed by worker and then period
+    mutable std::vector<std::vector<Context>> contexts;
+
+    /**
+     * \brief Copies of measurements owned by this
+     *
+     * Only filled in objects created with method Clone. Pointers to these measurements are also
+     * included in the periods.
+     */
+    std::vector<std::unique_ptr<MeasurementBase>> ownedMeasurements;
+
+    /// Names of all parameters
+    std::vector<std::string> paramNames;
+
+    /// Indices of parameters that are nuisances
+    std::vector<unsigned> nuisanceParams;
+
+    /// Number of nuisances shared among periods
+    unsigned numShared;
+
+    /**
+     * \brief Variations needed to compute the gradient
+     *
+     * Each variation is described by the index of a period and a position in its paramIndices.
+     */
+    std::vector<std::pair<unsigned, unsigned>> gradVariations;
+
+    /// Per-worker buffers for points at which the loss is evaluated
+    mutable std::vector<std::vector<double>> points;
+
+    /// Buffer for losses in individual periods
+    mutable std::vector<double> periodLosses;
+
+    /// Buffer for values of losses at points of finite-difference stencils
+    mutable std::vector<double> stencilValues;
+};
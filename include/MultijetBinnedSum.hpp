@@ -2,8 +2,11 @@
 
 #include <FitBase.hpp>
 
+#include <FlatHist2D.hpp>
 #include <Morphing.hpp>
 #include <Nuisances.hpp>
+#include <ScratchArena.hpp>
+#include <ThreadPool.hpp>
 
 #include <TH1.h>
 #include <TH1D.h>
@@ -14,6 +17,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 
@@ -34,6 +38,10 @@ struct FracBin;
  * 
  * Several systematic uncertainties are included. They are evaluated as multiplicative shifts in
  * B^{Sim}.
+ * 
+ * Trigger bins are independent of each other, and they can be processed in parallel (see method
+ * SetNumThreads). Each worker thread then uses its own scratch arena, so that an evaluation does
+ * not allocate heap memory once the arenas have grown to the needed sizes.
  */
 class MultijetBinnedSum: public MeasurementBase
 {
@@ -56,25 +64,46 @@ private:
          */
         std::vector<double> binning;
         
+        /// Edges of bins of simBalProfile, including the upper edge of the last bin
+        std::vector<double> simBinning;
+        
         /**
          * \brief Profiles of the balance observable in data and simulation
          * 
          * Binning of the profile in simulation defines bins to compute chi^2.
          */
-        std::unique_ptr<TProfile> balProfile, simBalProfile;
+        std::shared_ptr<TProfile> balProfile, simBalProfile;
         
         /// Distribution of pt of the leading jet in data
-        std::unique_ptr<TH1> ptLead;
+        std::shared_ptr<TH1> ptLead;
         
         /**
          * \brief Profile of pt of the leading jet in data
          * 
          * Used to obtain true mean pt in each bin.
          */
-        std::unique_ptr<TProfile> ptLeadProfile;
+        std::shared_ptr<TProfile> ptLeadProfile;
         
         /// Sum of projections of pt of jets in bins of pt of the leading and other jets
-        std::unique_ptr<TH2> ptJetSumProj;
+        std::shared_ptr<TH2> ptJetSumProj;
+        
+        /// Contents of ptJetSumProj stored in a dense array
+        std::shared_ptr<FlatHist2D> ptJetSumProjContents;
+        
+        /// Centres of bins of ptJetSumProj along the y axis. Indexed with (bin - 1).
+        std::vector<double> ptJetCentres;
+        
+        /// Position of the first element of ptJetCentres among points from GetCorrectionPoints
+        unsigned correctionOffset;
+        
+        /**
+         * \brief Factors to recompute the balance observable in bins of pt of other jets
+         * 
+         * Computed for the current jet correction, which is evaluated at ptJetCentres. For the
+         * pt balance the factors are equal to the correction, and for MPF they are given by 1
+         * minus the correction. Indexed with (bin - 1).
+         */
+        mutable std::vector<double> jetFactors;
         
         /**
          * \brief Squared uncertainty on the difference between mean balance observables in data
@@ -102,10 +131,24 @@ private:
     };
         
 public:
-    /// Constructor
-    MultijetBinnedSum(std::string const &fileName, Method method, NuisanceDefinitions &nuisanceDefs);
+    /**
+     * \brief Constructor
+     * 
+     * The histograms of jet projections are stored in the given mode. With a single-precision
+     * mode, the loss of precision is evaluated at construction and can be accessed with method
+     * GetStoragePrecision.
+     */
+    MultijetBinnedSum(std::string const &fileName, Method method, NuisanceDefinitions &nuisanceDefs,
+      FlatHist2D::Storage storage = FlatHist2D::Storage::Double);
     
 public:
+    /**
+     * \brief Creates a copy of this measurement
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
@@ -120,6 +163,15 @@ public:
      */
     TH1D GetRecompBalance(JetCorrBase const &corrector, Nuisances const &nuisances) const;
     
+    /**
+     * \brief Returns the loss of precision due to the storage mode chosen in the constructor
+     * 
+     * The deviations are evaluated with a unit jet correction and all nuisances set to zero,
+     * including all trigger bins. If the inputs are stored in double precision, all deviations are
+     * zero.
+     */
+    StoragePrecision const &GetStoragePrecision() const;
+    
     /**
      * \brief Evaluates the deviation with the given jet corrector and set of nuisances
      * 
@@ -127,6 +179,22 @@ public:
      */
     virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const override;
     
+    /**
+     * \brief Evaluates the deviation using precomputed values of the jet correction
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual double EvalWithCorrections(JetCorrBase const &corrector, Nuisances const &nuisances,
+      double const *corrections) const override;
+    
+    /**
+     * \brief Returns centres of bins in pt of other jets for all trigger bins
+     * 
+     * The correction for the leading jet and the inversion of the correction for the jet pt
+     * threshold are still evaluated directly. Reimplemented from MeasurementBase.
+     */
+    virtual std::vector<double> GetCorrectionPoints() const override;
+    
     /**
      * \brief Selects a subrange of trigger bins to use
      * 
@@ -139,17 +207,59 @@ public:
      */
     void SetTriggerBinRange(unsigned begin, unsigned end = -1);
     
+    /**
+     * \brief Sets the number of threads used to process trigger bins
+     * 
+     * If the number is zero, the number of hardware threads is used. By default, all trigger bins
+     * are processed in the calling thread. The results do not depend on the number of threads.
+     */
+    void SetNumThreads(unsigned numThreads);
+    
 private:
-    /// Recomputes MPF in data for given trigger bin, 2D pt window, and jet correction
+    /**
+     * \brief Recomputes MPF in data for given trigger bin, 2D pt window, and jet correction
+     * 
+     * Factors for other jets must have been computed in advance for the same jet correction.
+     */
     static double ComputeMPF(TriggerBin const &triggerBin, FracBin const &ptLeadStart,
       FracBin const &ptLeadEnd, FracBin const &ptJetStart, JetCorrBase const &corrector);
     
-    /// Recomputes pt balance in data for given trigger bin, 2D pt window, and jet correction
+    /**
+     * \brief Recomputes pt balance in data for given trigger bin, 2D pt window, and jet correction
+     * 
+     * Factors for other jets must have been computed in advance for the same jet correction.
+     */
     static double ComputePtBal(TriggerBin const &triggerBin, FracBin const &ptLeadStart,
       FracBin const &ptLeadEnd, FracBin const &ptJetStart, JetCorrBase const &corrector);
     
-    /// Recomputes mean balance observable in all trigger bins for the given jet correction
-    void UpdateBalance(JetCorrBase const &corrector, Nuisances const &) const;
+    /// Computes chi^2 from the recomputed balance observable in all selected trigger bins
+    double SumChi2(Nuisances const &nuisances) const;
+    
+    /**
+     * \brief Recomputes mean balance observable in all trigger bins for the given jet correction
+     * 
+     * If given, the array of corrections must contain values of the correction at the points
+     * returned by GetCorrectionPoints, and they are used for other jets instead of evaluating
+     * the correction.
+     */
+    void UpdateBalance(JetCorrBase const &corrector, Nuisances const &,
+      double const *corrections = nullptr) const;
+    
+    /**
+     * \brief Recomputes mean balance observable in a single trigger bin
+     * 
+     * The given arena is reset and then used for all temporary buffers. Precomputed corrections
+     * are used if given, as in UpdateBalance.
+     */
+    void UpdateTriggerBin(TriggerBin const &triggerBin, JetCorrBase const &corrector,
+      double minPtUncorr, ScratchArena &scratch, double const *corrections) const;
+    
+    /**
+     * \brief Updates cached quantities that depend on the selected range of trigger bins
+     * 
+     * These are the dimensionality and the ordering of bins in GetRecompBalance.
+     */
+    void UpdateSelection();
     
 private:
     /// Method of computation
@@ -170,5 +280,39 @@ private:
     
     /// Dimensionality of the deviation
     unsigned dimensionality;
+    
+    /// Loss of precision due to the storage mode
+    StoragePrecision storagePrecision;
+    
+    /**
+     * \brief Bins of all selected trigger bins ordered in pt of the leading jet
+     * 
+     * Each element contains the index of a trigger bin and the (zero-based) index of a bin in its
+     * binning for simulation. Used to build the histogram in GetRecompBalance.
+     */
+    std::vector<std::pair<unsigned, unsigned>> recompBalOrder;
+    
+    /**
+     * \brief Edges of the histogram built in GetRecompBalance
+     * 
+     * Follow the order of recompBalOrder. The last edge is the largest upper edge among all
+     * selected trigger bins.
+     */
+    std::vector<double> recompBalEdges;
+    
+    /**
+     * \brief Pool of threads to process trigger bins
+     * 
+     * Null if the computation is done in the calling thread only.
+     */
+    std::shared_ptr<ThreadPool> threadPool;
+    
+    /**
+     * \brief Temporary buffers used in the recomputation of the balance observable
+     * 
+     * There is one arena for each worker of the thread pool. An arena is reset whenever the
+     * worker starts processing a new trigger bin.
+     */
+    mutable std::vector<ScratchArena> workerScratch;
 };
 
@@ -2,9 +2,12 @@
 
 #include <FitBase.hpp>
 
+#include <FlatHist2D.hpp>
 #include <Morphing.hpp>
 #include <Nuisances.hpp>
+#include <SplineTable.hpp>
 
+#include <TFile.h>
 #include <TGraphErrors.h>
 #include <TH1.h>
 #include <TH2.h>
@@ -12,6 +15,7 @@
 #include <TSpline.h>
 
 #include <array>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <set>
@@ -46,6 +50,9 @@
  * the given jet correction and set of nuisance parameters. This is done with methods
  * RecomputeBalanceData and RecomputeBalanceSim. The residual deviations can be computed using
  * method ComputeResiduals. Using this is the preferred way to visualize the performance of the fit.
+ *
+ * When both methods are needed for the same input file, class MultijetCrawlingBinsJoint should be
+ * used instead of two independent objects of this class, so that common inputs are shared.
  * 
  * [1] https://indico.cern.ch/event/780845/#16-multijet-analysis-with-craw
  */
@@ -75,77 +82,317 @@ private:
      * The pt balance observable is defined using a smooth threshold: jets are included in the
      * computation with a certain weight that changes from 0 to 1 between two reference points.
      * With the grid approximation, this translates into weights along the second axis, which are
-     * also cached.
+     * also cached. The threshold can be different for the two methods, and the weights are
+     * computed separately for each of them.
+     *
+     * The class also caches sums over the second axis of the histogram of jet projections,
+     * weighted with the factors for the enabled methods. To allow a partial recomputation, each
+     * such sum is split into contributions from fixed blocks of bins along the second axis, which
+     * are added up in a fixed order.
+     *
+     * The cache is updated incrementally. The jet correction used in the previous update is
+     * remembered, and if only some of its parameters have changed, only the values in the range of
+     * pt reported by JetCorrBase::GetParamSupport for these parameters are recomputed. Each update
+     * that changes the cached values is assigned a revision number. The revisions of the last
+     * changes are tracked for bins along the first axis and for blocks along the second axis, and
+     * the sums over the second axis are recomputed lazily, only for the blocks that have changed.
+     * Since the recomputed values are evaluated in exactly the same way as in a full update, the
+     * results do not depend on the history of updates, provided that the batched evaluation of
+     * the jet correction gives the same result for a given pt regardless of its position in the
+     * batch.
      * 
      * Bin indices exposed in the interface of this class always follow the ROOT convention, i.e.
      * start from 1.
      */
     class JetCache
     {
+    public:
+        /**
+         * \struct Batch
+         *
+         * Values computed with method EvalBatch for several jet corrections at once
+         *
+         * Points of a batch that share the same parameters of the correction are mapped to the
+         * same distinct correction. Per-bin values for distinct correction c are stored in
+         * segments of the arrays that start at c * numBinsPtLead and are indexed with
+         * (binPtLead - 1). Only bins in the range requested in EvalBatch are filled. The object
+         * can be reused for multiple batches, and its memory is then only allocated once.
+         */
+        struct Batch
+        {
+            /// Number of bins along the first axis, which gives the stride of per-bin arrays
+            unsigned numBinsPtLead;
+
+            /// Index of the distinct correction for each point
+            std::vector<unsigned> corrIndices;
+
+            /// Index of the first point for each distinct correction
+            std::vector<unsigned> corrPoints;
+
+            /// Corrections for typical pt along the first axis
+            std::vector<double> ptLeadCorrections;
+
+            /// Logarithms of corrected typical pt along the first axis
+            std::vector<double> logCorrectedPtLead;
+
+            /// Sums over the second axis for enabled methods, indexed with int(Method)
+            std::array<std::vector<double>, 2> sumsJets;
+
+            /// Buffer for corrections for typical pt along the second axis
+            std::vector<double> ptJetCorrections;
+
+            /**
+             * Matrix of factors along the second axis
+             *
+             * There is a column for each enabled method and distinct correction, and the rows are
+             * indexed with (binPtJet - 1).
+             */
+            std::vector<double> factors;
+
+            /// Buffer for the product of a block of the histogram of jet projections and factors
+            std::vector<double> products;
+        };
+
     public:
         /**
          * Constructor
          * 
+         * \param sumProj  Contents of the histogram of jet projections.
          * \param meanPtLead  Ordered vector of typical pt in bins along the first axis.
          * \param meanPtJet  Ordered vector of typical pt in bins along the second axis.
          * \param thresholdStart, thresholdEnd  Reference values of pt that define the smooth
-         *     pt threshold.
+         *     pt threshold. They are used for both methods.
+         * \param method  Method for which sums over the second axis are computed. More methods
+         *     can be enabled with method EnableMethod.
          */
-        JetCache(std::vector<double> const &meanPtLead, std::vector<double> const &meanPtJet,
-          double thresholdStart, double thresholdEnd);
+        JetCache(std::shared_ptr<FlatHist2D const> sumProj, std::vector<double> const &meanPtLead,
+          std::vector<double> const &meanPtJet, double thresholdStart, double thresholdEnd,
+          Method method);
         
     public:
         /// Returns mean pt of the leading jet in the given bin with applied correction
         double CorrectedMeanPtLead(unsigned bin) const;
         
+        /// Returns logarithm of mean pt of the leading jet in the given bin with applied correction
+        double LogCorrectedMeanPtLead(unsigned bin) const;
+        
         /// Returns correction for typical pt in the given bin along the first axis
         double CorrectionPtLead(unsigned bin) const;
         
         /// Returns correction for typical pt in the given bin along the second axis
         double CorrectionPtJet(unsigned bin) const;
+
+        /**
+         * Enables computation of sums over the second axis for the given method
+         *
+         * When both methods are enabled, the sums for them are computed in a single pass over the
+         * histogram of jet projections.
+         */
+        void EnableMethod(Method method);
+
+        /**
+         * Computes values needed for chi^2 for several jet corrections at once
+         *
+         * Parameters of the correction for point i are read from
+         * corrParams + i * corrector.GetNumParams(), and the given corrector is used to evaluate
+         * the correction with them. Sums over the second axis are computed for all enabled
+         * methods and for bins along the first axis in the range [firstBinPtLead, lastBinPtLead]
+         * as the product of the corresponding block of the histogram of jet projections and a
+         * matrix of factors with a column for each method and distinct correction. Cached values
+         * in this object are neither used nor changed. The results agree with those obtained with
+         * Update and SumJets up to rounding errors.
+         */
+        void EvalBatch(JetCorrBase &corrector, double const *corrParams, unsigned numPoints,
+          unsigned firstBinPtLead, unsigned lastBinPtLead, Batch &batch) const;
+        
+        /**
+         * Returns typical pt in all bins along the first axis followed by those along the second
+         * axis
+         *
+         * These are the points at which the jet correction is evaluated.
+         */
+        std::vector<double> GetCorrectionPoints() const;
+        
+        /// Returns reference points that define the pt threshold for the given method
+        std::pair<double, double> GetThreshold(Method method) const;
+
+        /**
+         * Forces a full recomputation at the next update
+         *
+         * Must be called if the contents of the histogram of jet projections change.
+         */
+        void Invalidate();
+
+        /**
+         * Returns array of factors to recompute the MPF observable
+         * 
+         * The factors are given by (1 - c) * w, where c and w are the correction and the weight
+         * for bins along the second axis, computed with the threshold for the MPF method. The
+         * array is indexed with (bin - 1).
+         */
+        double const *MPFFactors() const;
+        
+        /**
+         * Returns array of factors to recompute the pt balance observable
+         * 
+         * The factors are given by c * w, where c and w are the correction and the weight for bins
+         * along the second axis, computed with the threshold for the pt balance method. The array
+         * is indexed with (bin - 1).
+         */
+        double const *PtBalFactors() const;
         
         /**
          * Returns range of bins with non-trivial content along the second axis
          * 
-         * The returned pair consist of the first bin along the second axis in which the weight is
-         * non-zero, and the last bin along the axis. When iterating over the second axis, this
-         * information allows to skip immediately bins with zero weights.
+         * The returned pair consist of the first bin along the second axis in which the weight for
+         * the given method is non-zero, and the last bin along the axis. When iterating over the
+         * second axis, this information allows to skip immediately bins with zero weights.
+         */
+        std::pair<unsigned, unsigned> PtJetBinRange(Method method) const;
+
+        /**
+         * Returns revision of the last change of the correction in the given bin along the first
+         * axis
+         *
+         * The returned value is positive after the first update. It can be used to cache
+         * quantities that depend on the corrected pt of the leading jet.
+         */
+        unsigned long PtLeadRevision(unsigned bin) const;
+
+        /**
+         * Changes the pt threshold for the given method
+         *
+         * The new threshold is taken into account at the next update, which will be a full one.
          */
-        std::pair<unsigned, unsigned> PtJetBinRange() const;
+        void SetThreshold(Method method, double thresholdStart, double thresholdEnd);
+
+        /**
+         * Returns sum over the second axis of the histogram of jet projections for the given bin
+         * along the first axis
+         *
+         * The sum is weighted with the factors returned by PtBalFactors or MPFFactors, depending
+         * on the method, which must have been enabled. Blocks of the sum that have changed since
+         * the last call for this bin are recomputed.
+         */
+        double SumJets(Method method, unsigned binPtLead) const;
         
-        /// Updates all cached values for the given correction
-        void Update(JetCorrBase const &corrector);
+        /**
+         * Updates cached values for the given correction
+         *
+         * Only the values that might have changed since the previous update are recomputed. If
+         * an array of corrections is given, it must contain values of the given correction at the
+         * points returned by GetCorrectionPoints, and they are used instead of evaluating the
+         * correction.
+         */
+        void Update(JetCorrBase const &corrector, double const *corrections = nullptr);
         
-        /// Returns weight for the given bin along the second axis
-        double Weight(unsigned bin) const;
+        /// Returns weight for the given method and bin along the second axis
+        double Weight(Method method, unsigned bin) const;
         
+    private:
+        /// Cached values that depend on the pt threshold, which is specific to a method
+        struct MethodCache
+        {
+            /// Indicates whether sums over the second axis are computed for this method
+            bool enabled;
+
+            /// Reference points defining the smooth threshold
+            double thresholdStart, thresholdEnd;
+
+            /// Cached values of weights for bins along the second axis
+            std::vector<double> jetWeights;
+
+            /// Cached factors along the second axis, as returned by MPFFactors or PtBalFactors
+            std::vector<double> factors;
+
+            /**
+             * Range of bins along the second axis that have non-zero contribution
+             *
+             * The boundaries of the range are included.
+             */
+            unsigned firstPtJetBin, lastPtJetBin;
+
+            /**
+             * Contributions of blocks of bins along the second axis to the sums returned by
+             * SumJets
+             *
+             * Indexed with (binPtLead - 1) * numBlocks + block.
+             */
+            mutable std::vector<double> blockSums;
+
+            /// Cached sums over the second axis, indexed with (binPtLead - 1)
+            mutable std::vector<double> rowSums;
+        };
+
     private:
         /**
          * Computes weight for the given corrected pt
          * 
          * The weight changes smoothly from 0 below thresholdStart to 1 above thresholdEnd.
          */
-        double JetWeight(double pt) const;
+        static double JetWeight(double pt, double thresholdStart, double thresholdEnd);
+
+        /// Recomputes blocks of sums over the second axis that have changed for the given bin
+        void RefreshRow(unsigned binPtLead) const;
+
+        /**
+         * Recomputes cached values for typical pt within the given range
+         *
+         * Blocks along the second axis affected by the changes are assigned the current revision.
+         * Precomputed corrections are used if given, as described for method Update.
+         */
+        void UpdateRange(JetCorrBase const &corrector, double minPt, double maxPt,
+          double const *corrections);
         
     private:
+        /// Number of bins along the second axis in a block
+        static unsigned const blockSize = 32;
+
+        /**
+         * Histogram of jet projections
+         * 
+         * The axes of the histogram are the pt of the leading jet and pt of any other jet in the
+         * event. It is filled with projection of pt of a jet along the direction opposed to the
+         * diretion of the pt of the leading jet, normalized by pt of the leading jet. Contents of
+         * the histogram are stored in a dense array so that sums along the second axis can be
+         * vectorized.
+         */
+        std::shared_ptr<FlatHist2D const> sumProj;
+
         /// Typical values of pt along the two axes
         std::vector<double> meanPtLead, meanPtJet;
         
-        /// Reference points defining the smooth threshold for pt balance
-        double thresholdStart, thresholdEnd;
-        
         /// Cached values of the correction for typical pt values along the two axes
         std::vector<double> ptLeadCorrections, ptJetCorrections;
         
-        /// Cached values of weights for bins along the second axis
-        std::vector<double> jetWeights;
+        /// Cached logarithms of corrected typical pt along the first axis
+        std::vector<double> logCorrectedPtLead;
         
+        /// Cached values specific to the two methods, indexed with int(Method)
+        std::array<MethodCache, 2> methodCaches;
+
         /**
-         * Range of bins along the second axis that have non-zero contribution
-         * 
-         * The boundaries of the range are included.
+         * Configuration identifier and parameters of the correction used in the last update
+         *
+         * An identifier equal to zero indicates that a full update is needed.
          */
-        unsigned firstPtJetBin, lastPtJetBin;
+        std::uint64_t corrConfigId;
+        std::vector<double> corrParams;
+
+        /// Revision of the last update that has changed cached values
+        unsigned long revision;
+
+        /// Revisions of the last changes in bins along the first axis
+        std::vector<unsigned long> ptLeadRevisions;
+
+        /// Number of blocks along the second axis
+        unsigned numBlocks;
+
+        /// Revisions of the last changes in blocks along the second axis
+        std::vector<unsigned long> blockRevisions;
+
+        /// Revisions of the last refreshes of sums over the second axis, per bin along first axis
+        mutable std::vector<unsigned long> rowRevisions;
     };
     
     /**
@@ -160,7 +407,7 @@ private:
      * corrections are accessed exclusively through a JetCache object.
      *
      * Systematic variations in the mean value of the balance observable in data and simulation are
-     * supported. They need to be registered with methods AddDataSyst and AddSimSyst.
+     * supported. They need to be registered with methods AddDataSyst and SetSimSysts.
      */
     class Chi2Bin
     {
@@ -173,15 +420,14 @@ private:
          *     as other arguments, that contribute to the current chi^2 bin.
          * \param ptLeadHist  Histogram of event counts in bins of pt of the leading jet in data.
          * \param mpfProfile  Profile with mean values of the MPF observable.
-         * \param sumProj  Histogram of jet projections in data. See description of data member
-         *     with the same name.
-         * \param simBalSpline  Spline that approximates mean value of the balance observable in
-         *     simulation. See description of data member with the same name.
+         * \param simBalSplines  Splines that approximate mean value of the balance observable in
+         *     simulation and its systematic variations. See description of data member with the
+         *     same name.
          * \param unc2  Squared uncertainty to be used in the computation of chi^2.
          */
         Chi2Bin(Method method, unsigned firstBin, unsigned lastBin,
           std::shared_ptr<TH1> ptLeadHist, std::shared_ptr<TProfile> mpfProfile,
-          std::shared_ptr<TH2> sumProj, std::shared_ptr<Spline> simBalSpline, double unc2);
+          std::shared_ptr<SplineTable const> simBalSplines, double unc2);
         
     public:
         /**
@@ -197,23 +443,52 @@ private:
         void AddDataSyst(unsigned nuisanceIndex, double up, double down);
 
         /**
-         * Add systematic variation in simulation
+         * Adds chi^2 in this bin for all points of a batch
          *
-         * \param nuisanceIndex  Index of nuisance parameter that controls this variation.
-         * \param up  Spline that defines the reference up relative deviation for the mean value of
-         *     the balance observable in simulation. Parameterized as a function of the logarithm of
-         *     pt of the leading jet.
-         * \param down  Spline that defines the reference down variation, similarly to parameter up.
+         * Mean values of the balance observable in data and simulation are computed from values
+         * in the batch rather than from the JetCache object. For point i, chi^2 is computed with
+         * nuisances[i] and added to chi2[i]. Splines for the balance in simulation are only
+         * evaluated once for each distinct correction in the batch.
+         */
+        void AddChi2Batch(Method method, JetCache::Batch const &batch, Nuisances const *nuisances,
+          unsigned numPoints, double *chi2) const;
+
+        /// Returns the range of bins in pt of the leading jet included in this chi^2 bin
+        std::pair<unsigned, unsigned> BinRange() const;
+
+        /**
+         * Set systematic variations in simulation
+         *
+         * \param nuisanceIndices  Indices of nuisance parameters that control the variations. The
+         *     table of splines given to the constructor must contain the splines for the up and
+         *     down relative deviations for each variation, in the same order.
          */
-        void AddSimSyst(unsigned nuisanceIndex, std::shared_ptr<Spline> up,
-          std::shared_ptr<Spline> down);
+        void SetSimSysts(std::vector<unsigned> const &nuisanceIndices);
 
         /// Computes value of chi^2 in this bin
         double Chi2(Nuisances const &nuisances) const;
+
+        /**
+         * Computes value of chi^2 in this bin given the mean balance in data
+         *
+         * The mean balance must have been computed with the current state of the JetCache object.
+         */
+        double Chi2(double meanBalance, Nuisances const &nuisances) const;
         
         /// Computes mean value of the balance observable in data in this chi^2 bin
         double MeanBalance(Nuisances const &nuisances) const;
 
+        /**
+         * Computes mean values of both balance observables in data in a single pass
+         *
+         * This chi^2 bin must use the pt balance method, and the given one must use the MPF method
+         * and cover the same range. They must also share the JetCache object, in which both
+         * methods are enabled, so that each row of the histogram of jet projections is read only
+         * once. Returns mean values of the pt balance and MPF observables, in this order.
+         */
+        std::array<double, 2> MeanBalancePair(Chi2Bin const &mpfBin,
+          Nuisances const &nuisances) const;
+
         /**
          * Computes mean value of pt of the leading jet in this chi^2 bin
          *
@@ -225,23 +500,37 @@ private:
          * Computes mean value of the balance observable in simulation in this chi^2 bin
          *
          * The computation takes into account the shift in the position of this chi^2 bin along pt,
-         * which caused by the cached jet correction.
+         * which caused by the cached jet correction. Values of the splines are cached for each bin
+         * in pt of the leading jet and only recomputed when the correction in it changes.
          */
         double MeanSimBalance(Nuisances const &nuisances) const;
         
         /// Returns the range in pt of the leading jet for this chi^2 bin
         std::pair<double, double> PtRange() const;
         
-        /// Computes mean value of the balance observable in simulation at given pt
-        double SimBalance(double const ptLead, Nuisances const &nuisances) const;
+        /// Computes mean value of the balance observable in simulation at given log(pt)
+        double SimBalance(double const logPtLead, Nuisances const &nuisances) const;
         
-        /// Updates JetCache object used in the computations
+        /**
+         * Updates JetCache object used in the computations
+         *
+         * Cached values of the splines are discarded.
+         */
         void SetJetCache(JetCache const *jetCache);
 
         /// Returns statistical uncertainty in data
         double Uncertainty() const;
     
     private:
+        /// Applies registered systematic variations in data to the given mean balance
+        double ApplyDataSysts(double meanBalance, Nuisances const &nuisances) const;
+
+        /**
+         * Computes mean value of the balance observable in simulation from precomputed values of
+         * all splines from simBalSplines
+         */
+        double CombineSimSplines(double const *splineValues, Nuisances const &nuisances) const;
+
         /// Implements computation of mean value of the MPF observable in data
         double MeanMPF(Nuisances const &nuisances) const;
         
@@ -267,20 +556,14 @@ private:
         std::shared_ptr<TProfile> mpfProfile;
         
         /**
-         * Histogram of jet projections
+         * Mean value of the balance observable in simulation and its systematic variations
          * 
-         * The axes of the histogram are the pt of the leading jet and pt of any other jet in the
-         * event. It is filled with projection of pt of a jet along the direction opposed to the
-         * diretion of the pt of the leading jet, normalized by pt of the leading jet.
-         */
-        std::shared_ptr<TH2> sumProj;
-        
-        /**
-         * Mean value of the balance observable in simulation
-         * 
-         * Parameterized as a function of the natural logarithm of pt.
+         * Parameterized as a function of the natural logarithm of pt. The first spline in the
+         * table describes the nominal mean value. It is followed by pairs of splines that give up
+         * and down relative deviations for the systematic variations. The table is shared among all
+         * chi^2 bins that use the same splines.
          */
-        std::shared_ptr<Spline> simBalSpline;
+        std::shared_ptr<SplineTable const> simBalSplines;
         
         /// Squared uncertainty to be used for chi^2
         double unc2;
@@ -301,15 +584,60 @@ private:
         std::map<unsigned, PointMorph> dataVariations;
 
         /**
-         * Registered systematic variations in simulation
+         * Indices of nuisance parameters for systematic variations in simulation
          *
-         * The key of the map is the index of the nuisance parameter that corresponds to the
-         * variation. The value is a pair of splines that give up and down relative deviations in
-         * the mean value of the balance observable. As with simBalSpline, these splines are
-         * parameterized with the natural logarithm of pt.
+         * The order follows the order of the variations in simBalSplines.
          */
-        std::map<unsigned, std::array<std::shared_ptr<Spline>, 2>> simVariations;
+        std::vector<unsigned> simSystIndices;
+
+        /// Buffer to store values of all splines from simBalSplines
+        mutable std::vector<double> simSplineValues;
+
+        /**
+         * Cached values of all splines from simBalSplines in bins in pt of the leading jet
+         *
+         * Indexed with (binPtLead - firstBin) * numSplines + spline.
+         */
+        mutable std::vector<double> simSplineCache;
+
+        /**
+         * Revisions of the JetCache object for which the cached values of splines were computed
+         *
+         * Indexed with (binPtLead - firstBin). Zero indicates that the values are not available.
+         */
+        mutable std::vector<unsigned long> simSplineRevisions;
+
+        /**
+         * Buffer for values of all splines from simBalSplines in all bins in pt of the leading
+         * jet, used in batched evaluation
+         */
+        mutable std::vector<double> batchSplineValues;
+    };
+
+    /**
+     * \struct SharedInputs
+     *
+     * Inputs that do not depend on the computation method
+     *
+     * They are read from the input file once and can be shared between measurements that use
+     * different methods.
+     */
+    struct SharedInputs
+    {
+        /// Target binning in pt of the leading jet for the computation of chi^2
+        std::vector<double> binning;
+
+        /// Histogram of event counts in bins of pt of the leading jet
+        std::shared_ptr<TH1> ptLeadHist;
+
+        /// Contents of the histogram of jet projections
+        std::shared_ptr<FlatHist2D> sumProjContents;
+
+        /// Typical values of pt along the two axes of the histogram of jet projections
+        std::vector<double> meanPtLead, meanPtJet;
     };
+
+    friend class MultijetCrawlingBinsJoint;
     
 public:
     /**
@@ -319,11 +647,30 @@ public:
      * \param method  Computation method.
      * \param nuisanceDefs  Object that will collect requested nuisance parameters.
      * \param systToExclude  Labels of systematic uncertainties that should not be included.
+     * \param storage  Storage mode for the histogram of jet projections. With a single-precision
+     *     mode, the loss of precision is evaluated at construction and can be accessed with
+     *     method GetStoragePrecision.
      */
     MultijetCrawlingBins(std::string const &fileName, Method method,
-      NuisanceDefinitions &nuisanceDefs, std::set<std::string> systToExclude = {});
+      NuisanceDefinitions &nuisanceDefs, std::set<std::string> systToExclude = {},
+      FlatHist2D::Storage storage = FlatHist2D::Storage::Double);
+    
+    /**
+     * Copy constructor
+     * 
+     * Inputs are shared with the source object. The cache of jet corrections is copied, so that
+     * the two objects can be evaluated independently.
+     */
+    MultijetCrawlingBins(MultijetCrawlingBins const &src);
     
 public:
+    /**
+     * Creates a copy of this measurement
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    
     /**
      * Computes data-to-simulation residuals for given jet correction and nuisances
      *
@@ -343,6 +690,15 @@ public:
      */
     virtual unsigned GetDim() const override;
     
+    /**
+     * Returns the loss of precision due to the storage mode chosen in the constructor
+     * 
+     * The deviations are evaluated with a unit jet correction and all nuisances set to zero,
+     * including all chi^2 bins. If the inputs are stored in double precision, all deviations are
+     * zero.
+     */
+    StoragePrecision const &GetStoragePrecision() const;
+    
     /**
      * Computes chi^2 for the given jet corrector and set of nuisances
      * 
@@ -350,6 +706,36 @@ public:
      */
     virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const override;
 
+    /**
+     * Evaluates chi^2 for several points at once
+     *
+     * Sums over the histogram of jet projections for all points are computed as a single matrix
+     * product, see JetCache::EvalBatch. Points with identical parameters of the jet correction
+     * share the computation. The cache of jet corrections used by Eval is not affected.
+     *
+     * Reimplemented from MeasurementBase.
+     */
+    virtual void EvalMany(JetCorrBase &corrector, double const *corrParams,
+      Nuisances const *nuisances, unsigned numPoints, double *results) const override;
+
+    /**
+     * Computes chi^2 using precomputed jet corrections
+     *
+     * The corrections are used to update the cache of jet corrections instead of evaluating the
+     * corrector.
+     *
+     * Reimplemented from MeasurementBase.
+     */
+    virtual double EvalWithCorrections(JetCorrBase const &corrector, Nuisances const &nuisances,
+      double const *corrections) const override;
+
+    /**
+     * Returns typical pt in bins of the leading jet and of other jets
+     *
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::vector<double> GetCorrectionPoints() const override;
+
     /**
      * Recompute mean balance observable in data for given jet correction and nuisances
      *
@@ -380,6 +766,56 @@ public:
      */
     std::pair<double, double> SetPtLeadRange(double minPt, double maxPt);
     
+private:
+    /**
+     * Constructs a measurement without any chi^2 bins
+     *
+     * It must be initialized with method Initialize.
+     */
+    MultijetCrawlingBins(Method method);
+
+    /**
+     * Converts the histogram of jet projections to the given storage mode
+     *
+     * The histogram must be shared by all given measurements. For each measurement, the loss of
+     * precision is evaluated and saved. The returned object describes the loss of precision for
+     * the sum of chi^2 values of all measurements.
+     */
+    static StoragePrecision ConvertStorage(std::vector<MultijetCrawlingBins *> const &measurements,
+      FlatHist2D &sumProjContents, FlatHist2D::Storage storage,
+      NuisanceDefinitions const &nuisanceDefs);
+
+    /**
+     * Computes mean balance in all chi^2 bins and the total chi^2 for a unit correction
+     *
+     * All nuisances are set to zero, and the masks for chi^2 bins are ignored. The total chi^2 is
+     * returned as the last element of the vector.
+     */
+    std::vector<double> EvalUnitCorrection(NuisanceDefinitions const &nuisanceDefs) const;
+
+    /**
+     * Reads method-specific inputs and constructs chi^2 bins and the JetCache object
+     *
+     * The jet pt threshold is set from the input file for both methods in the JetCache object.
+     */
+    void Initialize(TFile &inputFile, std::string const &fileName, SharedInputs const &inputs,
+      NuisanceDefinitions &nuisanceDefs, std::set<std::string> const &systToExclude);
+
+    /// Opens input file, throwing an exception in case of failure
+    static std::unique_ptr<TFile> OpenInputFile(std::string const &fileName);
+
+    /// Returns the range of bins in pt of the leading jet spanned by chi^2 bins that are not masked
+    std::pair<unsigned, unsigned> PtLeadBinRange() const;
+
+    /// Reads inputs that do not depend on the method from the given file
+    static SharedInputs ReadSharedInputs(TFile &inputFile, std::string const &fileName);
+
+    /// Makes this object and all its chi^2 bins use the given JetCache object
+    void SetJetCache(std::shared_ptr<JetCache> jetCache);
+
+    /// Sums chi^2 over all chi^2 bins that are not masked, using the current state of the cache
+    double SumChi2(Nuisances const &nuisances) const;
+
 private:
     /// Method of computation
     Method method;
@@ -399,6 +835,152 @@ private:
      */
     std::vector<bool> chi2BinMask;
     
-    /// An object to cache values of jet corrections
-    mutable std::unique_ptr<JetCache> jetCache;
+    /**
+     * An object to cache values of jet corrections
+     *
+     * Only shared between the two measurements owned by a MultijetCrawlingBinsJoint object.
+     */
+    mutable std::shared_ptr<JetCache> jetCache;
+
+    /// Buffers for batched evaluation
+    mutable JetCache::Batch batch;
+    
+    /// Loss of precision due to the storage mode
+    StoragePrecision storagePrecision;
+};
+
+
+/**
+ * \class MultijetCrawlingBinsJoint
+ *
+ * Joint measurement with the pt balance and MPF methods in multijet topology
+ *
+ * Inputs that are common for the two methods, which include the histograms of pt of the leading jet
+ * and of jet projections, are read only once and shared by two MultijetCrawlingBins objects, one
+ * for each method. The memory footprint is thus roughly halved compared to two independent
+ * measurements. The objects also share a single JetCache, so that the jet correction is evaluated
+ * once, and the mean balance with both methods is computed in a single pass over the histogram of
+ * jet projections.
+ *
+ * The chi^2 is given by the sum of chi^2 values for the two methods, which allows a joint fit.
+ * Note that correlations between the two observables, which are computed from the same events, are
+ * not taken into account. Values of chi^2 for the two methods can be computed in a single pass with
+ * method EvalMethods. The individual measurements are available through method GetMethod, which
+ * allows to use them as separate loss functions. Since they share a JetCache object, they must not
+ * be evaluated concurrently, unless they are cloned first.
+ *
+ * Nuisance parameters for systematic variations with the same labels in the two methods are
+ * identified, i.e. the variations are treated as fully correlated.
+ */
+class MultijetCrawlingBinsJoint: public MeasurementBase
+{
+public:
+    using Method = MultijetCrawlingBins::Method;
+
+public:
+    /**
+     * Constructor
+     *
+     * The arguments have the same meaning as for MultijetCrawlingBins. The input file must contain
+     * inputs for both methods.
+     */
+    MultijetCrawlingBinsJoint(std::string const &fileName, NuisanceDefinitions &nuisanceDefs,
+      std::set<std::string> systToExclude = {},
+      FlatHist2D::Storage storage = FlatHist2D::Storage::Double);
+
+    /**
+     * Copy constructor
+     *
+     * Inputs are shared with the source object, but the cache of jet corrections is not.
+     */
+    MultijetCrawlingBinsJoint(MultijetCrawlingBinsJoint const &src);
+
+public:
+    /**
+     * Creates a copy of this measurement
+     *
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+
+    /**
+     * Computes the sum of chi^2 values for the two methods
+     *
+     * Implemented from MeasurementBase.
+     */
+    virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const override;
+
+    /**
+     * Computes chi^2 separately for the pt balance and MPF methods, in this order
+     *
+     * Both values are computed in a single pass. If an array of corrections is given, it must
+     * contain values of the given correction at the points returned by GetCorrectionPoints.
+     */
+    std::array<double, 2> EvalMethods(JetCorrBase const &corrector, Nuisances const &nuisances,
+      double const *corrections = nullptr) const;
+
+    /**
+     * Evaluates the sum of chi^2 values for the two methods for several points at once
+     *
+     * Factors for both methods and all points are combined into a single matrix, which is
+     * multiplied by the histogram of jet projections. See MultijetCrawlingBins::EvalMany.
+     *
+     * Reimplemented from MeasurementBase.
+     */
+    virtual void EvalMany(JetCorrBase &corrector, double const *corrParams,
+      Nuisances const *nuisances, unsigned numPoints, double *results) const override;
+
+    /**
+     * Computes the sum of chi^2 values for the two methods using precomputed jet corrections
+     *
+     * Reimplemented from MeasurementBase.
+     */
+    virtual double EvalWithCorrections(JetCorrBase const &corrector, Nuisances const &nuisances,
+      double const *corrections) const override;
+
+    /**
+     * Returns typical pt in bins of the leading jet and of other jets
+     *
+     * The two methods share these points. Reimplemented from MeasurementBase.
+     */
+    virtual std::vector<double> GetCorrectionPoints() const override;
+
+    /**
+     * Returns total number of chi^2 bins for the two methods
+     *
+     * Implemented from MeasurementBase.
+     */
+    virtual unsigned GetDim() const override;
+
+    /**
+     * Returns the measurement for the given method
+     *
+     * It shares the cache of jet corrections with the measurement for the other method.
+     */
+    MultijetCrawlingBins const &GetMethod(Method method) const;
+
+    /**
+     * Returns the loss of precision due to the storage mode chosen in the constructor
+     *
+     * The relative error in chi^2 refers to the sum of the chi^2 values for the two methods.
+     */
+    StoragePrecision const &GetStoragePrecision() const;
+
+    /**
+     * Restricts computation to given range in pt of the leading jet
+     *
+     * The range is applied to both methods. See MultijetCrawlingBins::SetPtLeadRange.
+     */
+    std::pair<double, double> SetPtLeadRange(double minPt, double maxPt);
+
+private:
+    /// Makes the two measurements use a common JetCache with thresholds for the two methods
+    void ShareJetCache();
+
+private:
+    /// Measurements with the pt balance and MPF methods
+    std::unique_ptr<MultijetCrawlingBins> ptBal, mpf;
+
+    /// Loss of precision due to the storage mode
+    StoragePrecision storagePrecision;
 };
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <FitBase.hpp>
+#include <ThreadPool.hpp>
+
+#include <Math/IFunction.h>
+
+#include <memory>
+#include <vector>
+
+
+/**
+ * \class ParallelGradFunction
+ * \brief Adapter that exposes a loss function with a parallel numerical gradient to minimizers
+ *
+ * Implements the interface ROOT::Math::IMultiGradFunction for a CombLossFunction. The gradient is
+ * computed with central finite differences, which requires 2 N evaluations of the loss function for
+ * N parameters. These evaluations are distributed among several threads. Each thread uses its own
+ * evaluation context, which is a copy of the loss function obtained with CombLossFunction::Clone.
+ * Thus, the jet correction and all measurements must support cloning.
+ *
+ * The copies are created in the constructor. Changes made to the original loss function or its
+ * measurements after that (for instance, a change of the pt range) are not propagated to them.
+ * The original loss function is not owned by this and is used as the context for the first worker.
+ * An object of this class must not be used concurrently from several threads.
+ */
+class ParallelGradFunction: public ROOT::Math::IMultiGradFunction
+{
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param lossFunc  Loss function to wrap. It must outlive this object.
+     * \param numThreads  Number of threads to use. If zero, the number of hardware threads is
+     *     used.
+     */
+    ParallelGradFunction(CombLossFunction const &lossFunc, unsigned numThreads = 0);
+
+public:
+    /**
+     * \brief Creates a copy with separate evaluation contexts
+     *
+     * Implemented from ROOT::Math::IMultiGradFunction.
+     */
+    virtual ROOT::Math::IMultiGenFunction *Clone() const override;
+
+    /**
+     * \brief Computes the value of the loss function and its gradient
+     *
+     * Reimplemented from ROOT::Math::IMultiGradFunction.
+     */
+    virtual void FdF(double const *x, double &f, double *grad) const override;
+
+    /// Returns the number of points of the finite-difference stencil evaluated together
+    unsigned GetBatchSize() const;
+
+    /// Returns number of threads used
+    unsigned GetNumThreads() const;
+
+    /**
+     * \brief Computes the gradient of the loss function
+     *
+     * Reimplemented from ROOT::Math::IMultiGradFunction.
+     */
+    virtual void Gradient(double const *x, double *grad) const override;
+
+    /**
+     * \brief Returns the number of parameters of the loss function
+     *
+     * Implemented from ROOT::Math::IMultiGradFunction.
+     */
+    virtual unsigned int NDim() const override;
+
+    /**
+     * \brief Sets the number of points of the finite-difference stencil evaluated together
+     *
+     * With a batch size larger than one, each worker evaluates groups of consecutive points with
+     * CombLossFunction::EvalRawInputMany, which allows measurements such as MultijetCrawlingBins
+     * to share computations among the points. With the default batch size of one, points are
+     * evaluated individually with CombLossFunction::EvalRawInput, and measurements can instead
+     * update their caches incrementally. The batch size must not exceed
+     * CombLossFunction::maxBatchSize.
+     */
+    void SetBatchSize(unsigned batchSize);
+
+    /**
+     * \brief Sets the relative step for finite differences
+     *
+     * The step for a parameter x is computed as relStep * max(|x|, 1). The default value is the
+     * cubic root of the machine epsilon, which is optimal for central differences.
+     */
+    void SetRelStep(double relStep);
+
+private:
+    /**
+     * \brief Computes the derivative with respect to a single parameter
+     *
+     * Implemented from ROOT::Math::IMultiGradFunction. Only uses the original loss function.
+     */
+    virtual double DoDerivative(double const *x, unsigned int icoord) const override;
+
+    /**
+     * \brief Evaluates the loss function
+     *
+     * Implemented from ROOT::Math::IMultiGradFunction. Uses the original loss function.
+     */
+    virtual double DoEval(double const *x) const override;
+
+    /// Computes the step for finite differences for the given value of a parameter
+    double Step(double x) const;
+
+private:
+    /// Original loss function
+    CombLossFunction const &lossFunc;
+
+    /// Relative step for finite differences
+    double relStep;
+
+    /// Number of points of the stencil evaluated together
+    unsigned batchSize;
+
+    /// Pool of threads to compute the gradient
+    mutable ThreadPool threadPool;
+
+    /// Copies of the loss function used by workers other than the first one
+    std::vector<std::unique_ptr<CombLossFunction>> clones;
+
+    /**
+     * \brief Evaluation contexts indexed by worker
+     *
+     * Includes the original loss function at index 0, followed by its copies.
+     */
+    std::vector<CombLossFunction const *> contexts;
+
+    /// Per-worker buffers for batches of points at which the loss function is evaluated
+    mutable std::vector<std::vector<double>> points;
+
+    /// Buffer for values of the loss function at the points of the finite-difference stencil
+    mutable std::vector<double> stencilValues;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <FitBase.hpp>
+#include <ThreadPool.hpp>
+
+#include <Math/Minimizer.h>
+
+#include <memory>
+#include <vector>
+
+
+/**
+ * \class ParallelMinos
+ * \brief Computes MINOS errors for all free parameters, running independent searches in parallel
+ *
+ * In Minuit2, the MINOS error on each side of each parameter is found with a separate sequence of
+ * minimizations with that parameter fixed, and the searches are executed one after another. This
+ * class distributes the searches, two per free parameter, among several threads. The minimum in
+ * the internal format of Minuit2 is reconstructed once from the values and the covariance matrix
+ * of a completed fit, and all searches start from it, as Minuit2Minimizer::GetMinosError does. As
+ * in ParallelGradFunction, each thread evaluates a separate copy of the loss function obtained
+ * with CombLossFunction::Clone, so that with more than one thread the jet correction and all
+ * measurements must support cloning.
+ *
+ * The searches evaluate the gradient numerically in Minuit2 and do not use additional threads.
+ */
+class ParallelMinos
+{
+public:
+    /// MINOS errors for a single parameter
+    struct Interval
+    {
+        /// Signed errors in the negative and positive directions
+        double lower, upper;
+
+        /// Flags showing whether the searches on each side have succeeded
+        bool lowerValid, upperValid;
+    };
+
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param lossFunc  Loss function to compute errors for. It must outlive this object.
+     * \param numThreads  Number of threads to use. If zero, the number of hardware threads is
+     *     used.
+     */
+    ParallelMinos(CombLossFunction const &lossFunc, unsigned numThreads = 0);
+
+public:
+    /// Returns number of threads used
+    unsigned GetNumThreads() const;
+
+    /**
+     * \brief Computes MINOS errors around the minimum found by the given minimizer
+     *
+     * The minimizer must have been used to minimize the loss function given to the constructor.
+     * Its variable settings, strategy, error definition, tolerance, and limit on the number of
+     * function calls are reproduced in the searches. The fitted covariance matrix, if available,
+     * is used as the metric at the minimum, so that Migrad only needs to confirm the convergence
+     * before the searches start. Returns an interval for each variable of the minimizer. For
+     * fixed variables, the errors are zero and marked as not valid. If the reconstructed minimum
+     * is not valid, so are all the intervals.
+     */
+    std::vector<Interval> Run(ROOT::Math::Minimizer const &fitted);
+
+private:
+    /// Original loss function
+    CombLossFunction const &lossFunc;
+
+    /// Pool of threads to execute the searches
+    ThreadPool threadPool;
+
+    /// Copies of the loss function used by workers other than the first one
+    std::vector<std::unique_ptr<CombLossFunction>> clones;
+
+    /**
+     * \brief Evaluation contexts indexed by worker
+     *
+     * Includes the original loss function at index 0, followed by its copies.
+     */
+    std::vector<CombLossFunction const *> contexts;
+};
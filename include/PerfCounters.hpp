@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class PerfCounters
+ * \brief Hardware performance counters aggregated over instrumented regions of code
+ *
+ * Regions of code are defined by static objects of class PerfRegion and instrumented with
+ * PerfScope. When counting is enabled, each scope reads the hardware counters of the calling
+ * thread at its start and end and adds the differences to the totals of its region. The counters
+ * are accessed with the Linux perf_event_open interface and only count events in user space.
+ *
+ * Counting is disabled by default, and then a scope costs a single atomic load. Hardware
+ * counters are often not available, for instance, in containers or virtual machines, or because
+ * of the setting of kernel.perf_event_paranoid. In that case Enable returns false with an
+ * explanation, and scopes do nothing. Individual events that are not supported by the CPU are
+ * reported as unavailable.
+ *
+ * All methods are static and thread-safe.
+ */
+class PerfCounters
+{
+public:
+    /// Supported events
+    enum class Event: unsigned
+    {
+        Cycles,
+        Instructions,
+        CacheReferences,
+        CacheMisses,
+        Branches,
+        BranchMisses
+    };
+
+    /// Number of supported events
+    static constexpr unsigned numEvents = 6;
+
+    /**
+     * \struct RegionSummary
+     * \brief Aggregated counters for a region
+     *
+     * Counts are scaled to account for multiplexing of counters. A negative count means that the
+     * event is not available.
+     */
+    struct RegionSummary
+    {
+        std::string name;
+
+        /// Number of times the region has been executed with counting enabled
+        unsigned long calls;
+
+        /// Counts for all events, indexed with Event
+        std::array<double, numEvents> counts;
+    };
+
+public:
+    /**
+     * \brief Enables counting
+     *
+     * Checks whether hardware counters can be opened in the calling thread. If not, counting
+     * stays disabled and the reason is available from GetStatus. Returns true if counting has
+     * been enabled.
+     */
+    static bool Enable();
+
+    /// Disables counting, preserving the accumulated counts
+    static void Disable();
+
+    /// Checks whether counting is enabled
+    static bool IsEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /// Returns a description of the state of hardware counters, e.g. the reason for a failure
+    static std::string GetStatus();
+
+    /// Returns aggregated counters for all regions that have been executed with counting enabled
+    static std::vector<RegionSummary> GetSummary();
+
+    /**
+     * \brief Prints a table with derived metrics for all regions
+     *
+     * The metrics are the instructions per cycle (IPC), the fraction of cache references that
+     * miss the last-level cache, and the fraction of mispredicted branches.
+     */
+    static void Report(std::ostream &out);
+
+    /// Resets accumulated counts for all regions
+    static void Reset();
+
+private:
+    /// Flag indicating whether counting is enabled
+    static std::atomic<bool> enabled;
+};
+
+
+/**
+ * \class PerfRegion
+ * \brief Named region of code for which hardware counters are aggregated
+ *
+ * Objects of this class should have static storage duration. They are typically defined as
+ * function-local static variables next to the instrumented code.
+ */
+class PerfRegion
+{
+    friend class PerfCounters;
+    friend class PerfScope;
+
+public:
+    /// Constructor from the name of the region
+    PerfRegion(std::string const &name);
+
+    PerfRegion(PerfRegion const &) = delete;
+    PerfRegion &operator=(PerfRegion const &) = delete;
+
+private:
+    /// Name of the region
+    std::string name;
+
+    /// Number of executions of the region
+    std::atomic<unsigned long> calls;
+
+    /// Accumulated raw counts for all events
+    std::array<std::atomic<unsigned long>, PerfCounters::numEvents> counts;
+
+    /**
+     * \brief Accumulated time during which events were enabled and actually counted
+     *
+     * Used to scale the counts if counters have been multiplexed.
+     */
+    std::atomic<unsigned long> timeEnabled, timeRunning;
+};
+
+
+/**
+ * \class PerfScope
+ * \brief Adds hardware counters between its construction and destruction to a region
+ *
+ * Does nothing if counting is disabled at the time of construction.
+ */
+class PerfScope
+{
+public:
+    /// Starts counting for the given region
+    PerfScope(PerfRegion &region);
+
+    PerfScope(PerfScope const &) = delete;
+
+    /// Stops counting and updates the region
+    ~PerfScope() noexcept;
+
+    PerfScope &operator=(PerfScope const &) = delete;
+
+private:
+    /// Region to be updated, or nullptr if counting is not active
+    PerfRegion *region;
+
+    /// Values of the group of counters at the start
+    std::array<unsigned long, PerfCounters::numEvents + 2> startValues;
+};
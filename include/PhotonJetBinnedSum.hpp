@@ -3,17 +3,13 @@
 #include <FitBase.hpp>
 
 #include <Nuisances.hpp>
+#include <ThreadPool.hpp>
 
-#include <TH1.h>
-#include <TH2.h>
-#include <TProfile.h>
-#include <TProfile2D.h>
-
-#include <set>
+#include <array>
+#include <memory>
+#include <string>
 #include <vector>
 
-struct FracBin;
-
 
 /**
  * \class PhotonJetBinnedSum
@@ -26,6 +22,12 @@ struct FracBin;
  * correction following an approach similar to the multijet analysis.
  * 
  * Changes of photon pt scale in data are propagated into the pt of the photon.
+ * 
+ * All inputs are copied into flat arrays at construction. Only cells of the 2D distributions in
+ * pt of the photon and jets that are not empty and belong to photon bins with events are kept. In
+ * each evaluation, the jet correction is computed for all of them with a single call to
+ * JetCorrBase::EvalBatch, and the jet pt threshold is inverted once. The mean balance observable
+ * can then be recomputed in different bins independently, and this can be done in parallel.
  */
 class PhotonJetBinnedSum: public MeasurementBase
 {
@@ -43,6 +45,14 @@ public:
       NuisanceDefinitions &nuisanceDefs);
     
 public:
+    /**
+     * \brief Creates a copy of this measurement
+     * 
+     * The copy uses its own pool of threads with the same number of threads as this.
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
@@ -57,52 +67,131 @@ public:
      */
     virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const override;
     
-private:
-    /// Recomputes MPF in data for given photon pt bin, 2D pt window, and jet correction
-    double ComputeMPF(FracBin const &ptPhotonStart, FracBin const &ptPhotonEnd,
-      JetCorrBase const &corrector, Nuisances const &nuisances) const;
+    /**
+     * \brief Evaluates the deviation using precomputed values of the jet correction
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual double EvalWithCorrections(JetCorrBase const &corrector, Nuisances const &nuisances,
+      double const *corrections) const override;
     
-    /// Recomputes PtBal in data for given photon pt bin, 2D pt window, and jet correction
-    double ComputePtBal(FracBin const &ptPhotonStart, FracBin const &ptPhotonEnd,
-      JetCorrBase const &corrector, Nuisances const &nuisances) const;
+    /**
+     * \brief Returns mean pt of jets in all non-empty cells
+     * 
+     * The pt threshold is still applied by inverting the correction, which is not covered by
+     * these points. Reimplemented from MeasurementBase.
+     */
+    virtual std::vector<double> GetCorrectionPoints() const override;
     
-    /// Recomputes mean balance observable in all photon pt bins for the given jet correction
-    void UpdateBalance(JetCorrBase const &corrector, Nuisances const &nuisances) const;
+    /**
+     * \brief Sets the number of threads used to recompute the balance observable
+     * 
+     * Bins in pt of the photon are distributed among the threads. If the number is zero, the
+     * number of hardware threads is used. By default, the computation is done in the calling
+     * thread only.
+     */
+    void SetNumThreads(unsigned numThreads);
+    
+private:
+    /**
+     * \struct PhotonBin
+     * \brief Inputs for a bin in pt of the photon in data
+     */
+    struct PhotonBin
+    {
+        /// Number of events
+        double numEvents;
+        
+        /// Mean pt of the photon
+        double meanPhotonPt;
+        
+        /// Mean balance observable, as measured
+        double meanBal;
+        
+        /// Range of cells of this bin, in the arrays of cells [firstCell, endCell)
+        unsigned firstCell, endCell;
+    };
     
 private:
-    /// Profiles of the balance observable in data and simulation
-    std::unique_ptr<TProfile> balProfile, simBalProfile;
+    /**
+     * \brief Recomputes the balance observable in the given bin of simulation
+     * 
+     * Factors for cells must have been computed for the current jet correction.
+     */
+    double ComputeBalance(unsigned simBin, unsigned startJetBin, double fracStartBin,
+      double photonScaleFactor) const;
     
-    /// Distribution of the pt of the photon in data
-    std::unique_ptr<TH1> ptPhoton;
+    /**
+     * \brief Recomputes mean balance observable in all photon pt bins for the given jet correction
+     * 
+     * If given, the array of corrections must contain values of the correction at
+     * cellMeanJetPt, and they are used instead of evaluating the correction.
+     */
+    void UpdateBalance(JetCorrBase const &corrector, Nuisances const &nuisances,
+      double const *corrections = nullptr) const;
     
-    /// Profile of the pt of the photon in data
-    std::unique_ptr<TProfile> ptPhotonProfile;
+    /// Computes chi^2 from the recomputed balance observable
+    double SumChi2() const;
     
-    /// Sum of projections of pt of jets in bins of pt of the photon and jets
-    std::unique_ptr<TH2> ptJetSumProj;
+private:
+    /// Method of computation
+    Method method;
     
-    /// 2D profile of pt of jets
-    std::unique_ptr<TProfile2D> ptJet2DProfile; 
+    /// Mean balance observable in simulation in bins used to compute chi^2
+    std::vector<double> simBal;
     
     /**
      * \brief Squared uncertainty on the difference between mean balance observables in data
      * and simulation
      */
     std::vector<double> totalUnc2;
-
-    //Jet pt threshold
+    
+    /// Jet pt threshold
     double jetPtMin;
-
+    
+    /// Edges of bins in pt of jets, including the upper edge of the last bin
+    std::vector<double> jetBinning;
+    
+    /// Bins in pt of the photon in data that contain events
+    std::vector<PhotonBin> photonBins;
+    
+    /**
+     * \brief Ranges of photonBins included in each bin of simulation
+     * 
+     * Each range is given as [first, end). Ranges of adjacent bins can overlap.
+     */
+    std::vector<std::array<unsigned, 2>> simBinRanges;
+    
+    /**
+     * \brief Indices of bins in pt of jets for non-empty cells
+     * 
+     * Cells of each photon bin are sorted in the jet pt.
+     */
+    std::vector<unsigned> cellJetBins;
+    
+    /// Sums of projections of pt of jets in non-empty cells
+    std::vector<double> cellSumProj;
+    
+    /// Mean pt of jets in non-empty cells
+    std::vector<double> cellMeanJetPt;
+    
+    /**
+     * \brief Factors to recompute the balance observable in non-empty cells
+     * 
+     * Computed for the current jet correction evaluated at cellMeanJetPt. For the pt balance the
+     * factors are equal to the correction, and for MPF they are given by 1 minus the correction.
+     */
+    mutable std::vector<double> cellFactors;
+    
     /**
     * \brief Recomputed mean balance observable in data
     * 
-    * Computed in the binning of simBalProfile.
+    * Computed in the binning of simulation.
     */
     mutable std::vector<double> recompBal;
     
-    /// Method of computation
-    Method method;
+    /// Index of the nuisance parameter for the photon pt scale
+    unsigned photonScaleIndex;
     
     /**
      * \brief Size of the variation in the photon pt scale
@@ -111,4 +200,11 @@ private:
      * parameter is +1.
      */
     double photonScaleVar;
+    
+    /**
+     * \brief Pool of threads to recompute the balance observable
+     * 
+     * Null if the computation is done in the calling thread only.
+     */
+    std::shared_ptr<ThreadPool> threadPool;
 };
@@ -50,6 +50,13 @@ public:
     PhotonJetRun1(std::string const &fileName, Method method, NuisanceDefinitions &nuisanceDefs);
     
 public:
+    /**
+     * \brief Creates a copy of this measurement
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
@@ -9,6 +9,9 @@
 #include <vector>
 
 
+class ScratchArena;
+
+
 /**
  * \struct FracBin
  * \brief Auxiliary POD to describe a bin with an inclusion fraction
@@ -45,3 +48,14 @@ using BinMap = std::map<unsigned, std::array<FracBin, 2>>;
  * boundary is set to zero. Bins are numbered such that the underflow bin is assigned index 0.
  */
 BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &target);
+
+
+/**
+ * \brief Constructs a mapping from one binning to another without allocating heap memory
+ *
+ * Same as the version above, but the binnings are given as arrays of numSource and numTarget
+ * edges. The range of source bins for target bin i is written into ranges[i], and the output array
+ * must have room for numTarget + 1 elements. Temporary buffers are obtained from the given arena.
+ */
+void mapBinning(double const *source, unsigned numSource, double const *target,
+  unsigned numTarget, std::array<FracBin, 2> *ranges, ScratchArena &arena);
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class RecordFile
+ * \brief Append-only file of fixed-size records for long computations
+ *
+ * Results of independent work units, such as points of a scan, are appended to the file as soon as
+ * they are computed. Each record contains an integer key that identifies the work unit, a fixed
+ * number of floating-point values, and a checksum. When a computation is restarted, completed work
+ * units are read back and can be skipped.
+ *
+ * This is a counterpart of class RecordFile from python/records.py and uses the same binary format,
+ * including the CRC-32 checksums of records and the sidecar index with extension ".idx". The data
+ * file is flushed to disk every few records or seconds, and the index every few thousand records.
+ * On opening an existing file, records that are not covered by the index are validated, and a
+ * record that has been only partly written or is corrupted is discarded together with everything
+ * after it.
+ *
+ * All values are stored in the little-endian byte order, which must be the native one.
+ */
+class RecordFile
+{
+public:
+    /**
+     * \brief Opens an existing file or creates a new one
+     *
+     * \param path  Path to the data file.
+     * \param numValues  Number of floating-point values in a record.
+     * \param signature  Number that identifies the computation, as computed by GridSignature.
+     *     Opening an existing file with a different signature or number of values results in an
+     *     exception.
+     * \param syncEvery  Maximal number of records appended between two flushes to disk.
+     * \param syncInterval  Maximal time in seconds between two flushes to disk.
+     * \param indexEvery  Number of records appended between two updates of the index.
+     */
+    RecordFile(std::string const &path, unsigned numValues, std::uint64_t signature = 0,
+      unsigned syncEvery = 100, double syncInterval = 10., unsigned indexEvery = 1000);
+
+    RecordFile(RecordFile const &) = delete;
+
+    /// Closes the file, ignoring any errors
+    ~RecordFile() noexcept;
+
+    RecordFile &operator=(RecordFile const &) = delete;
+
+public:
+    /**
+     * \brief Appends a record
+     *
+     * The record reaches the disk at the latest after the number of records or the time interval
+     * given at construction.
+     */
+    void Append(std::uint64_t key, std::vector<double> const &values);
+
+    /**
+     * \brief Flushes all records, updates the index, and closes the file
+     *
+     * Calling this method more than once has no effect.
+     */
+    void Close();
+
+    /**
+     * \brief Computes signature from grids of work units
+     *
+     * Reproduces function grid_signature from python/records.py. The definition, which describes
+     * the function evaluated at the points, is included in the digest if it is not empty. The
+     * Python version serializes it as JSON with sorted keys.
+     */
+    static std::uint64_t GridSignature(std::vector<std::vector<double>> const &grids,
+      std::string const &definition = "");
+
+    /// Returns keys of all records
+    std::set<std::uint64_t> GetCompleted() const;
+
+    /// Returns the number of records in the file
+    unsigned long GetNumRecords() const;
+
+    /**
+     * \brief Reads all records
+     *
+     * Returns a map from keys to values. If there are several records with the same key, the last
+     * one is used.
+     */
+    std::map<std::uint64_t, std::vector<double>> Read();
+
+private:
+    /// Reads keys from the index, or returns an empty vector if it is not usable
+    std::vector<std::uint64_t> ReadIndex(unsigned long numRecords) const;
+
+    /// Reads back an existing file and drops damaged records at its end
+    void Recover();
+
+    /// Returns the size of a record in bytes
+    std::size_t RecordSize() const;
+
+    /// Makes sure all appended records are stored on disk
+    void Sync();
+
+    /// Saves the index, replacing the old one atomically
+    void WriteIndex();
+
+private:
+    /// Paths to the data file and the index
+    std::string path, indexPath;
+
+    /// Number of values in a record
+    unsigned numValues;
+
+    /// Signature of the computation
+    std::uint64_t signature;
+
+    /// Parameters that control flushing to disk and updates of the index
+    unsigned syncEvery;
+    double syncInterval;
+    unsigned indexEvery;
+
+    /// Descriptor of the data file opened for appending, or -1 if it has been closed
+    int fd;
+
+    /// Keys of all records in the order they appear in the file
+    std::vector<std::uint64_t> keys;
+
+    /// Numbers of records appended since the last flush and the last update of the index
+    unsigned numUnsynced, numUnindexed;
+
+    /// Time of the last flush
+    std::chrono::steady_clock::time_point lastSync;
+};
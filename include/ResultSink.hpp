@@ -0,0 +1,226 @@
+#pragma once
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * \struct FitRecord
+ * \brief Results of a single fit, as stored by a ResultSink
+ */
+struct FitRecord
+{
+    /// Constructs a record for the given number of parameters with all values set to zero
+    FitRecord(unsigned numParams = 0);
+
+    /// Identifier of the fit, such as the index of a point in a scan or the seed of a toy
+    std::uint64_t key;
+
+    /// Values of the parameters at the minimum and their uncertainties
+    std::vector<double> params, errors;
+
+    /// Covariance matrix of the parameters in the row-major order
+    std::vector<double> covariance;
+
+    /// Minimal value of the loss function
+    double chi2;
+
+    /// Number of degrees of freedom
+    unsigned ndf;
+
+    /// Status code reported by the minimizer
+    int status;
+
+    /// Wall time spent in the fit, in seconds
+    double time;
+};
+
+
+/**
+ * \class ResultSink
+ * \brief Abstract base class to stream results of many fits into a file with a columnar layout
+ *
+ * All records have the same schema, which is fixed by the names of the parameters given at
+ * construction. Records are buffered, and the storage is updated so that all records written so
+ * far can be read back when method Flush is called, as well as when the sink is closed or
+ * destroyed. Records written after the last flush may be lost if the program terminates abruptly.
+ *
+ * Use method Create to construct a sink with a backend chosen based on the path.
+ */
+class ResultSink
+{
+public:
+    virtual ~ResultSink() = default;
+
+public:
+    /**
+     * \brief Flushes all records and closes the underlying files
+     *
+     * No records can be written afterwards. Calling this method more than once has no effect.
+     */
+    virtual void Close() = 0;
+
+    /**
+     * \brief Creates a sink with the backend chosen based on the path
+     *
+     * Paths with extension ".root" result in a TreeResultSink. Any other path is interpreted as a
+     * directory for an NpyResultSink. An existing file or directory is overwritten.
+     */
+    static std::unique_ptr<ResultSink> Create(std::string const &path,
+      std::vector<std::string> const &paramNames);
+
+    /// Makes sure all records written so far can be read back
+    virtual void Flush() = 0;
+
+    /// Returns the number of parameters in each record
+    unsigned GetNumParams() const;
+
+    /// Returns the number of records written so far
+    unsigned long GetNumRecords() const;
+
+    /**
+     * \brief Writes a record
+     *
+     * Throws an exception if the numbers of parameters or the size of the covariance matrix does
+     * not match the schema or if the sink has been closed.
+     */
+    void Write(FitRecord const &record);
+
+protected:
+    /// Constructor
+    ResultSink(std::vector<std::string> const &paramNames);
+
+    /// Writes a record whose consistency has already been checked
+    virtual void WriteImpl(FitRecord const &record) = 0;
+
+protected:
+    /// Names of the parameters
+    std::vector<std::string> paramNames;
+
+    /// Number of records written so far
+    unsigned long numRecords;
+
+    /// Indicates whether the sink has been closed
+    bool closed;
+};
+
+
+/**
+ * \class NpyResultSink
+ * \brief Result sink that stores each field in a separate file in NumPy format
+ *
+ * The files are placed in a directory and named after the fields of FitRecord, e.g. "params.npy".
+ * The first dimension of each array is the index of the record. Parameters and errors are stored
+ * as arrays of shape (N, n), where n is the number of parameters, and the covariance matrices as an
+ * array of shape (N, n, n). Names of the parameters are written to file "param_names.txt", one per
+ * line.
+ *
+ * Each header is reserved with a fixed size so that the number of records can be updated in place
+ * when the sink is flushed. The files can be memory-mapped from Python without copying the data,
+ * e.g. with numpy.load(path, mmap_mode='r') or function read_results in python/results.py. The
+ * latter also recovers records written after the last flush.
+ */
+class NpyResultSink: public ResultSink
+{
+public:
+    /**
+     * \brief Constructor
+     *
+     * Creates the directory if it does not exist yet. Files in it are overwritten.
+     */
+    NpyResultSink(std::string const &directory, std::vector<std::string> const &paramNames);
+
+    /// Closes the sink, ignoring any errors
+    ~NpyResultSink() noexcept;
+
+public:
+    /// Implemented from ResultSink
+    virtual void Close() override;
+
+    /// Implemented from ResultSink
+    virtual void Flush() override;
+
+private:
+    /// A single field stored in a separate file
+    struct Column
+    {
+        /// Output file
+        std::ofstream file;
+
+        /// Path to the file, for error reporting
+        std::string path;
+
+        /// Description of the data type in NumPy format, e.g. "<f8"
+        std::string descr;
+
+        /// Dimensions of an array for a single record, not including the record index
+        std::vector<unsigned> shape;
+    };
+
+    /// Indices of columns
+    enum ColumnIndex: unsigned
+    {
+        Key, Params, Errors, Covariance, Chi2, NDF, Status, Time, NumColumns
+    };
+
+private:
+    /// Writes (or rewrites) the header of the given column with the current number of records
+    void WriteHeader(Column &column);
+
+    /// Implemented from ResultSink
+    virtual void WriteImpl(FitRecord const &record) override;
+
+private:
+    /// Output columns, indexed with ColumnIndex
+    std::vector<Column> columns;
+};
+
+
+/**
+ * \class TreeResultSink
+ * \brief Result sink that stores records in a ROOT TTree
+ *
+ * The tree is called "Results" and contains a branch for each field of FitRecord. Parameters,
+ * errors, and the covariance matrix are stored as fixed-size arrays. Names of the parameters are
+ * saved as TObjString objects in the user info list of the tree. A flush writes the tree header
+ * with TTree::AutoSave, so that the file can be recovered if the program terminates.
+ */
+class TreeResultSink: public ResultSink
+{
+public:
+    /// Constructor; an existing file is overwritten
+    TreeResultSink(std::string const &fileName, std::vector<std::string> const &paramNames);
+
+    /// Closes the sink, ignoring any errors
+    ~TreeResultSink() noexcept;
+
+public:
+    /// Implemented from ResultSink
+    virtual void Close() override;
+
+    /// Implemented from ResultSink
+    virtual void Flush() override;
+
+private:
+    /// Implemented from ResultSink
+    virtual void WriteImpl(FitRecord const &record) override;
+
+private:
+    /// Output file
+    std::unique_ptr<TFile> file;
+
+    /// Output tree, which is owned by the file
+    TTree *tree;
+
+    /// Buffer with the current record, whose fields are connected to the branches of the tree
+    FitRecord buffer;
+
+    /// Buffer for the key with a type supported by TTree
+    ULong64_t keyBuffer;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+
+/**
+ * \class ScratchArena
+ * \brief Reusable storage for temporary buffers needed to evaluate a measurement
+ *
+ * Buffers are obtained with method Allocate and are all released at once with method Reset, which
+ * is normally called at the start of each evaluation. While the capacity of the arena is
+ * insufficient, it allocates additional blocks of memory. At the next reset they are merged into a
+ * single block large enough for all buffers requested since the previous reset. Thus, as long as
+ * evaluations request the same buffers, the arena only allocates heap memory in the first one or
+ * two of them.
+ *
+ * Buffers are not initialized, and only types that do not need destruction can be stored. An arena
+ * is meant to be owned by an object that evaluates the loss function and is not safe to use from
+ * several threads. A copy of an arena is empty, so that copies of the owning object do not share
+ * buffers.
+ */
+class ScratchArena
+{
+public:
+    /// Constructs an arena with the given initial capacity, in bytes
+    ScratchArena(std::size_t initialCapacity = 0);
+
+    /// Constructs an empty arena with the same capacity as the source
+    ScratchArena(ScratchArena const &src);
+
+    ScratchArena(ScratchArena &&) = default;
+
+    /// Releases all buffers; the capacity of the source is not copied
+    ScratchArena &operator=(ScratchArena const &);
+
+    ScratchArena &operator=(ScratchArena &&) = default;
+
+public:
+    /**
+     * \brief Returns an uninitialized buffer for n objects of type T
+     *
+     * The buffer remains valid until the next call to Reset.
+     */
+    template<typename T>
+    T *Allocate(std::size_t n);
+
+    /// Returns the total size of allocated blocks, in bytes
+    std::size_t GetCapacity() const;
+
+    /**
+     * \brief Releases all buffers
+     *
+     * If more than one block has been allocated, they are replaced by a single block.
+     */
+    void Reset();
+
+private:
+    /// Block of memory
+    struct Block
+    {
+        std::unique_ptr<unsigned char[]> data;
+        std::size_t size;
+    };
+
+private:
+    /// Returns a buffer of the given size and alignment, allocating a new block if needed
+    void *AllocateBytes(std::size_t size, std::size_t alignment);
+
+    /// Allocates a new block with at least the given size and makes it current
+    void AddBlock(std::size_t minSize);
+
+private:
+    /// Allocated blocks of memory. Buffers are taken from the last one.
+    std::vector<Block> blocks;
+
+    /// Number of bytes used in the last block
+    std::size_t used;
+};
+
+
+template<typename T>
+T *ScratchArena::Allocate(std::size_t n)
+{
+    static_assert(std::is_trivially_destructible<T>::value,
+      "ScratchArena only supports types that do not need destruction.");
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+      "ScratchArena does not support over-aligned types.");
+
+    return static_cast<T *>(AllocateBytes(n * sizeof(T), alignof(T)));
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <TSpline.h>
+
+#include <memory>
+#include <vector>
+
+
+/**
+ * \class SplineTable
+ * \brief A set of cubic splines represented on a common grid of knots
+ *
+ * Several splines that are always evaluated at the same point are converted into a single table of
+ * polynomial coefficients. The common grid is the union of the knots of all splines. Within each
+ * interval of the common grid, every spline is described by a cubic polynomial, which is obtained
+ * by re-expanding the polynomial of the corresponding segment of the original spline about the
+ * lower boundary of the interval. This transformation is exact, up to rounding errors. Thus, a
+ * single search for the interval serves all splines, and then they are evaluated together with a
+ * loop that is vectorized by the compiler.
+ *
+ * Outside of the range of the knots, the splines are extrapolated using the polynomials of the
+ * first or last segments, in the same way as done by TSpline3::Eval.
+ */
+class SplineTable
+{
+public:
+    /**
+     * \brief Constructs the table from the given splines
+     *
+     * Each spline must contain at least two knots. The order of the splines is preserved in the
+     * results of method Eval.
+     */
+    SplineTable(std::vector<std::shared_ptr<TSpline3>> const &splines);
+
+public:
+    /**
+     * \brief Evaluates all splines at the given point
+     *
+     * The values are written into the given buffer, which must have a size of at least
+     * GetNumSplines().
+     */
+    void Eval(double x, double *values) const;
+
+    /// Returns the number of splines in the table
+    unsigned GetNumSplines() const;
+
+private:
+    /// Number of splines
+    unsigned numSplines;
+
+    /// Common grid of knots, sorted in the increasing order
+    std::vector<double> knots;
+
+    /**
+     * \brief Polynomial coefficients
+     *
+     * For each interval of the common grid, there is a block of 4 * numSplines elements, which
+     * contains the constant terms for all splines, followed by the linear terms, and so on. The
+     * polynomials are written in the distance from the lower boundary of the interval.
+     */
+    std::vector<double> coeffs;
+};
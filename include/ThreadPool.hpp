@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * \class ThreadPool
+ * \brief Fixed set of worker threads to execute parallel loops
+ *
+ * The pool executes loops over a given number of tasks. The tasks are distributed among the
+ * workers dynamically. Each task is given the index of the worker that executes it, which allows
+ * it to use resources dedicated to that worker, such as a copy of the loss function. The thread
+ * that starts a loop participates in it as the worker with index 0. Because of this, a pool with a
+ * single worker does not start any threads and executes all tasks sequentially.
+ */
+class ThreadPool
+{
+public:
+    /// Signature for a task, which receives the index of the task and the index of the worker
+    using Task = std::function<void(unsigned task, unsigned worker)>;
+
+public:
+    /**
+     * \brief Constructor from the number of workers
+     *
+     * If the number is zero, it is set to the number of hardware threads.
+     */
+    ThreadPool(unsigned numWorkers = 0);
+
+    ThreadPool(ThreadPool const &) = delete;
+
+    /// Stops all worker threads
+    ~ThreadPool() noexcept;
+
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+public:
+    /// Returns the number of workers, including the calling thread
+    unsigned GetNumWorkers() const;
+
+    /**
+     * \brief Executes a loop of tasks and waits for its completion
+     *
+     * Calls task(i, worker) for i = 0, ..., numTasks - 1. If a task throws an exception, the
+     * tasks that have not been started yet are skipped, and the exception is rethrown in the
+     * calling thread after the running tasks have finished. This method must not be called
+     * concurrently from several threads or from within a task.
+     */
+    void Run(unsigned numTasks, Task const &task);
+
+private:
+    /// Executes tasks from the current loop until none are left
+    void ExecuteTasks(unsigned worker);
+
+    /// Main function for worker threads
+    void WorkerLoop(unsigned worker);
+
+private:
+    /// Worker threads, not including the calling thread
+    std::vector<std::thread> threads;
+
+    /// Mutex that protects the state of the current loop
+    std::mutex mutex;
+
+    /// Condition variables to notify about the start of a loop and about a finished worker
+    std::condition_variable startCondition, doneCondition;
+
+    /// Task for the current loop
+    Task const *currentTask;
+
+    /// Number of tasks in the current loop
+    unsigned numTasks;
+
+    /// Index of the next task to be executed
+    std::atomic<unsigned> nextTask;
+
+    /// Counter of loops, which is used to wake up worker threads
+    unsigned long generation;
+
+    /// Number of worker threads that have not finished the current loop
+    unsigned numBusy;
+
+    /// Flag to request worker threads to stop
+    bool stop;
+
+    /// First exception thrown by a task in the current loop
+    std::exception_ptr error;
+};
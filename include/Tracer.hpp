@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+
+/**
+ * \class Tracer
+ * \brief Records timed spans and saves them in the Chrome trace-event format
+ *
+ * Tracing is disabled by default, and then recording a span with a fixed name costs a single
+ * atomic load. After a call to Start, spans created with class TraceSpan are collected from all
+ * threads, and each thread is shown as a separate track. Evaluations of the loss function are too
+ * frequent to be traced individually, so only every n-th of them is recorded, as decided by
+ * SampleEval. The trace is written to a JSON file by Stop and can be viewed with Perfetto or
+ * chrome://tracing.
+ *
+ * All methods are static and thread-safe.
+ */
+class Tracer
+{
+public:
+    /// Clock used for timestamps
+    using Clock = std::chrono::steady_clock;
+
+public:
+    /**
+     * \brief Starts tracing
+     *
+     * The trace will be saved in the file with the given name. Only one in evalSamplingPeriod
+     * evaluations of the loss function is recorded. The calling thread is labelled as the main
+     * one. If tracing is already active, an exception is thrown.
+     */
+    static void Start(std::string const &fileName, unsigned evalSamplingPeriod = 100);
+
+    /**
+     * \brief Stops tracing and writes the trace to the file
+     *
+     * Does nothing if tracing is not active. Spans that are still open at this moment are not
+     * included.
+     */
+    static void Stop();
+
+    /// Checks whether tracing is active
+    static bool IsEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Decides whether the current evaluation of the loss function should be traced
+     *
+     * Returns true for one call in evalSamplingPeriod while tracing is active and false otherwise.
+     */
+    static bool SampleEval();
+
+    /**
+     * \brief Sets the name of the track for the calling thread
+     *
+     * Can be called regardless of whether tracing is active.
+     */
+    static void SetThreadName(std::string const &name);
+
+    /// Records a completed span in the calling thread
+    static void AddSpan(std::string const &name, std::string const &category,
+      Clock::time_point start, Clock::time_point end);
+
+private:
+    /// Flag indicating whether tracing is active
+    static std::atomic<bool> enabled;
+};
+
+
+/**
+ * \class TraceSpan
+ * \brief Records the time between its construction and destruction as a span in the trace
+ *
+ * Nothing is recorded if tracing is not active at the time of construction.
+ */
+class TraceSpan
+{
+public:
+    /**
+     * \brief Starts a span with the given name and category if the given flag is true
+     *
+     * The flag allows to trace a sampled subset of operations, for instance, with the flag set by
+     * Tracer::SampleEval. The name and the category are only copied if the span is active, so
+     * that with tracing disabled this constructor only costs an atomic load. It should be used
+     * for all spans with fixed names.
+     */
+    TraceSpan(char const *name, char const *category = "jecfit", bool active = true);
+
+    /**
+     * \brief Starts a span with a name constructed at run time
+     *
+     * The caller has to build the strings even if tracing is disabled. Prefer the overload for
+     * C strings when the name is fixed.
+     */
+    TraceSpan(std::string const &name, std::string const &category);
+
+    TraceSpan(TraceSpan const &) = delete;
+
+    /// Ends the span
+    ~TraceSpan() noexcept;
+
+    TraceSpan &operator=(TraceSpan const &) = delete;
+
+public:
+    /**
+     * \brief Ends the span
+     *
+     * Subsequent calls have no effect. This method is useful when the lifetime of the object is
+     * not controlled by a scope, such as in Python.
+     */
+    void End();
+
+private:
+    /// Indicates whether the span is being recorded
+    bool active;
+
+    /// Name and category of the span
+    std::string name, category;
+
+    /// Time when the span started
+    Tracer::Clock::time_point start;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class WorkDistributor
+ * \brief Distributes independent work units among MPI ranks
+ *
+ * Work units are identified by consecutive indices, such as indices of points in a scan or seeds
+ * of toy experiments. The process with rank 0 acts as a coordinator: it hands out units one at a
+ * time to other ranks as soon as they become idle and collects their results. This dynamic
+ * scheduling balances the load when the time needed for a unit varies strongly. If there is only
+ * one rank, it processes all units itself.
+ *
+ * The library is built with MPI support when macro JECFIT_MPI is defined. Otherwise this class
+ * behaves as if there were a single rank, so that programs using it also work without MPI.
+ */
+class WorkDistributor
+{
+public:
+    /// Signature for a function that processes a work unit and returns results for it
+    using Task = std::function<std::vector<double>(unsigned long unit)>;
+
+    /// Signature for a function that is notified at rank 0 about results for a unit
+    using ResultCallback = std::function<void(unsigned long unit,
+      std::vector<double> const &results)>;
+
+public:
+    /**
+     * \brief Constructor
+     *
+     * Initializes MPI unless this has already been done. The arguments are passed to MPI_Init.
+     */
+    WorkDistributor(int *argc, char ***argv);
+
+    WorkDistributor(WorkDistributor const &) = delete;
+
+    /// Finalizes MPI if it has been initialized by this object
+    ~WorkDistributor() noexcept;
+
+    WorkDistributor &operator=(WorkDistributor const &) = delete;
+
+public:
+    /// Returns the number of ranks
+    unsigned GetNumRanks() const;
+
+    /// Returns the rank of this process
+    unsigned GetRank() const;
+
+    /// Checks if this process is the coordinator
+    bool IsRoot() const;
+
+    /**
+     * \brief Processes given work units
+     *
+     * Must be called by all ranks. The task must return exactly numValues results for each unit.
+     * With several ranks, an exception thrown on any rank, by the task or by the callback, would
+     * leave the other ranks waiting for messages forever. Instead, the message is printed and the
+     * whole MPI job is aborted. With a single rank, exceptions are propagated to the caller.
+     *
+     * \param units  Indices of work units to process.
+     * \param numValues  Number of values returned by the task for each unit.
+     * \param task  Function to process a unit.
+     * \param callback  Optional function called at rank 0 as soon as results for a unit have been
+     *     received, for instance to write them to a file.
+     * \return At rank 0, map from indices of units to their results. Empty map at other ranks.
+     */
+    std::map<unsigned long, std::vector<double>> Run(std::vector<unsigned long> const &units,
+      unsigned numValues, Task const &task, ResultCallback const &callback = {});
+
+private:
+    /// Processes all units in this process
+    std::map<unsigned long, std::vector<double>> RunSerial(
+      std::vector<unsigned long> const &units, unsigned numValues, Task const &task,
+      ResultCallback const &callback);
+
+#ifdef JECFIT_MPI
+    /// Hands out units to other ranks and collects the results
+    std::map<unsigned long, std::vector<double>> RunCoordinator(
+      std::vector<unsigned long> const &units, unsigned numValues,
+      ResultCallback const &callback);
+
+    /// Requests units from the coordinator and processes them until told to stop
+    void RunWorker(unsigned numValues, Task const &task);
+
+    /// Prints the given message and aborts all ranks
+    [[noreturn]] void Abort(std::string const &message) const;
+#endif
+
+    /// Checks that the task has returned the expected number of values
+    static void CheckNumValues(unsigned long unit, std::vector<double> const &results,
+      unsigned numValues);
+
+private:
+    /// Rank of this process and the total number of ranks
+    unsigned rank, numRanks;
+
+    /// Indicates whether MPI has been initialized by this object
+    bool ownsMPI;
+};
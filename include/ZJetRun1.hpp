@@ -44,6 +44,13 @@ public:
     ZJetRun1(std::string const &fileName, Method method);
     
 public:
+    /**
+     * \brief Creates a copy of this measurement
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
@@ -58,6 +65,21 @@ public:
      */
     virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const override;
     
+    /**
+     * \brief Evaluates the deviation using precomputed values of the jet correction
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual double EvalWithCorrections(JetCorrBase const &corrector, Nuisances const &nuisances,
+      double const *corrections) const override;
+    
+    /**
+     * \brief Returns mean pt of Z boson in all bins
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::vector<double> GetCorrectionPoints() const override;
+    
 private:
     /// Input data in bins of pt of Z boson
     std::vector<PtBin> bins;
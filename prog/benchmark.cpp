@@ -0,0 +1,344 @@
+/**
+ * Measures how the evaluation of the loss function scales with the size of the problem and the
+ * number of threads, e.g.
+ *   benchmark --chi2-bins 8 16 32 --jet-bins 100 400 --nuisances 0 8 --threads 1 2 4 8
+ * Synthetic inputs for MultijetCrawlingBins are generated for each size with the writer shared
+ * with unit tests. The gradient of the loss function is computed repeatedly with
+ * ParallelGradFunction, which evaluates CombLossFunction in several threads. Two sweeps are
+ * performed. In the strong-scaling sweep, each problem size is run with all requested numbers of
+ * threads. In the weak-scaling sweep, the number of nuisances, and thus the number of evaluations
+ * per gradient, grows proportionally to the number of threads. Points of the finite-difference
+ * stencil can be evaluated in batches with --batch-size. Results are saved in a CSV file, which
+ * can be plotted with bin/plot_benchmark.py. Optionally, hardware counters for the main
+ * computational kernels are reported for each configuration.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <MultijetCrawlingBins.hpp>
+#include <Nuisances.hpp>
+#include <ParallelGradFunction.hpp>
+#include <PerfCounters.hpp>
+#include <TestHelpers.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * \struct ProblemSize
+ * \brief Dimensions of a synthetic multijet measurement
+ */
+struct ProblemSize
+{
+    /// Number of chi^2 bins
+    unsigned numChi2Bins;
+
+    /// Number of bins in pt of other jets
+    unsigned numJetBins;
+
+    /// Number of nuisance parameters, given by systematic variations in data
+    unsigned numNuisances;
+};
+
+
+/**
+ * \struct Measurement
+ * \brief Results of the benchmark for one configuration
+ */
+struct Measurement
+{
+    /// Number of parameters of the loss function
+    unsigned numParams;
+
+    /// Number of gradients and evaluations of the loss function per second
+    double gradientRate, evalRate;
+
+    /// Peak resident set size during the benchmark, in MiB
+    double peakRSS;
+};
+
+
+/// Resets the peak resident set size of the process, if supported by the system
+void ResetPeakRSS()
+{
+    std::ofstream clearRefs("/proc/self/clear_refs");
+
+    if (clearRefs)
+        clearRefs << "5";
+}
+
+
+/**
+ * \brief Returns the peak resident set size of the process, in MiB
+ *
+ * The value is read from /proc/self/status, which reflects resets with ResetPeakRSS. If it is
+ * not available, the peak over the lifetime of the process is returned.
+ */
+double GetPeakRSS()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+        {
+            std::istringstream value(line.substr(6));
+            double kib;
+            value >> kib;
+            return kib / 1024.;
+        }
+    }
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.;
+}
+
+
+/**
+ * \brief Measures the rate of computation of the gradient for the given problem and threads
+ *
+ * The gradient is computed repeatedly until the given time has passed, after one warm-up
+ * computation. Points of the stencil are evaluated in batches of the given size. Each gradient
+ * needs two evaluations of the loss function per parameter. Hardware counters, if enabled, are
+ * reset after the warm-up.
+ */
+Measurement Run(ProblemSize const &size, unsigned numThreads, unsigned batchSize,
+  double minTime, std::string const &fileName, std::mt19937 &generator)
+{
+    using namespace std::chrono;
+
+    ResetPeakRSS();
+
+    // Only the pt balance method is used, and all nuisances come from variations in data
+    CrawlingBinsSpec spec;
+    spec.numChi2Bins = size.numChi2Bins;
+    spec.numJetBins = size.numJetBins;
+    spec.methods = {"PtBal"};
+
+    for (unsigned i = 0; i < size.numNuisances; ++i)
+        spec.dataSysts.emplace_back("Syst" + std::to_string(i));
+
+    WriteCrawlingBinsInputs(fileName, spec, generator);
+
+    NuisanceDefinitions nuisanceDefs;
+    MultijetCrawlingBins measurement(fileName, MultijetCrawlingBins::Method::PtBal,
+      nuisanceDefs);
+    std::remove(fileName.c_str());
+
+    CombLossFunction lossFunc(std::make_unique<JetCorrStd2P>(), nuisanceDefs);
+    lossFunc.AddMeasurement(&measurement);
+    ParallelGradFunction gradFunc(lossFunc, numThreads);
+    gradFunc.SetBatchSize(batchSize);
+
+    unsigned const numParams = gradFunc.NDim();
+    std::vector<double> x(numParams, 0.), grad(numParams);
+    x[0] = 0.01;
+    x[1] = -0.005;
+
+    gradFunc.Gradient(x.data(), grad.data());
+    PerfCounters::Reset();
+
+    unsigned long numGradients = 0;
+    auto const start = steady_clock::now();
+    double elapsed;
+
+    do
+    {
+        // Alternate the point slightly so that no cache can skip the computation
+        x[0] = (numGradients % 2 == 0) ? 0.01 : 0.011;
+        gradFunc.Gradient(x.data(), grad.data());
+        ++numGradients;
+        elapsed = duration<double>(steady_clock::now() - start).count();
+    }
+    while (elapsed < minTime);
+
+    Measurement result;
+    result.numParams = numParams;
+    result.gradientRate = numGradients / elapsed;
+    result.evalRate = result.gradientRate * 2 * numParams;
+    result.peakRSS = GetPeakRSS();
+
+    return result;
+}
+
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    namespace po = boost::program_options;
+
+
+    // Parse arguments
+    unsigned const numHardwareThreads = max(thread::hardware_concurrency(), 1u);
+    vector<unsigned> defaultThreads;
+
+    for (unsigned n = 1; n < numHardwareThreads; n *= 2)
+        defaultThreads.emplace_back(n);
+
+    defaultThreads.emplace_back(numHardwareThreads);
+
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("chi2-bins", po::value<vector<unsigned>>()->multitoken()->default_value({8, 16, 32},
+        "8 16 32"), "Numbers of chi^2 bins")
+      ("jet-bins", po::value<vector<unsigned>>()->multitoken()->default_value({100, 400},
+        "100 400"), "Numbers of bins in pt of other jets")
+      ("nuisances", po::value<vector<unsigned>>()->multitoken()->default_value({0, 8}, "0 8"),
+        "Numbers of nuisance parameters")
+      ("threads,j", po::value<vector<unsigned>>()->multitoken()->default_value(defaultThreads,
+        "1 2 4 ... up to all hardware threads"), "Numbers of threads")
+      ("batch-size", po::value<unsigned>()->default_value(1),
+        "Number of points of the finite-difference stencil evaluated together, up to 8")
+      ("weak-nuisances", po::value<unsigned>()->default_value(4),
+        "Number of nuisances per thread in the weak-scaling sweep, which uses the first given "
+        "numbers of chi^2 and jet bins; 0 to skip the sweep")
+      ("min-time", po::value<double>()->default_value(1.),
+        "Minimal duration of the measurement for each configuration, in seconds")
+      ("seed", po::value<unsigned>()->default_value(1), "Seed to generate inputs")
+      ("perf-counters", "Report hardware counters for the main computational kernels")
+      ("output,o", po::value<string>()->default_value("benchmark.csv"),
+        "Name for output CSV file");
+
+    po::variables_map optionsMap;
+
+    po::store(
+      po::command_line_parser(argc, argv).options(options).run(),
+      optionsMap);
+
+    if (optionsMap.count("help"))
+    {
+        cerr << "Measures scaling of the evaluation of the loss function.\n";
+        cerr << "Usage: benchmark [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+
+    po::notify(optionsMap);
+
+    auto const &chi2BinsList = optionsMap["chi2-bins"].as<vector<unsigned>>();
+    auto const &jetBinsList = optionsMap["jet-bins"].as<vector<unsigned>>();
+    auto const &nuisancesList = optionsMap["nuisances"].as<vector<unsigned>>();
+    auto threadsList = optionsMap["threads"].as<vector<unsigned>>();
+    unsigned const weakNuisances = optionsMap["weak-nuisances"].as<unsigned>();
+    unsigned const batchSize = optionsMap["batch-size"].as<unsigned>();
+    double const minTime = optionsMap["min-time"].as<double>();
+
+    for (auto &numThreads: threadsList)
+    {
+        if (numThreads == 0)
+            numThreads = numHardwareThreads;
+    }
+
+    sort(threadsList.begin(), threadsList.end());
+    threadsList.erase(unique(threadsList.begin(), threadsList.end()), threadsList.end());
+
+    if (chi2BinsList.empty() or jetBinsList.empty() or nuisancesList.empty() or
+      threadsList.empty() or count(chi2BinsList.begin(), chi2BinsList.end(), 0u) > 0 or
+      count(jetBinsList.begin(), jetBinsList.end(), 0u) > 0)
+    {
+        cerr << "Numbers of bins and threads must be non-empty lists of positive values.\n";
+        return EXIT_FAILURE;
+    }
+
+    if (batchSize == 0 or batchSize > CombLossFunction::maxBatchSize)
+    {
+        cerr << "Batch size must be between 1 and " << CombLossFunction::maxBatchSize << ".\n";
+        return EXIT_FAILURE;
+    }
+
+
+    string const resFileName(optionsMap["output"].as<string>());
+    ofstream resFile(resFileName);
+    resFile << "mode,chi2_bins,jet_bins,nuisances,params,threads,batch_size,gradients_per_s,"
+      "evals_per_s,efficiency,peak_rss_mb\n";
+    resFile << setprecision(6);
+
+    if (optionsMap.count("perf-counters") and not PerfCounters::Enable())
+        cout << "Hardware counters are not available: " << PerfCounters::GetStatus() << '\n';
+
+    string const inputFileName("benchmark_inputs_" + to_string(getpid()) + ".root");
+    mt19937 generator(optionsMap["seed"].as<unsigned>());
+
+    // Runs a sweep over numbers of threads for the given problem sizes and writes the results.
+    //The parallel efficiency is computed with respect to the run with the smallest number of
+    //threads, as the ratio of throughputs per thread.
+    auto const sweep = [&](string const &mode, vector<ProblemSize> const &sizes)
+    {
+        double refRate = 0.;
+
+        for (unsigned i = 0; i < threadsList.size(); ++i)
+        {
+            unsigned const numThreads = threadsList[i];
+            ProblemSize const &size = sizes[i];
+            Measurement const result = Run(size, numThreads, batchSize, minTime, inputFileName,
+              generator);
+
+            if (i == 0)
+                refRate = result.evalRate / numThreads;
+
+            double const efficiency = result.evalRate / numThreads / refRate;
+
+            resFile << mode << ',' << size.numChi2Bins << ',' << size.numJetBins << ',' <<
+              size.numNuisances << ',' << result.numParams << ',' << numThreads << ',' <<
+              batchSize << ',' << result.gradientRate << ',' << result.evalRate << ',' <<
+              efficiency << ',' << result.peakRSS << '\n';
+            resFile.flush();
+
+            cout << mode << ": " << size.numChi2Bins << " chi^2 bins, " << size.numJetBins <<
+              " jet bins, " << size.numNuisances << " nuisances, " << numThreads <<
+              " threads: " << result.evalRate << " evaluations/s, efficiency " << efficiency <<
+              ", peak RSS " << result.peakRSS << " MiB" << endl;
+
+            if (PerfCounters::IsEnabled())
+                PerfCounters::Report(cout);
+        }
+    };
+
+
+    // Strong scaling: fixed problem sizes
+    for (unsigned const numChi2Bins: chi2BinsList)
+        for (unsigned const numJetBins: jetBinsList)
+            for (unsigned const numNuisances: nuisancesList)
+                sweep("strong", vector<ProblemSize>(threadsList.size(),
+                  ProblemSize{numChi2Bins, numJetBins, numNuisances}));
+
+
+    // Weak scaling: the number of nuisances grows with the number of threads
+    if (weakNuisances > 0)
+    {
+        vector<ProblemSize> sizes;
+
+        for (unsigned const numThreads: threadsList)
+            sizes.emplace_back(ProblemSize{chi2BinsList.front(), jetBinsList.front(),
+              weakNuisances * numThreads});
+
+        sweep("weak", sizes);
+    }
+
+
+    resFile.close();
+    cout << "\nResults saved to file \"" << resFileName << "\".\n";
+
+
+    return EXIT_SUCCESS;
+}
@@ -1,13 +1,20 @@
 /**
- * Fits residual jet correction. The standard 2p parameterization is used. Results are saved in a
- * text file.
+ * Fits residual jet correction. The standard 2p parameterization is used unless a formula for the
+ * correction is given. Results are saved in a text file.
  */
 
 #include <JetCorrConstraint.hpp>
 #include <JetCorrDefinitions.hpp>
+#include <JetCorrExpression.hpp>
 #include <FitBase.hpp>
+#include <MinuitTelemetry.hpp>
 #include <MultijetCrawlingBins.hpp>
 #include <Nuisances.hpp>
+#include <ParallelGradFunction.hpp>
+#include <ParallelMinos.hpp>
+#include <PerfCounters.hpp>
+#include <ResultSink.hpp>
+#include <Tracer.hpp>
 
 #include <Minuit2/Minuit2Minimizer.h>
 #include <Math/Functor.h>
@@ -16,12 +23,14 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
 
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <iostream>
 #include <list>
 #include <memory>
 #include <string>
+#include <vector>
 
 
 int main(int argc, char **argv)
@@ -35,12 +44,44 @@ int main(int argc, char **argv)
     options.add_options()
       ("help,h", "Prints help message")
       ("balance,b", po::value<string>()->default_value("PtBal"),
-        "Type of balance variable, PtBal or MPF")
+        "Type of balance variable, PtBal, MPF, or Joint to fit both at once")
       ("multijet", po::value<string>(), "Input file for multijet analysis")
+      ("storage", po::value<string>()->default_value("double"),
+        "Storage for inputs of multijet analysis: double, float, or scaled-float")
       ("constraint,c", po::value<string>(),
         "Constraint for jet correction at reference pt scale, in the form \"correction,rel_unc\"")
+      ("corr-expr", po::value<string>(),
+        "Formula for jet correction in terms of x = log(pt), pt, and named parameters; the "
+        "standard 2p form is used by default. The parameters start from 0 and are limited to "
+        "[-1, 1], so the formula should give a correction close to 1 when they are 0")
+      ("threads,j", po::value<unsigned>()->default_value(1),
+        "Number of threads to compute the gradient of the loss function; 0 to use all hardware "
+        "threads")
+      ("batch-size", po::value<unsigned>()->default_value(1),
+        "Number of points evaluated together when computing the gradient of the loss function, "
+        "up to 8")
+      ("hesse", "Compute the full Hesse matrix after the minimization")
+      ("minos", "Compute asymmetric MINOS errors for all free parameters after the minimization, "
+        "using the number of threads given by --threads")
+      ("print-level,v", po::value<int>()->default_value(3),
+        "Verbosity level of the minimizer; 0 to disable printing")
+      ("telemetry", po::value<string>(),
+        "File or named pipe to which progress of the minimization is appended as JSON lines")
+      ("telemetry-interval", po::value<double>()->default_value(1.),
+        "Minimal interval between records about iterations of the minimization, in seconds")
+      ("telemetry-label", po::value<string>()->default_value(""),
+        "Label to identify this fit in the telemetry records")
+      ("perf-counters",
+        "Report hardware counters for the main computational kernels at the end of the fit")
+      ("trace", po::value<string>(),
+        "Name for JSON file with a trace of the fit in the Chrome trace-event format")
+      ("trace-sampling", po::value<unsigned>()->default_value(100),
+        "Only one in this many evaluations of the loss function is traced")
       ("output,o", po::value<string>()->default_value("fit.out"),
-        "Name for output file with results of the fit");
+        "Name for output file with results of the fit")
+      ("columnar", po::value<string>(),
+        "Also write results of the fit with a ResultSink to this path: a ROOT file if the "
+        "extension is \".root\" and a directory with NumPy arrays otherwise");
     
     po::variables_map optionsMap;
     
@@ -58,12 +99,14 @@ int main(int argc, char **argv)
     }
     
     
-    bool useMPF = false;
+    bool useMPF = false, useJoint = false;
     string balanceVar(optionsMap["balance"].as<string>());
     boost::to_lower(balanceVar);
     
     if (balanceVar == "mpf")
         useMPF = true;
+    else if (balanceVar == "joint")
+        useJoint = true;
     else if (balanceVar != "ptbal")
     {
         cerr << "Do not recognize balance variable \"" <<
@@ -72,6 +115,30 @@ int main(int argc, char **argv)
     }
     
     
+    if (optionsMap.count("trace"))
+        Tracer::Start(optionsMap["trace"].as<string>(),
+          optionsMap["trace-sampling"].as<unsigned>());
+    
+    if (optionsMap.count("perf-counters") and not PerfCounters::Enable())
+        cout << "Hardware counters are not available: " << PerfCounters::GetStatus() << '\n';
+    
+    
+    FlatHist2D::Storage storage;
+    string const storageLabel(optionsMap["storage"].as<string>());
+    
+    if (storageLabel == "double")
+        storage = FlatHist2D::Storage::Double;
+    else if (storageLabel == "float")
+        storage = FlatHist2D::Storage::Float;
+    else if (storageLabel == "scaled-float")
+        storage = FlatHist2D::Storage::ScaledFloat;
+    else
+    {
+        cerr << "Do not recognize storage mode \"" << storageLabel << "\".\n";
+        return EXIT_FAILURE;
+    }
+    
+    
     NuisanceDefinitions nuisanceDefs;
 
 
@@ -80,12 +147,34 @@ int main(int argc, char **argv)
     
     if (optionsMap.count("multijet"))
     {
-        auto *measurement = new MultijetCrawlingBins(
-          optionsMap["multijet"].as<string>(),
-          (useMPF) ? MultijetCrawlingBins::Method::MPF : MultijetCrawlingBins::Method::PtBal,
-          nuisanceDefs);
-        measurement->SetPtLeadRange(0., 1600.);
-        measurements.emplace_back(measurement);
+        TraceSpan span("Load multijet", "fit");
+        StoragePrecision precision;
+        
+        if (useJoint)
+        {
+            auto *measurement = new MultijetCrawlingBinsJoint(optionsMap["multijet"].as<string>(),
+              nuisanceDefs, {}, storage);
+            measurement->SetPtLeadRange(0., 1600.);
+            precision = measurement->GetStoragePrecision();
+            measurements.emplace_back(measurement);
+        }
+        else
+        {
+            auto *measurement = new MultijetCrawlingBins(
+              optionsMap["multijet"].as<string>(),
+              (useMPF) ? MultijetCrawlingBins::Method::MPF : MultijetCrawlingBins::Method::PtBal,
+              nuisanceDefs, {}, storage);
+            measurement->SetPtLeadRange(0., 1600.);
+            precision = measurement->GetStoragePrecision();
+            measurements.emplace_back(measurement);
+        }
+        
+        if (storage != FlatHist2D::Storage::Double)
+        {
+            cout << "Compact storage of multijet inputs: maximal relative error in mean balance " <<
+              precision.maxRelErrorBalance << ", relative error in chi^2 " <<
+              precision.relErrorChi2 << ".\n";
+        }
     }
     
     if (optionsMap.count("constraint"))
@@ -139,7 +228,18 @@ int main(int argc, char **argv)
 
     
     // Construct an object to evaluate the loss function
-    auto jetCorr = make_unique<JetCorrStd2P>();
+    unique_ptr<JetCorrBase> jetCorr;
+    vector<string> poiNames;
+    
+    if (optionsMap.count("corr-expr"))
+    {
+        auto exprCorr = make_unique<JetCorrExpression>(optionsMap["corr-expr"].as<string>());
+        poiNames = exprCorr->GetParamNames();
+        jetCorr = move(exprCorr);
+    }
+    else
+        jetCorr = make_unique<JetCorrStd2P>();
+    
     CombLossFunction lossFunc(move(jetCorr), nuisanceDefs);
     
     for (auto const &measurement: measurements)
@@ -147,14 +247,46 @@ int main(int argc, char **argv)
     
     unsigned const nPars = lossFunc.GetNumParams();
     
+    auto const &correctionTable = lossFunc.GetCorrectionTable();
+    cout << "Jet correction is evaluated at " << correctionTable.GetNumDistinctPoints() <<
+      " distinct points shared by measurements that request " <<
+      correctionTable.GetNumPoints() << " points.\n";
+    
     
     // Create minimizer
     ROOT::Minuit2::Minuit2Minimizer minimizer;
     ROOT::Math::Functor func(&lossFunc, &CombLossFunction::EvalRawInput, nPars);
-    minimizer.SetFunction(func);
+    unique_ptr<ParallelGradFunction> gradFunc;
+    unsigned const numThreads = optionsMap["threads"].as<unsigned>();
+    unsigned const batchSize = optionsMap["batch-size"].as<unsigned>();
+    
+    if (numThreads == 1 and batchSize == 1)
+        minimizer.SetFunction(func);
+    else
+    {
+        // Compute the gradient in parallel and/or in batches instead of letting Minuit2 do it
+        //sequentially
+        gradFunc.reset(new ParallelGradFunction(lossFunc, numThreads));
+        gradFunc->SetBatchSize(batchSize);
+        minimizer.SetFunction(*gradFunc);
+        cout << "Gradient of the loss function is computed with " <<
+          gradFunc->GetNumThreads() << " threads, evaluating " << batchSize <<
+          " point(s) at a time.\n";
+    }
+    
     minimizer.SetStrategy(1);   // Standard quality
     minimizer.SetErrorDef(1.);  // Error level for a chi2 function
-    minimizer.SetPrintLevel(3);
+    minimizer.SetPrintLevel(optionsMap["print-level"].as<int>());
+    
+    unique_ptr<MinuitTelemetry> telemetry;
+    
+    if (optionsMap.count("telemetry"))
+    {
+        telemetry.reset(new MinuitTelemetry(optionsMap["telemetry"].as<string>(),
+          optionsMap["telemetry-interval"].as<double>(),
+          optionsMap["telemetry-label"].as<string>()));
+        minimizer.SetTraceObject(*telemetry);
+    }
     
     
     // Initial point
@@ -162,7 +294,8 @@ int main(int argc, char **argv)
     
     for (unsigned i = 0; i < nPOI; ++i)
     {
-        minimizer.SetVariable(i, "p" + to_string(i), 0., 1e-2);
+        string const name((i < poiNames.size()) ? poiNames[i] : "p" + to_string(i));
+        minimizer.SetVariable(i, name, 0., 1e-2);
         minimizer.SetVariableLimits(i, -1., 1.);
     }
     
@@ -174,7 +307,33 @@ int main(int argc, char **argv)
     
     
     // Run minimization
-    minimizer.Minimize();
+    auto const startTime = chrono::steady_clock::now();
+    
+    {
+        TraceSpan span("Minimize", "fit");
+        minimizer.Minimize();
+    }
+    
+    if (optionsMap.count("hesse"))
+    {
+        TraceSpan span("Hesse", "fit");
+        minimizer.Hesse();
+    }
+    
+    vector<ParallelMinos::Interval> minosErrors;
+    
+    if (optionsMap.count("minos"))
+    {
+        ParallelMinos minos(lossFunc, numThreads);
+        cout << "MINOS errors are computed with " << minos.GetNumThreads() << " threads.\n";
+        minosErrors = minos.Run(minimizer);
+    }
+    
+    double const fitTime =
+      chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    
+    if (telemetry)
+        telemetry->Finish(minimizer);
     
     
     // Print results
@@ -192,11 +351,22 @@ int main(int argc, char **argv)
     cout << "  Parameters:\n";
     
     for (unsigned i = 0; i < nPars; ++i)
-        cout << "    " << minimizer.VariableName(i) << ":  " << results[i] << " +- " <<
-          errors[i] << "\n";
+    {
+        cout << "    " << minimizer.VariableName(i) << ":  " << results[i] << " +- " << errors[i];
+        
+        if (not minosErrors.empty() and not minimizer.IsFixedVariable(i))
+        {
+            auto const &interval = minosErrors[i];
+            cout << ",  MINOS: " << interval.lower << (interval.lowerValid ? "" : " (invalid)") <<
+              " +" << interval.upper << (interval.upperValid ? "" : " (invalid)");
+        }
+        
+        cout << '\n';
+    }
     
     
     // Save fit results in a text file
+    TraceSpan outputSpan("Write output", "fit");
     string const resFileName(optionsMap["output"].as<string>());
     ofstream resFile(resFileName);
     
@@ -218,10 +388,58 @@ int main(int argc, char **argv)
     resFile << "\n# Minimal chi^2, NDF, p-value:\n";
     resFile << minimizer.MinValue() << " " << lossFunc.GetNDF() << " " << pValue << '\n';
     
+    if (not minosErrors.empty())
+    {
+        resFile << "\n# MINOS errors (lower, upper, validity of lower, validity of upper):\n";
+        
+        for (auto const &interval: minosErrors)
+            resFile << interval.lower << " " << interval.upper << " " << interval.lowerValid <<
+              " " << interval.upperValid << '\n';
+    }
+    
     resFile.close();
+    cout << "\nResults saved to file \"" << resFileName << "\".\n";
+    
+    if (optionsMap.count("columnar"))
+    {
+        vector<string> paramNames;
+        FitRecord record(nPars);
+        
+        for (unsigned i = 0; i < nPars; ++i)
+        {
+            paramNames.emplace_back(minimizer.VariableName(i));
+            record.params[i] = results[i];
+            record.errors[i] = errors[i];
+            
+            for (unsigned j = 0; j < nPars; ++j)
+                record.covariance[i * nPars + j] = minimizer.CovMatrix(i, j);
+        }
+        
+        record.chi2 = minimizer.MinValue();
+        record.ndf = lossFunc.GetNDF();
+        record.status = minimizer.Status();
+        record.time = fitTime;
+        
+        string const columnarPath(optionsMap["columnar"].as<string>());
+        auto sink = ResultSink::Create(columnarPath, paramNames);
+        sink->Write(record);
+        sink->Close();
+        cout << "Results also saved to \"" << columnarPath << "\".\n";
+    }
     
+    outputSpan.End();
     
-    cout << "\nResults saved to file \"" << resFileName << "\".\n";
+    if (PerfCounters::IsEnabled())
+    {
+        cout << '\n';
+        PerfCounters::Report(cout);
+    }
+    
+    if (Tracer::IsEnabled())
+    {
+        Tracer::Stop();
+        cout << "Trace saved to file \"" << optionsMap["trace"].as<string>() << "\".\n";
+    }
     
     
     return EXIT_SUCCESS;
@@ -0,0 +1,212 @@
+/**
+ * Fits residual jet corrections in several data-taking periods simultaneously, e.g.
+ *   fitPeriods --period BCD=multijet_BCD.root --period EF1=multijet_EF1.root \
+ *     --period F2GH=multijet_F2GH.root --shared "JER.*" --shared MultijetMEFactor
+ * A separate standard 2p correction is fitted for each period. Nuisances that match one of the
+ * given patterns are shared among periods, while all other nuisances are specific to each period.
+ * The covariance matrix is computed exploiting the block structure of the problem. Results are
+ * saved in a text file.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <MultijetCrawlingBins.hpp>
+#include <MultiPeriodLossFunction.hpp>
+#include <Nuisances.hpp>
+
+#include <Minuit2/Minuit2Minimizer.h>
+#include <TMath.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    namespace po = boost::program_options;
+
+
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("period,p", po::value<vector<string>>()->required(),
+        "Data-taking period with its input file for multijet analysis, in the form "
+        "\"name=file\"; can be repeated")
+      ("shared,s", po::value<vector<string>>()->default_value({}, ""),
+        "Regular expression for names of nuisances shared among periods; can be repeated")
+      ("balance,b", po::value<string>()->default_value("PtBal"),
+        "Type of balance variable, PtBal, MPF, or Joint to fit both at once")
+      ("threads,j", po::value<unsigned>()->default_value(1),
+        "Number of threads to evaluate the loss function; 0 to use all hardware threads")
+      ("output,o", po::value<string>()->default_value("fit.out"),
+        "Name for output file with results of the fit");
+
+    po::variables_map optionsMap;
+
+    po::store(
+      po::command_line_parser(argc, argv).options(options).run(),
+      optionsMap);
+
+    if (optionsMap.count("help"))
+    {
+        cerr << "Fits for jet corrections in several data-taking periods simultaneously.\n";
+        cerr << "Usage: fitPeriods [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+
+    po::notify(optionsMap);
+
+
+    string balanceVar(optionsMap["balance"].as<string>());
+    boost::to_lower(balanceVar);
+
+    if (balanceVar != "ptbal" and balanceVar != "mpf" and balanceVar != "joint")
+    {
+        cerr << "Do not recognize balance variable \"" <<
+          optionsMap["balance"].as<string>() << "\".\n";
+        return EXIT_FAILURE;
+    }
+
+
+    // Construct measurements for all periods and combine them
+    MultiPeriodLossFunction lossFunc(optionsMap["shared"].as<vector<string>>(),
+      optionsMap["threads"].as<unsigned>());
+    vector<unique_ptr<MeasurementBase>> measurements;
+
+    for (auto const &periodText: optionsMap["period"].as<vector<string>>())
+    {
+        auto const eqPos = periodText.find('=');
+
+        if (eqPos == string::npos or eqPos == 0 or eqPos + 1 == periodText.size())
+        {
+            cerr << "Failed to parse period \"" << periodText << "\".\n";
+            return EXIT_FAILURE;
+        }
+
+        string const periodName(periodText.substr(0, eqPos));
+        string const fileName(periodText.substr(eqPos + 1));
+        NuisanceDefinitions nuisanceDefs;
+
+        if (balanceVar == "joint")
+        {
+            auto *measurement = new MultijetCrawlingBinsJoint(fileName, nuisanceDefs);
+            measurement->SetPtLeadRange(0., 1600.);
+            measurements.emplace_back(measurement);
+        }
+        else
+        {
+            auto *measurement = new MultijetCrawlingBins(fileName,
+              (balanceVar == "mpf") ?
+              MultijetCrawlingBins::Method::MPF : MultijetCrawlingBins::Method::PtBal,
+              nuisanceDefs);
+            measurement->SetPtLeadRange(0., 1600.);
+            measurements.emplace_back(measurement);
+        }
+
+        lossFunc.AddPeriod(periodName, make_unique<JetCorrStd2P>(), nuisanceDefs,
+          {measurements.back().get()});
+    }
+
+    unsigned const nPars = lossFunc.NDim();
+    cout << "Fitting " << lossFunc.GetNumPeriods() << " periods with " << nPars <<
+      " parameters in total, using " << lossFunc.GetNumThreads() << " threads.\n";
+
+
+    // Create minimizer. The covariance matrix is computed separately, exploiting the block
+    //structure of the Hessian, so the quick strategy is sufficient.
+    ROOT::Minuit2::Minuit2Minimizer minimizer;
+    minimizer.SetFunction(lossFunc);
+    minimizer.SetStrategy(0);
+    minimizer.SetErrorDef(1.);  // Error level for a chi2 function
+    minimizer.SetPrintLevel(3);
+
+    // Parameters of jet corrections start at the offset of each period
+    vector<bool> isPOI(nPars, false);
+    unsigned const nCorrParams = JetCorrStd2P().GetNumParams();
+
+    for (unsigned period = 0; period < lossFunc.GetNumPeriods(); ++period)
+        for (unsigned i = 0; i < nCorrParams; ++i)
+            isPOI[lossFunc.GetPeriodOffset(period) + i] = true;
+
+    for (unsigned i = 0; i < nPars; ++i)
+    {
+        if (isPOI[i])
+        {
+            minimizer.SetVariable(i, lossFunc.GetParamName(i), 0., 1e-2);
+            minimizer.SetVariableLimits(i, -1., 1.);
+        }
+        else
+        {
+            minimizer.SetVariable(i, lossFunc.GetParamName(i), 0., 1.);
+            minimizer.SetVariableLimits(i, -5., 5.);
+        }
+    }
+
+
+    // Run minimization
+    minimizer.Minimize();
+
+    double const *results = minimizer.X();
+    auto const covariance = lossFunc.ComputeCovariance(results);
+
+
+    // Print results
+    cout << "\n\n\033[1mSummary\033[0m:\n";
+    cout << "  Status: " << minimizer.Status() << '\n';
+    cout << "  Minimal value: " << minimizer.MinValue() << '\n';
+    cout << "  NDF: " << lossFunc.GetNDF() << '\n';
+
+    double const pValue = TMath::Prob(minimizer.MinValue(), lossFunc.GetNDF());
+    cout << "  p-value: " << pValue << '\n';
+    cout << "  Parameters:\n";
+
+    for (unsigned i = 0; i < nPars; ++i)
+        cout << "    " << lossFunc.GetParamName(i) << ":  " << results[i] << " +- " <<
+          sqrt(covariance[i * nPars + i]) << "\n";
+
+
+    // Save fit results in a text file
+    string const resFileName(optionsMap["output"].as<string>());
+    ofstream resFile(resFileName);
+
+    resFile << "# Parameter names\n";
+
+    for (unsigned i = 0; i < nPars; ++i)
+        resFile << lossFunc.GetParamName(i) << " ";
+
+    resFile << "\n\n# Fitted parameters\n";
+
+    for (unsigned i = 0; i < nPars; ++i)
+        resFile << results[i] << " ";
+
+    resFile << "\n\n# Covariance matrix:\n";
+
+    for (unsigned i = 0; i < nPars; ++i)
+    {
+        for (unsigned j = 0; j < nPars; ++j)
+            resFile << covariance[i * nPars + j] << " ";
+
+        resFile << '\n';
+    }
+
+    resFile << "\n# Minimal chi^2, NDF, p-value:\n";
+    resFile << minimizer.MinValue() << " " << lossFunc.GetNDF() << " " << pValue << '\n';
+
+    resFile.close();
+
+
+    cout << "\nResults saved to file \"" << resFileName << "\".\n";
+
+
+    return EXIT_SUCCESS;
+}
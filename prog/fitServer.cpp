@@ -0,0 +1,87 @@
+/**
+ * Runs a server that keeps loss functions loaded in memory and serves requests from clients over
+ * a UNIX-domain socket. See class FitServer for details and python/fitclient.py for the client.
+ * The server stops on SIGINT or SIGTERM. If it fails, e.g. because of an error on the socket, the
+ * program exits with a non-zero status.
+ */
+
+#include <FitServer.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <pthread.h>
+#include <signal.h>
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    namespace po = boost::program_options;
+
+
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("socket,s", po::value<string>()->default_value("jecfit.sock"),
+        "Path to the socket to listen on");
+
+    po::variables_map optionsMap;
+    po::store(po::command_line_parser(argc, argv).options(options).run(), optionsMap);
+    po::notify(optionsMap);
+
+    if (optionsMap.count("help"))
+    {
+        cerr << "Serves evaluations and fits of the loss function over a UNIX-domain socket.\n";
+        cerr << "Usage: fitServer [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+
+
+    // Block termination signals in all threads. They are received by a dedicated thread, which
+    //stops the server.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    string const socketPath(optionsMap["socket"].as<string>());
+    FitServer server(socketPath);
+
+    thread signalThread([&server, &signals]()
+    {
+        int signal;
+        sigwait(&signals, &signal);
+        server.Stop();
+    });
+
+    cout << "Listening on socket \"" << socketPath << "\"." << endl;
+    bool failure = false;
+
+    try
+    {
+        server.Run();
+    }
+    catch (exception const &error)
+    {
+        cerr << error.what() << endl;
+        failure = true;
+    }
+
+    // If the server has stopped for a reason other than a signal, wake up the signal thread
+    pthread_kill(signalThread.native_handle(), SIGTERM);
+    signalThread.join();
+
+    cout << "Server stopped." << endl;
+
+
+    return (failure) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
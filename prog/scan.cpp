@@ -0,0 +1,349 @@
+/**
+ * Computes chi^2 on a grid of values of the parameters of the standard 2p correction, profiling
+ * nuisance parameters at each point. When built with MPI support, points of the grid are
+ * distributed dynamically among ranks, e.g.
+ *   mpirun -np 16 scan --multijet multijet.root --p0 -0.01,0.01,51 --p1 -0.02,0.02,51
+ * Each rank reads the inputs once. Results are gathered by rank 0 and appended to a text file as
+ * soon as they arrive.
+ * Optionally, full results of the profiling fit at each point, including values of nuisances and
+ * the covariance matrix, are also written with a ResultSink.
+ * With option --resume, results are also checkpointed in a RecordFile. If the scan is restarted
+ * with the same file, points found in it are not recomputed but copied to the outputs.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <MultijetCrawlingBins.hpp>
+#include <Nuisances.hpp>
+#include <RecordFile.hpp>
+#include <ResultSink.hpp>
+#include <WorkDistributor.hpp>
+
+#include <Minuit2/Minuit2Minimizer.h>
+#include <Math/Functor.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/// Parses a range in the form "min,max,numPoints" and returns the points
+std::vector<double> ParseRange(std::string const &text)
+{
+    std::vector<std::string> tokens;
+    boost::split(tokens, text, boost::is_any_of(","));
+
+    if (tokens.size() != 3)
+    {
+        std::ostringstream message;
+        message << "ParseRange: Failed to parse range \"" << text << "\".";
+        throw std::runtime_error(message.str());
+    }
+
+    double const min = std::stod(tokens[0]), max = std::stod(tokens[1]);
+    int const numPoints = std::stoi(tokens[2]);
+
+    if (numPoints < 1 or (numPoints == 1 and min != max))
+    {
+        std::ostringstream message;
+        message << "ParseRange: Wrong number of points in range \"" << text << "\".";
+        throw std::runtime_error(message.str());
+    }
+
+    std::vector<double> points;
+
+    for (int i = 0; i < numPoints; ++i)
+        points.emplace_back((numPoints == 1) ? min : min + (max - min) * i / (numPoints - 1));
+
+    return points;
+}
+
+
+/// Encodes the given text as a JSON string
+std::string JsonString(std::string const &text)
+{
+    std::string encoded("\"");
+
+    for (char const c: text)
+    {
+        if (c == '"' or c == '\\')
+            encoded += '\\';
+
+        encoded += c;
+    }
+
+    return encoded + '"';
+}
+
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    namespace po = boost::program_options;
+
+    WorkDistributor distributor(&argc, &argv);
+
+
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("multijet", po::value<string>()->required(), "Input file for multijet analysis")
+      ("balance,b", po::value<string>()->default_value("PtBal"),
+        "Type of balance variable, PtBal or MPF")
+      ("p0", po::value<string>()->required(),
+        "Range for the first parameter, in the form \"min,max,num_points\"")
+      ("p1", po::value<string>()->required(),
+        "Range for the second parameter, in the form \"min,max,num_points\"")
+      ("output,o", po::value<string>()->default_value("scan.out"),
+        "Name for output file with results of the scan")
+      ("columnar", po::value<string>(),
+        "Also save full results of the profiling fits in columnar format: in a ROOT file if the "
+        "path ends with \".root\", or in a directory of .npy files otherwise")
+      ("resume", po::value<string>(),
+        "Record file in which computed points are checkpointed. If it exists, points found in it "
+        "are not recomputed");
+
+    po::variables_map optionsMap;
+    po::store(po::command_line_parser(argc, argv).options(options).run(), optionsMap);
+
+    if (optionsMap.count("help"))
+    {
+        if (distributor.IsRoot())
+        {
+            cerr << "Computes profiled chi^2 on a grid of parameters of jet correction.\n";
+            cerr << "Usage: scan [options]\n";
+            cerr << options << endl;
+        }
+
+        return EXIT_FAILURE;
+    }
+
+    po::notify(optionsMap);
+
+
+    string balanceVar(optionsMap["balance"].as<string>());
+    boost::to_lower(balanceVar);
+    MultijetCrawlingBins::Method method;
+
+    if (balanceVar == "mpf")
+        method = MultijetCrawlingBins::Method::MPF;
+    else if (balanceVar == "ptbal")
+        method = MultijetCrawlingBins::Method::PtBal;
+    else
+    {
+        cerr << "Do not recognize balance variable \"" <<
+          optionsMap["balance"].as<string>() << "\".\n";
+        return EXIT_FAILURE;
+    }
+
+    auto const p0Values = ParseRange(optionsMap["p0"].as<string>());
+    auto const p1Values = ParseRange(optionsMap["p1"].as<string>());
+
+
+    // Construct the loss function. This is done once in each rank.
+    NuisanceDefinitions nuisanceDefs;
+    MultijetCrawlingBins measurement(optionsMap["multijet"].as<string>(), method,
+      nuisanceDefs);
+    measurement.SetPtLeadRange(0., 1600.);
+
+    CombLossFunction lossFunc(make_unique<JetCorrStd2P>(), nuisanceDefs);
+    lossFunc.AddMeasurement(&measurement);
+
+    unsigned const nPars = lossFunc.GetNumParams();
+    unsigned const nPOI = nPars - nuisanceDefs.GetNumParams();
+
+
+    // Minimize with respect to nuisances for the given values of the POI. The result for each
+    //point consists of the minimal chi^2 and the status of the minimization. If columnar output
+    //is requested, it is followed by the time spent, values of all parameters, their errors, and
+    //the covariance matrix.
+    bool const fullResults = optionsMap.count("columnar");
+    unsigned const numValues = (fullResults) ? 3 + 2 * nPars + nPars * nPars : 2;
+
+    auto profile = [&](unsigned long point)
+    {
+        auto const startTime = chrono::steady_clock::now();
+        double const poi[] = {p0Values[point / p1Values.size()],
+          p1Values[point % p1Values.size()]};
+        vector<double> result(numValues, 0.);
+
+        auto elapsedTime = [&startTime]()
+        {
+            return chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+        };
+
+        if (nPOI == nPars)
+        {
+            result[0] = lossFunc.EvalRawInput(poi);
+
+            if (fullResults)
+            {
+                result[2] = elapsedTime();
+                copy(poi, poi + nPars, result.begin() + 3);
+            }
+
+            return result;
+        }
+
+        ROOT::Minuit2::Minuit2Minimizer minimizer;
+        ROOT::Math::Functor func(&lossFunc, &CombLossFunction::EvalRawInput, nPars);
+        minimizer.SetFunction(func);
+        minimizer.SetStrategy(1);
+        minimizer.SetErrorDef(1.);
+        minimizer.SetPrintLevel(0);
+
+        for (unsigned i = 0; i < nPOI; ++i)
+            minimizer.SetFixedVariable(i, "p" + to_string(i), poi[i]);
+
+        for (unsigned i = nPOI; i < nPars; ++i)
+        {
+            minimizer.SetVariable(i, nuisanceDefs.GetName(i - nPOI), 0., 1.);
+            minimizer.SetVariableLimits(i, -5., 5.);
+        }
+
+        minimizer.Minimize();
+        result[0] = minimizer.MinValue();
+        result[1] = minimizer.Status();
+
+        if (fullResults)
+        {
+            result[2] = elapsedTime();
+            copy(minimizer.X(), minimizer.X() + nPars, result.begin() + 3);
+            copy(minimizer.Errors(), minimizer.Errors() + nPars, result.begin() + 3 + nPars);
+
+            for (unsigned i = 0; i < nPars; ++i)
+                for (unsigned j = 0; j < nPars; ++j)
+                    result[3 + 2 * nPars + i * nPars + j] = minimizer.CovMatrix(i, j);
+        }
+
+        return result;
+    };
+
+    // Points already computed in a previous run of the same scan are read back from the record
+    //file. Its signature covers the grid and the definition of the loss function, and the number
+    //of values per record depends on whether full results are requested.
+    unique_ptr<RecordFile> records;
+    map<uint64_t, vector<double>> completed;
+
+    if (distributor.IsRoot() and optionsMap.count("resume"))
+    {
+        string const definition = "{\"balance\": " + JsonString(balanceVar) +
+          ", \"correction\": \"Std2P\", \"multijet\": " +
+          JsonString(optionsMap["multijet"].as<string>()) + "}";
+        records = make_unique<RecordFile>(optionsMap["resume"].as<string>(), numValues,
+          RecordFile::GridSignature({p0Values, p1Values}, definition));
+        completed = records->Read();
+
+        if (not completed.empty())
+            cout << "Resuming scan with " << completed.size() << " of " <<
+              p0Values.size() * p1Values.size() << " points computed." << endl;
+    }
+
+    vector<unsigned long> points;
+
+    for (unsigned long i = 0; i < p0Values.size() * p1Values.size(); ++i)
+    {
+        if (completed.count(i) == 0)
+            points.emplace_back(i);
+    }
+
+    // Results are written by rank 0 as soon as they are received, so that a scan terminated
+    //prematurely keeps all points computed so far. The text file is flushed with each line, and
+    //the columnar sink every few records.
+    string const resFileName(optionsMap["output"].as<string>());
+    ofstream resFile;
+    unique_ptr<ResultSink> sink;
+    FitRecord record(nPars);
+    record.ndf = lossFunc.GetNDF();
+    unsigned const flushPeriod = 16;
+
+    if (distributor.IsRoot())
+    {
+        resFile.open(resFileName);
+        resFile << "# p0 p1 chi2 status" << endl;
+
+        if (fullResults)
+        {
+            vector<string> paramNames;
+
+            for (unsigned i = 0; i < nPars; ++i)
+                paramNames.emplace_back((i < nPOI) ?
+                  "p" + to_string(i) : nuisanceDefs.GetName(i - nPOI));
+
+            sink = ResultSink::Create(optionsMap["columnar"].as<string>(), paramNames);
+        }
+    }
+
+    auto save = [&](unsigned long point, vector<double> const &values)
+    {
+        resFile << p0Values[point / p1Values.size()] << " " <<
+          p1Values[point % p1Values.size()] << " " << values[0] << " " << values[1] << endl;
+
+        if (not sink)
+            return;
+
+        record.key = point;
+        record.chi2 = values[0];
+        record.status = int(values[1]);
+        record.time = values[2];
+
+        auto const params = values.begin() + 3;
+        copy(params, params + nPars, record.params.begin());
+        copy(params + nPars, params + 2 * nPars, record.errors.begin());
+        copy(params + 2 * nPars, params + 2 * nPars + nPars * nPars, record.covariance.begin());
+
+        sink->Write(record);
+
+        if (sink->GetNumRecords() % flushPeriod == 0)
+            sink->Flush();
+    };
+
+    for (auto const &[point, values]: completed)
+        save(point, values);
+
+    auto checkpoint = [&](unsigned long point, vector<double> const &values)
+    {
+        if (records)
+            records->Append(point, values);
+
+        save(point, values);
+    };
+
+    auto const results = distributor.Run(points, numValues, profile, checkpoint);
+
+    if (distributor.IsRoot())
+    {
+        resFile.close();
+        cout << "Results for " << results.size() + completed.size() << " points, of which " <<
+          results.size() << " computed with " << distributor.GetNumRanks() <<
+          " ranks, saved to file \"" << resFileName << "\".\n";
+
+        if (records)
+        {
+            records->Close();
+            cout << "Checkpoints saved to \"" << optionsMap["resume"].as<string>() << "\".\n";
+        }
+
+        if (sink)
+        {
+            sink->Close();
+            cout << "Full results of the fits saved to \"" <<
+              optionsMap["columnar"].as<string>() << "\".\n";
+        }
+    }
+
+
+    return EXIT_SUCCESS;
+}
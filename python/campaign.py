@@ -0,0 +1,683 @@
+"""Scheduler for campaigns of fits.
+
+A campaign is described in a YAML file.  It lists data-taking periods,
+methods, and steps, such as the nominal fit, the refinement of the Hesse
+matrix, computation of impacts, scans, and plotting commands.  Each step
+is instantiated for every combination of period and method, unless it is
+declared to act on the whole campaign.  Dependencies between steps form
+a directed acyclic graph.  Steps that minimize the loss function start
+from the minimum found by the upstream fit.
+
+Jobs are executed in a pool of local worker processes.  Their outputs
+and statuses are stored in the working directory of the campaign, so
+that an interrupted campaign resumes from where it stopped.  A job is
+rerun if its description has changed since it was executed or if any of
+its upstream jobs is rerun.  See config/campaign.yaml for an example.
+"""
+
+import concurrent.futures
+import hashlib
+import itertools
+import json
+import multiprocessing
+import os
+import shlex
+import subprocess
+import time
+
+import yaml
+
+from records import RecordFile, grid_signature
+
+
+class Job:
+    """Single unit of work in a campaign."""
+
+    def __init__(
+        self, name, step, kind, options, period=None, method=None,
+        settings=None
+    ):
+        """Initialize from properties.
+
+        Arguments:
+            name:  Unique name of the job.
+            step:  Name of the step the job is an instance of.
+            kind:  Kind of the step, which defines what the job does.
+            options:  Dictionary with options of the step.
+            period:  Data-taking period or None for campaign-wide jobs.
+            method:  Method or None for campaign-wide jobs.
+            settings:  Dictionary with settings for the loss function.
+        """
+
+        self.name = name
+        self.step = step
+        self.kind = kind
+        self.options = options
+        self.period = period
+        self.method = method
+        self.settings = settings or {}
+
+        # Names of upstream jobs, grouped by step
+        self.dependencies = {}
+
+        # Name of the upstream job whose fit results give the starting
+        # point, if any
+        self.start_from = None
+
+
+    @property
+    def all_dependencies(self):
+        """Flat list of names of all upstream jobs."""
+
+        return [
+            name for names in self.dependencies.values() for name in names
+        ]
+
+
+    def digest(self, upstream_digests):
+        """Compute a hash of the job description.
+
+        The hash is used to detect whether the description has changed
+        since the job was executed.  Hashes of upstream jobs are
+        included, so that a change anywhere upstream also changes the
+        hash of this job.  Otherwise a job that was skipped after its
+        upstream had been modified and rerun would later be considered
+        up to date.
+
+        Arguments:
+            upstream_digests:  Dictionary that maps names of all
+                upstream jobs to their hashes.
+        """
+
+        description = {
+            'kind': self.kind, 'options': self.options,
+            'period': self.period, 'method': self.method,
+            'settings': self.settings, 'dependencies': self.dependencies,
+            'upstream': {
+                name: upstream_digests[name]
+                for name in self.all_dependencies
+            }
+        }
+        serialized = json.dumps(description, sort_keys=True)
+        return hashlib.sha1(serialized.encode()).hexdigest()
+
+
+class Campaign:
+    """Campaign of jobs with dependencies."""
+
+    # Kinds of steps that produce fit results in the format of
+    # FitResults.serialize and thus can be used as starting points
+    fit_kinds = {'fit', 'hesse'}
+
+    # Kinds of steps that use a starting point from upstream
+    warm_start_kinds = {'fit', 'hesse', 'impacts', 'scan'}
+
+    known_kinds = {'fit', 'hesse', 'impacts', 'scan', 'merge', 'command'}
+
+
+    def __init__(self, path, workdir=None, num_workers=None):
+        """Initialize from a YAML description.
+
+        Arguments:
+            path:  Path to YAML file describing the campaign.
+            workdir:  Working directory for outputs and state of the
+                campaign.  Overrides the one given in the description.
+            num_workers:  Number of worker processes.  Overrides the
+                number given in the description.  If not given in either
+                place, the number of CPUs is used.
+        """
+
+        with open(path) as f:
+            self.config = yaml.safe_load(f)
+
+        self.workdir = workdir or self.config.get('workdir', 'campaign')
+        self.num_workers = (
+            num_workers or self.config.get('workers') or os.cpu_count()
+        )
+        self.state_path = os.path.join(self.workdir, 'state.json')
+
+        self.jobs = {}
+        self._build_jobs()
+        self.order = self._sort_jobs()
+
+        # Hashes of job descriptions, computed in topological order so
+        # that each one can include the hashes of upstream jobs
+        self.digests = {}
+
+        for name in self.order:
+            self.digests[name] = self.jobs[name].digest(self.digests)
+
+
+    def output_path(self, name):
+        """Return path to the output file of the job with given name."""
+
+        return os.path.join(self.workdir, 'results', name + '.json')
+
+
+    def plan(self):
+        """Find jobs that need to be run.
+
+        A job needs to be run if it has not been completed successfully
+        with the current description or if any of its upstream jobs
+        needs to be run.
+
+        Return value:
+            List of names of jobs in topological order.
+        """
+
+        state = self._load_state()
+        to_run = []
+
+        for name in self.order:
+            job = self.jobs[name]
+            record = state.get(name)
+
+            if (
+                record is None or record['status'] != 'done' or
+                record['hash'] != self.digests[name] or
+                not os.path.exists(self.output_path(name)) or
+                any(dep in to_run for dep in job.all_dependencies)
+            ):
+                to_run.append(name)
+
+        return to_run
+
+
+    def run(self, log=print):
+        """Run all jobs that need to be run.
+
+        Jobs whose upstream jobs have failed are skipped.  The state is
+        saved after every finished job.
+
+        Arguments:
+            log:  Function to report progress.
+
+        Return value:
+            Dictionary that maps names of jobs that have been considered
+            to their final statuses: "done", "failed", or "skipped".
+        """
+
+        state = self._load_state()
+        pending = self.plan()
+        outcome = {}
+
+        if not pending:
+            return outcome
+
+        os.makedirs(os.path.join(self.workdir, 'logs'), exist_ok=True)
+
+        # ROOT is not safe to use after a fork, so start workers afresh
+        context = multiprocessing.get_context('spawn')
+        running = {}
+        start_times = {}
+
+        with concurrent.futures.ProcessPoolExecutor(
+            max_workers=self.num_workers, mp_context=context
+        ) as executor:
+            while pending or running:
+                for name in list(pending):
+                    job = self.jobs[name]
+                    dep_outcomes = [
+                        outcome.get(dep) for dep in job.all_dependencies
+                    ]
+
+                    if any(o in ('failed', 'skipped') for o in dep_outcomes):
+                        pending.remove(name)
+                        outcome[name] = 'skipped'
+                        log('[skipped] {}'.format(name))
+                        continue
+
+                    if any(
+                        dep in pending or dep in running.values()
+                        for dep in job.all_dependencies
+                    ):
+                        continue
+
+                    future = executor.submit(
+                        execute_job, self._job_payload(job)
+                    )
+                    running[future] = name
+                    start_times[name] = time.time()
+                    pending.remove(name)
+
+                if not running:
+                    break
+
+                finished, _ = concurrent.futures.wait(
+                    running, return_when=concurrent.futures.FIRST_COMPLETED
+                )
+
+                for future in finished:
+                    name = running.pop(future)
+                    job = self.jobs[name]
+                    elapsed = time.time() - start_times[name]
+
+                    try:
+                        future.result()
+                    except Exception as error:
+                        outcome[name] = 'failed'
+                        state[name] = {
+                            'status': 'failed', 'hash': self.digests[name],
+                            'error': '{}: {}'.format(
+                                type(error).__name__, error
+                            )
+                        }
+                        log('[failed] {} ({:.1f} s): {}'.format(
+                            name, elapsed, state[name]['error']
+                        ))
+                    else:
+                        outcome[name] = 'done'
+                        state[name] = {
+                            'status': 'done', 'hash': self.digests[name],
+                            'time': elapsed
+                        }
+                        log('[done] {} ({:.1f} s)'.format(name, elapsed))
+
+                    self._save_state(state)
+
+        return outcome
+
+
+    def _build_jobs(self):
+        """Expand steps into jobs and connect them."""
+
+        periods = self.config.get('periods', {})
+        methods = self.config.get('methods', [])
+        steps = self.config.get('steps', {})
+        common_settings = self.config.get('fit', {})
+
+        if not steps:
+            raise RuntimeError('Campaign does not define any steps.')
+
+        step_jobs = {}
+
+        for step, options in steps.items():
+            options = dict(options or {})
+            kind = options.pop('kind', step)
+            scope = options.pop('scope', 'each')
+            options.pop('after', None)
+
+            if kind not in self.known_kinds:
+                raise RuntimeError(
+                    'Step "{}" is of unknown kind "{}".'.format(step, kind)
+                )
+
+            if scope == 'campaign':
+                job = Job(step, step, kind, options)
+                step_jobs[step] = [job]
+            elif scope == 'each':
+                step_jobs[step] = []
+
+                for period, method in (
+                    (p, m) for p in periods for m in methods
+                ):
+                    settings = dict(common_settings)
+                    settings.update(periods[period] or {})
+                    job = Job(
+                        '/'.join((step, period, method)), step, kind,
+                        options, period, method, settings
+                    )
+                    step_jobs[step].append(job)
+            else:
+                raise RuntimeError(
+                    'Step "{}" has unknown scope "{}".'.format(step, scope)
+                )
+
+            for job in step_jobs[step]:
+                self.jobs[job.name] = job
+
+
+        # Connect jobs.  A per-period job depends on the job of the
+        # upstream step for the same period and method, while a
+        # campaign-wide job depends on all jobs of the upstream step.
+        for step, options in steps.items():
+            upstream_steps = (options or {}).get('after', [])
+
+            if isinstance(upstream_steps, str):
+                upstream_steps = [upstream_steps]
+
+            for upstream_step in upstream_steps:
+                if upstream_step not in step_jobs:
+                    raise RuntimeError(
+                        'Step "{}" depends on unknown step "{}".'.format(
+                            step, upstream_step
+                        )
+                    )
+
+            for job in step_jobs[step]:
+                for upstream_step in upstream_steps:
+                    candidates = step_jobs[upstream_step]
+
+                    if job.period is not None:
+                        candidates = [
+                            c for c in candidates
+                            if c.period in (None, job.period) and
+                            c.method in (None, job.method)
+                        ]
+
+                    job.dependencies[upstream_step] = [
+                        c.name for c in candidates
+                    ]
+
+                    if (
+                        job.kind in self.warm_start_kinds and
+                        job.start_from is None and
+                        candidates and candidates[0].period is not None and
+                        candidates[0].kind in self.fit_kinds
+                    ):
+                        job.start_from = candidates[0].name
+
+
+    def _job_payload(self, job):
+        """Construct the description of a job for a worker process."""
+
+        inputs = {
+            step: [self.output_path(name) for name in names]
+            for step, names in job.dependencies.items()
+        }
+
+        return {
+            'name': job.name, 'kind': job.kind, 'options': job.options,
+            'period': job.period, 'method': job.method,
+            'settings': job.settings, 'inputs': inputs,
+            'start': (
+                self.output_path(job.start_from) if job.start_from
+                else None
+            ),
+            'output': self.output_path(job.name),
+            'log': os.path.join(
+                self.workdir, 'logs', job.name.replace('/', '_') + '.log'
+            ),
+            'workdir': self.workdir
+        }
+
+
+    def _load_state(self):
+        """Read the state of the campaign saved previously."""
+
+        if not os.path.exists(self.state_path):
+            return {}
+
+        with open(self.state_path) as f:
+            return json.load(f)
+
+
+    def _save_state(self, state):
+        """Save the state of the campaign.
+
+        The file is replaced atomically, so that it is never corrupted
+        if the campaign is killed.
+        """
+
+        os.makedirs(self.workdir, exist_ok=True)
+        _write_json_atomic(self.state_path, state)
+
+
+    def _sort_jobs(self):
+        """Order jobs topologically and check that there are no cycles."""
+
+        order = []
+        marks = {}
+
+        def visit(name, path):
+            mark = marks.get(name)
+
+            if mark == 'done':
+                return
+            elif mark == 'visiting':
+                raise RuntimeError(
+                    'Dependencies form a cycle: {}.'.format(
+                        ' -> '.join(path + [name])
+                    )
+                )
+
+            marks[name] = 'visiting'
+
+            for dep in self.jobs[name].all_dependencies:
+                visit(dep, path + [name])
+
+            marks[name] = 'done'
+            order.append(name)
+
+        for name in self.jobs:
+            visit(name, [])
+
+        return order
+
+
+def execute_job(payload):
+    """Execute a single job in a worker process.
+
+    The output is written to a temporary file, which is then renamed, so
+    that a killed job never leaves a partial output.
+    """
+
+    kind = payload['kind']
+
+    if kind == 'command':
+        result = _run_command(payload)
+    elif kind == 'merge':
+        result = [
+            _read_json(path)
+            for paths in payload['inputs'].values() for path in paths
+        ]
+    else:
+        result = _run_fit_step(payload)
+
+    os.makedirs(os.path.dirname(payload['output']), exist_ok=True)
+    _write_json_atomic(payload['output'], result)
+
+
+def _create_loss_func(payload):
+    """Construct the loss function for a per-period job."""
+
+    # Import here so that the scheduler itself does not need ROOT
+    import jecfit
+
+    settings = payload['settings']
+
+    if 'multijet' not in settings:
+        raise RuntimeError(
+            'No inputs for multijet analysis given for period "{}".'.format(
+                payload['period']
+            )
+        )
+
+    loss_func = jecfit.MultijetChi2(
+        settings['multijet'], payload['method'],
+        exclude_syst=set(settings.get('exclude_syst', [])),
+        corr_form=settings.get('corr_form', '2p'),
+        constraint_option=settings.get('constraint'),
+        storage=settings.get('storage', 'double'),
+        num_threads=settings.get('num_threads', 1)
+    )
+    loss_func.set_pt_range(*settings.get('pt_range', [0., 1.6e3]))
+
+    return loss_func
+
+
+def _run_command(payload):
+    """Run an external command.
+
+    The command is formatted with fields period, method, workdir, and
+    inputs.  The latter maps names of upstream steps to paths of their
+    outputs, separated by spaces if there are several.
+    """
+
+    inputs = {
+        step: ' '.join(paths) for step, paths in payload['inputs'].items()
+    }
+    command = payload['options']['command'].format(
+        period=payload['period'], method=payload['method'],
+        workdir=payload['workdir'], inputs=inputs
+    )
+
+    with open(payload['log'], 'w') as log_file:
+        subprocess.run(
+            shlex.split(command), stdout=log_file, stderr=subprocess.STDOUT,
+            check=True
+        )
+
+    return {'command': command}
+
+
+def _run_fit_step(payload):
+    """Run a job that minimizes the loss function."""
+
+    import jecfit
+
+    loss_func = _create_loss_func(payload)
+    kind = payload['kind']
+    options = payload['options']
+
+    start = None
+
+    if payload['start']:
+        start = jecfit.FitResults(_read_json(payload['start']))
+
+    print_level = options.get('print_level', 0)
+
+    if kind in ('fit', 'hesse'):
+        if kind == 'fit':
+            fit_results = loss_func.fit(print_level, start=start)
+        else:
+            fit_results = loss_func.hesse(print_level, start=start)
+
+        # Same format as produced by fit.py
+        result = fit_results.serialize()
+        result.update({
+            'ndf': loss_func.ndf,
+            'p_value': loss_func.p_value(fit_results.min_value),
+            'period': payload['period'],
+            'variant': payload['method'],
+            'corr_form': payload['settings'].get('corr_form', '2p'),
+            'constraint': payload['settings'].get('constraint')
+        })
+        return result
+
+    if start is None:
+        raise RuntimeError(
+            'Job "{}" of kind "{}" requires an upstream fit.'.format(
+                payload['name'], kind
+            )
+        )
+
+    if kind == 'impacts':
+        return _compute_impacts(loss_func, start, payload)
+    else:
+        return _compute_scans(loss_func, start, payload)
+
+
+def _compute_impacts(loss_func, start, payload):
+    """Compute impacts of nuisances on POI.
+
+    Each nuisance is fixed to its post-fit value shifted by its post-fit
+    uncertainty, up and down, and the remaining parameters are refitted.
+    The impact is the resulting shift in every POI.
+    """
+
+    num_poi = loss_func.num_poi
+    impacts = []
+
+    for index in range(num_poi, len(start.parameters)):
+        nuisance = start.parameters[index]
+        shifts = {}
+
+        for direction, sign in [('up', 1.), ('down', -1.)]:
+            fit_results = loss_func.fit(
+                0, start=start,
+                fixed={index: nuisance.value + sign * nuisance.error}
+            )
+            shifts[direction] = [
+                fit_results.parameters[i].value - start.parameters[i].value
+                for i in range(num_poi)
+            ]
+
+        impacts.append({'nuisance': nuisance.name, **shifts})
+
+    return {
+        'period': payload['period'], 'variant': payload['method'],
+        'impacts': impacts
+    }
+
+
+def _compute_scans(loss_func, start, payload):
+    """Compute 1D scans of chi^2 along each POI.
+
+    Nuisances are profiled, starting from their values at the minimum.
+    The scan covers the given number of post-fit uncertainties around
+    the minimum.  Values of chi^2 are checkpointed in a record file, so
+    that a restarted job only computes the missing points.
+    """
+
+    options = payload['options']
+    num_points = options.get('num_points', 51)
+    window = options.get('window', 2.)
+
+    num_poi = loss_func.num_poi
+    central = [p.value for p in start.parameters[:num_poi]]
+    grids = []
+
+    for parameter in start.parameters[:num_poi]:
+        grids.append([
+            parameter.value + window * parameter.error * (
+                2 * i / (num_points - 1) - 1
+            )
+            for i in range(num_points)
+        ])
+
+    record_path = os.path.join(
+        payload['workdir'], 'records',
+        payload['name'].replace('/', '_') + '.rec'
+    )
+    os.makedirs(os.path.dirname(record_path), exist_ok=True)
+
+    with RecordFile(
+        record_path, 1,
+        signature=grid_signature(*grids, definition=loss_func.definition)
+    ) as records:
+        completed = records.completed()
+
+        for ivar, i in itertools.product(range(num_poi), range(num_points)):
+            key = ivar * num_points + i
+
+            if key in completed:
+                continue
+
+            point = list(central)
+            point[ivar] = grids[ivar][i]
+            records.append(key, [loss_func(point, start=start)])
+
+        chi2 = records.read()
+
+    scans = []
+
+    for ivar in range(num_poi):
+        scans.append({
+            'parameter': start.parameters[ivar].name,
+            'values': grids[ivar],
+            'chi2': [
+                chi2[ivar * num_points + i][0] for i in range(num_points)
+            ]
+        })
+
+    return {
+        'period': payload['period'], 'variant': payload['method'],
+        'scans': scans
+    }
+
+
+def _read_json(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def _write_json_atomic(path, content):
+    """Write JSON file, replacing any existing one atomically."""
+
+    tmp_path = path + '.tmp'
+
+    with open(tmp_path, 'w') as f:
+        json.dump(content, f, indent=2)
+
+    os.replace(tmp_path, path)
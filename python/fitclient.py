@@ -0,0 +1,604 @@
+"""Client for the fit server.
+
+The server, started with the fitServer program, keeps loss functions
+loaded in memory and evaluates them on request.  This module implements
+its protocol using only the standard library and NumPy, so that it does
+not need ROOT.  Class RemoteMultijetChi2 mirrors the interface of
+jecfit.MultijetChi2.
+
+Messages in both directions consist of a 32-bit length followed by a
+payload.  All numbers are little-endian.  Strings are encoded as a
+32-bit length followed by UTF-8 characters, and arrays as a 32-bit
+length followed by 64-bit floating-point values.  A request starts with
+an 8-bit code and the name of a configuration.  A response starts with
+an 8-bit status, which is 0 on success.  Otherwise it is 1 and is
+followed by an error message.  Layouts of the remaining fields of
+requests and responses are given below, with types u8, u32, i32, f64,
+str, and arr.
+
+Load (1):
+    request:  str input_path, str method, str corr_form,
+        str constraint, str storage, u32 n, str excluded_syst[n],
+        f64 min_pt_lead, f64 max_pt_lead
+    response:  u32 num_poi, u32 n, str nuisance_name[n], u32 ndf
+Eval (2):
+    request:  arr params
+    response:  f64 chi2
+EvalBatch (3):
+    request:  arr params of all points, concatenated
+    response:  arr chi2
+Fit (4):
+    request:  arr start (possibly empty), u32 n,
+        (u32 index, f64 value)[n] for fixed parameters
+    response:  i32 status, i32 covariance_status, f64 min_value,
+        arr values, arr errors, arr covariance (row-major)
+Scan (5):
+    request:  arr start (possibly empty), arr POI of all points,
+        concatenated
+    response:  arr chi2 with nuisances profiled
+Residuals (6):
+    request:  arr params
+    response:  arr x, arr y, arr y_error
+"""
+
+from collections import namedtuple
+import hashlib
+import os
+import socket
+import struct
+
+import numpy as np
+
+
+REQUEST_LOAD = 1
+REQUEST_EVAL = 2
+REQUEST_EVAL_BATCH = 3
+REQUEST_FIT = 4
+REQUEST_SCAN = 5
+REQUEST_RESIDUALS = 6
+
+
+class ServerError(RuntimeError):
+    """Error reported by the fit server."""
+
+    pass
+
+
+class _Writer:
+    """Encoder for payloads of requests."""
+
+    def __init__(self):
+        self._chunks = []
+
+
+    def u8(self, value):
+        self._chunks.append(struct.pack('<B', value))
+
+
+    def u32(self, value):
+        self._chunks.append(struct.pack('<I', value))
+
+
+    def f64(self, value):
+        self._chunks.append(struct.pack('<d', value))
+
+
+    def string(self, value):
+        encoded = value.encode('utf-8')
+        self.u32(len(encoded))
+        self._chunks.append(encoded)
+
+
+    def array(self, values):
+        values = np.asarray(values, dtype='<f8').ravel()
+        self.u32(len(values))
+        self._chunks.append(values.tobytes())
+
+
+    def data(self):
+        return b''.join(self._chunks)
+
+
+class _Reader:
+    """Decoder for payloads of responses."""
+
+    def __init__(self, data):
+        self._data = data
+        self._pos = 0
+
+
+    def _unpack(self, fmt):
+        values = struct.unpack_from(fmt, self._data, self._pos)
+        self._pos += struct.calcsize(fmt)
+        return values[0]
+
+
+    def u8(self):
+        return self._unpack('<B')
+
+
+    def u32(self):
+        return self._unpack('<I')
+
+
+    def i32(self):
+        return self._unpack('<i')
+
+
+    def f64(self):
+        return self._unpack('<d')
+
+
+    def string(self):
+        length = self.u32()
+        value = self._data[self._pos:self._pos + length].decode('utf-8')
+        self._pos += length
+        return value
+
+
+    def array(self):
+        length = self.u32()
+        values = np.frombuffer(
+            self._data, dtype='<f8', count=length, offset=self._pos
+        ).astype(float)
+        self._pos += 8 * length
+        return values
+
+
+class FitClient:
+    """Connection to the fit server.
+
+    Implements requests of the protocol described in the module
+    docstring.  A connection should not be shared between threads
+    without external synchronization.
+    """
+
+    def __init__(self, socket_path='jecfit.sock'):
+        """Connect to the server listening on the given socket."""
+
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.connect(socket_path)
+
+
+    def close(self):
+        """Close the connection."""
+
+        self._socket.close()
+
+
+    def __enter__(self):
+        return self
+
+
+    def __exit__(self, *args):
+        self.close()
+
+
+    def load(
+        self, name, input_path, method='PtBal', corr_form='2p',
+        constraint=None, storage='double', exclude_syst=(),
+        pt_range=(0., float('inf'))
+    ):
+        """Load a configuration of the loss function.
+
+        The server constructs the loss function once and shares it among
+        all clients.  If a configuration with the given name has already
+        been loaded, its definition must match.
+
+        Return value:
+            Tuple with the number of POI, list of names of nuisance
+            parameters, and the number of degrees of freedom.
+        """
+
+        writer = self._start(REQUEST_LOAD, name)
+        writer.string(input_path)
+        writer.string(method)
+        writer.string(corr_form)
+        writer.string(constraint or '')
+        writer.string(storage)
+        writer.u32(len(exclude_syst))
+
+        for syst in sorted(exclude_syst):
+            writer.string(syst)
+
+        writer.f64(pt_range[0])
+        writer.f64(pt_range[1])
+        reader = self._request(writer)
+
+        num_poi = reader.u32()
+        nuisance_names = [reader.string() for _ in range(reader.u32())]
+        ndf = reader.u32()
+        return num_poi, nuisance_names, ndf
+
+
+    def eval(self, name, params):
+        """Evaluate the loss function at given values of all parameters."""
+
+        writer = self._start(REQUEST_EVAL, name)
+        writer.array(params)
+        return self._request(writer).f64()
+
+
+    def eval_batch(self, name, points):
+        """Evaluate the loss function at several points.
+
+        Arguments:
+            name:  Name of the configuration.
+            points:  array_like of shape (n, num_params).
+
+        Return value:
+            NumPy array with values of the loss function.
+        """
+
+        writer = self._start(REQUEST_EVAL_BATCH, name)
+        writer.array(points)
+        return self._request(writer).array()
+
+
+    def fit(self, name, start=None, fixed=None):
+        """Minimize the loss function.
+
+        Arguments:
+            name:  Name of the configuration.
+            start:  array_like with initial values of all parameters or
+                None.
+            fixed:  Dictionary that maps indices of parameters to values
+                at which they are fixed.  If None, all parameters are
+                floating.
+
+        Return value:
+            Tuple with the status of the minimization and of the
+            covariance matrix, minimal value, NumPy arrays with values
+            and errors of parameters, and the covariance matrix.
+        """
+
+        writer = self._start(REQUEST_FIT, name)
+        writer.array(start if start is not None else [])
+        fixed = fixed or {}
+        writer.u32(len(fixed))
+
+        for index, value in sorted(fixed.items()):
+            writer.u32(index)
+            writer.f64(value)
+
+        reader = self._request(writer)
+        status = reader.i32()
+        covariance_status = reader.i32()
+        min_value = reader.f64()
+        values = reader.array()
+        errors = reader.array()
+        covariance = reader.array().reshape((len(values), len(values)))
+        return status, covariance_status, min_value, values, errors, \
+            covariance
+
+
+    def scan(self, name, poi_points, start=None):
+        """Compute loss function with nuisances profiled.
+
+        Arguments:
+            name:  Name of the configuration.
+            poi_points:  array_like of shape (n, num_poi).
+            start:  array_like with initial values of all parameters or
+                None.
+
+        Return value:
+            NumPy array with values of the loss function.
+        """
+
+        writer = self._start(REQUEST_SCAN, name)
+        writer.array(start if start is not None else [])
+        writer.array(poi_points)
+        return self._request(writer).array()
+
+
+    def residuals(self, name, params):
+        """Compute data-to-simulation residuals.
+
+        Return value:
+            Tuple of NumPy arrays representing a graph with residuals.
+        """
+
+        writer = self._start(REQUEST_RESIDUALS, name)
+        writer.array(params)
+        reader = self._request(writer)
+        return reader.array(), reader.array(), reader.array()
+
+
+    @staticmethod
+    def _start(code, name):
+        """Start encoding a request."""
+
+        writer = _Writer()
+        writer.u8(code)
+        writer.string(name)
+        return writer
+
+
+    def _request(self, writer):
+        """Send a request and return a reader for the response.
+
+        Raise ServerError if the server has failed to execute the
+        request.
+        """
+
+        payload = writer.data()
+        self._socket.sendall(struct.pack('<I', len(payload)) + payload)
+
+        length = struct.unpack('<I', self._receive(4))[0]
+        reader = _Reader(self._receive(length))
+
+        if reader.u8() != 0:
+            raise ServerError(reader.string())
+
+        return reader
+
+
+    def _receive(self, size):
+        """Receive exactly given number of bytes."""
+
+        chunks = []
+
+        while size > 0:
+            chunk = self._socket.recv(size)
+
+            if not chunk:
+                raise ConnectionError('Connection closed by the server.')
+
+            chunks.append(chunk)
+            size -= len(chunk)
+
+        return b''.join(chunks)
+
+
+class FitResults:
+    """Fit results received from the server.
+
+    Provides the same interface as jecfit.FitResults, which cannot be
+    used here because it requires ROOT.
+    """
+
+    Variable = namedtuple(
+        'Variable', ['name', 'value', 'error', 'lower_error', 'upper_error']
+    )
+    Variable.__new__.__defaults__ = (None, None)
+
+
+    def __init__(self, dictionary):
+        self.status = dictionary['status']
+        self.covariance_status = dictionary['covariance_status']
+        self.min_value = dictionary['min_value']
+        self.parameters = [
+            FitResults.Variable(**v) for v in dictionary['parameters']
+        ]
+        self.covariance_matrix = np.array(dictionary['covariance_matrix'])
+
+
+    def serialize(self):
+        """Convert to a plain dictionary to store in a JSON file."""
+
+        return {
+            'status': self.status,
+            'covariance_status': self.covariance_status,
+            'min_value': self.min_value,
+            'parameters': [p._asdict() for p in self.parameters],
+            'covariance_matrix': self.covariance_matrix.tolist()
+        }
+
+
+class RemoteMultijetChi2:
+    """Loss function for multijet data evaluated by the fit server.
+
+    Drop-in replacement for jecfit.MultijetChi2.  The loss function is
+    constructed by the server only once, and it is shared by all
+    clients that use the same configuration.  The configuration is
+    loaded when it is needed for the first time, so that setting the
+    range in pt right after construction does not read the inputs
+    twice.
+    """
+
+    def __init__(
+        self, file_path, method, exclude_syst=set(), corr_form='2p',
+        constraint_option=None, storage='double',
+        socket_path='jecfit.sock'
+    ):
+        """Connect to the server.
+
+        Arguments are the same as for jecfit.MultijetChi2, except for
+        socket_path, which is the path to the socket of the server.
+        A relative path to the inputs is resolved with respect to the
+        working directory of the client, not of the server.
+        """
+
+        self._client = FitClient(socket_path)
+        self._definition = {
+            'input_path': os.path.abspath(file_path), 'method': method,
+            'corr_form': corr_form, 'constraint': constraint_option,
+            'storage': storage, 'exclude_syst': sorted(exclude_syst),
+            'pt_range': [0., float('inf')]
+        }
+        self._name = None
+
+
+    def __call__(self, params, nuisances='profile', start=None):
+        """Compute chi^2 for given values of POI and nuisances.
+
+        See jecfit.MultijetChi2.__call__.
+        """
+
+        if isinstance(nuisances, str):
+            if self.nuisance_names:
+                return self._client.scan(
+                    self.name, [params[:self.num_poi]], self._start(start)
+                )[0]
+
+            nuisances = []
+
+        x = np.zeros(self.num_poi + len(self.nuisance_names))
+        x[:self.num_poi] = params[:self.num_poi]
+        x[self.num_poi:] = nuisances
+        return self._client.eval(self.name, x)
+
+
+    def evaluate_batch(self, points):
+        """Evaluate chi^2 at several points in a single request.
+
+        Arguments:
+            points:  array_like of shape (n, num_params) with values of
+                all parameters.
+
+        Return value:
+            NumPy array with values of chi^2.
+        """
+
+        return self._client.eval_batch(self.name, points)
+
+
+    def scan(self, poi_points, start=None):
+        """Compute profiled chi^2 at several points in a single request.
+
+        Arguments:
+            poi_points:  array_like of shape (n, num_poi).
+            start:  FitResults to take starting values of nuisances
+                from.
+
+        Return value:
+            NumPy array with values of chi^2.
+        """
+
+        return self._client.scan(
+            self.name, poi_points, self._start(start)
+        )
+
+
+    def compute_residuals(self, params, nuisances):
+        """Compute data-to-simulation residuals.
+
+        See jecfit.MultijetChi2.compute_residuals.
+        """
+
+        x = np.zeros(self.num_poi + len(self.nuisance_names))
+        x[:self.num_poi] = params
+
+        if isinstance(nuisances, dict):
+            for label, value in nuisances.items():
+                x[self.num_poi + self.nuisance_names.index(label)] = value
+        else:
+            x[self.num_poi:] = nuisances
+
+        return self._client.residuals(self.name, x)
+
+
+    def fit(self, print_level=3, start=None, fixed=None):
+        """Perform the fit.
+
+        See jecfit.MultijetChi2.fit.  The print level is ignored since
+        the minimization runs in the server.
+        """
+
+        status, covariance_status, min_value, values, errors, covariance = \
+            self._client.fit(self.name, self._start(start), fixed)
+        names = [
+            'p{:d}'.format(i) for i in range(self.num_poi)
+        ] + self.nuisance_names
+
+        return FitResults({
+            'status': status,
+            'covariance_status': covariance_status,
+            'min_value': min_value,
+            'parameters': [
+                {'name': n, 'value': v, 'error': e}
+                for n, v, e in zip(names, values, errors)
+            ],
+            'covariance_matrix': covariance
+        })
+
+
+    def close(self):
+        """Close the connection to the server."""
+
+        self._client.close()
+
+
+    @property
+    def definition(self):
+        """Settings that define the loss function.
+
+        See jecfit.MultijetChi2.definition.
+        """
+
+        return dict(self._definition)
+
+
+    @property
+    def name(self):
+        """Name of the configuration in the server.
+
+        It is derived from the definition of the configuration, so that
+        clients with identical definitions share it.
+        """
+
+        if self._name is None:
+            self._name = hashlib.sha1(
+                repr(sorted(self._definition.items())).encode('utf-8')
+            ).hexdigest()[:16]
+            d = self._definition
+            self._num_poi, self._nuisance_names, self._ndf = \
+                self._client.load(
+                    self._name, d['input_path'], d['method'],
+                    d['corr_form'], d['constraint'], d['storage'],
+                    d['exclude_syst'], d['pt_range']
+                )
+
+        return self._name
+
+
+    @property
+    def num_poi(self):
+        """Number of parameters of interest."""
+
+        self.name
+        return self._num_poi
+
+
+    @property
+    def nuisance_names(self):
+        """Names of nuisance parameters."""
+
+        self.name
+        return self._nuisance_names
+
+
+    @property
+    def ndf(self):
+        """Number of degrees of freedom."""
+
+        self.name
+        return self._ndf
+
+
+    def p_value(self, chi2):
+        """Compute p-value for given chi^2."""
+
+        import scipy.special
+        return 1 - scipy.special.gammainc(self.ndf / 2, chi2 / 2)
+
+
+    def set_pt_range(self, min_pt1, max_pt1):
+        """Set range in pt of the leading jet used in measurement.
+
+        The server keeps configurations immutable, so this switches to
+        a different configuration.
+        """
+
+        self._definition['pt_range'] = [min_pt1, max_pt1]
+        self._name = None
+
+
+    @staticmethod
+    def _start(start):
+        """Convert FitResults into initial values of parameters."""
+
+        if start is None:
+            return None
+
+        return [p.value for p in start.parameters]
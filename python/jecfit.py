@@ -1,4 +1,5 @@
 from collections import namedtuple
+from contextlib import contextmanager
 import itertools
 import re
 import os
@@ -13,9 +14,14 @@ _location = os.path.dirname(os.path.dirname(__file__))
 ROOT.gInterpreter.AddIncludePath(os.path.join(_location, 'include'))
 ROOT.gInterpreter.Declare('#include <FitBase.hpp>')
 ROOT.gInterpreter.Declare('#include <JetCorrDefinitions.hpp>')
+ROOT.gInterpreter.Declare('#include <JetCorrExpression.hpp>')
 ROOT.gInterpreter.Declare('#include <JetCorrConstraint.hpp>')
+ROOT.gInterpreter.Declare('#include <MinuitTelemetry.hpp>')
 ROOT.gInterpreter.Declare('#include <MultijetCrawlingBins.hpp>')
+ROOT.gInterpreter.Declare('#include <ParallelGradFunction.hpp>')
+ROOT.gInterpreter.Declare('#include <ParallelMinos.hpp>')
 ROOT.gInterpreter.Declare('#include <PythonWrapping.hpp>')
+ROOT.gInterpreter.Declare('#include <Tracer.hpp>')
 ROOT.gSystem.Load(os.path.join(_location, 'lib', 'libjecfit.so'))
 ROOT.gSystem.Load(os.path.join(
     _location, 'lib', 'libjecfit_pythonwrapping.so')
@@ -27,6 +33,54 @@ JetCorrStd2P.__doc__ = """L3Res correction with two parameters."""
 JetCorrSpline = ROOT.JetCorrSpline
 JetCorrSpline.__doc__ = """L3Res correction based on spline."""
 
+JetCorrBSpline = ROOT.JetCorrBSpline
+JetCorrBSpline.__doc__ = """L3Res correction based on B-spline with local support."""
+
+JetCorrExpression = ROOT.JetCorrExpression
+JetCorrExpression.__doc__ = """L3Res correction defined by a formula."""
+
+MinuitTelemetry = ROOT.MinuitTelemetry
+MinuitTelemetry.__doc__ = """Stream of JSON records about progress of a fit.
+
+Constructed from the path to the output file, the minimal interval
+between records about iterations in seconds, and a label for the fit.
+"""
+
+
+def start_trace(path, eval_sampling_period=100):
+    """Start recording a trace of the computation.
+
+    Spans for loading of inputs, minimization, and sampled evaluations
+    of the loss function are recorded until stop_trace() is called and
+    then saved in the Chrome trace-event format, which can be viewed
+    with Perfetto.
+
+    Arguments:
+        path:  Path for the output JSON file.
+        eval_sampling_period:  Only one in this many evaluations of the
+            loss function is traced.
+    """
+
+    ROOT.Tracer.Start(path, eval_sampling_period)
+
+
+def stop_trace():
+    """Stop recording the trace and save it."""
+
+    ROOT.Tracer.Stop()
+
+
+@contextmanager
+def _trace_span(name):
+    """Record the enclosed block as a span in the trace, if active."""
+
+    span = ROOT.TraceSpan(name, 'python')
+
+    try:
+        yield
+    finally:
+        span.End()
+
 
 def create_constraint(option_text):
     """Create constraint for jet correction from text description.
@@ -51,13 +105,21 @@ def create_correction(label):
     """Create jet correction object from a label.
 
     The given label defines the functional form of the correction.  When
-    relevant, hyperparameters are set.
+    relevant, hyperparameters are set.  A label of the form
+    'expr:<formula>' creates a correction defined by the formula, in
+    which x = log(pt).  Fits start from zero values of all parameters
+    and limit them to [-1, 1], so the formula should be close to 1 when
+    the parameters are zero.
     """
 
     if label == '2p':
         return JetCorrStd2P()
     elif label == 'spline':
         return JetCorrSpline(30., 1500., 5)
+    elif label == 'bspline':
+        return JetCorrBSpline(30., 1500., 10)
+    elif label.startswith('expr:'):
+        return JetCorrExpression(label[len('expr:'):])
     else:
         raise RuntimeError('Unknown label "{}".'.format(label))
 
@@ -70,7 +132,7 @@ class MultijetChi2:
     
     def __init__(
         self, file_path, method, exclude_syst=set(), corr_form='2p',
-        constraint_option=None
+        constraint_option=None, storage='double', num_threads=1
     ):
         """Initialize from results of multijet analysis.
         
@@ -82,6 +144,14 @@ class MultijetChi2:
             correction_form:  Functional form for jet correction.
             constraint_option:  String defining a constraint to be
                 applied to the jet correction.  See create_constraint().
+            storage:  Storage mode for inputs, "double", "float", or
+                "scaled-float".  Single-precision modes reduce the
+                memory footprint.  The resulting loss of precision is
+                reported by attribute storage_precision.
+            num_threads:  Number of threads to compute the gradient of
+                the loss function in minimization.  If 1, the gradient
+                is computed by Minuit2 itself.  If 0, all hardware
+                threads are used.
         """
         
         if method == 'PtBal':
@@ -91,16 +161,27 @@ class MultijetChi2:
         else:
             raise RuntimeError('Unsupported method "{}".'.format(method))
 
+        storage_codes = {
+            'double': ROOT.FlatHist2D.Storage.Double,
+            'float': ROOT.FlatHist2D.Storage.Float,
+            'scaled-float': ROOT.FlatHist2D.Storage.ScaledFloat
+        }
+
+        if storage not in storage_codes:
+            raise RuntimeError('Unsupported storage "{}".'.format(storage))
+
         exclude_syst_converted = ROOT.std.set('std::string')()
 
         for syst in exclude_syst:
             exclude_syst_converted.insert(syst)
         
         self._nuisance_defs = ROOT.NuisanceDefinitions()
-        self.measurement = ROOT.MultijetCrawlingBins(
-            file_path, method_code, self._nuisance_defs,
-            exclude_syst_converted
-        )
+
+        with _trace_span('Load multijet'):
+            self.measurement = ROOT.MultijetCrawlingBins(
+                file_path, method_code, self._nuisance_defs,
+                exclude_syst_converted, storage_codes[storage]
+            )
 
         if constraint_option:
             self._constraint = create_constraint(constraint_option)
@@ -116,41 +197,52 @@ class MultijetChi2:
 
         if constraint_option:
             self._loss_func.AddMeasurement(self._constraint)
+
+        self.num_threads = num_threads
+        self._definition = {
+            'input_path': os.path.abspath(file_path), 'method': method,
+            'corr_form': corr_form, 'constraint': constraint_option,
+            'storage': storage, 'exclude_syst': sorted(exclude_syst),
+            'pt_range': [0., float('inf')]
+        }
     
     
-    def __call__(self, params, nuisances='profile'):
+    def __call__(self, params, nuisances='profile', start=None):
         """Compute chi^2 for given values of POI and nuisances.
         
         Arguments:
-            params:  array_like with values of the two parameters of the
-                jet correction.
+            params:  array_like with values of all num_poi parameters
+                of the jet correction.
             nuisances:  array_like with values of nuisances or string
                 'profile'.  In the latter case nuisance parameters are
                 profiled.
+            start:  FitResults to take starting values of nuisances
+                from when they are profiled.
         
         Return value:
             Value of chi^2.
         """
         
-        if (
-            nuisances == 'profile' and
-            self._nuisance_defs.GetNumParams() > 0
-        ):
-            minimizer = self._setup_minimizer()
-            
-            for i in range(2):
-                minimizer.SetVariableValue(i, params[i])
-                minimizer.FixVariable(i)
-            
-            minimizer.Minimize()
-            return minimizer.MinValue()
+        num_poi = self.num_poi
         
-        else:
-            x = np.zeros(self._loss_func.GetNumParams())
-            x[0:2] = params
-            x[2:] = nuisances
+        if isinstance(nuisances, str):
+            if self._nuisance_defs.GetNumParams() > 0:
+                minimizer = self._setup_minimizer(start=start)
+                
+                for i in range(num_poi):
+                    minimizer.SetVariableValue(i, params[i])
+                    minimizer.FixVariable(i)
+                
+                minimizer.Minimize()
+                return minimizer.MinValue()
             
-            return self._loss_func_wrapper(x)
+            nuisances = []
+        
+        x = np.zeros(self._loss_func.GetNumParams())
+        x[:num_poi] = params[:num_poi]
+        x[num_poi:] = nuisances
+        
+        return self._loss_func_wrapper(x)
 
 
     def compute_residuals(self, params, nuisances):
@@ -193,15 +285,149 @@ class MultijetChi2:
         return x, y, yerr
     
     
-    def fit(self, print_level=3):
-        """Perform the fit with all parameters floating."""
+    def fit(self, print_level=3, start=None, fixed=None, telemetry=None):
+        """Perform the fit.
+
+        Arguments:
+            print_level:  Verbosity level for the minimizer.  Use 0 to
+                disable printing.
+            start:  FitResults from a previous fit to start from.  Its
+                parameter values and errors are used as the initial
+                point and steps.  By default the fit starts from zero.
+            fixed:  Dictionary that maps indices of parameters to values
+                at which they are fixed in the fit.  If None, all
+                parameters are floating.
+            telemetry:  MinuitTelemetry to report progress of the
+                minimization to.
+
+        Return value:
+            FitResults.
+        """
         
-        minimizer = self._setup_minimizer(print_level=print_level)
-        minimizer.Minimize()
+        minimizer = self._setup_minimizer(
+            print_level=print_level, start=start, telemetry=telemetry
+        )
+
+        for index, value in (fixed or {}).items():
+            minimizer.SetVariableValue(index, value)
+            minimizer.FixVariable(index)
+
+        with _trace_span('Minimize'):
+            minimizer.Minimize()
+
+        if telemetry is not None:
+            telemetry.Finish(minimizer)
         
         return FitResults(minimizer)
+
+
+    def hesse(self, print_level=3, start=None, telemetry=None):
+        """Refine the minimum and compute full Hesse matrix.
+
+        Run the minimization with the high-quality strategy, which is
+        followed by an explicit computation of the Hesse matrix.  Should
+        normally be started from the results of a previous fit.
+
+        Arguments:
+            print_level:  Verbosity level for the minimizer.
+            start:  FitResults from a previous fit to start from.
+            telemetry:  MinuitTelemetry to report progress of the
+                minimization to.
+
+        Return value:
+            FitResults.
+        """
+
+        minimizer = self._setup_minimizer(
+            print_level=print_level, start=start, telemetry=telemetry
+        )
+        minimizer.SetStrategy(2)
+
+        with _trace_span('Minimize'):
+            minimizer.Minimize()
+
+        with _trace_span('Hesse'):
+            minimizer.Hesse()
+
+        if telemetry is not None:
+            telemetry.Finish(minimizer)
+
+        return FitResults(minimizer)
+
+
+    def minos(self, print_level=3, start=None, telemetry=None):
+        """Perform the fit and compute MINOS errors.
+
+        After the minimization, asymmetric errors are computed for all
+        parameters.  Searches for the lower and upper errors of
+        different parameters are executed concurrently, using the
+        number of threads given at construction.
+
+        Arguments:
+            print_level:  Verbosity level for the minimizer.
+            start:  FitResults from a previous fit to start from.
+            telemetry:  MinuitTelemetry to report progress of the
+                minimization to.
+
+        Return value:
+            FitResults with MINOS errors.
+        """
+
+        minimizer = self._setup_minimizer(
+            print_level=print_level, start=start, telemetry=telemetry
+        )
+
+        with _trace_span('Minimize'):
+            minimizer.Minimize()
+
+        minos = ROOT.ParallelMinos(self._loss_func, self.num_threads)
+        intervals = minos.Run(minimizer)
+
+        if telemetry is not None:
+            telemetry.Finish(minimizer)
+
+        return FitResults(minimizer, minos_errors=intervals)
     
     
+    @property
+    def definition(self):
+        """Settings that define the loss function.
+
+        Dictionary with the path to the inputs, the method, the form of
+        the jet correction, the constraint, the storage mode, excluded
+        systematic uncertainties, and the range in pt of the leading
+        jet.  Can be passed to records.grid_signature.
+        """
+
+        return dict(self._definition)
+
+
+    @property
+    def storage_precision(self):
+        """Loss of precision due to the storage mode for inputs.
+
+        Return value:
+            Tuple with the maximal relative deviation in the mean
+            balance and relative deviation in chi^2.
+        """
+
+        precision = self.measurement.GetStoragePrecision()
+        return precision.maxRelErrorBalance, precision.relErrorChi2
+
+
+    @property
+    def num_poi(self):
+        """Number of parameters of interest.
+
+        They precede nuisance parameters in the list of parameters.
+        """
+
+        return (
+            self._loss_func.GetNumParams() -
+            self._nuisance_defs.GetNumParams()
+        )
+
+
     @property
     def ndf(self):
         """Number of degrees of freedom."""
@@ -219,22 +445,39 @@ class MultijetChi2:
         """Set range in pt of the leading jet used in measurement."""
         
         self.measurement.SetPtLeadRange(min_pt1, max_pt1)
+        self._definition['pt_range'] = [min_pt1, max_pt1]
     
     
-    def _setup_minimizer(self, print_level=0):
+    def _setup_minimizer(self, print_level=0, start=None, telemetry=None):
         """Create and setup a minimizer.
         
         Wrapper for the loss function is stored in self, which is needed
         to prevert it from being deleted by guarbage collection.
         Because of this, only a single minimizer can be used at a time.
+
+        If FitResults are given as the start, the initial values and
+        steps of all parameters are taken from them.  If a
+        MinuitTelemetry is given, it is attached to the minimizer.
         """
         
         minimizer = ROOT.Minuit2.Minuit2Minimizer()
-        self._loss_func_wrapper = ROOT.WrapLossFunction(self._loss_func)
+
+        # The parallel wrapper copies the loss function.  Create it anew
+        # so that it picks up changes such as the range in pt.
+        if self.num_threads != 1:
+            self._loss_func_wrapper = ROOT.ParallelGradFunction(
+                self._loss_func, self.num_threads
+            )
+        else:
+            self._loss_func_wrapper = ROOT.WrapLossFunction(self._loss_func)
+
         minimizer.SetFunction(self._loss_func_wrapper)
         minimizer.SetStrategy(1)
         minimizer.SetErrorDef(1.)
         minimizer.SetPrintLevel(print_level)
+
+        if telemetry is not None:
+            minimizer.SetTraceObject(telemetry)
         
         num_params = self._loss_func.GetNumParams()
         num_poi = num_params - self._nuisance_defs.GetNumParams()
@@ -248,19 +491,46 @@ class MultijetChi2:
                 i, self._nuisance_defs.GetName(i - num_poi), 0., 1.
             )
             minimizer.SetVariableLimits(i, -5., 5.)
+
+        if start is not None:
+            if len(start.parameters) != num_params:
+                raise RuntimeError(
+                    'Starting point contains {} parameters while {} are '
+                    'expected.'.format(len(start.parameters), num_params)
+                )
+
+            for i, p in enumerate(start.parameters):
+                minimizer.SetVariableValue(i, p.value)
+
+                if p.error > 0.:
+                    minimizer.SetVariableStepSize(i, p.error)
         
         return minimizer
 
 
 class FitResults:
-    """Pythonic wrapper for fit results from Minuit2Minimizer."""
+    """Pythonic wrapper for fit results from Minuit2Minimizer.
+
+    Each parameter has a symmetric error from the minimizer.  Its lower
+    (negative) and upper MINOS errors are None unless they have been
+    computed and the corresponding searches have succeeded.
+    """
     
-    Variable = namedtuple('Variable', ['name', 'value', 'error'])
+    Variable = namedtuple(
+        'Variable', ['name', 'value', 'error', 'lower_error', 'upper_error']
+    )
+    Variable.__new__.__defaults__ = (None, None)
+
 
+    def __init__(self, arg, minos_errors=None):
+        """Initialize from a minimizer or a result of serialize.
+
+        When constructing from a minimizer, MINOS errors can be given
+        as a sequence of ParallelMinos.Interval.
+        """
 
-    def __init__(self, arg):
         if isinstance(arg, ROOT.Math.Minimizer):
-            self._from_minimizer(arg)
+            self._from_minimizer(arg, minos_errors)
         else:
             self._from_dict(arg)
 
@@ -274,7 +544,9 @@ class FitResults:
             serialized_parameters.append({
                 'name': p.name,
                 'value': p.value,
-                'error': p.error
+                'error': p.error,
+                'lower_error': p.lower_error,
+                'upper_error': p.upper_error
             })
 
         return {
@@ -298,7 +570,7 @@ class FitResults:
         self.covariance_matrix = np.array(dictionary['covariance_matrix'])
 
     
-    def _from_minimizer(self, minimizer):
+    def _from_minimizer(self, minimizer, minos_errors=None):
         """Initialize from a ROOT.Math.Minimizer."""
         
         self.status = minimizer.Status()
@@ -308,10 +580,21 @@ class FitResults:
 
         self.parameters = []
         
-        for p in minimizer.State().MinuitParameters():
-            self.parameters.append(
-                FitResults.Variable(p.Name(), p.Value(), p.Error())
-            )
+        for i, p in enumerate(minimizer.State().MinuitParameters()):
+            lower_error, upper_error = None, None
+
+            if minos_errors is not None:
+                interval = minos_errors[i]
+
+                if interval.lowerValid:
+                    lower_error = interval.lower
+
+                if interval.upperValid:
+                    upper_error = interval.upper
+
+            self.parameters.append(FitResults.Variable(
+                p.Name(), p.Value(), p.Error(), lower_error, upper_error
+            ))
 
         num_pars = len(self.parameters)
         self.covariance_matrix = np.empty((num_pars, num_pars))
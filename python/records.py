@@ -0,0 +1,311 @@
+"""Append-only files of fixed-size records for long computations.
+
+Results of independent work units, such as points of a scan or toy
+experiments, are appended to the file as soon as they are computed.
+Each record contains an integer key that identifies the work unit (an
+index in a grid or a random seed), a fixed number of floating-point
+values, and a checksum.  When a computation is restarted, completed
+work units are read back and can be skipped.
+
+The data file is flushed to disk periodically.  Every so often a
+sidecar index with keys of all records written so far is also saved, so
+that on restart only records past the index need to be read and
+validated.  A record that has been only partly written or is corrupted
+is discarded together with everything after it.
+"""
+
+import hashlib
+import json
+import os
+import struct
+import time
+import zlib
+
+
+def grid_signature(*grids, definition=None):
+    """Compute signature for a RecordFile from grids of work units.
+
+    Arguments:
+        grids:  Flat sequences of numbers, such as coordinates of points
+            in a scan.
+        definition:  JSON-serializable description of the function
+            evaluated at the points, such as attribute definition of
+            jecfit.MultijetChi2.  Records computed for a different loss
+            function are then not reused.
+
+    Return value:
+        Integer that changes whenever any of the grids or the
+        definition changes.
+    """
+
+    digest = hashlib.sha1()
+
+    for grid in grids:
+        digest.update(struct.pack('<{:d}d'.format(len(grid)), *grid))
+
+    if definition is not None:
+        digest.update(
+            json.dumps(definition, sort_keys=True).encode('utf-8')
+        )
+
+    return struct.unpack('<Q', digest.digest()[:8])[0]
+
+
+class RecordFile:
+    """Append-only file of fixed-size records.
+
+    Can be used as a context manager, which closes the file on exit.
+    """
+
+    _header_format = struct.Struct('<8sIIQ')
+    _magic = b'JECFREC1'
+
+    _index_header_format = struct.Struct('<8sQ')
+    _index_magic = b'JECFIDX1'
+
+
+    def __init__(
+        self, path, num_values, signature=0, sync_every=100,
+        sync_interval=10., index_every=1000
+    ):
+        """Open existing file or create a new one.
+
+        Arguments:
+            path:  Path to the data file.  The index is stored in a file
+                with extension ".idx" appended.
+            num_values:  Number of floating-point values in a record.
+            signature:  Integer that identifies the computation, for
+                instance a hash of the grid of a scan.  Opening an
+                existing file with a different signature is an error.
+            sync_every:  Maximal number of records appended between
+                two flushes to disk.
+            sync_interval:  Maximal time in seconds between two flushes
+                to disk.
+            index_every:  Number of records appended between two
+                updates of the index.
+        """
+
+        self.path = path
+        self.index_path = path + '.idx'
+        self.num_values = num_values
+        self.signature = signature
+        self.sync_every = sync_every
+        self.sync_interval = sync_interval
+        self.index_every = index_every
+
+        self._record_format = struct.Struct('<Q{:d}dII'.format(num_values))
+        self._payload_size = self._record_format.size - 8
+
+        self._keys = []
+        self._num_unsynced = 0
+        self._num_unindexed = 0
+        self._last_sync = time.time()
+
+        if os.path.exists(path):
+            self._recover()
+            self._file = open(path, 'ab', buffering=0)
+        else:
+            self._file = open(path, 'wb', buffering=0)
+            self._file.write(self._header_format.pack(
+                self._magic, num_values, 0, signature
+            ))
+            self._sync()
+            self._write_index()
+
+
+    def __enter__(self):
+        return self
+
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+
+    def __len__(self):
+        """Number of records in the file."""
+
+        return len(self._keys)
+
+
+    def append(self, key, values):
+        """Append a record.
+
+        The record reaches the disk at the latest after the number of
+        records or the time interval given at construction.
+        """
+
+        if len(values) != self.num_values:
+            raise RuntimeError(
+                'Record contains {} values while {} are expected.'.format(
+                    len(values), self.num_values
+                )
+            )
+
+        payload = struct.pack(
+            '<Q{:d}d'.format(self.num_values), key, *values
+        )
+        self._file.write(payload + struct.pack(
+            '<II', zlib.crc32(payload), 0
+        ))
+        self._keys.append(key)
+        self._num_unsynced += 1
+        self._num_unindexed += 1
+
+        if (
+            self._num_unsynced >= self.sync_every or
+            time.time() - self._last_sync >= self.sync_interval
+        ):
+            self._sync()
+
+        if self._num_unindexed >= self.index_every:
+            self._write_index()
+
+
+    def close(self):
+        """Flush all records, update the index, and close the file."""
+
+        if self._file.closed:
+            return
+
+        self._write_index()
+        self._file.close()
+
+
+    def completed(self):
+        """Return set of keys of all records."""
+
+        return set(self._keys)
+
+
+    def read(self):
+        """Read all records.
+
+        Return value:
+            Dictionary that maps keys to tuples of values.  If there are
+            several records with the same key, the last one is used.
+        """
+
+        self._sync()
+        records = {}
+
+        with open(self.path, 'rb') as f:
+            f.seek(self._header_format.size)
+
+            for _ in range(len(self._keys)):
+                unpacked = self._record_format.unpack(
+                    f.read(self._record_format.size)
+                )
+                records[unpacked[0]] = unpacked[1:-2]
+
+        return records
+
+
+    def _read_index(self, num_records):
+        """Read keys from the index.
+
+        Return an empty list if the index is missing, damaged, or refers
+        to more records than are present in the data file.
+        """
+
+        try:
+            with open(self.index_path, 'rb') as f:
+                magic, num_indexed = self._index_header_format.unpack(
+                    f.read(self._index_header_format.size)
+                )
+                data = f.read(8 * num_indexed)
+        except (OSError, struct.error):
+            return []
+
+        if (
+            magic != self._index_magic or num_indexed > num_records or
+            len(data) != 8 * num_indexed
+        ):
+            return []
+
+        return list(struct.unpack('<{:d}Q'.format(num_indexed), data))
+
+
+    def _recover(self):
+        """Read back existing file and drop damaged records at its end."""
+
+        with open(self.path, 'r+b') as f:
+            header = f.read(self._header_format.size)
+
+            try:
+                magic, num_values, _, signature = \
+                    self._header_format.unpack(header)
+            except struct.error:
+                raise RuntimeError(
+                    'File "{}" is not a valid record file.'.format(self.path)
+                )
+
+            if magic != self._magic:
+                raise RuntimeError(
+                    'File "{}" is not a valid record file.'.format(self.path)
+                )
+
+            if num_values != self.num_values or signature != self.signature:
+                raise RuntimeError(
+                    'File "{}" has been written for a different '
+                    'computation.  Remove it to start anew.'.format(self.path)
+                )
+
+            size = os.fstat(f.fileno()).st_size
+            num_records = (
+                (size - self._header_format.size) // self._record_format.size
+            )
+            self._keys = self._read_index(num_records)
+            num_indexed = len(self._keys)
+
+            # Validate records that are not covered by the index
+            f.seek(
+                self._header_format.size +
+                num_indexed * self._record_format.size
+            )
+
+            for _ in range(num_indexed, num_records):
+                record = f.read(self._record_format.size)
+                crc = struct.unpack_from('<I', record, self._payload_size)[0]
+
+                if zlib.crc32(record[:self._payload_size]) != crc:
+                    break
+
+                self._keys.append(struct.unpack_from('<Q', record)[0])
+
+            # Drop everything after the last valid record
+            f.truncate(
+                self._header_format.size +
+                len(self._keys) * self._record_format.size
+            )
+
+        self._num_unindexed = len(self._keys) - num_indexed
+
+
+    def _sync(self):
+        """Make sure all appended records are stored on disk."""
+
+        os.fsync(self._file.fileno())
+        self._num_unsynced = 0
+        self._last_sync = time.time()
+
+
+    def _write_index(self):
+        """Save the index, replacing the old one atomically.
+
+        The data file is flushed first, so that the index never refers
+        to records that are not on disk.
+        """
+
+        self._sync()
+        tmp_path = self.index_path + '.tmp'
+
+        with open(tmp_path, 'wb') as f:
+            f.write(self._index_header_format.pack(
+                self._index_magic, len(self._keys)
+            ))
+            f.write(struct.pack('<{:d}Q'.format(len(self._keys)), *self._keys))
+            f.flush()
+            os.fsync(f.fileno())
+
+        os.replace(tmp_path, self.index_path)
+        self._num_unindexed = 0
@@ -0,0 +1,96 @@
+"""Reading of fit results written by ResultSink.
+
+Class NpyResultSink in the C++ library stores every field of a fit
+record in a separate file in NumPy format, all of them in the same
+directory.  The functions in this module map these files into memory
+without copying the data.  Files written by TreeResultSink can be read
+with standard ROOT tools, e.g. ROOT.RDataFrame('Results', path).
+"""
+
+import os
+
+import numpy as np
+
+
+COLUMNS = (
+    'key', 'params', 'errors', 'covariance', 'chi2', 'ndf', 'status', 'time'
+)
+
+
+def map_npy(path):
+    """Map an array in NumPy format into memory in read-only mode.
+
+    Unlike numpy.load, the number of rows is deduced from the size of
+    the file rather than read from the header.  This allows to access
+    rows appended after the header has last been updated, e.g. while
+    the writer is still running or if it has been terminated.  An
+    incomplete row at the end of the file is ignored.
+
+    Arguments:
+        path:  Path to a .npy file.
+
+    Return value:
+        Read-only numpy.memmap.  Its first dimension is the index of
+        the row.
+    """
+
+    with open(path, 'rb') as f:
+        version = np.lib.format.read_magic(f)
+
+        if version == (1, 0):
+            shape, fortran_order, dtype = \
+                np.lib.format.read_array_header_1_0(f)
+        else:
+            shape, fortran_order, dtype = \
+                np.lib.format.read_array_header_2_0(f)
+
+        offset = f.tell()
+
+    if fortran_order:
+        raise RuntimeError(
+            'Array in file "{}" is stored in Fortran order.'.format(path)
+        )
+
+    row_shape = shape[1:]
+    row_size = dtype.itemsize * int(np.prod(row_shape, dtype=np.int64))
+    num_rows = (os.path.getsize(path) - offset) // row_size
+
+    if num_rows == 0:
+        return np.empty((0,) + row_shape, dtype=dtype)
+
+    return np.memmap(
+        path, dtype=dtype, mode='r', offset=offset,
+        shape=(num_rows,) + row_shape
+    )
+
+
+def read_results(directory):
+    """Read fit results stored by NpyResultSink.
+
+    Arrays for all fields are memory-mapped without copying.  If the
+    writer has been interrupted, fields may contain different numbers
+    of rows; they are then truncated to the number of complete records.
+
+    Arguments:
+        directory:  Directory with the results.
+
+    Return value:
+        Dictionary that maps names of fields of the fit record, as
+        listed in COLUMNS, to read-only arrays.  The first dimension of
+        each array is the index of the record.  In addition, key
+        'param_names' gives the list of names of the parameters.
+    """
+
+    results = {
+        name: map_npy(os.path.join(directory, name + '.npy'))
+        for name in COLUMNS
+    }
+    num_records = min(len(array) for array in results.values())
+
+    for name in COLUMNS:
+        results[name] = results[name][:num_records]
+
+    with open(os.path.join(directory, 'param_names.txt')) as f:
+        results['param_names'] = [line.strip() for line in f if line.strip()]
+
+    return results
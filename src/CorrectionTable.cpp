@@ -0,0 +1,128 @@
+#include <CorrectionTable.hpp>
+#include <FitBase.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+
+CorrectionTable::CorrectionTable():
+    setOffsets{0}, corrConfigId(0)
+{}
+
+
+unsigned CorrectionTable::AddPoints(std::vector<double> const &pts)
+{
+    for (double const pt: pts)
+    {
+        if (not std::isfinite(pt))
+        {
+            std::ostringstream message;
+            message << "CorrectionTable::AddPoints: Given value of pt " << pt << " is not finite.";
+            throw std::runtime_error(message.str());
+        }
+    }
+
+    points.insert(points.end(), pts.begin(), pts.end());
+    setOffsets.emplace_back(points.size());
+
+    // Rebuild the merged set of distinct points
+    distinctPoints = points;
+    std::sort(distinctPoints.begin(), distinctPoints.end());
+    distinctPoints.erase(std::unique(distinctPoints.begin(), distinctPoints.end()),
+      distinctPoints.end());
+
+    pointIndices.resize(points.size());
+
+    for (unsigned i = 0; i < points.size(); ++i)
+        pointIndices[i] = std::lower_bound(distinctPoints.begin(), distinctPoints.end(),
+          points[i]) - distinctPoints.begin();
+
+    distinctCorrections.assign(distinctPoints.size(), 0.);
+    corrections.assign(points.size(), 0.);
+    corrConfigId = 0;
+
+    return setOffsets.size() - 2;
+}
+
+
+double const *CorrectionTable::GetCorrections(unsigned set) const
+{
+    if (set + 1 >= setOffsets.size())
+    {
+        std::ostringstream message;
+        message << "CorrectionTable::GetCorrections: Set with index " << set <<
+          " has not been registered.";
+        throw std::runtime_error(message.str());
+    }
+
+    return corrections.data() + setOffsets[set];
+}
+
+
+unsigned CorrectionTable::GetNumDistinctPoints() const
+{
+    return distinctPoints.size();
+}
+
+
+unsigned CorrectionTable::GetNumPoints() const
+{
+    return points.size();
+}
+
+
+void CorrectionTable::Update(JetCorrBase const &corrector)
+{
+    if (points.empty())
+        return;
+
+    auto const &params = corrector.GetParams();
+    double minPt = 0., maxPt = std::numeric_limits<double>::infinity();
+
+    // If the correction has the same configuration as in the previous update, find the range in
+    //pt affected by the parameters that have changed
+    if (corrector.GetConfigId() == corrConfigId and params.size() == corrParams.size())
+    {
+        std::swap(minPt, maxPt);
+
+        for (unsigned i = 0; i < params.size(); ++i)
+        {
+            if (params[i] != corrParams[i])
+            {
+                auto const support = corrector.GetParamSupport(i);
+                minPt = std::min(minPt, support.first);
+                maxPt = std::max(maxPt, support.second);
+            }
+        }
+
+        // Nothing to do if no parameter has changed
+        if (minPt > maxPt)
+            return;
+    }
+
+    corrConfigId = corrector.GetConfigId();
+    corrParams = params;
+
+    unsigned const begin = std::lower_bound(distinctPoints.begin(), distinctPoints.end(), minPt) -
+      distinctPoints.begin();
+    unsigned const end = std::upper_bound(distinctPoints.begin(), distinctPoints.end(), maxPt) -
+      distinctPoints.begin();
+
+    if (end <= begin)
+        return;
+
+    corrector.EvalBatch(distinctPoints.data() + begin, distinctCorrections.data() + begin,
+      end - begin);
+
+    for (unsigned i = 0; i < points.size(); ++i)
+    {
+        unsigned const index = pointIndices[i];
+
+        if (index >= begin and index < end)
+            corrections[i] = distinctCorrections[index];
+    }
+}
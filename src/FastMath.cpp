@@ -0,0 +1,155 @@
+#include <FastMath.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+namespace {
+
+/// Number of values processed at once in batched functions
+unsigned const chunkSize = 64;
+
+
+/// Checks if the argument is in the domain of fastLog
+inline bool inLogDomain(double x)
+{
+    return x >= DBL_MIN and x <= DBL_MAX;
+}
+
+
+/// Checks if the argument is in the domain of fastExp
+inline bool inExpDomain(double x)
+{
+    return x >= -708. and x <= 709.;
+}
+
+}  // anonymous namespace
+
+
+bool isFastMathEnabled()
+{
+    #ifdef JECFIT_FAST_MATH
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+
+double mathLog(double x)
+{
+    #ifdef JECFIT_FAST_MATH
+    return (inLogDomain(x)) ? fastLog(x) : std::log(x);
+    #else
+    return std::log(x);
+    #endif
+}
+
+
+double mathExp(double x)
+{
+    #ifdef JECFIT_FAST_MATH
+    return (inExpDomain(x)) ? fastExp(x) : std::exp(x);
+    #else
+    return std::exp(x);
+    #endif
+}
+
+
+double mathPow(double x, double y)
+{
+    #ifdef JECFIT_FAST_MATH
+    if (not inLogDomain(x))
+        return std::pow(x, y);
+
+    double const exponent = y * fastLog(x);
+    return (inExpDomain(exponent)) ? fastExp(exponent) : std::pow(x, y);
+    #else
+    return std::pow(x, y);
+    #endif
+}
+
+
+void mathLogBatch(double const *x, double *result, unsigned n)
+{
+    #ifdef JECFIT_FAST_MATH
+    // Inputs are processed in chunks. The first loop over a chunk is vectorized by the compiler.
+    // Arguments outside of the domain of the approximation are rare, and they are recomputed in a
+    // separate loop. The buffer allows the computation to be done in place.
+    double buffer[chunkSize];
+
+    for (unsigned start = 0; start < n; start += chunkSize)
+    {
+        unsigned const size = std::min(n - start, chunkSize);
+        double const *chunk = x + start;
+
+        for (unsigned i = 0; i < size; ++i)
+            buffer[i] = fastLog(chunk[i]);
+
+        for (unsigned i = 0; i < size; ++i)
+            if (not inLogDomain(chunk[i]))
+                buffer[i] = std::log(chunk[i]);
+
+        std::copy(buffer, buffer + size, result + start);
+    }
+    #else
+    for (unsigned i = 0; i < n; ++i)
+        result[i] = std::log(x[i]);
+    #endif
+}
+
+
+void mathExpBatch(double const *x, double *result, unsigned n)
+{
+    #ifdef JECFIT_FAST_MATH
+    double buffer[chunkSize];
+
+    for (unsigned start = 0; start < n; start += chunkSize)
+    {
+        unsigned const size = std::min(n - start, chunkSize);
+        double const *chunk = x + start;
+
+        for (unsigned i = 0; i < size; ++i)
+            buffer[i] = fastExp(chunk[i]);
+
+        for (unsigned i = 0; i < size; ++i)
+            if (not inExpDomain(chunk[i]))
+                buffer[i] = std::exp(chunk[i]);
+
+        std::copy(buffer, buffer + size, result + start);
+    }
+    #else
+    for (unsigned i = 0; i < n; ++i)
+        result[i] = std::exp(x[i]);
+    #endif
+}
+
+
+void mathPowBatch(double const *x, double y, double *result, unsigned n)
+{
+    #ifdef JECFIT_FAST_MATH
+    double logBuffer[chunkSize], buffer[chunkSize];
+
+    for (unsigned start = 0; start < n; start += chunkSize)
+    {
+        unsigned const size = std::min(n - start, chunkSize);
+        double const *chunk = x + start;
+
+        for (unsigned i = 0; i < size; ++i)
+            logBuffer[i] = y * fastLog(chunk[i]);
+
+        for (unsigned i = 0; i < size; ++i)
+            buffer[i] = fastExp(logBuffer[i]);
+
+        for (unsigned i = 0; i < size; ++i)
+            if (not inLogDomain(chunk[i]) or not inExpDomain(logBuffer[i]))
+                buffer[i] = std::pow(chunk[i], y);
+
+        std::copy(buffer, buffer + size, result + start);
+    }
+    #else
+    for (unsigned i = 0; i < n; ++i)
+        result[i] = std::pow(x[i], y);
+    #endif
+}
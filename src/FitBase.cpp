@@ -1,13 +1,30 @@
 #include <FitBase.hpp>
+#include <Tracer.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
 
 
+namespace
+{
+
+/// Returns a new unique identifier for a configuration of a jet correction
+std::uint64_t newConfigId()
+{
+    static std::atomic<std::uint64_t> lastId(0);
+    return ++lastId;
+}
+
+}  // anonymous namespace
+
+
+
 JetCorrBase::JetCorrBase(unsigned numParams):
-    parameters(numParams)
+    parameters(numParams), configId(newConfigId())
 {}
 
 
@@ -21,12 +38,37 @@ double JetCorrBase::Apply(double pt) const
 }
 
 
+std::unique_ptr<JetCorrBase> JetCorrBase::Clone() const
+{
+    throw std::runtime_error("JetCorrBase::Clone: Cloning is not supported by this correction.");
+}
+
+
+void JetCorrBase::EvalBatch(double const *pt, double *corrections, unsigned n) const
+{
+    for (unsigned i = 0; i < n; ++i)
+        corrections[i] = Eval(pt[i]);
+}
+
+
+std::uint64_t JetCorrBase::GetConfigId() const
+{
+    return configId;
+}
+
+
 unsigned JetCorrBase::GetNumParams() const
 {
     return parameters.size();
 }
 
 
+std::pair<double, double> JetCorrBase::GetParamSupport(unsigned) const
+{
+    return {0., std::numeric_limits<double>::infinity()};
+}
+
+
 std::vector<double> const &JetCorrBase::GetParams() const
 {
     return parameters;
@@ -92,6 +134,12 @@ double JetCorrBase::UndoCorr(double pt, double tolerance) const
 }
 
 
+void JetCorrBase::ConfigChanged()
+{
+    configId = newConfigId();
+}
+
+
 std::ostream &operator<<(std::ostream &os, JetCorrBase const &corrector)
 {
     auto const &params = corrector.GetParams();
@@ -108,6 +156,39 @@ std::ostream &operator<<(std::ostream &os, JetCorrBase const &corrector)
 }
 
 
+std::unique_ptr<MeasurementBase> MeasurementBase::Clone() const
+{
+    throw std::runtime_error("MeasurementBase::Clone: Cloning is not supported by this "
+      "measurement.");
+}
+
+
+std::vector<double> MeasurementBase::GetCorrectionPoints() const
+{
+    return {};
+}
+
+
+void MeasurementBase::EvalMany(JetCorrBase &corrector, double const *corrParams,
+  Nuisances const *nuisances, unsigned numPoints, double *results) const
+{
+    unsigned const numCorrParams = corrector.GetNumParams();
+    
+    for (unsigned i = 0; i < numPoints; ++i)
+    {
+        corrector.SetParams(corrParams + i * numCorrParams);
+        results[i] = Eval(corrector, nuisances[i]);
+    }
+}
+
+
+double MeasurementBase::EvalWithCorrections(JetCorrBase const &corrector,
+  Nuisances const &nuisances, double const *) const
+{
+    return Eval(corrector, nuisances);
+}
+
+
 CombLossFunction::CombLossFunction(std::unique_ptr<JetCorrBase> &&corrector_,
   NuisanceDefinitions const &nuisanceDefs):
     corrector(std::move(corrector_)), nuisances(nuisanceDefs)
@@ -123,6 +204,28 @@ CombLossFunction::CombLossFunction(JetCorrBase *corrector_,
 void CombLossFunction::AddMeasurement(MeasurementBase const *measurement)
 {
     measurements.emplace_back(measurement);
+    correctionSets.emplace_back(correctionTable.AddPoints(measurement->GetCorrectionPoints()));
+}
+
+
+std::unique_ptr<CombLossFunction> CombLossFunction::Clone() const
+{
+    auto clone = std::make_unique<CombLossFunction>(corrector->Clone(),
+      nuisances.GetDefinitions());
+    
+    for (auto const &m: measurements)
+    {
+        clone->ownedMeasurements.emplace_back(m->Clone());
+        clone->AddMeasurement(clone->ownedMeasurements.back().get());
+    }
+    
+    return clone;
+}
+
+
+CorrectionTable const &CombLossFunction::GetCorrectionTable() const
+{
+    return correctionTable;
 }
 
 
@@ -162,11 +265,13 @@ double CombLossFunction::Eval(std::vector<double> const &corrParams, Nuisances c
 {
     corrector->SetParams(corrParams);
     nuisances.SetValues(nuisances_);
+    correctionTable.Update(*corrector);
     
     double loss = 0.;
     
-    for (auto const &m: measurements)
-        loss += m->Eval(*corrector, nuisances);
+    for (unsigned i = 0; i < measurements.size(); ++i)
+        loss += measurements[i]->EvalWithCorrections(*corrector, nuisances,
+          correctionTable.GetCorrections(correctionSets[i]));
     
     loss += nuisances.Eval();
     
@@ -176,18 +281,64 @@ double CombLossFunction::Eval(std::vector<double> const &corrParams, Nuisances c
 
 double CombLossFunction::EvalRawInput(double const *x) const
 {
+    TraceSpan span("EvalRawInput", "eval", Tracer::SampleEval());
+    
     // The input array starts from parameters of the jet correction and then followed by values of
     //nuisances
     corrector->SetParams(x);
     nuisances.SetValues(x + corrector->GetNumParams());
     
+    // Evaluate the correction once for all measurements
+    correctionTable.Update(*corrector);
+    
     double loss = 0.;
     
-    for (auto const &m: measurements)
-        loss += m->Eval(*corrector, nuisances);
+    for (unsigned i = 0; i < measurements.size(); ++i)
+        loss += measurements[i]->EvalWithCorrections(*corrector, nuisances,
+          correctionTable.GetCorrections(correctionSets[i]));
     
     loss += nuisances.Eval();
     
     return loss;
 }
 
+
+void CombLossFunction::EvalRawInputMany(double const *x, unsigned numPoints, double *results)
+  const
+{
+    TraceSpan span("EvalRawInputMany", "eval", Tracer::SampleEval());
+    unsigned const numCorrParams = corrector->GetNumParams();
+    unsigned const numParams = GetNumParams();
+    
+    // Buffers are allocated on the first call only
+    batchCorrParams.resize(maxBatchSize * numCorrParams);
+    batchResults.resize(maxBatchSize);
+    
+    while (batchNuisances.size() < maxBatchSize)
+        batchNuisances.emplace_back(nuisances.GetDefinitions());
+    
+    for (unsigned start = 0; start < numPoints; start += maxBatchSize)
+    {
+        unsigned const size = std::min(numPoints - start, maxBatchSize);
+        
+        for (unsigned i = 0; i < size; ++i)
+        {
+            double const *point = x + (start + i) * numParams;
+            std::copy(point, point + numCorrParams, batchCorrParams.begin() + i * numCorrParams);
+            batchNuisances[i].SetValues(point + numCorrParams);
+            results[start + i] = 0.;
+        }
+        
+        for (auto const &m: measurements)
+        {
+            m->EvalMany(*corrector, batchCorrParams.data(), batchNuisances.data(), size,
+              batchResults.data());
+            
+            for (unsigned i = 0; i < size; ++i)
+                results[start + i] += batchResults[i];
+        }
+        
+        for (unsigned i = 0; i < size; ++i)
+            results[start + i] += batchNuisances[i].Eval();
+    }
+}
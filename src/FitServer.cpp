@@ -0,0 +1,965 @@
+#include <FitServer.hpp>
+
+#include <JetCorrDefinitions.hpp>
+#include <JetCorrExpression.hpp>
+
+#include <Minuit2/Minuit2Minimizer.h>
+#include <Math/Functor.h>
+#include <TGraphErrors.h>
+#include <TROOT.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace {
+
+/// Maximal size of a request, in bytes
+constexpr std::uint32_t maxRequestSize = 1u << 30;
+
+
+/**
+ * \class MessageReader
+ * \brief Decodes fields of a request
+ */
+class MessageReader
+{
+public:
+    MessageReader(std::string const &data);
+
+public:
+    /// Checks that all data have been read
+    void CheckEnd() const;
+
+    std::vector<double> ReadArray();
+    double ReadDouble();
+    std::string ReadString();
+    std::uint32_t ReadUInt32();
+    std::uint8_t ReadUInt8();
+
+private:
+    /// Checks that there are at least the given number of unread bytes
+    void Require(std::size_t size) const;
+
+    /// Reads a little-endian 64-bit integer
+    std::uint64_t ReadUInt64();
+
+private:
+    std::string const &data;
+    std::size_t pos;
+};
+
+
+/**
+ * \class MessageWriter
+ * \brief Encodes fields of a response
+ */
+class MessageWriter
+{
+public:
+    std::string const &GetData() const;
+
+    void WriteArray(std::vector<double> const &values);
+    void WriteArray(double const *values, unsigned size);
+    void WriteDouble(double value);
+    void WriteInt32(std::int32_t value);
+    void WriteString(std::string const &value);
+    void WriteUInt32(std::uint32_t value);
+    void WriteUInt8(std::uint8_t value);
+
+private:
+    void WriteUInt64(std::uint64_t value);
+
+private:
+    std::string data;
+};
+
+
+MessageReader::MessageReader(std::string const &data_):
+    data(data_), pos(0)
+{}
+
+
+void MessageReader::CheckEnd() const
+{
+    if (pos != data.size())
+    {
+        std::ostringstream message;
+        message << "MessageReader::CheckEnd: Request contains " << data.size() - pos <<
+          " unexpected trailing bytes.";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+std::vector<double> MessageReader::ReadArray()
+{
+    std::uint32_t const size = ReadUInt32();
+    Require(std::size_t(size) * 8);
+    std::vector<double> values(size);
+
+    for (auto &value: values)
+        value = ReadDouble();
+
+    return values;
+}
+
+
+double MessageReader::ReadDouble()
+{
+    std::uint64_t const bits = ReadUInt64();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+std::string MessageReader::ReadString()
+{
+    std::uint32_t const size = ReadUInt32();
+    Require(size);
+    std::string value(data, pos, size);
+    pos += size;
+    return value;
+}
+
+
+std::uint32_t MessageReader::ReadUInt32()
+{
+    Require(4);
+    std::uint32_t value = 0;
+
+    for (unsigned i = 0; i < 4; ++i)
+        value |= std::uint32_t(std::uint8_t(data[pos + i])) << (8 * i);
+
+    pos += 4;
+    return value;
+}
+
+
+std::uint8_t MessageReader::ReadUInt8()
+{
+    Require(1);
+    return data[pos++];
+}
+
+
+void MessageReader::Require(std::size_t size) const
+{
+    if (data.size() - pos < size)
+        throw std::runtime_error("MessageReader::Require: Request is truncated.");
+}
+
+
+std::uint64_t MessageReader::ReadUInt64()
+{
+    Require(8);
+    std::uint64_t value = 0;
+
+    for (unsigned i = 0; i < 8; ++i)
+        value |= std::uint64_t(std::uint8_t(data[pos + i])) << (8 * i);
+
+    pos += 8;
+    return value;
+}
+
+
+std::string const &MessageWriter::GetData() const
+{
+    return data;
+}
+
+
+void MessageWriter::WriteArray(std::vector<double> const &values)
+{
+    WriteArray(values.data(), values.size());
+}
+
+
+void MessageWriter::WriteArray(double const *values, unsigned size)
+{
+    WriteUInt32(size);
+
+    for (unsigned i = 0; i < size; ++i)
+        WriteDouble(values[i]);
+}
+
+
+void MessageWriter::WriteDouble(double value)
+{
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    WriteUInt64(bits);
+}
+
+
+void MessageWriter::WriteInt32(std::int32_t value)
+{
+    WriteUInt32(std::uint32_t(value));
+}
+
+
+void MessageWriter::WriteString(std::string const &value)
+{
+    WriteUInt32(value.size());
+    data += value;
+}
+
+
+void MessageWriter::WriteUInt32(std::uint32_t value)
+{
+    for (unsigned i = 0; i < 4; ++i)
+        data += char((value >> (8 * i)) & 0xFF);
+}
+
+
+void MessageWriter::WriteUInt8(std::uint8_t value)
+{
+    data += char(value);
+}
+
+
+void MessageWriter::WriteUInt64(std::uint64_t value)
+{
+    for (unsigned i = 0; i < 8; ++i)
+        data += char((value >> (8 * i)) & 0xFF);
+}
+
+
+/// Reads exactly the given number of bytes; returns false if the connection has been closed
+bool ReadAll(int fd, char *buffer, std::size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t const numRead = ::read(fd, buffer, size);
+
+        if (numRead < 0 and errno == EINTR)
+            continue;
+
+        if (numRead <= 0)
+            return false;
+
+        buffer += numRead;
+        size -= numRead;
+    }
+
+    return true;
+}
+
+
+/// Writes all given bytes; returns false if the connection has been closed
+bool WriteAll(int fd, char const *buffer, std::size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t const numWritten = ::send(fd, buffer, size, MSG_NOSIGNAL);
+
+        if (numWritten < 0 and errno == EINTR)
+            continue;
+
+        if (numWritten <= 0)
+            return false;
+
+        buffer += numWritten;
+        size -= numWritten;
+    }
+
+    return true;
+}
+
+
+/// Constructs a message for a failed system call
+std::string SystemError(std::string const &where, std::string const &what)
+{
+    std::ostringstream message;
+    message << where << ": " << what << " failed: " << std::strerror(errno) << ".";
+    return message.str();
+}
+
+}  // anonymous namespace
+
+
+/**
+ * \class FitServer::Context
+ * \brief Copy of the loss function reserved for a single request
+ *
+ * Takes a free copy from the configuration or creates a new one, and returns it back to the
+ * configuration on destruction.
+ */
+class FitServer::Context
+{
+public:
+    Context(Configuration &config);
+    ~Context() noexcept;
+
+public:
+    CombLossFunction &operator*() const;
+
+private:
+    Configuration &config;
+    std::unique_ptr<CombLossFunction> lossFunc;
+};
+
+
+FitServer::Context::Context(Configuration &config_):
+    config(config_)
+{
+    {
+        std::lock_guard<std::mutex> lock(config.contextsMutex);
+
+        if (not config.freeContexts.empty())
+        {
+            lossFunc = std::move(config.freeContexts.back());
+            config.freeContexts.pop_back();
+            return;
+        }
+    }
+
+    lossFunc = config.lossFunc->Clone();
+}
+
+
+FitServer::Context::~Context() noexcept
+{
+    std::lock_guard<std::mutex> lock(config.contextsMutex);
+    config.freeContexts.emplace_back(std::move(lossFunc));
+}
+
+
+CombLossFunction &FitServer::Context::operator*() const
+{
+    return *lossFunc;
+}
+
+
+bool FitServer::ConfigurationSpec::operator==(ConfigurationSpec const &other) const
+{
+    return (inputPath == other.inputPath and method == other.method and
+      corrForm == other.corrForm and constraint == other.constraint and
+      storage == other.storage and excludedSysts == other.excludedSysts and
+      minPtLead == other.minPtLead and maxPtLead == other.maxPtLead);
+}
+
+
+FitServer::FitServer(std::string const &socketPath_):
+    socketPath(socketPath_), listenFd(-1), stopping(false)
+{
+    // Connections are served concurrently, and they read input files and evaluate and fit loss
+    //functions in separate threads
+    ROOT::EnableThreadSafety();
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::ostringstream message;
+        message << "FitServer::FitServer: Socket path \"" << socketPath << "\" is too long.";
+        throw std::runtime_error(message.str());
+    }
+
+    std::strcpy(address.sun_path, socketPath.c_str());
+    auto const *genericAddress = reinterpret_cast<sockaddr const *>(&address);
+
+
+    // Check if another server is listening on the same path. If not, remove the stale socket file.
+    int const probeFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (probeFd < 0)
+        throw std::runtime_error(SystemError("FitServer::FitServer", "socket"));
+
+    bool const isRunning = (::connect(probeFd, genericAddress, sizeof(address)) == 0);
+    ::close(probeFd);
+
+    if (isRunning)
+    {
+        std::ostringstream message;
+        message << "FitServer::FitServer: Another server is already listening on socket \"" <<
+          socketPath << "\".";
+        throw std::runtime_error(message.str());
+    }
+
+    ::unlink(socketPath.c_str());
+
+
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listenFd < 0)
+        throw std::runtime_error(SystemError("FitServer::FitServer", "socket"));
+
+    if (::bind(listenFd, genericAddress, sizeof(address)) != 0 or ::listen(listenFd, 64) != 0)
+    {
+        std::string const message(SystemError("FitServer::FitServer",
+          "Listening on socket \"" + socketPath + "\""));
+        ::close(listenFd);
+        throw std::runtime_error(message);
+    }
+}
+
+
+FitServer::~FitServer() noexcept
+{
+    ::close(listenFd);
+    ::unlink(socketPath.c_str());
+}
+
+
+void FitServer::Load(std::string const &name, ConfigurationSpec const &spec)
+{
+    auto checkExisting = [this, &name, &spec]()
+    {
+        auto const res = configurations.find(name);
+
+        if (res == configurations.end())
+            return false;
+
+        if (not (res->second->spec == spec))
+        {
+            std::ostringstream message;
+            message << "FitServer::Load: Configuration \"" << name << "\" has already been " <<
+              "loaded with a different specification.";
+            throw std::runtime_error(message.str());
+        }
+
+        return true;
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(configurationsMutex);
+
+        if (checkExisting())
+            return;
+    }
+
+    // Reading inputs takes time, so do not block other requests. If several clients load the same
+    //configuration simultaneously, the first one to finish wins.
+    auto config = CreateConfiguration(spec);
+
+    std::lock_guard<std::mutex> lock(configurationsMutex);
+
+    if (not checkExisting())
+        configurations.emplace(name, std::move(config));
+}
+
+
+void FitServer::Run()
+{
+    while (not stopping)
+    {
+        int const fd = ::accept(listenFd, nullptr, nullptr);
+
+        if (fd < 0)
+        {
+            if (stopping)
+                break;
+            else if (errno == EINTR or errno == ECONNABORTED)
+                continue;
+            else
+                throw std::runtime_error(SystemError("FitServer::Run", "accept"));
+        }
+
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+
+        if (stopping)
+        {
+            ::close(fd);
+            break;
+        }
+
+        // Clean up threads for connections that have been closed
+        for (auto it = connectionThreads.begin(); it != connectionThreads.end();)
+        {
+            if (*it->second)
+            {
+                it->first.join();
+                it = connectionThreads.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        auto finished = std::make_shared<std::atomic<bool>>(false);
+        connectionFds.insert(fd);
+        connectionThreads.emplace_back(std::thread([this, fd, finished]()
+        {
+            ServeConnection(fd);
+
+            {
+                std::lock_guard<std::mutex> lock(connectionsMutex);
+                connectionFds.erase(fd);
+            }
+
+            ::close(fd);
+            *finished = true;
+        }), finished);
+    }
+
+
+    // Wait for all connections to be closed
+    decltype(connectionThreads) threads;
+
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        threads.swap(connectionThreads);
+    }
+
+    for (auto &thread: threads)
+        thread.first.join();
+}
+
+
+void FitServer::Stop()
+{
+    stopping = true;
+    ::shutdown(listenFd, SHUT_RDWR);
+
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+
+    for (int const fd: connectionFds)
+        ::shutdown(fd, SHUT_RDWR);
+}
+
+
+std::unique_ptr<FitServer::Configuration> FitServer::CreateConfiguration(
+  ConfigurationSpec const &spec)
+{
+    MultijetCrawlingBins::Method method;
+
+    if (spec.method == "PtBal")
+        method = MultijetCrawlingBins::Method::PtBal;
+    else if (spec.method == "MPF")
+        method = MultijetCrawlingBins::Method::MPF;
+    else
+    {
+        std::ostringstream message;
+        message << "FitServer::CreateConfiguration: Unsupported method \"" << spec.method << "\".";
+        throw std::runtime_error(message.str());
+    }
+
+    FlatHist2D::Storage storage;
+
+    if (spec.storage == "double")
+        storage = FlatHist2D::Storage::Double;
+    else if (spec.storage == "float")
+        storage = FlatHist2D::Storage::Float;
+    else if (spec.storage == "scaled-float")
+        storage = FlatHist2D::Storage::ScaledFloat;
+    else
+    {
+        std::ostringstream message;
+        message << "FitServer::CreateConfiguration: Unsupported storage \"" << spec.storage <<
+          "\".";
+        throw std::runtime_error(message.str());
+    }
+
+    auto createCorrection = [&spec]() -> std::unique_ptr<JetCorrBase>
+    {
+        if (spec.corrForm == "2p")
+            return std::make_unique<JetCorrStd2P>();
+        else if (spec.corrForm == "spline")
+            return std::make_unique<JetCorrSpline>(30., 1500., 5);
+        else if (spec.corrForm == "bspline")
+            return std::make_unique<JetCorrBSpline>(30., 1500., 10);
+        else if (spec.corrForm.compare(0, 5, "expr:") == 0)
+            return std::make_unique<JetCorrExpression>(spec.corrForm.substr(5));
+        else
+        {
+            std::ostringstream message;
+            message << "FitServer::CreateConfiguration: Unknown form of correction \"" <<
+              spec.corrForm << "\".";
+            throw std::runtime_error(message.str());
+        }
+    };
+
+    // Check the correction before the inputs are read since the latter is slow
+    auto corrector = createCorrection();
+
+
+    // Parse the constraint in the same way as the Python wrapper does. The default reference pt
+    //is used if only two numbers are given.
+    std::vector<double> constraintParams;
+
+    if (not spec.constraint.empty())
+    {
+        std::istringstream constraintText(spec.constraint);
+        std::string token;
+
+        try
+        {
+            while (std::getline(constraintText, token, ','))
+                constraintParams.emplace_back(std::stod(token));
+        }
+        catch (std::invalid_argument const &)
+        {
+            constraintParams.clear();
+        }
+
+        if (constraintParams.size() == 2)
+            constraintParams.insert(constraintParams.begin(), 208.);
+
+        if (constraintParams.size() != 3)
+        {
+            std::ostringstream message;
+            message << "FitServer::CreateConfiguration: Failed to parse constraint \"" <<
+              spec.constraint << "\".";
+            throw std::runtime_error(message.str());
+        }
+    }
+
+
+    auto config = std::make_unique<Configuration>();
+    config->spec = spec;
+    config->measurement = std::make_unique<MultijetCrawlingBins>(spec.inputPath, method,
+      config->nuisanceDefs, spec.excludedSysts, storage);
+    config->measurement->SetPtLeadRange(spec.minPtLead, spec.maxPtLead);
+
+    // The nuisance for the constraint is registered after those of the measurement, as in the
+    //Python wrapper
+    if (not constraintParams.empty())
+    {
+        config->constraint = std::make_unique<JetCorrConstraint>(constraintParams[0],
+          constraintParams[1], constraintParams[2]);
+        config->nuisanceDefs.Register("constraint");
+    }
+
+    config->lossFunc = std::make_unique<CombLossFunction>(std::move(corrector),
+      config->nuisanceDefs);
+    config->lossFunc->AddMeasurement(config->measurement.get());
+
+    if (config->constraint)
+        config->lossFunc->AddMeasurement(config->constraint.get());
+
+    config->residualCorrector = createCorrection();
+    config->residualMeasurement = std::make_unique<MultijetCrawlingBins>(*config->measurement);
+
+    return config;
+}
+
+
+FitServer::Configuration &FitServer::GetConfiguration(std::string const &name)
+{
+    std::lock_guard<std::mutex> lock(configurationsMutex);
+    auto const res = configurations.find(name);
+
+    if (res == configurations.end())
+    {
+        std::ostringstream message;
+        message << "FitServer::GetConfiguration: Configuration \"" << name <<
+          "\" has not been loaded.";
+        throw std::runtime_error(message.str());
+    }
+
+    // Configurations are never removed, so the reference remains valid after the lock is released
+    return *res->second;
+}
+
+
+void FitServer::ServeConnection(int fd)
+{
+    std::string request;
+
+    while (true)
+    {
+        char header[4];
+
+        if (not ReadAll(fd, header, 4))
+            return;
+
+        std::uint32_t size = 0;
+
+        for (unsigned i = 0; i < 4; ++i)
+            size |= std::uint32_t(std::uint8_t(header[i])) << (8 * i);
+
+        if (size > maxRequestSize)
+            return;
+
+        request.resize(size);
+
+        if (not ReadAll(fd, &request[0], size))
+            return;
+
+        std::string response;
+
+        try
+        {
+            response = std::string(1, '\0') + HandleRequest(request);
+        }
+        catch (std::exception const &e)
+        {
+            MessageWriter error;
+            error.WriteUInt8(1);
+            error.WriteString(e.what());
+            response = error.GetData();
+        }
+
+        MessageWriter frame;
+        frame.WriteUInt32(response.size());
+        std::string const data = frame.GetData() + response;
+
+        if (not WriteAll(fd, data.data(), data.size()))
+            return;
+    }
+}
+
+
+std::string FitServer::HandleRequest(std::string const &request)
+{
+    MessageReader reader(request);
+    auto const code = Request(reader.ReadUInt8());
+    std::string const name = reader.ReadString();
+    MessageWriter response;
+
+    if (code == Request::Load)
+    {
+        ConfigurationSpec spec;
+        spec.inputPath = reader.ReadString();
+        spec.method = reader.ReadString();
+        spec.corrForm = reader.ReadString();
+        spec.constraint = reader.ReadString();
+        spec.storage = reader.ReadString();
+        std::uint32_t const numExcluded = reader.ReadUInt32();
+
+        for (unsigned i = 0; i < numExcluded; ++i)
+            spec.excludedSysts.insert(reader.ReadString());
+
+        spec.minPtLead = reader.ReadDouble();
+        spec.maxPtLead = reader.ReadDouble();
+        reader.CheckEnd();
+
+        Load(name, spec);
+        auto const &config = GetConfiguration(name);
+
+        unsigned const numParams = config.lossFunc->GetNumParams();
+        unsigned const numNuisances = config.nuisanceDefs.GetNumParams();
+        response.WriteUInt32(numParams - numNuisances);
+        response.WriteUInt32(numNuisances);
+
+        for (auto const &nuisanceName: config.nuisanceDefs.GetNames())
+            response.WriteString(nuisanceName);
+
+        response.WriteUInt32(config.lossFunc->GetNDF());
+        return response.GetData();
+    }
+
+
+    auto &config = GetConfiguration(name);
+    unsigned const numParams = config.lossFunc->GetNumParams();
+    unsigned const numPOI = numParams - config.nuisanceDefs.GetNumParams();
+
+    auto checkSize = [](std::vector<double> const &values, unsigned expectedSize)
+    {
+        if (values.size() != expectedSize)
+        {
+            std::ostringstream message;
+            message << "FitServer::HandleRequest: Received " << values.size() <<
+              " parameters while " << expectedSize << " are expected.";
+            throw std::runtime_error(message.str());
+        }
+    };
+
+    auto checkMultiple = [](std::vector<double> const &values, unsigned pointSize)
+    {
+        if (values.size() % pointSize != 0)
+        {
+            std::ostringstream message;
+            message << "FitServer::HandleRequest: Received " << values.size() <<
+              " values, which is not a multiple of the number of parameters " << pointSize << ".";
+            throw std::runtime_error(message.str());
+        }
+    };
+
+    // Set up a minimizer in the same way as in the Python wrapper. Initial values of parameters
+    //are taken from the given vector if it is not empty.
+    auto setupMinimizer = [&](ROOT::Minuit2::Minuit2Minimizer &minimizer,
+      std::vector<double> const &start)
+    {
+        minimizer.SetStrategy(1);
+        minimizer.SetErrorDef(1.);
+        minimizer.SetPrintLevel(0);
+
+        for (unsigned i = 0; i < numPOI; ++i)
+        {
+            minimizer.SetVariable(i, "p" + std::to_string(i), 0., 1e-2);
+            minimizer.SetVariableLimits(i, -1., 1.);
+        }
+
+        for (unsigned i = numPOI; i < numParams; ++i)
+        {
+            minimizer.SetVariable(i, config.nuisanceDefs.GetName(i - numPOI), 0., 1.);
+            minimizer.SetVariableLimits(i, -5., 5.);
+        }
+
+        for (unsigned i = 0; i < start.size(); ++i)
+            minimizer.SetVariableValue(i, start[i]);
+    };
+
+
+    switch (code)
+    {
+        case Request::Eval:
+        {
+            auto const x = reader.ReadArray();
+            reader.CheckEnd();
+            checkSize(x, numParams);
+
+            Context context(config);
+            response.WriteDouble((*context).EvalRawInput(x.data()));
+            break;
+        }
+
+        case Request::EvalBatch:
+        {
+            auto const x = reader.ReadArray();
+            reader.CheckEnd();
+
+            checkMultiple(x, numParams);
+
+            Context context(config);
+            unsigned const numPoints = x.size() / numParams;
+            std::vector<double> values(numPoints);
+            (*context).EvalRawInputMany(x.data(), numPoints, values.data());
+
+            response.WriteArray(values);
+            break;
+        }
+
+        case Request::Fit:
+        {
+            auto const start = reader.ReadArray();
+            std::uint32_t const numFixed = reader.ReadUInt32();
+            std::vector<std::pair<unsigned, double>> fixed;
+
+            for (unsigned i = 0; i < numFixed; ++i)
+            {
+                unsigned const index = reader.ReadUInt32();
+                fixed.emplace_back(index, reader.ReadDouble());
+            }
+
+            reader.CheckEnd();
+
+            if (not start.empty())
+                checkSize(start, numParams);
+
+            Context context(config);
+            ROOT::Minuit2::Minuit2Minimizer minimizer;
+            ROOT::Math::Functor func(&*context, &CombLossFunction::EvalRawInput, numParams);
+            minimizer.SetFunction(func);
+            setupMinimizer(minimizer, start);
+
+            for (auto const &f: fixed)
+            {
+                if (f.first >= numParams)
+                    throw std::runtime_error("FitServer::HandleRequest: Index of fixed "
+                      "parameter is out of range.");
+
+                minimizer.SetVariableValue(f.first, f.second);
+                minimizer.FixVariable(f.first);
+            }
+
+            minimizer.Minimize();
+
+            response.WriteInt32(minimizer.Status());
+            response.WriteInt32(minimizer.CovMatrixStatus());
+            response.WriteDouble(minimizer.MinValue());
+            response.WriteArray(minimizer.X(), numParams);
+            response.WriteArray(minimizer.Errors(), numParams);
+
+            std::vector<double> covariance(numParams * numParams);
+
+            for (unsigned i = 0; i < numParams; ++i)
+                for (unsigned j = 0; j < numParams; ++j)
+                    covariance[i * numParams + j] = minimizer.CovMatrix(i, j);
+
+            response.WriteArray(covariance);
+            break;
+        }
+
+        case Request::Scan:
+        {
+            auto const start = reader.ReadArray();
+            auto const poiValues = reader.ReadArray();
+            reader.CheckEnd();
+
+            if (not start.empty())
+                checkSize(start, numParams);
+
+            checkMultiple(poiValues, numPOI);
+
+            Context context(config);
+            unsigned const numPoints = poiValues.size() / numPOI;
+            std::vector<double> values(numPoints);
+
+            for (unsigned iPoint = 0; iPoint < numPoints; ++iPoint)
+            {
+                double const *poi = poiValues.data() + iPoint * numPOI;
+
+                // If there are no nuisances, nothing to profile
+                if (numPOI == numParams)
+                {
+                    values[iPoint] = (*context).EvalRawInput(poi);
+                    continue;
+                }
+
+                ROOT::Minuit2::Minuit2Minimizer minimizer;
+                ROOT::Math::Functor func(&*context, &CombLossFunction::EvalRawInput, numParams);
+                minimizer.SetFunction(func);
+                setupMinimizer(minimizer, start);
+
+                for (unsigned i = 0; i < numPOI; ++i)
+                {
+                    minimizer.SetVariableValue(i, poi[i]);
+                    minimizer.FixVariable(i);
+                }
+
+                minimizer.Minimize();
+                values[iPoint] = minimizer.MinValue();
+            }
+
+            response.WriteArray(values);
+            break;
+        }
+
+        case Request::Residuals:
+        {
+            auto const x = reader.ReadArray();
+            reader.CheckEnd();
+            checkSize(x, numParams);
+
+            std::lock_guard<std::mutex> lock(config.residualsMutex);
+            config.residualCorrector->SetParams(x.data());
+            Nuisances nuisances(config.nuisanceDefs);
+            nuisances.SetValues(x.data() + numPOI);
+
+            TGraphErrors const graph(
+              config.residualMeasurement->ComputeResiduals(*config.residualCorrector,
+                nuisances));
+            unsigned const numPoints = graph.GetN();
+            std::vector<double> yErrors(numPoints);
+
+            for (unsigned i = 0; i < numPoints; ++i)
+                yErrors[i] = graph.GetErrorY(i);
+
+            response.WriteArray(graph.GetX(), numPoints);
+            response.WriteArray(graph.GetY(), numPoints);
+            response.WriteArray(yErrors);
+            break;
+        }
+
+        default:
+        {
+            std::ostringstream message;
+            message << "FitServer::HandleRequest: Unknown request code " << int(code) << ".";
+            throw std::runtime_error(message.str());
+        }
+    }
+
+    return response.GetData();
+}
@@ -0,0 +1,235 @@
+#include <FlatHist2D.hpp>
+
+#include <Kernels.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+
+double StoragePrecision::Deviation(double value, double reference)
+{
+    if (reference == 0.)
+        return std::abs(value);
+    else
+        return std::abs(value / reference - 1.);
+}
+
+
+
+FlatHist2D::FlatHist2D():
+    numBinsX(0), numBinsY(0), storage(Storage::Double)
+{}
+
+
+FlatHist2D::FlatHist2D(TH2 const &hist, Storage storage_):
+    numBinsX(hist.GetNbinsX()), numBinsY(hist.GetNbinsY()),
+    storage(Storage::Double)
+{
+    contents.reserve(numBinsX * numBinsY);
+
+    for (unsigned binX = 1; binX <= numBinsX; ++binX)
+        for (unsigned binY = 1; binY <= numBinsY; ++binY)
+            contents.emplace_back(hist.GetBinContent(binX, binY));
+
+    SetStorage(storage_);
+}
+
+
+double FlatHist2D::Dot(unsigned binX, double const *weights, unsigned firstBinY,
+  unsigned lastBinY) const
+{
+    if (lastBinY < firstBinY)
+        return 0.;
+
+    unsigned const offset = (binX - 1) * numBinsY + firstBinY - 1;
+    unsigned const n = lastBinY - firstBinY + 1;
+    weights += firstBinY - 1;
+
+    switch (storage)
+    {
+        case Storage::Float:
+            return dotProductCompensated(compactContents.data() + offset, weights, n);
+
+        case Storage::ScaledFloat:
+            return rowScales[binX - 1] *
+              dotProductCompensated(compactContents.data() + offset, weights, n);
+
+        default:
+            return dotProduct(contents.data() + offset, weights, n);
+    }
+}
+
+
+std::array<double, 2> FlatHist2D::DotPair(unsigned binX, double const *weights1,
+  double const *weights2, unsigned firstBinY, unsigned lastBinY) const
+{
+    if (lastBinY < firstBinY)
+        return {0., 0.};
+
+    unsigned const offset = (binX - 1) * numBinsY + firstBinY - 1;
+    unsigned const n = lastBinY - firstBinY + 1;
+    weights1 += firstBinY - 1;
+    weights2 += firstBinY - 1;
+
+    switch (storage)
+    {
+        case Storage::Float:
+            return dotProductCompensatedPair(compactContents.data() + offset, weights1, weights2,
+              n);
+
+        case Storage::ScaledFloat:
+        {
+            auto const sums = dotProductCompensatedPair(compactContents.data() + offset,
+              weights1, weights2, n);
+            double const scale = rowScales[binX - 1];
+            return {scale * sums[0], scale * sums[1]};
+        }
+
+        default:
+            return dotProductPair(contents.data() + offset, weights1, weights2, n);
+    }
+}
+
+
+double FlatHist2D::GetBinContent(unsigned binX, unsigned binY) const
+{
+    unsigned const index = (binX - 1) * numBinsY + binY - 1;
+
+    switch (storage)
+    {
+        case Storage::Float:
+            return compactContents[index];
+
+        case Storage::ScaledFloat:
+            return rowScales[binX - 1] * compactContents[index];
+
+        default:
+            return contents[index];
+    }
+}
+
+
+std::size_t FlatHist2D::GetMemorySize() const
+{
+    return contents.size() * sizeof(double) + compactContents.size() * sizeof(float) +
+      rowScales.size() * sizeof(double);
+}
+
+
+unsigned FlatHist2D::GetNbinsX() const
+{
+    return numBinsX;
+}
+
+
+unsigned FlatHist2D::GetNbinsY() const
+{
+    return numBinsY;
+}
+
+
+FlatHist2D::Storage FlatHist2D::GetStorage() const
+{
+    return storage;
+}
+
+
+void FlatHist2D::MultiplyRows(unsigned firstBinX, unsigned lastBinX, double const *weights,
+  unsigned numColumns, unsigned firstBinY, unsigned lastBinY, double *results) const
+{
+    if (lastBinX < firstBinX)
+        return;
+
+    unsigned const numRows = lastBinX - firstBinX + 1;
+
+    if (lastBinY < firstBinY)
+    {
+        std::fill(results, results + numRows * numColumns, 0.);
+        return;
+    }
+
+    unsigned const offset = (firstBinX - 1) * numBinsY + firstBinY - 1;
+    unsigned const n = lastBinY - firstBinY + 1;
+    weights += (firstBinY - 1) * numColumns;
+
+    switch (storage)
+    {
+        case Storage::Float:
+            matrixProduct(compactContents.data() + offset, numBinsY, weights, results, numRows,
+              n, numColumns);
+            break;
+
+        case Storage::ScaledFloat:
+            matrixProduct(compactContents.data() + offset, numBinsY, weights, results, numRows,
+              n, numColumns);
+
+            for (unsigned row = 0; row < numRows; ++row)
+            {
+                double const scale = rowScales[firstBinX - 1 + row];
+
+                for (unsigned j = 0; j < numColumns; ++j)
+                    results[row * numColumns + j] *= scale;
+            }
+
+            break;
+
+        default:
+            matrixProduct(contents.data() + offset, numBinsY, weights, results, numRows, n,
+              numColumns);
+    }
+}
+
+
+void FlatHist2D::SetStorage(Storage newStorage)
+{
+    if (newStorage == storage)
+        return;
+
+    // Restore double-precision contents first, so that only one conversion needs to be
+    // implemented for each mode
+    if (storage != Storage::Double)
+    {
+        contents.resize(numBinsX * numBinsY);
+
+        for (unsigned binX = 1; binX <= numBinsX; ++binX)
+            for (unsigned binY = 1; binY <= numBinsY; ++binY)
+                contents[(binX - 1) * numBinsY + binY - 1] = GetBinContent(binX, binY);
+
+        compactContents = std::vector<float>();
+        rowScales = std::vector<double>();
+        storage = Storage::Double;
+    }
+
+    if (newStorage == Storage::Double)
+        return;
+
+
+    compactContents.resize(contents.size());
+
+    if (newStorage == Storage::ScaledFloat)
+    {
+        rowScales.assign(numBinsX, 1.);
+
+        for (unsigned row = 0; row < numBinsX; ++row)
+        {
+            auto const rowBegin = contents.begin() + row * numBinsY;
+            double maxAbs = 0.;
+
+            for (auto it = rowBegin; it != rowBegin + numBinsY; ++it)
+                maxAbs = std::max(maxAbs, std::abs(*it));
+
+            if (maxAbs > 0.)
+                rowScales[row] = maxAbs;
+        }
+    }
+
+    for (unsigned i = 0; i < contents.size(); ++i)
+    {
+        double const scale = (newStorage == Storage::ScaledFloat) ? rowScales[i / numBinsY] : 1.;
+        compactContents[i] = contents[i] / scale;
+    }
+
+    // Release the double-precision copy
+    contents = std::vector<double>();
+    storage = newStorage;
+}
@@ -9,6 +9,12 @@ JetCorrConstraint::JetCorrConstraint(double ptRef_, double targetCorrection_,
 {}
 
 
+std::unique_ptr<MeasurementBase> JetCorrConstraint::Clone() const
+{
+    return std::make_unique<JetCorrConstraint>(*this);
+}
+
+
 unsigned JetCorrConstraint::GetDim() const
 {
     return 1;
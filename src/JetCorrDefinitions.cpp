@@ -1,7 +1,10 @@
 #include <JetCorrDefinitions.hpp>
 
+#include <FastMath.hpp>
+
 #include <algorithm>
 #include <cmath>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
 
@@ -12,11 +15,17 @@ JetCorrStableLogLin::JetCorrStableLogLin(double ptMin_):
 {}
 
 
+std::unique_ptr<JetCorrBase> JetCorrStableLogLin::Clone() const
+{
+    return std::make_unique<JetCorrStableLogLin>(*this);
+}
+
+
 double JetCorrStableLogLin::Eval(double pt) const
 {
     double const b = 1.;
-    return 1. + parameters[0] * std::log(pt / ptMin) +
-      parameters[0] / b * (std::pow(pt / ptMin, -b) - 1);
+    return 1. + parameters[0] * mathLog(pt / ptMin) +
+      parameters[0] / b * (mathPow(pt / ptMin, -b) - 1);
 }
 
 
@@ -27,6 +36,12 @@ JetCorrStd2P::JetCorrStd2P():
 {}
 
 
+std::unique_ptr<JetCorrBase> JetCorrStd2P::Clone() const
+{
+    return std::make_unique<JetCorrStd2P>(*this);
+}
+
+
 double JetCorrStd2P::Eval(double pt) const
 {
     double response = 1. + parameters[0] + parameters[1] / 0.03 * (fSPR(pt) - fSPR(ptRef));
@@ -34,6 +49,22 @@ double JetCorrStd2P::Eval(double pt) const
 }
 
 
+void JetCorrStd2P::EvalBatch(double const *pt, double *corrections, unsigned n) const
+{
+    // The power function is the most expensive part of the computation. Evaluate it for all
+    //values at once, which allows the computation to be vectorized.
+    mathPowBatch(pt, paramsSPR[2], corrections, n);
+    double const sprRef = fSPR(ptRef);
+    
+    for (unsigned i = 0; i < n; ++i)
+    {
+        double const response = 1. + parameters[0] +
+          parameters[1] / 0.03 * (fSPRFromPower(corrections[i]) - sprRef);
+        corrections[i] = 1 / response;
+    }
+}
+
+
 void JetCorrStd2P::SetParamsSPR(std::initializer_list<double> paramsSPR_)
 {
     if (paramsSPR_.size() != paramsSPR.size())
@@ -45,12 +76,19 @@ void JetCorrStd2P::SetParamsSPR(std::initializer_list<double> paramsSPR_)
     }
     
     std::copy(paramsSPR_.begin(), paramsSPR_.end(), paramsSPR.begin());
+    ConfigChanged();
 }
 
 
 double JetCorrStd2P::fSPR(double pt) const
 {
-    return std::max(0., paramsSPR[0] + paramsSPR[1] * std::pow(pt, paramsSPR[2]));
+    return fSPRFromPower(mathPow(pt, paramsSPR[2]));
+}
+
+
+double JetCorrStd2P::fSPRFromPower(double power) const
+{
+    return std::max(0., paramsSPR[0] + paramsSPR[1] * power);
 }
 
 
@@ -63,6 +101,12 @@ JetCorrStd3P::JetCorrStd3P():
 }
 
 
+std::unique_ptr<JetCorrBase> JetCorrStd3P::Clone() const
+{
+    return std::make_unique<JetCorrStd3P>(*this);
+}
+
+
 double JetCorrStd3P::Eval(double pt) const
 {
     double response = 1. + parameters[0] + \
@@ -72,6 +116,33 @@ double JetCorrStd3P::Eval(double pt) const
 }
 
 
+void JetCorrStd3P::EvalBatch(double const *pt, double *corrections, unsigned n) const
+{
+    double const sprRef = fSPR(ptRef), l1Ref = fL1(ptRef);
+    
+    // Both powers and logarithms of pt are needed. Compute them in chunks to avoid a memory
+    //allocation. They are stored in local buffers because the output array may coincide with the
+    //input one and thus must only be written after pt has been read.
+    unsigned const chunkSize = 64;
+    double powers[chunkSize], logPts[chunkSize];
+    
+    for (unsigned start = 0; start < n; start += chunkSize)
+    {
+        unsigned const size = std::min(n - start, chunkSize);
+        mathPowBatch(pt + start, paramsSPR[2], powers, size);
+        mathLogBatch(pt + start, logPts, size);
+        
+        for (unsigned i = 0; i < size; ++i)
+        {
+            double const response = 1. + parameters[0] +
+              parameters[1] / 0.03 * (fSPRFromPower(powers[i]) - sprRef) +
+              parameters[2] * (fL1FromLog(pt[start + i], logPts[i]) - l1Ref);
+            corrections[start + i] = 1 / response;
+        }
+    }
+}
+
+
 void JetCorrStd3P::SetParamsL1(std::initializer_list<double> paramsL1_)
 {
     if (paramsL1_.size() != paramsL1.size())
@@ -83,12 +154,19 @@ void JetCorrStd3P::SetParamsL1(std::initializer_list<double> paramsL1_)
     }
     
     std::copy(paramsL1_.begin(), paramsL1_.end(), paramsL1.begin());
+    ConfigChanged();
 }
 
 
 double JetCorrStd3P::fL1(double pt) const
 {
-    return 1. - (paramsL1[0] + paramsL1[1] * std::log(pt)) / pt;
+    return fL1FromLog(pt, mathLog(pt));
+}
+
+
+double JetCorrStd3P::fL1FromLog(double pt, double logPt) const
+{
+    return 1. - (paramsL1[0] + paramsL1[1] * logPt) / pt;
 }
 
 
@@ -121,10 +199,37 @@ JetCorrSpline::JetCorrSpline(std::vector<double> const &ptKnots):
 }
 
 
+JetCorrSpline::JetCorrSpline(JetCorrSpline const &src):
+    JetCorrBase(src),
+    knots(src.knots)
+{
+    ParamsUpdatedHook();
+}
+
+
+std::unique_ptr<JetCorrBase> JetCorrSpline::Clone() const
+{
+    return std::make_unique<JetCorrSpline>(*this);
+}
+
+
 double JetCorrSpline::Eval(double pt) const
 {
-    double const logPt = std::log(pt);
+    return EvalLog(mathLog(pt));
+}
+
+
+void JetCorrSpline::EvalBatch(double const *pt, double *corrections, unsigned n) const
+{
+    mathLogBatch(pt, corrections, n);
 
+    for (unsigned i = 0; i < n; ++i)
+        corrections[i] = EvalLog(corrections[i]);
+}
+
+
+double JetCorrSpline::EvalLog(double logPt) const
+{
     // Interpolate between the knots using the spline but extrapolate linearly
     if (logPt < knots.front())
     {
@@ -147,3 +252,151 @@ void JetCorrSpline::ParamsUpdatedHook()
     corrSpline.reset(new TSpline3("", knots.data(), parameters.data(), knots.size()));
 }
 
+
+
+JetCorrBSpline::JetCorrBSpline(double minPt, double maxPt, unsigned numBreakpoints):
+    JetCorrBase(numBreakpoints + 2)
+{
+    // Equidistant breakpoints in log(pt)
+    std::vector<double> logBreakpoints;
+    logBreakpoints.reserve(numBreakpoints);
+    double const logMinPt = std::log(minPt), logMaxPt = std::log(maxPt);
+    double const step = (logMaxPt - logMinPt) / (numBreakpoints - 1);
+
+    for (unsigned i = 0; i + 1 < numBreakpoints; ++i)
+        logBreakpoints.emplace_back(logMinPt + step * i);
+
+    logBreakpoints.emplace_back(logMaxPt);
+    BuildKnots(logBreakpoints);
+}
+
+
+JetCorrBSpline::JetCorrBSpline(std::vector<double> const &ptBreakpoints):
+    JetCorrBase(ptBreakpoints.size() + 2)
+{
+    std::vector<double> logBreakpoints;
+    logBreakpoints.reserve(ptBreakpoints.size());
+
+    for (auto const &pt: ptBreakpoints)
+        logBreakpoints.emplace_back(std::log(pt));
+
+    BuildKnots(logBreakpoints);
+}
+
+
+std::unique_ptr<JetCorrBase> JetCorrBSpline::Clone() const
+{
+    return std::make_unique<JetCorrBSpline>(*this);
+}
+
+
+double JetCorrBSpline::Eval(double pt) const
+{
+    return EvalLog(mathLog(pt));
+}
+
+
+void JetCorrBSpline::EvalBatch(double const *pt, double *corrections, unsigned n) const
+{
+    mathLogBatch(pt, corrections, n);
+
+    for (unsigned i = 0; i < n; ++i)
+        corrections[i] = EvalLog(corrections[i]);
+}
+
+
+std::pair<double, double> JetCorrBSpline::GetParamSupport(unsigned index) const
+{
+    if (index >= GetNumParams())
+    {
+        std::ostringstream message;
+        message << "JetCorrBSpline::GetParamSupport: Index " << index << " is out of range " <<
+          "for a correction with " << GetNumParams() << " parameters.";
+        throw std::runtime_error(message.str());
+    }
+
+    double const inf = std::numeric_limits<double>::infinity();
+
+    // Basis function with the given index is non-zero between knots index and (index + 4). The
+    //first two and the last two parameters also define the linear extrapolation.
+    double const minLogPt = (index < 2) ? -inf : knots[index];
+    double const maxLogPt = (index + 2 >= GetNumParams()) ? inf : knots[index + 4];
+    double const margin = 1e-9;
+
+    return {std::exp(minLogPt) * (1 - margin), std::exp(maxLogPt) * (1 + margin)};
+}
+
+
+void JetCorrBSpline::BuildKnots(std::vector<double> const &logBreakpoints)
+{
+    if (logBreakpoints.size() < 2)
+    {
+        std::ostringstream message;
+        message << "JetCorrBSpline::BuildKnots: At least two breakpoints are needed while " <<
+          logBreakpoints.size() << " given.";
+        throw std::runtime_error(message.str());
+    }
+
+    for (unsigned i = 1; i < logBreakpoints.size(); ++i)
+    {
+        if (not (logBreakpoints[i] > logBreakpoints[i - 1]))
+        {
+            std::ostringstream message;
+            message << "JetCorrBSpline::BuildKnots: Breakpoints are not strictly increasing.";
+            throw std::runtime_error(message.str());
+        }
+    }
+
+    knots.clear();
+    knots.reserve(logBreakpoints.size() + 6);
+    knots.insert(knots.end(), 3, logBreakpoints.front());
+    knots.insert(knots.end(), logBreakpoints.begin(), logBreakpoints.end());
+    knots.insert(knots.end(), 3, logBreakpoints.back());
+}
+
+
+double JetCorrBSpline::EvalLog(double logPt) const
+{
+    unsigned const numParams = GetNumParams();
+    double const minLogPt = knots[3], maxLogPt = knots[numParams];
+
+    // Extrapolate linearly using the derivative of the spline at the boundary. For the clamped
+    //knot vector, it is determined by the two outermost coefficients.
+    if (logPt < minLogPt)
+    {
+        double const slope = 3 * (parameters[1] - parameters[0]) / (knots[4] - minLogPt);
+        return 1 + parameters[0] + slope * (logPt - minLogPt);
+    }
+    else if (logPt > maxLogPt)
+    {
+        double const slope = 3 * (parameters[numParams - 1] - parameters[numParams - 2]) /
+          (maxLogPt - knots[numParams - 1]);
+        return 1 + parameters[numParams - 1] + slope * (logPt - maxLogPt);
+    }
+
+
+    // Find the knot span, i.e. index s such that knots[s] <= logPt < knots[s + 1], with the last
+    //breakpoint included in the last span. Only basis functions with indices from s - 3 to s are
+    //non-zero in it.
+    unsigned const span = std::upper_bound(knots.begin() + 4, knots.begin() + numParams, logPt) -
+      knots.begin() - 1;
+
+
+    // Evaluate the spline with de Boor's algorithm
+    double d[4];
+
+    for (unsigned j = 0; j < 4; ++j)
+        d[j] = parameters[span - 3 + j];
+
+    for (unsigned r = 1; r < 4; ++r)
+    {
+        for (unsigned j = 3; j >= r; --j)
+        {
+            unsigned const i = span - 3 + j;
+            double const alpha = (logPt - knots[i]) / (knots[i + 4 - r] - knots[i]);
+            d[j] = (1 - alpha) * d[j - 1] + alpha * d[j];
+        }
+    }
+
+    return 1 + d[3];
+}
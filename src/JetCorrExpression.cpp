@@ -0,0 +1,849 @@
+#include <JetCorrExpression.hpp>
+
+#include <FastMath.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+
+using namespace std::string_literals;
+
+
+namespace
+{
+
+/// Computes an integer power with repeated multiplications
+inline double powInt(double base, int exponent)
+{
+    double result = 1.;
+
+    for (int i = 0; i < std::abs(exponent); ++i)
+        result *= base;
+
+    return (exponent < 0) ? 1. / result : result;
+}
+
+}  // anonymous namespace
+
+
+
+/**
+ * \struct JetCorrExpression::Node
+ * \brief Node of an immutable expression tree
+ *
+ * Subtrees can be shared among different trees.
+ */
+struct JetCorrExpression::Node
+{
+    /// Creates a constant
+    static std::shared_ptr<Node const> Const(double value);
+
+    /// Creates a leaf that represents a parameter, log(pt), or pt
+    static std::shared_ptr<Node const> Leaf(OpCode op, unsigned index = 0);
+
+    /// Creates an integer power of the given node, simplifying it if possible
+    static std::shared_ptr<Node const> PowInt(std::shared_ptr<Node const> base, int exponent);
+
+    /// Checks if this node is a constant with the given value
+    bool IsConst(double v) const;
+
+    /// Operation
+    OpCode op;
+
+    /// Value of the constant or the exponent for an integer power
+    double value;
+
+    /// Index of the parameter
+    unsigned index;
+
+    /// Operands; the right one is only set for binary operations
+    std::shared_ptr<Node const> left, right;
+};
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Node::Const(double value)
+{
+    return std::make_shared<Node const>(Node{OpCode::Const, value, 0, nullptr, nullptr});
+}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Node::Leaf(OpCode op,
+  unsigned index)
+{
+    return std::make_shared<Node const>(Node{op, 0., index, nullptr, nullptr});
+}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Node::PowInt(
+  std::shared_ptr<Node const> base, int exponent)
+{
+    if (exponent == 0)
+        return Const(1.);
+    else if (exponent == 1)
+        return base;
+    else if (base->op == OpCode::Const)
+        return Const(powInt(base->value, exponent));
+    else
+        return std::make_shared<Node const>(Node{OpCode::PowInt, double(exponent), 0, base,
+          nullptr});
+}
+
+
+bool JetCorrExpression::Node::IsConst(double v) const
+{
+    return (op == OpCode::Const and value == v);
+}
+
+
+
+/**
+ * \class JetCorrExpression::Parser
+ * \brief Recursive-descent parser that constructs an expression tree from a formula
+ *
+ * The grammar, from the lowest to the highest precedence, is
+ *   sum      := product (('+' | '-') product)*
+ *   product  := unary (('*' | '/') unary)*
+ *   unary    := ('-' | '+') unary | power
+ *   power    := primary ('^' unary)?
+ *   primary  := number | identifier | function '(' arguments ')' | '(' sum ')'
+ */
+class JetCorrExpression::Parser
+{
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param text  Formula to parse.
+     * \param paramNames  Names of known parameters.
+     * \param registerParams  If true, unknown identifiers are added to paramNames. Otherwise they
+     *     result in an error.
+     */
+    Parser(std::string const &text, std::vector<std::string> &paramNames, bool registerParams);
+
+public:
+    /// Parses the full formula
+    std::shared_ptr<Node const> Parse();
+
+private:
+    /// Consumes the given character if it is the next non-space character
+    bool Accept(char c);
+
+    /// Consumes the given character, throwing an exception if it is not found
+    void Expect(char c);
+
+    /// Throws an exception with the given reason, reporting the current position
+    [[noreturn]] void Fail(std::string const &reason) const;
+
+    std::shared_ptr<Node const> ParsePower();
+    std::shared_ptr<Node const> ParsePrimary();
+    std::shared_ptr<Node const> ParseProduct();
+    std::shared_ptr<Node const> ParseSum();
+    std::shared_ptr<Node const> ParseUnary();
+
+    /// Skips white spaces
+    void SkipSpaces();
+
+private:
+    std::string const &text;
+    std::vector<std::string> &paramNames;
+    bool registerParams;
+
+    /// Current position in the text
+    std::size_t pos;
+};
+
+
+JetCorrExpression::Parser::Parser(std::string const &text_,
+  std::vector<std::string> &paramNames_, bool registerParams_):
+    text(text_), paramNames(paramNames_), registerParams(registerParams_), pos(0)
+{}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Parser::Parse()
+{
+    auto const tree = ParseSum();
+    SkipSpaces();
+
+    if (pos != text.size())
+        Fail("unexpected character '"s + text[pos] + "'");
+
+    return tree;
+}
+
+
+bool JetCorrExpression::Parser::Accept(char c)
+{
+    SkipSpaces();
+
+    if (pos < text.size() and text[pos] == c)
+    {
+        ++pos;
+        return true;
+    }
+    else
+        return false;
+}
+
+
+void JetCorrExpression::Parser::Expect(char c)
+{
+    if (not Accept(c))
+        Fail("expected '"s + c + "'");
+}
+
+
+void JetCorrExpression::Parser::Fail(std::string const &reason) const
+{
+    std::ostringstream message;
+    message << "JetCorrExpression::JetCorrExpression: Failed to parse formula \"" << text <<
+      "\" at position " << pos << ": " << reason << ".";
+    throw std::runtime_error(message.str());
+}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Parser::ParsePower()
+{
+    auto const base = ParsePrimary();
+
+    // The exponent is parsed as a unary expression, which makes the operator right-associative
+    if (Accept('^'))
+        return MakeNode(OpCode::Pow, base, ParseUnary());
+    else
+        return base;
+}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Parser::ParsePrimary()
+{
+    SkipSpaces();
+
+    if (pos == text.size())
+        Fail("unexpected end of formula");
+
+    if (Accept('('))
+    {
+        auto const node = ParseSum();
+        Expect(')');
+        return node;
+    }
+
+    char const c = text[pos];
+
+    if (std::isdigit(c) or c == '.')
+    {
+        char const *start = text.c_str() + pos;
+        char *end;
+        double const value = std::strtod(start, &end);
+
+        if (end == start)
+            Fail("malformed number");
+
+        pos += end - start;
+        return Node::Const(value);
+    }
+
+    if (not (std::isalpha(c) or c == '_'))
+        Fail("unexpected character '"s + c + "'");
+
+    std::size_t const start = pos;
+
+    while (pos < text.size() and (std::isalnum(text[pos]) or text[pos] == '_'))
+        ++pos;
+
+    std::string const name(text, start, pos - start);
+
+
+    // Function call
+    if (Accept('('))
+    {
+        auto const argument = ParseSum();
+
+        if (name == "pow")
+        {
+            Expect(',');
+            auto const exponent = ParseSum();
+            Expect(')');
+            return MakeNode(OpCode::Pow, argument, exponent);
+        }
+
+        Expect(')');
+
+        if (name == "exp")
+            return MakeNode(OpCode::Exp, argument);
+        else if (name == "log")
+            return MakeNode(OpCode::Log, argument);
+        else if (name == "sqrt")
+            return MakeNode(OpCode::Sqrt, argument);
+        else
+            Fail("unknown function \"" + name + "\"");
+    }
+
+
+    // Variables and parameters
+    if (name == "x")
+        return Node::Leaf(OpCode::LogPt);
+    else if (name == "pt")
+        return Node::Leaf(OpCode::Pt);
+
+    auto const paramIt = std::find(paramNames.begin(), paramNames.end(), name);
+
+    if (paramIt != paramNames.end())
+        return Node::Leaf(OpCode::Param, paramIt - paramNames.begin());
+
+    if (not registerParams)
+        Fail("unknown parameter \"" + name + "\"");
+
+    paramNames.emplace_back(name);
+    return Node::Leaf(OpCode::Param, paramNames.size() - 1);
+}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Parser::ParseProduct()
+{
+    auto node = ParseUnary();
+
+    while (true)
+    {
+        if (Accept('*'))
+            node = MakeNode(OpCode::Mul, node, ParseUnary());
+        else if (Accept('/'))
+            node = MakeNode(OpCode::Div, node, ParseUnary());
+        else
+            return node;
+    }
+}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Parser::ParseSum()
+{
+    auto node = ParseProduct();
+
+    while (true)
+    {
+        if (Accept('+'))
+            node = MakeNode(OpCode::Add, node, ParseProduct());
+        else if (Accept('-'))
+            node = MakeNode(OpCode::Sub, node, ParseProduct());
+        else
+            return node;
+    }
+}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Parser::ParseUnary()
+{
+    if (Accept('-'))
+        return MakeNode(OpCode::Neg, ParseUnary());
+    else if (Accept('+'))
+        return ParseUnary();
+    else
+        return ParsePower();
+}
+
+
+void JetCorrExpression::Parser::SkipSpaces()
+{
+    while (pos < text.size() and std::isspace(text[pos]))
+        ++pos;
+}
+
+
+
+JetCorrExpression::JetCorrExpression(std::string const &formula_):
+    JetCorrBase(0),
+    formula(formula_)
+{
+    Compile(true);
+}
+
+
+JetCorrExpression::JetCorrExpression(std::string const &formula_,
+  std::vector<std::string> const &paramNames_):
+    JetCorrBase(0),
+    formula(formula_), paramNames(paramNames_)
+{
+    Compile(false);
+}
+
+
+std::unique_ptr<JetCorrBase> JetCorrExpression::Clone() const
+{
+    return std::make_unique<JetCorrExpression>(*this);
+}
+
+
+double JetCorrExpression::Eval(double pt) const
+{
+    return Execute(program, pt);
+}
+
+
+void JetCorrExpression::EvalBatch(double const *pt, double *corrections, unsigned n) const
+{
+    ExecuteBatch(program, pt, corrections, n);
+}
+
+
+double JetCorrExpression::EvalParamDerivative(unsigned index, double pt) const
+{
+    return Execute(derivativePrograms.at(index), pt);
+}
+
+
+void JetCorrExpression::EvalParamDerivativeBatch(unsigned index, double const *pt,
+  double *derivatives, unsigned n) const
+{
+    ExecuteBatch(derivativePrograms.at(index), pt, derivatives, n);
+}
+
+
+std::string const &JetCorrExpression::GetFormula() const
+{
+    return formula;
+}
+
+
+std::vector<std::string> const &JetCorrExpression::GetParamNames() const
+{
+    return paramNames;
+}
+
+
+void JetCorrExpression::Compile(bool registerParams)
+{
+    for (unsigned i = 0; i < paramNames.size(); ++i)
+    {
+        if (std::count(paramNames.begin(), paramNames.end(), paramNames[i]) > 1 or
+          paramNames[i] == "x" or paramNames[i] == "pt")
+        {
+            std::ostringstream message;
+            message << "JetCorrExpression::JetCorrExpression: Name \"" << paramNames[i] <<
+              "\" cannot be used for a parameter.";
+            throw std::runtime_error(message.str());
+        }
+    }
+
+    Parser parser(formula, paramNames, registerParams);
+    auto const tree = parser.Parse();
+
+    // Parameters are set to zero initially
+    parameters.assign(paramNames.size(), 0.);
+
+    program = CompileTree(tree);
+    derivativePrograms.clear();
+
+    for (unsigned i = 0; i < paramNames.size(); ++i)
+        derivativePrograms.emplace_back(CompileTree(Differentiate(tree, i)));
+}
+
+
+JetCorrExpression::Program JetCorrExpression::CompileTree(std::shared_ptr<Node const> const &tree)
+{
+    Program program{{}, 0, false};
+
+    // Emit instructions in the post order. The returned value is the depth of the stack needed to
+    //evaluate the subtree.
+    auto emit = [&program](auto const &self, Node const &node) -> unsigned
+    {
+        unsigned depth;
+
+        if (not node.left)
+            depth = 1;
+        else if (not node.right)
+            depth = self(self, *node.left);
+        else
+        {
+            unsigned const leftDepth = self(self, *node.left);
+            unsigned const rightDepth = self(self, *node.right);
+            depth = std::max(leftDepth, rightDepth + 1);
+        }
+
+        if (node.op == OpCode::LogPt)
+            program.usesLogPt = true;
+
+        program.instructions.emplace_back(Instruction{node.op, node.value, node.index});
+        return depth;
+    };
+
+    program.stackDepth = emit(emit, *tree);
+
+    if (program.stackDepth > maxStackDepth)
+    {
+        std::ostringstream message;
+        message << "JetCorrExpression::CompileTree: Evaluation of the formula needs a stack of " <<
+          "depth " << program.stackDepth << ", while at most " << maxStackDepth <<
+          " is supported.";
+        throw std::runtime_error(message.str());
+    }
+
+    return program;
+}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::Differentiate(
+  std::shared_ptr<Node const> const &tree, unsigned index)
+{
+    auto const &a = tree->left;
+    auto const &b = tree->right;
+
+    switch (tree->op)
+    {
+        case OpCode::Param:
+            return Node::Const((tree->index == index) ? 1. : 0.);
+
+        case OpCode::Add:
+            return MakeNode(OpCode::Add, Differentiate(a, index), Differentiate(b, index));
+
+        case OpCode::Sub:
+            return MakeNode(OpCode::Sub, Differentiate(a, index), Differentiate(b, index));
+
+        case OpCode::Mul:
+            return MakeNode(OpCode::Add,
+              MakeNode(OpCode::Mul, Differentiate(a, index), b),
+              MakeNode(OpCode::Mul, a, Differentiate(b, index)));
+
+        case OpCode::Div:
+            // (a / b)' = (a' - (a / b) b') / b
+            return MakeNode(OpCode::Div,
+              MakeNode(OpCode::Sub, Differentiate(a, index),
+                MakeNode(OpCode::Mul, tree, Differentiate(b, index))),
+              b);
+
+        case OpCode::Neg:
+            return MakeNode(OpCode::Neg, Differentiate(a, index));
+
+        case OpCode::Pow:
+        {
+            auto const da = Differentiate(a, index);
+            auto const db = Differentiate(b, index);
+
+            // (a^b)' = b a^(b - 1) a' for a constant exponent and
+            //a^b (b' log(a) + b a' / a) in general
+            if (db->IsConst(0.))
+                return MakeNode(OpCode::Mul,
+                  MakeNode(OpCode::Mul, b,
+                    MakeNode(OpCode::Pow, a, MakeNode(OpCode::Sub, b, Node::Const(1.)))),
+                  da);
+            else
+                return MakeNode(OpCode::Mul, tree,
+                  MakeNode(OpCode::Add,
+                    MakeNode(OpCode::Mul, db, MakeNode(OpCode::Log, a)),
+                    MakeNode(OpCode::Div, MakeNode(OpCode::Mul, b, da), a)));
+        }
+
+        case OpCode::PowInt:
+        {
+            int const n = int(tree->value);
+            return MakeNode(OpCode::Mul,
+              MakeNode(OpCode::Mul, Node::Const(n), Node::PowInt(a, n - 1)),
+              Differentiate(a, index));
+        }
+
+        case OpCode::Exp:
+            return MakeNode(OpCode::Mul, tree, Differentiate(a, index));
+
+        case OpCode::Log:
+            return MakeNode(OpCode::Div, Differentiate(a, index), a);
+
+        case OpCode::Sqrt:
+            return MakeNode(OpCode::Div, Differentiate(a, index),
+              MakeNode(OpCode::Mul, Node::Const(2.), tree));
+
+        default:
+            // Constants, log(pt), and pt do not depend on the parameters
+            return Node::Const(0.);
+    }
+}
+
+
+double JetCorrExpression::Execute(Program const &program, double pt) const
+{
+    double stack[maxStackDepth];
+    unsigned top = 0;
+    double const logPt = (program.usesLogPt) ? mathLog(pt) : 0.;
+
+    for (auto const &instruction: program.instructions)
+    {
+        switch (instruction.op)
+        {
+            case OpCode::Const:
+                stack[top++] = instruction.value;
+                break;
+
+            case OpCode::Param:
+                stack[top++] = parameters[instruction.index];
+                break;
+
+            case OpCode::LogPt:
+                stack[top++] = logPt;
+                break;
+
+            case OpCode::Pt:
+                stack[top++] = pt;
+                break;
+
+            case OpCode::Add:
+                --top;
+                stack[top - 1] += stack[top];
+                break;
+
+            case OpCode::Sub:
+                --top;
+                stack[top - 1] -= stack[top];
+                break;
+
+            case OpCode::Mul:
+                --top;
+                stack[top - 1] *= stack[top];
+                break;
+
+            case OpCode::Div:
+                --top;
+                stack[top - 1] /= stack[top];
+                break;
+
+            case OpCode::Neg:
+                stack[top - 1] = -stack[top - 1];
+                break;
+
+            case OpCode::Pow:
+                --top;
+                stack[top - 1] = std::pow(stack[top - 1], stack[top]);
+                break;
+
+            case OpCode::PowInt:
+                stack[top - 1] = powInt(stack[top - 1], int(instruction.value));
+                break;
+
+            case OpCode::Exp:
+                stack[top - 1] = mathExp(stack[top - 1]);
+                break;
+
+            case OpCode::Log:
+                stack[top - 1] = mathLog(stack[top - 1]);
+                break;
+
+            case OpCode::Sqrt:
+                stack[top - 1] = std::sqrt(stack[top - 1]);
+                break;
+        }
+    }
+
+    return stack[0];
+}
+
+
+void JetCorrExpression::ExecuteBatch(Program const &program, double const *pt, double *results,
+  unsigned n) const
+{
+    // Each slot of the stack holds values for a full chunk. Every instruction is applied to all of
+    //them before the next one is executed, so that the loops can be vectorized.
+    double stack[maxStackDepth][chunkSize];
+    double logPts[chunkSize];
+
+    for (unsigned start = 0; start < n; start += chunkSize)
+    {
+        unsigned const size = std::min(n - start, chunkSize);
+        double const *chunk = pt + start;
+        unsigned top = 0;
+
+        if (program.usesLogPt)
+            mathLogBatch(chunk, logPts, size);
+
+        for (auto const &instruction: program.instructions)
+        {
+            double *const dst = (instruction.op == OpCode::Const or
+              instruction.op == OpCode::Param or instruction.op == OpCode::LogPt or
+              instruction.op == OpCode::Pt) ? stack[top++] : stack[top - 1];
+            double const *src = stack[top - 1];
+
+            switch (instruction.op)
+            {
+                case OpCode::Const:
+                    std::fill(dst, dst + size, instruction.value);
+                    break;
+
+                case OpCode::Param:
+                    std::fill(dst, dst + size, parameters[instruction.index]);
+                    break;
+
+                case OpCode::LogPt:
+                    std::copy(logPts, logPts + size, dst);
+                    break;
+
+                case OpCode::Pt:
+                    std::copy(chunk, chunk + size, dst);
+                    break;
+
+                case OpCode::Add:
+                    --top;
+
+                    for (unsigned i = 0; i < size; ++i)
+                        stack[top - 1][i] += src[i];
+
+                    break;
+
+                case OpCode::Sub:
+                    --top;
+
+                    for (unsigned i = 0; i < size; ++i)
+                        stack[top - 1][i] -= src[i];
+
+                    break;
+
+                case OpCode::Mul:
+                    --top;
+
+                    for (unsigned i = 0; i < size; ++i)
+                        stack[top - 1][i] *= src[i];
+
+                    break;
+
+                case OpCode::Div:
+                    --top;
+
+                    for (unsigned i = 0; i < size; ++i)
+                        stack[top - 1][i] /= src[i];
+
+                    break;
+
+                case OpCode::Neg:
+                    for (unsigned i = 0; i < size; ++i)
+                        dst[i] = -dst[i];
+
+                    break;
+
+                case OpCode::Pow:
+                    --top;
+
+                    for (unsigned i = 0; i < size; ++i)
+                        stack[top - 1][i] = std::pow(stack[top - 1][i], src[i]);
+
+                    break;
+
+                case OpCode::PowInt:
+                    for (unsigned i = 0; i < size; ++i)
+                        dst[i] = powInt(dst[i], int(instruction.value));
+
+                    break;
+
+                case OpCode::Exp:
+                    mathExpBatch(dst, dst, size);
+                    break;
+
+                case OpCode::Log:
+                    mathLogBatch(dst, dst, size);
+                    break;
+
+                case OpCode::Sqrt:
+                    for (unsigned i = 0; i < size; ++i)
+                        dst[i] = std::sqrt(dst[i]);
+
+                    break;
+            }
+        }
+
+        std::copy(stack[0], stack[0] + size, results + start);
+    }
+}
+
+
+std::shared_ptr<JetCorrExpression::Node const> JetCorrExpression::MakeNode(OpCode op,
+  std::shared_ptr<Node const> left, std::shared_ptr<Node const> right)
+{
+    bool const leftConst = (left->op == OpCode::Const);
+    bool const rightConst = (right and right->op == OpCode::Const);
+
+    switch (op)
+    {
+        case OpCode::Neg:
+            if (leftConst)
+                return Node::Const(-left->value);
+            else if (left->op == OpCode::Neg)
+                return left->left;
+
+            break;
+
+        case OpCode::Exp:
+            if (leftConst)
+                return Node::Const(std::exp(left->value));
+
+            break;
+
+        case OpCode::Log:
+            if (leftConst)
+                return Node::Const(std::log(left->value));
+
+            break;
+
+        case OpCode::Sqrt:
+            if (leftConst)
+                return Node::Const(std::sqrt(left->value));
+
+            break;
+
+        case OpCode::Add:
+            if (leftConst and rightConst)
+                return Node::Const(left->value + right->value);
+            else if (left->IsConst(0.))
+                return right;
+            else if (right->IsConst(0.))
+                return left;
+
+            break;
+
+        case OpCode::Sub:
+            if (leftConst and rightConst)
+                return Node::Const(left->value - right->value);
+            else if (right->IsConst(0.))
+                return left;
+            else if (left->IsConst(0.))
+                return MakeNode(OpCode::Neg, right);
+
+            break;
+
+        case OpCode::Mul:
+            if (leftConst and rightConst)
+                return Node::Const(left->value * right->value);
+            else if (left->IsConst(0.) or right->IsConst(0.))
+                return Node::Const(0.);
+            else if (left->IsConst(1.))
+                return right;
+            else if (right->IsConst(1.))
+                return left;
+            else if (left->IsConst(-1.))
+                return MakeNode(OpCode::Neg, right);
+            else if (right->IsConst(-1.))
+                return MakeNode(OpCode::Neg, left);
+
+            break;
+
+        case OpCode::Div:
+            if (leftConst and rightConst)
+                return Node::Const(left->value / right->value);
+            else if (left->IsConst(0.))
+                return Node::Const(0.);
+            else if (right->IsConst(1.))
+                return left;
+
+            break;
+
+        case OpCode::Pow:
+            if (leftConst and rightConst)
+                return Node::Const(std::pow(left->value, right->value));
+            else if (rightConst and right->value == std::round(right->value) and
+              std::abs(right->value) <= 16.)
+                return Node::PowInt(left, int(right->value));
+
+            break;
+
+        default:
+            break;
+    }
+
+    return std::make_shared<Node const>(Node{op, 0., 0, left, right});
+}
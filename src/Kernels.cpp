@@ -0,0 +1,908 @@
+#include <Kernels.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Vectorized kernels are only built for x86-64 and compilers that support per-function target
+// attributes. Elsewhere only the scalar implementation is available.
+#if defined(__x86_64__) and (defined(__GNUC__) or defined(__clang__))
+#define JECFIT_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#ifdef JECFIT_BLAS
+// Fortran interface of BLAS, which is provided by all implementations, unlike the C interface
+extern "C" void dgemm_(char const *transA, char const *transB, int const *m, int const *n,
+  int const *k, double const *alpha, double const *a, int const *lda, double const *b,
+  int const *ldb, double const *beta, double *c, int const *ldc);
+#endif
+
+
+namespace
+{
+
+using DotProductFunc = double (*)(double const *, double const *, unsigned);
+using DotProductCompensatedFunc = double (*)(float const *, double const *, unsigned);
+using DotProductPairFunc = std::array<double, 2> (*)(double const *, double const *,
+  double const *, unsigned);
+using DotProductCompensatedPairFunc = std::array<double, 2> (*)(float const *, double const *,
+  double const *, unsigned);
+template<typename T>
+using MatrixProductFunc = void (*)(T const *, unsigned, double const *, double *, unsigned,
+  unsigned, unsigned);
+
+
+double dotProductScalar(double const *a, double const *b, unsigned n)
+{
+    double sum = 0.;
+
+    for (unsigned i = 0; i < n; ++i)
+        sum += a[i] * b[i];
+
+    return sum;
+}
+
+
+double dotProductCompensatedScalar(float const *a, double const *b, unsigned n)
+{
+    double sum = 0., compensation = 0.;
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        double const y = double(a[i]) * b[i] - compensation;
+        double const t = sum + y;
+        compensation = (t - sum) - y;
+        sum = t;
+    }
+
+    return sum;
+}
+
+
+std::array<double, 2> dotProductPairScalar(double const *a, double const *b1, double const *b2,
+  unsigned n)
+{
+    double sum1 = 0., sum2 = 0.;
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        sum1 += a[i] * b1[i];
+        sum2 += a[i] * b2[i];
+    }
+
+    return {sum1, sum2};
+}
+
+
+std::array<double, 2> dotProductCompensatedPairScalar(float const *a, double const *b1,
+  double const *b2, unsigned n)
+{
+    double sum1 = 0., compensation1 = 0., sum2 = 0., compensation2 = 0.;
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        double const x = a[i];
+
+        double const y1 = x * b1[i] - compensation1;
+        double const t1 = sum1 + y1;
+        compensation1 = (t1 - sum1) - y1;
+        sum1 = t1;
+
+        double const y2 = x * b2[i] - compensation2;
+        double const t2 = sum2 + y2;
+        compensation2 = (t2 - sum2) - y2;
+        sum2 = t2;
+    }
+
+    return {sum1, sum2};
+}
+
+
+template<typename T>
+void matrixProductScalar(T const *a, unsigned lda, double const *b, double *c, unsigned m,
+  unsigned n, unsigned k)
+{
+    for (unsigned row = 0; row < m; ++row)
+    {
+        double *cRow = c + row * k;
+        std::fill(cRow, cRow + k, 0.);
+
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double const x = a[row * lda + i];
+            double const *bRow = b + i * k;
+
+            for (unsigned j = 0; j < k; ++j)
+                cRow[j] += x * bRow[j];
+        }
+    }
+}
+
+
+/**
+ * \brief Combines partial sums and compensations from individual SIMD lanes
+ *
+ * The partial sums are added with the compensated summation, and the accumulated compensation
+ * terms are subtracted at the end.
+ */
+double combineLanes(double const *sums, double const *compensations, unsigned numLanes)
+{
+    double sum = 0., compensation = 0.;
+
+    for (unsigned i = 0; i < numLanes; ++i)
+        compensation += compensations[i];
+
+    for (unsigned i = 0; i < numLanes; ++i)
+    {
+        double const y = sums[i] - compensation;
+        double const t = sum + y;
+        compensation = (t - sum) - y;
+        sum = t;
+    }
+
+    return sum - compensation;
+}
+
+
+#ifdef JECFIT_X86_DISPATCH
+
+// Some versions of GCC issue false warnings about uninitialized variables inside AVX-512 intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx2,fma")))
+double dotProductAVX2(double const *a, double const *b, unsigned n)
+{
+    // Use several independent accumulators to hide the latency of FMA instructions
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d sum2 = _mm256_setzero_pd(), sum3 = _mm256_setzero_pd();
+    unsigned i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), sum0);
+        sum1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), sum1);
+        sum2 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8), sum2);
+        sum3 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12), sum3);
+    }
+
+    for (; i + 4 <= n; i += 4)
+        sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), sum0);
+
+    __m256d const sum = _mm256_add_pd(_mm256_add_pd(sum0, sum1), _mm256_add_pd(sum2, sum3));
+    __m128d const half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+    double result = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+
+    for (; i < n; ++i)
+        result += a[i] * b[i];
+
+    return result;
+}
+
+
+__attribute__((target("avx512f")))
+double dotProductAVX512(double const *a, double const *b, unsigned n)
+{
+    __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+    __m512d sum2 = _mm512_setzero_pd(), sum3 = _mm512_setzero_pd();
+    unsigned i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        sum0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), sum0);
+        sum1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8), sum1);
+        sum2 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 16), _mm512_loadu_pd(b + i + 16), sum2);
+        sum3 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 24), _mm512_loadu_pd(b + i + 24), sum3);
+    }
+
+    for (; i + 8 <= n; i += 8)
+        sum0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), sum0);
+
+    // The tail is processed with masked loads, which fill missing lanes with zeros
+    if (i < n)
+    {
+        __mmask8 const mask = (1u << (n - i)) - 1;
+        sum1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, a + i),
+          _mm512_maskz_loadu_pd(mask, b + i), sum1);
+    }
+
+    __m512d const sum = _mm512_add_pd(_mm512_add_pd(sum0, sum1), _mm512_add_pd(sum2, sum3));
+    double lanes[8];
+    _mm512_storeu_pd(lanes, sum);
+
+    return ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) +
+      ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+}
+
+
+__attribute__((target("avx2,fma")))
+double horizontalSumAVX2(__m256d x)
+{
+    __m128d const half = _mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+}
+
+
+__attribute__((target("avx2,fma")))
+std::array<double, 2> dotProductPairAVX2(double const *a, double const *b1, double const *b2,
+  unsigned n)
+{
+    // Two independent accumulators for each of the products. Each element of a is loaded once.
+    __m256d sum10 = _mm256_setzero_pd(), sum11 = _mm256_setzero_pd();
+    __m256d sum20 = _mm256_setzero_pd(), sum21 = _mm256_setzero_pd();
+    unsigned i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256d const a0 = _mm256_loadu_pd(a + i), a1 = _mm256_loadu_pd(a + i + 4);
+        sum10 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(b1 + i), sum10);
+        sum11 = _mm256_fmadd_pd(a1, _mm256_loadu_pd(b1 + i + 4), sum11);
+        sum20 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(b2 + i), sum20);
+        sum21 = _mm256_fmadd_pd(a1, _mm256_loadu_pd(b2 + i + 4), sum21);
+    }
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d const a0 = _mm256_loadu_pd(a + i);
+        sum10 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(b1 + i), sum10);
+        sum20 = _mm256_fmadd_pd(a0, _mm256_loadu_pd(b2 + i), sum20);
+    }
+
+    double result1 = horizontalSumAVX2(_mm256_add_pd(sum10, sum11));
+    double result2 = horizontalSumAVX2(_mm256_add_pd(sum20, sum21));
+
+    for (; i < n; ++i)
+    {
+        result1 += a[i] * b1[i];
+        result2 += a[i] * b2[i];
+    }
+
+    return {result1, result2};
+}
+
+
+__attribute__((target("avx512f")))
+std::array<double, 2> dotProductPairAVX512(double const *a, double const *b1, double const *b2,
+  unsigned n)
+{
+    __m512d sum10 = _mm512_setzero_pd(), sum11 = _mm512_setzero_pd();
+    __m512d sum20 = _mm512_setzero_pd(), sum21 = _mm512_setzero_pd();
+    unsigned i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512d const a0 = _mm512_loadu_pd(a + i), a1 = _mm512_loadu_pd(a + i + 8);
+        sum10 = _mm512_fmadd_pd(a0, _mm512_loadu_pd(b1 + i), sum10);
+        sum11 = _mm512_fmadd_pd(a1, _mm512_loadu_pd(b1 + i + 8), sum11);
+        sum20 = _mm512_fmadd_pd(a0, _mm512_loadu_pd(b2 + i), sum20);
+        sum21 = _mm512_fmadd_pd(a1, _mm512_loadu_pd(b2 + i + 8), sum21);
+    }
+
+    // At most two more iterations, the last one with masked loads
+    for (; i < n; i += 8)
+    {
+        __mmask8 const mask = (n - i >= 8) ? 0xFF : (1u << (n - i)) - 1;
+        __m512d const a0 = _mm512_maskz_loadu_pd(mask, a + i);
+        sum10 = _mm512_fmadd_pd(a0, _mm512_maskz_loadu_pd(mask, b1 + i), sum10);
+        sum20 = _mm512_fmadd_pd(a0, _mm512_maskz_loadu_pd(mask, b2 + i), sum20);
+    }
+
+    return {_mm512_reduce_add_pd(_mm512_add_pd(sum10, sum11)),
+      _mm512_reduce_add_pd(_mm512_add_pd(sum20, sum21))};
+}
+
+__attribute__((target("avx2,fma")))
+double dotProductCompensatedAVX2(float const *a, double const *b, unsigned n)
+{
+    // Two independent pairs of partial sums and compensations, each with four lanes
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d comp0 = _mm256_setzero_pd(), comp1 = _mm256_setzero_pd();
+    unsigned i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256d const y0 = _mm256_fmsub_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i)),
+          _mm256_loadu_pd(b + i), comp0);
+        __m256d const y1 = _mm256_fmsub_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 4)),
+          _mm256_loadu_pd(b + i + 4), comp1);
+        __m256d const t0 = _mm256_add_pd(sum0, y0);
+        __m256d const t1 = _mm256_add_pd(sum1, y1);
+        comp0 = _mm256_sub_pd(_mm256_sub_pd(t0, sum0), y0);
+        comp1 = _mm256_sub_pd(_mm256_sub_pd(t1, sum1), y1);
+        sum0 = t0;
+        sum1 = t1;
+    }
+
+    double sums[8], compensations[8];
+    _mm256_storeu_pd(sums, sum0);
+    _mm256_storeu_pd(sums + 4, sum1);
+    _mm256_storeu_pd(compensations, comp0);
+    _mm256_storeu_pd(compensations + 4, comp1);
+
+    double const head = combineLanes(sums, compensations, 8);
+    double const tail = dotProductCompensatedScalar(a + i, b + i, n - i);
+    return head + tail;
+}
+
+
+__attribute__((target("avx512f")))
+double dotProductCompensatedAVX512(float const *a, double const *b, unsigned n)
+{
+    __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+    __m512d comp0 = _mm512_setzero_pd(), comp1 = _mm512_setzero_pd();
+    unsigned i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512d const y0 = _mm512_fmsub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(a + i)),
+          _mm512_loadu_pd(b + i), comp0);
+        __m512d const y1 = _mm512_fmsub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(a + i + 8)),
+          _mm512_loadu_pd(b + i + 8), comp1);
+        __m512d const t0 = _mm512_add_pd(sum0, y0);
+        __m512d const t1 = _mm512_add_pd(sum1, y1);
+        comp0 = _mm512_sub_pd(_mm512_sub_pd(t0, sum0), y0);
+        comp1 = _mm512_sub_pd(_mm512_sub_pd(t1, sum1), y1);
+        sum0 = t0;
+        sum1 = t1;
+    }
+
+    // Remaining elements are processed with masked loads, which fill missing lanes with zeros
+    if (i < n)
+    {
+        unsigned const numRemaining = std::min(n - i, 8u);
+        __mmask8 const mask = (1u << numRemaining) - 1;
+        __m256 const aPart = _mm512_castps512_ps256(_mm512_maskz_loadu_ps(mask, a + i));
+        __m512d const y0 = _mm512_fmsub_pd(_mm512_cvtps_pd(aPart),
+          _mm512_maskz_loadu_pd(mask, b + i), comp0);
+        __m512d const t0 = _mm512_add_pd(sum0, y0);
+        comp0 = _mm512_sub_pd(_mm512_sub_pd(t0, sum0), y0);
+        sum0 = t0;
+        i += numRemaining;
+    }
+
+    double sums[16], compensations[16];
+    _mm512_storeu_pd(sums, sum0);
+    _mm512_storeu_pd(sums + 8, sum1);
+    _mm512_storeu_pd(compensations, comp0);
+    _mm512_storeu_pd(compensations + 8, comp1);
+
+    double const head = combineLanes(sums, compensations, 16);
+    double const tail = dotProductCompensatedScalar(a + i, b + i, n - i);
+    return head + tail;
+}
+
+
+__attribute__((target("avx2,fma")))
+std::array<double, 2> dotProductCompensatedPairAVX2(float const *a, double const *b1,
+  double const *b2, unsigned n)
+{
+    // A single pair of partial sums and compensations for each product keeps the number of live
+    //registers low
+    __m256d sum1 = _mm256_setzero_pd(), sum2 = _mm256_setzero_pd();
+    __m256d comp1 = _mm256_setzero_pd(), comp2 = _mm256_setzero_pd();
+    unsigned i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d const x = _mm256_cvtps_pd(_mm_loadu_ps(a + i));
+        __m256d const y1 = _mm256_fmsub_pd(x, _mm256_loadu_pd(b1 + i), comp1);
+        __m256d const y2 = _mm256_fmsub_pd(x, _mm256_loadu_pd(b2 + i), comp2);
+        __m256d const t1 = _mm256_add_pd(sum1, y1);
+        __m256d const t2 = _mm256_add_pd(sum2, y2);
+        comp1 = _mm256_sub_pd(_mm256_sub_pd(t1, sum1), y1);
+        comp2 = _mm256_sub_pd(_mm256_sub_pd(t2, sum2), y2);
+        sum1 = t1;
+        sum2 = t2;
+    }
+
+    double sums[8], compensations[8];
+    _mm256_storeu_pd(sums, sum1);
+    _mm256_storeu_pd(sums + 4, sum2);
+    _mm256_storeu_pd(compensations, comp1);
+    _mm256_storeu_pd(compensations + 4, comp2);
+
+    auto const tail = dotProductCompensatedPairScalar(a + i, b1 + i, b2 + i, n - i);
+    return {combineLanes(sums, compensations, 4) + tail[0],
+      combineLanes(sums + 4, compensations + 4, 4) + tail[1]};
+}
+
+
+__attribute__((target("avx512f")))
+std::array<double, 2> dotProductCompensatedPairAVX512(float const *a, double const *b1,
+  double const *b2, unsigned n)
+{
+    __m512d sum1 = _mm512_setzero_pd(), sum2 = _mm512_setzero_pd();
+    __m512d comp1 = _mm512_setzero_pd(), comp2 = _mm512_setzero_pd();
+
+    // The last iteration uses masked loads, which fill missing lanes with zeros
+    for (unsigned i = 0; i < n; i += 8)
+    {
+        __mmask8 const mask = (n - i >= 8) ? 0xFF : (1u << (n - i)) - 1;
+        __m256 const aPart = _mm512_castps512_ps256(_mm512_maskz_loadu_ps(mask, a + i));
+        __m512d const x = _mm512_cvtps_pd(aPart);
+        __m512d const y1 = _mm512_fmsub_pd(x, _mm512_maskz_loadu_pd(mask, b1 + i), comp1);
+        __m512d const y2 = _mm512_fmsub_pd(x, _mm512_maskz_loadu_pd(mask, b2 + i), comp2);
+        __m512d const t1 = _mm512_add_pd(sum1, y1);
+        __m512d const t2 = _mm512_add_pd(sum2, y2);
+        comp1 = _mm512_sub_pd(_mm512_sub_pd(t1, sum1), y1);
+        comp2 = _mm512_sub_pd(_mm512_sub_pd(t2, sum2), y2);
+        sum1 = t1;
+        sum2 = t2;
+    }
+
+    double sums[16], compensations[16];
+    _mm512_storeu_pd(sums, sum1);
+    _mm512_storeu_pd(sums + 8, sum2);
+    _mm512_storeu_pd(compensations, comp1);
+    _mm512_storeu_pd(compensations + 8, comp2);
+
+    return {combineLanes(sums, compensations, 8), combineLanes(sums + 8, compensations + 8, 8)};
+}
+
+
+/**
+ * \brief Computes a tile of the matrix product with the given number of rows
+ *
+ * The tile spans up to matrixProductTileWidth columns, and columns beyond the given width are
+ * masked out. Each row of the tile is accumulated in two registers, and each element of B is
+ * loaded once for all rows.
+ */
+template<unsigned numRows, typename T>
+__attribute__((target("avx2,fma")))
+void matrixProductTileAVX2(T const *a, unsigned lda, double const *b, unsigned ldb, double *c,
+  unsigned n, unsigned width)
+{
+    __m256i const mask0 = _mm256_cmpgt_epi64(_mm256_set1_epi64x(width),
+      _mm256_setr_epi64x(0, 1, 2, 3));
+    __m256i const mask1 = _mm256_cmpgt_epi64(_mm256_set1_epi64x(width),
+      _mm256_setr_epi64x(4, 5, 6, 7));
+    __m256d sum0[numRows], sum1[numRows];
+
+    for (unsigned r = 0; r < numRows; ++r)
+    {
+        sum0[r] = _mm256_setzero_pd();
+        sum1[r] = _mm256_setzero_pd();
+    }
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        __m256d const b0 = _mm256_maskload_pd(b + i * ldb, mask0);
+        __m256d const b1 = _mm256_maskload_pd(b + i * ldb + 4, mask1);
+
+        for (unsigned r = 0; r < numRows; ++r)
+        {
+            __m256d const x = _mm256_set1_pd(a[r * lda + i]);
+            sum0[r] = _mm256_fmadd_pd(x, b0, sum0[r]);
+            sum1[r] = _mm256_fmadd_pd(x, b1, sum1[r]);
+        }
+    }
+
+    for (unsigned r = 0; r < numRows; ++r)
+    {
+        _mm256_maskstore_pd(c + r * ldb, mask0, sum0[r]);
+        _mm256_maskstore_pd(c + r * ldb + 4, mask1, sum1[r]);
+    }
+}
+
+
+template<typename T>
+__attribute__((target("avx2,fma")))
+void matrixProductAVX2(T const *a, unsigned lda, double const *b, double *c, unsigned m,
+  unsigned n, unsigned k)
+{
+    // Tiles of 4 x 8 elements of C occupy 8 out of 16 registers
+    unsigned const tileRows = 4;
+
+    for (unsigned col = 0; col < k; col += matrixProductTileWidth)
+    {
+        unsigned const width = std::min(k - col, matrixProductTileWidth);
+        unsigned row = 0;
+
+        for (; row + tileRows <= m; row += tileRows)
+            matrixProductTileAVX2<tileRows>(a + row * lda, lda, b + col, k, c + row * k + col,
+              n, width);
+
+        for (; row < m; ++row)
+            matrixProductTileAVX2<1>(a + row * lda, lda, b + col, k, c + row * k + col, n,
+              width);
+    }
+}
+
+
+/// Computes a tile of the matrix product with the given number of rows, one register per row
+template<unsigned numRows, typename T>
+__attribute__((target("avx512f")))
+void matrixProductTileAVX512(T const *a, unsigned lda, double const *b, unsigned ldb, double *c,
+  unsigned n, unsigned width)
+{
+    __mmask8 const mask = (1u << width) - 1;
+    __m512d sum[numRows];
+
+    for (unsigned r = 0; r < numRows; ++r)
+        sum[r] = _mm512_setzero_pd();
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        __m512d const bRow = _mm512_maskz_loadu_pd(mask, b + i * ldb);
+
+        for (unsigned r = 0; r < numRows; ++r)
+            sum[r] = _mm512_fmadd_pd(_mm512_set1_pd(a[r * lda + i]), bRow, sum[r]);
+    }
+
+    for (unsigned r = 0; r < numRows; ++r)
+        _mm512_mask_storeu_pd(c + r * ldb, mask, sum[r]);
+}
+
+
+template<typename T>
+__attribute__((target("avx512f")))
+void matrixProductAVX512(T const *a, unsigned lda, double const *b, double *c, unsigned m,
+  unsigned n, unsigned k)
+{
+    // Tiles of 8 x 8 elements of C occupy 8 out of 32 registers
+    unsigned const tileRows = 8;
+
+    for (unsigned col = 0; col < k; col += matrixProductTileWidth)
+    {
+        unsigned const width = std::min(k - col, matrixProductTileWidth);
+        unsigned row = 0;
+
+        for (; row + tileRows <= m; row += tileRows)
+            matrixProductTileAVX512<tileRows>(a + row * lda, lda, b + col, k, c + row * k + col,
+              n, width);
+
+        for (; row < m; ++row)
+            matrixProductTileAVX512<1>(a + row * lda, lda, b + col, k, c + row * k + col, n,
+              width);
+    }
+}
+
+#pragma GCC diagnostic pop
+
+#endif  // JECFIT_X86_DISPATCH
+
+
+#ifdef JECFIT_BLAS
+
+/// Computes the matrix product with BLAS
+void matrixProductBLAS(double const *a, unsigned lda, double const *b, double *c, unsigned m,
+  unsigned n, unsigned k)
+{
+    if (m == 0 or k == 0)
+        return;
+
+    // BLAS expects matrices stored by columns. A matrix stored by rows is seen as its transpose,
+    //and thus compute C^T = B^T A^T.
+    char const noTrans = 'N';
+    int const mBLAS = k, nBLAS = m, kBLAS = n, ldaBLAS = k, ldbBLAS = lda, ldcBLAS = k;
+    double const alpha = 1., beta = 0.;
+    dgemm_(&noTrans, &noTrans, &mBLAS, &nBLAS, &kBLAS, &alpha, b, &ldaBLAS, a, &ldbBLAS, &beta,
+      c, &ldcBLAS);
+}
+
+#endif  // JECFIT_BLAS
+
+
+/// Returns implementation of the compensated dot product for the given instruction set
+DotProductCompensatedFunc selectDotProductCompensated(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef JECFIT_X86_DISPATCH
+        case SimdLevel::AVX2:
+            return &dotProductCompensatedAVX2;
+
+        case SimdLevel::AVX512:
+            return &dotProductCompensatedAVX512;
+#endif
+
+        default:
+            return &dotProductCompensatedScalar;
+    }
+}
+
+
+/// Returns implementation of the dot product for the given instruction set
+DotProductFunc selectDotProduct(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef JECFIT_X86_DISPATCH
+        case SimdLevel::AVX2:
+            return &dotProductAVX2;
+
+        case SimdLevel::AVX512:
+            return &dotProductAVX512;
+#endif
+
+        default:
+            return &dotProductScalar;
+    }
+}
+
+
+/// Returns implementation of the paired dot product for the given instruction set
+DotProductPairFunc selectDotProductPair(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef JECFIT_X86_DISPATCH
+        case SimdLevel::AVX2:
+            return &dotProductPairAVX2;
+
+        case SimdLevel::AVX512:
+            return &dotProductPairAVX512;
+#endif
+
+        default:
+            return &dotProductPairScalar;
+    }
+}
+
+
+/// Returns implementation of the paired compensated dot product for the given instruction set
+DotProductCompensatedPairFunc selectDotProductCompensatedPair(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef JECFIT_X86_DISPATCH
+        case SimdLevel::AVX2:
+            return &dotProductCompensatedPairAVX2;
+
+        case SimdLevel::AVX512:
+            return &dotProductCompensatedPairAVX512;
+#endif
+
+        default:
+            return &dotProductCompensatedPairScalar;
+    }
+}
+
+
+/// Returns implementation of the matrix product for the given instruction set
+template<typename T>
+MatrixProductFunc<T> selectMatrixProduct(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef JECFIT_X86_DISPATCH
+        case SimdLevel::AVX2:
+            return &matrixProductAVX2<T>;
+
+        case SimdLevel::AVX512:
+            return &matrixProductAVX512<T>;
+#endif
+
+        default:
+            return &matrixProductScalar<T>;
+    }
+}
+
+
+/**
+ * \brief Chooses the instruction set to be used by default
+ *
+ * Takes into account the override from the environment. An unsupported or unrecognized request
+ * results in an exception since silently falling back could distort timing studies.
+ */
+SimdLevel initialSimdLevel()
+{
+    char const *request = std::getenv("JECFIT_SIMD");
+
+    if (not request or std::strlen(request) == 0)
+        return detectSimdLevel();
+
+    std::string const requestStr(request);
+    SimdLevel level;
+
+    if (requestStr == "scalar")
+        level = SimdLevel::Scalar;
+    else if (requestStr == "avx2")
+        level = SimdLevel::AVX2;
+    else if (requestStr == "avx512")
+        level = SimdLevel::AVX512;
+    else
+    {
+        std::ostringstream message;
+        message << "initialSimdLevel: Unrecognized value \"" << requestStr << "\" in "
+          "environment variable JECFIT_SIMD.";
+        throw std::runtime_error(message.str());
+    }
+
+    if (not isSimdLevelSupported(level))
+    {
+        std::ostringstream message;
+        message << "initialSimdLevel: Instruction set " << simdLevelName(level) <<
+          " requested in environment variable JECFIT_SIMD is not supported by the CPU.";
+        throw std::runtime_error(message.str());
+    }
+
+    return level;
+}
+
+
+/// Currently selected instruction set and the corresponding implementations of the kernels
+struct Dispatch
+{
+    Dispatch(SimdLevel level_):
+        level(level_), dotProduct(selectDotProduct(level)),
+        dotProductCompensated(selectDotProductCompensated(level)),
+        dotProductPair(selectDotProductPair(level)),
+        dotProductCompensatedPair(selectDotProductCompensatedPair(level)),
+        matrixProduct(selectMatrixProduct<double>(level)),
+        matrixProductMixed(selectMatrixProduct<float>(level))
+    {}
+
+    SimdLevel level;
+    DotProductFunc dotProduct;
+    DotProductCompensatedFunc dotProductCompensated;
+    DotProductPairFunc dotProductPair;
+    DotProductCompensatedPairFunc dotProductCompensatedPair;
+    MatrixProductFunc<double> matrixProduct;
+    MatrixProductFunc<float> matrixProductMixed;
+};
+
+
+/**
+ * \brief Returns the dispatch table
+ *
+ * It is initialized on the first call, so that a malformed request in the environment results in
+ * an exception that can be caught rather than in a failure during loading of the library.
+ */
+Dispatch &getDispatch()
+{
+    static Dispatch dispatch(initialSimdLevel());
+    return dispatch;
+}
+
+}  // anonymous namespace
+
+
+SimdLevel detectSimdLevel()
+{
+#ifdef JECFIT_X86_DISPATCH
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::AVX512;
+
+    if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        return SimdLevel::AVX2;
+#endif
+
+    return SimdLevel::Scalar;
+}
+
+
+SimdLevel getSimdLevel()
+{
+    return getDispatch().level;
+}
+
+
+bool isSimdLevelSupported(SimdLevel level)
+{
+    return int(level) <= int(detectSimdLevel());
+}
+
+
+void setSimdLevel(SimdLevel level)
+{
+    if (not isSimdLevelSupported(level))
+    {
+        std::ostringstream message;
+        message << "setSimdLevel: Instruction set " << simdLevelName(level) <<
+          " is not supported by the CPU.";
+        throw std::runtime_error(message.str());
+    }
+
+    getDispatch() = Dispatch(level);
+}
+
+
+char const *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::Scalar:
+            return "scalar";
+
+        case SimdLevel::AVX2:
+            return "AVX2";
+
+        case SimdLevel::AVX512:
+            return "AVX-512";
+    }
+
+    return "unknown";
+}
+
+
+double dotProduct(double const *a, double const *b, unsigned n)
+{
+    return getDispatch().dotProduct(a, b, n);
+}
+
+
+double dotProduct(SimdLevel level, double const *a, double const *b, unsigned n)
+{
+    return selectDotProduct(level)(a, b, n);
+}
+
+
+double dotProductCompensated(float const *a, double const *b, unsigned n)
+{
+    return getDispatch().dotProductCompensated(a, b, n);
+}
+
+
+double dotProductCompensated(SimdLevel level, float const *a, double const *b, unsigned n)
+{
+    return selectDotProductCompensated(level)(a, b, n);
+}
+
+
+std::array<double, 2> dotProductPair(double const *a, double const *b1, double const *b2,
+  unsigned n)
+{
+    return getDispatch().dotProductPair(a, b1, b2, n);
+}
+
+
+std::array<double, 2> dotProductPair(SimdLevel level, double const *a, double const *b1,
+  double const *b2, unsigned n)
+{
+    return selectDotProductPair(level)(a, b1, b2, n);
+}
+
+
+std::array<double, 2> dotProductCompensatedPair(float const *a, double const *b1,
+  double const *b2, unsigned n)
+{
+    return getDispatch().dotProductCompensatedPair(a, b1, b2, n);
+}
+
+
+std::array<double, 2> dotProductCompensatedPair(SimdLevel level, float const *a,
+  double const *b1, double const *b2, unsigned n)
+{
+    return selectDotProductCompensatedPair(level)(a, b1, b2, n);
+}
+
+
+void matrixProduct(double const *a, unsigned lda, double const *b, double *c, unsigned m,
+  unsigned n, unsigned k)
+{
+#ifdef JECFIT_BLAS
+    matrixProductBLAS(a, lda, b, c, m, n, k);
+#else
+    getDispatch().matrixProduct(a, lda, b, c, m, n, k);
+#endif
+}
+
+
+void matrixProduct(SimdLevel level, double const *a, unsigned lda, double const *b, double *c,
+  unsigned m, unsigned n, unsigned k)
+{
+    selectMatrixProduct<double>(level)(a, lda, b, c, m, n, k);
+}
+
+
+void matrixProduct(float const *a, unsigned lda, double const *b, double *c, unsigned m,
+  unsigned n, unsigned k)
+{
+    getDispatch().matrixProductMixed(a, lda, b, c, m, n, k);
+}
+
+
+void matrixProduct(SimdLevel level, float const *a, unsigned lda, double const *b, double *c,
+  unsigned m, unsigned n, unsigned k)
+{
+    selectMatrixProduct<float>(level)(a, lda, b, c, m, n, k);
+}
@@ -0,0 +1,167 @@
+#include <MinuitTelemetry.hpp>
+
+#include <Minuit2/MinimumState.h>
+#include <Minuit2/MnUserParameterState.h>
+
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+
+namespace
+{
+
+/// Writes a string as a JSON literal
+void WriteJSONString(std::ostream &out, std::string const &text)
+{
+    out << '"';
+
+    for (char const c: text)
+    {
+        if (c == '"' or c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        else
+            out << c;
+    }
+
+    out << '"';
+}
+
+
+/// Writes a number as a JSON value, using null for values that are not finite
+void WriteJSONNumber(std::ostream &out, double value)
+{
+    if (std::isfinite(value))
+        out << value;
+    else
+        out << "null";
+}
+
+
+/// Writes an array of numbers
+void WriteJSONArray(std::ostream &out, double const *values, unsigned size)
+{
+    out << '[';
+
+    for (unsigned i = 0; i < size; ++i)
+    {
+        if (i > 0)
+            out << ", ";
+
+        WriteJSONNumber(out, values[i]);
+    }
+
+    out << ']';
+}
+
+}  // anonymous namespace
+
+
+
+MinuitTelemetry::MinuitTelemetry(std::string const &fileName, double minInterval_,
+  std::string const &label_):
+    out(fileName, std::ios::app), label(label_), minInterval(minInterval_),
+    startTime(std::chrono::steady_clock::now()), lastRecordTime(startTime),
+    iterationWritten(false)
+{
+    if (not out)
+    {
+        std::ostringstream message;
+        message << "MinuitTelemetry::MinuitTelemetry: Failed to open file \"" << fileName <<
+          "\" for writing.";
+        throw std::runtime_error(message.str());
+    }
+
+    out << std::setprecision(std::numeric_limits<double>::max_digits10);
+}
+
+
+void MinuitTelemetry::Finish(ROOT::Minuit2::Minuit2Minimizer const &minimizer)
+{
+    BeginRecord("end");
+    out << ", \"status\": " << minimizer.Status() << ", \"fval\": ";
+    WriteJSONNumber(out, minimizer.MinValue());
+    out << ", \"edm\": ";
+    WriteJSONNumber(out, minimizer.Edm());
+    out << ", \"nfcn\": " << minimizer.NCalls() << ", \"params\": ";
+
+    if (minimizer.X())
+        WriteJSONArray(out, minimizer.X(), minimizer.NDim());
+    else
+        out << "null";
+
+    out << "}" << std::endl;
+}
+
+
+void MinuitTelemetry::Init(ROOT::Minuit2::MnUserParameterState const &state)
+{
+    MnTraceObject::Init(state);
+    iterationWritten = false;
+
+    BeginRecord("start");
+    out << ", \"names\": [";
+
+    for (unsigned i = 0; i < state.Params().size(); ++i)
+    {
+        if (i > 0)
+            out << ", ";
+
+        WriteJSONString(out, state.Params()[i].GetName());
+    }
+
+    out << "]}" << std::endl;
+}
+
+
+void MinuitTelemetry::operator()(int iteration, ROOT::Minuit2::MinimumState const &state)
+{
+    auto const now = std::chrono::steady_clock::now();
+
+    if (iterationWritten and
+      std::chrono::duration<double>(now - lastRecordTime).count() < minInterval)
+        return;
+
+    iterationWritten = true;
+    lastRecordTime = now;
+
+    // Parameters in the state are internal ones. Convert them into external parameters, which
+    //also include fixed ones.
+    std::vector<double> const params(UserState().Trafo()(state.Vec()));
+
+    BeginRecord("iteration");
+    out << ", \"iter\": " << iteration << ", \"fval\": ";
+    WriteJSONNumber(out, state.Fval());
+    out << ", \"edm\": ";
+    WriteJSONNumber(out, state.Edm());
+    out << ", \"nfcn\": " << state.NFcn() << ", \"params\": ";
+    WriteJSONArray(out, params.data(), params.size());
+    out << "}" << std::endl;
+}
+
+
+void MinuitTelemetry::BeginRecord(char const *event)
+{
+    out << "{\"event\": \"" << event << "\"";
+
+    if (not label.empty())
+    {
+        out << ", \"label\": ";
+        WriteJSONString(out, label);
+    }
+
+    // Microsecond resolution is sufficient for the time
+    out << ", \"elapsed\": " << std::fixed << std::setprecision(6) << GetElapsed() <<
+      std::defaultfloat << std::setprecision(std::numeric_limits<double>::max_digits10);
+}
+
+
+double MinuitTelemetry::GetElapsed() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
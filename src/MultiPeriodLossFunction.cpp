@@ -0,0 +1,732 @@
+#include <MultiPeriodLossFunction.hpp>
+
+#include <TROOT.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace
+{
+/// Computes the step for finite differences for the given value of a parameter
+double Step(double x, double relStep)
+{
+    return relStep * std::max(std::abs(x), 1.);
+}
+
+
+/**
+ * \brief Inverts a symmetric positive-definite matrix in place
+ *
+ * The matrix of size n x n is stored in the row-major order. The inversion is done via the
+ * Cholesky decomposition. Returns false if the matrix is not positive-definite.
+ */
+bool InvertSymmetric(std::vector<double> &matrix, unsigned n)
+{
+    // Decompose the matrix as L L^T, storing L in the lower triangle
+    std::vector<double> l(n * n, 0.);
+
+    for (unsigned j = 0; j < n; ++j)
+    {
+        double diag = matrix[j * n + j];
+
+        for (unsigned k = 0; k < j; ++k)
+            diag -= l[j * n + k] * l[j * n + k];
+
+        if (not (diag > 0.))
+            return false;
+
+        l[j * n + j] = std::sqrt(diag);
+
+        for (unsigned i = j + 1; i < n; ++i)
+        {
+            double sum = matrix[i * n + j];
+
+            for (unsigned k = 0; k < j; ++k)
+                sum -= l[i * n + k] * l[j * n + k];
+
+            l[i * n + j] = sum / l[j * n + j];
+        }
+    }
+
+
+    // Invert L, which is lower-triangular
+    std::vector<double> lInv(n * n, 0.);
+
+    for (unsigned j = 0; j < n; ++j)
+    {
+        lInv[j * n + j] = 1. / l[j * n + j];
+
+        for (unsigned i = j + 1; i < n; ++i)
+        {
+            double sum = 0.;
+
+            for (unsigned k = j; k < i; ++k)
+                sum -= l[i * n + k] * lInv[k * n + j];
+
+            lInv[i * n + j] = sum / l[i * n + i];
+        }
+    }
+
+
+    // The inverse of the matrix is (L^-1)^T L^-1
+    for (unsigned i = 0; i < n; ++i)
+        for (unsigned j = 0; j <= i; ++j)
+        {
+            double sum = 0.;
+
+            for (unsigned k = i; k < n; ++k)
+                sum += lInv[k * n + i] * lInv[k * n + j];
+
+            matrix[i * n + j] = matrix[j * n + i] = sum;
+        }
+
+    return true;
+}
+
+
+/**
+ * \struct StencilPoint
+ * \brief Point at which the loss in a period is evaluated to compute the Hessian
+ *
+ * The point is shifted from the nominal one along up to two parameters, which are given by their
+ * positions in the list of parameters of the period. A shift of zero means no shift.
+ */
+struct StencilPoint
+{
+    unsigned period;
+    unsigned param1, param2;
+    int shift1, shift2;
+};
+}
+
+
+
+MultiPeriodLossFunction::Context::Context(NuisanceDefinitions const &nuisanceDefs):
+    nuisances(nuisanceDefs)
+{}
+
+
+
+MultiPeriodLossFunction::MultiPeriodLossFunction(std::vector<std::string> const &sharedNuisances,
+  unsigned numThreads):
+    sharedPatternStrings(sharedNuisances),
+    relStep(std::cbrt(std::numeric_limits<double>::epsilon())),
+    hessianRelStep(std::pow(std::numeric_limits<double>::epsilon(), 0.25)),
+    threadPool(numThreads),
+    numShared(0)
+{
+    for (auto const &pattern: sharedNuisances)
+        sharedPatterns.emplace_back(pattern);
+
+    unsigned const numWorkers = threadPool.GetNumWorkers();
+
+    if (numWorkers > 1)
+        ROOT::EnableThreadSafety();
+
+    contexts.resize(numWorkers);
+    points.resize(numWorkers);
+}
+
+
+void MultiPeriodLossFunction::AddPeriod(std::string const &name,
+  std::unique_ptr<JetCorrBase> &&corrector, NuisanceDefinitions const &nuisanceDefs,
+  std::vector<MeasurementBase const *> const &measurements)
+{
+    for (auto const &period: periods)
+    {
+        if (period.name == name)
+        {
+            std::ostringstream message;
+            message << "MultiPeriodLossFunction::AddPeriod: Period \"" << name <<
+              "\" has already been added.";
+            throw std::runtime_error(message.str());
+        }
+    }
+
+    Period period;
+    period.name = name;
+    period.nuisanceDefs = nuisanceDefs;
+    period.measurements = measurements;
+    periods.emplace_back(std::move(period));
+
+    for (unsigned worker = 0; worker < contexts.size(); ++worker)
+    {
+        Context context(nuisanceDefs);
+
+        if (worker == 0)
+        {
+            context.corrector = std::move(corrector);
+            context.measurements = measurements;
+        }
+        else
+        {
+            context.corrector = contexts[0].back().corrector->Clone();
+
+            for (auto const &m: measurements)
+            {
+                context.ownedMeasurements.emplace_back(m->Clone());
+                context.measurements.emplace_back(context.ownedMeasurements.back().get());
+            }
+        }
+
+        contexts[worker].emplace_back(std::move(context));
+    }
+
+    UpdateLayout();
+}
+
+
+ROOT::Math::IMultiGenFunction *MultiPeriodLossFunction::Clone() const
+{
+    auto *clone = new MultiPeriodLossFunction(sharedPatternStrings, threadPool.GetNumWorkers());
+    clone->relStep = relStep;
+    clone->hessianRelStep = hessianRelStep;
+
+    for (unsigned i = 0; i < periods.size(); ++i)
+    {
+        std::vector<MeasurementBase const *> measurements;
+
+        for (auto const &m: periods[i].measurements)
+        {
+            clone->ownedMeasurements.emplace_back(m->Clone());
+            measurements.emplace_back(clone->ownedMeasurements.back().get());
+        }
+
+        clone->AddPeriod(periods[i].name, contexts[0][i].corrector->Clone(),
+          periods[i].nuisanceDefs, measurements);
+    }
+
+    return clone;
+}
+
+
+std::vector<double> MultiPeriodLossFunction::ComputeCovariance(double const *x) const
+{
+    unsigned const numParams = NDim();
+
+
+    // Construct the list of points for finite differences. For each period, they include the
+    //nominal point, shifts along individual parameters, and shifts along pairs of parameters.
+    std::vector<StencilPoint> stencil;
+
+    for (unsigned p = 0; p < periods.size(); ++p)
+    {
+        unsigned const n = periods[p].paramIndices.size();
+        stencil.push_back({p, 0, 0, 0, 0});
+
+        for (unsigned i = 0; i < n; ++i)
+        {
+            stencil.push_back({p, i, 0, +1, 0});
+            stencil.push_back({p, i, 0, -1, 0});
+        }
+
+        for (unsigned i = 0; i < n; ++i)
+            for (unsigned j = i + 1; j < n; ++j)
+                for (int const shift1: {+1, -1})
+                    for (int const shift2: {+1, -1})
+                        stencil.push_back({p, i, j, shift1, shift2});
+    }
+
+    std::vector<double> values(stencil.size());
+
+    for (auto &point: points)
+        std::copy(x, x + numParams, point.begin());
+
+    threadPool.Run(stencil.size(), [this, x, &stencil, &values](unsigned task, unsigned worker)
+    {
+        auto const &s = stencil[task];
+        auto const &paramIndices = periods[s.period].paramIndices;
+        auto &point = points[worker];
+        auto const shiftPoint = [&](unsigned param, int shift)
+        {
+            if (shift != 0)
+            {
+                unsigned const index = paramIndices[param];
+                point[index] = x[index] + shift * Step(x[index], hessianRelStep);
+            }
+        };
+
+        shiftPoint(s.param1, s.shift1);
+        shiftPoint(s.param2, s.shift2);
+        values[task] = EvalPeriod(s.period, worker, point.data());
+
+        // Restore the nominal point
+        for (auto const &[param, shift]: {std::make_pair(s.param1, s.shift1),
+          std::make_pair(s.param2, s.shift2)})
+        {
+            if (shift != 0)
+                point[paramIndices[param]] = x[paramIndices[param]];
+        }
+    });
+
+
+    // Assemble the Hessian from the contributions of individual periods and the penalty terms for
+    //nuisances
+    std::vector<double> hessian(numParams * numParams, 0.);
+    unsigned task = 0;
+
+    for (auto const &period: periods)
+    {
+        unsigned const n = period.paramIndices.size();
+        std::vector<double> steps(n);
+
+        for (unsigned i = 0; i < n; ++i)
+            steps[i] = Step(x[period.paramIndices[i]], hessianRelStep);
+
+        double const center = values[task];
+        ++task;
+
+        for (unsigned i = 0; i < n; ++i)
+        {
+            unsigned const index = period.paramIndices[i];
+            hessian[index * numParams + index] +=
+              (values[task] - 2 * center + values[task + 1]) / (steps[i] * steps[i]);
+            task += 2;
+        }
+
+        for (unsigned i = 0; i < n; ++i)
+            for (unsigned j = i + 1; j < n; ++j)
+            {
+                double const d = (values[task] - values[task + 1] - values[task + 2] +
+                  values[task + 3]) / (4 * steps[i] * steps[j]);
+                task += 4;
+
+                unsigned const index1 = period.paramIndices[i],
+                  index2 = period.paramIndices[j];
+                hessian[index1 * numParams + index2] += d;
+                hessian[index2 * numParams + index1] += d;
+            }
+    }
+
+    for (unsigned const index: nuisanceParams)
+        hessian[index * numParams + index] += 2.;
+
+
+    // Invert the Hessian exploiting its arrowhead structure. Denote by A_p the diagonal block for
+    //period p, by B_p its off-diagonal block for shared nuisances, and by C the diagonal block for
+    //the shared nuisances. With X_p = A_p^-1 B_p and the Schur complement
+    //S = C - sum_p B_p^T X_p, the inverse has blocks S^-1 for the shared nuisances,
+    //-X_p S^-1 for the coupling between them and period p, and
+    //delta_pq A_p^-1 + X_p S^-1 X_q^T for periods p and q.
+    unsigned const sharedOffset = numParams - numShared;
+    auto const throwNotPosDef = []()
+    {
+        throw std::runtime_error("MultiPeriodLossFunction::ComputeCovariance: Hessian is not "
+          "positive-definite.");
+    };
+
+    std::vector<double> schur(numShared * numShared);
+
+    for (unsigned i = 0; i < numShared; ++i)
+        for (unsigned j = 0; j < numShared; ++j)
+            schur[i * numShared + j] =
+              hessian[(sharedOffset + i) * numParams + sharedOffset + j];
+
+    std::vector<std::vector<double>> blockInverses, couplings;
+
+    for (auto const &period: periods)
+    {
+        unsigned const m = period.blockSize;
+        std::vector<double> block(m * m);
+
+        for (unsigned i = 0; i < m; ++i)
+            for (unsigned j = 0; j < m; ++j)
+                block[i * m + j] = hessian[(period.offset + i) * numParams + period.offset + j];
+
+        if (not InvertSymmetric(block, m))
+            throwNotPosDef();
+
+        // X_p = A_p^-1 B_p
+        std::vector<double> coupling(m * numShared, 0.);
+
+        for (unsigned i = 0; i < m; ++i)
+            for (unsigned k = 0; k < m; ++k)
+            {
+                double const a = block[i * m + k];
+                double const *b = &hessian[(period.offset + k) * numParams + sharedOffset];
+
+                for (unsigned j = 0; j < numShared; ++j)
+                    coupling[i * numShared + j] += a * b[j];
+            }
+
+        for (unsigned k = 0; k < m; ++k)
+        {
+            double const *b = &hessian[(period.offset + k) * numParams + sharedOffset];
+
+            for (unsigned i = 0; i < numShared; ++i)
+                for (unsigned j = 0; j < numShared; ++j)
+                    schur[i * numShared + j] -= b[i] * coupling[k * numShared + j];
+        }
+
+        blockInverses.emplace_back(std::move(block));
+        couplings.emplace_back(std::move(coupling));
+    }
+
+    if (not InvertSymmetric(schur, numShared))
+        throwNotPosDef();
+
+
+    // Y_p = X_p S^-1
+    std::vector<std::vector<double>> projected;
+
+    for (unsigned p = 0; p < periods.size(); ++p)
+    {
+        unsigned const m = periods[p].blockSize;
+        std::vector<double> y(m * numShared, 0.);
+
+        for (unsigned i = 0; i < m; ++i)
+            for (unsigned k = 0; k < numShared; ++k)
+            {
+                double const c = couplings[p][i * numShared + k];
+
+                for (unsigned j = 0; j < numShared; ++j)
+                    y[i * numShared + j] += c * schur[k * numShared + j];
+            }
+
+        projected.emplace_back(std::move(y));
+    }
+
+
+    // Fill the covariance matrix, which is twice the inverse of the Hessian of a chi^2
+    std::vector<double> covariance(numParams * numParams, 0.);
+
+    for (unsigned i = 0; i < numShared; ++i)
+        for (unsigned j = 0; j < numShared; ++j)
+            covariance[(sharedOffset + i) * numParams + sharedOffset + j] =
+              2 * schur[i * numShared + j];
+
+    for (unsigned p = 0; p < periods.size(); ++p)
+    {
+        unsigned const m = periods[p].blockSize, offsetP = periods[p].offset;
+
+        for (unsigned i = 0; i < m; ++i)
+            for (unsigned j = 0; j < numShared; ++j)
+            {
+                double const c = -2 * projected[p][i * numShared + j];
+                covariance[(offsetP + i) * numParams + sharedOffset + j] = c;
+                covariance[(sharedOffset + j) * numParams + offsetP + i] = c;
+            }
+
+        // Only compute the upper triangle and fill the lower one by symmetry
+        for (unsigned q = p; q < periods.size(); ++q)
+        {
+            unsigned const n = periods[q].blockSize, offsetQ = periods[q].offset;
+
+            for (unsigned i = 0; i < m; ++i)
+                for (unsigned j = (p == q) ? i : 0; j < n; ++j)
+                {
+                    double sum = (p == q) ? blockInverses[p][i * m + j] : 0.;
+
+                    for (unsigned k = 0; k < numShared; ++k)
+                        sum += projected[p][i * numShared + k] * couplings[q][j * numShared + k];
+
+                    covariance[(offsetP + i) * numParams + offsetQ + j] = 2 * sum;
+                    covariance[(offsetQ + j) * numParams + offsetP + i] = 2 * sum;
+                }
+        }
+    }
+
+    return covariance;
+}
+
+
+double MultiPeriodLossFunction::EvalRawInput(double const *x) const
+{
+    threadPool.Run(periods.size(), [this, x](unsigned period, unsigned worker)
+    {
+        periodLosses[period] = EvalPeriod(period, worker, x);
+    });
+
+    double loss = EvalPenalty(x);
+
+    for (double const periodLoss: periodLosses)
+        loss += periodLoss;
+
+    return loss;
+}
+
+
+void MultiPeriodLossFunction::FdF(double const *x, double &f, double *grad) const
+{
+    f = DoEval(x);
+    Gradient(x, grad);
+}
+
+
+unsigned MultiPeriodLossFunction::GetNDF() const
+{
+    unsigned dimDeviations = 0;
+
+    for (auto const &period: periods)
+        for (auto const &m: period.measurements)
+            dimDeviations += m->GetDim();
+
+    return dimDeviations - NDim();
+}
+
+
+unsigned MultiPeriodLossFunction::GetNumPeriods() const
+{
+    return periods.size();
+}
+
+
+unsigned MultiPeriodLossFunction::GetNumThreads() const
+{
+    return threadPool.GetNumWorkers();
+}
+
+
+std::string const &MultiPeriodLossFunction::GetParamName(unsigned index) const
+{
+    if (index >= paramNames.size())
+    {
+        std::ostringstream message;
+        message << "MultiPeriodLossFunction::GetParamName: Requesting parameter with index " <<
+          index << " while only " << paramNames.size() << " parameters are defined.";
+        throw std::runtime_error(message.str());
+    }
+
+    return paramNames[index];
+}
+
+
+unsigned MultiPeriodLossFunction::GetPeriodOffset(unsigned period) const
+{
+    if (period >= periods.size())
+    {
+        std::ostringstream message;
+        message << "MultiPeriodLossFunction::GetPeriodOffset: Requesting period with index " <<
+          period << " while only " << periods.size() << " periods have been added.";
+        throw std::runtime_error(message.str());
+    }
+
+    return periods[period].offset;
+}
+
+
+void MultiPeriodLossFunction::Gradient(double const *x, double *grad) const
+{
+    unsigned const numParams = NDim();
+
+    for (auto &point: points)
+        std::copy(x, x + numParams, point.begin());
+
+    // For each variation, evaluate the loss in the affected period at points shifted up and down
+    //along the parameter, which are stored at positions 2 i and 2 i + 1 of the buffer
+    threadPool.Run(2 * gradVariations.size(), [this, x](unsigned task, unsigned worker)
+    {
+        auto const &[period, param] = gradVariations[task / 2];
+        unsigned const index = periods[period].paramIndices[param];
+        auto &point = points[worker];
+
+        double const step = Step(x[index], relStep);
+        point[index] = x[index] + ((task % 2 == 0) ? step : -step);
+        stencilValues[task] = EvalPeriod(period, worker, point.data());
+        point[index] = x[index];
+    });
+
+    std::fill(grad, grad + numParams, 0.);
+
+    for (unsigned i = 0; i < gradVariations.size(); ++i)
+    {
+        auto const &[period, param] = gradVariations[i];
+        unsigned const index = periods[period].paramIndices[param];
+
+        // Use the actual distance between the points, which accounts for rounding errors
+        double const step = Step(x[index], relStep);
+        double const width = (x[index] + step) - (x[index] - step);
+        grad[index] += (stencilValues[2 * i] - stencilValues[2 * i + 1]) / width;
+    }
+
+    // Derivative of the penalty terms for nuisances
+    for (unsigned const index: nuisanceParams)
+        grad[index] += 2 * x[index];
+}
+
+
+bool MultiPeriodLossFunction::IsShared(std::string const &nuisanceName) const
+{
+    for (auto const &pattern: sharedPatterns)
+    {
+        if (std::regex_match(nuisanceName, pattern))
+            return true;
+    }
+
+    return false;
+}
+
+
+unsigned int MultiPeriodLossFunction::NDim() const
+{
+    return paramNames.size();
+}
+
+
+void MultiPeriodLossFunction::SetRelStep(double relStep_)
+{
+    if (relStep_ <= 0.)
+    {
+        std::ostringstream message;
+        message << "MultiPeriodLossFunction::SetRelStep: Given step " << relStep_ <<
+          " is not positive.";
+        throw std::runtime_error(message.str());
+    }
+
+    relStep = relStep_;
+}
+
+
+double MultiPeriodLossFunction::DoDerivative(double const *x, unsigned int icoord) const
+{
+    auto &point = points[0];
+    std::copy(x, x + NDim(), point.begin());
+    double const step = Step(x[icoord], relStep);
+
+    point[icoord] = x[icoord] + step;
+    double const valueUp = EvalRawInput(point.data());
+
+    point[icoord] = x[icoord] - step;
+    double const valueDown = EvalRawInput(point.data());
+
+    return (valueUp - valueDown) / ((x[icoord] + step) - (x[icoord] - step));
+}
+
+
+double MultiPeriodLossFunction::DoEval(double const *x) const
+{
+    return EvalRawInput(x);
+}
+
+
+double MultiPeriodLossFunction::EvalPeriod(unsigned period, unsigned worker, double const *x)
+  const
+{
+    auto const &p = periods[period];
+    auto &context = contexts[worker][period];
+
+    context.corrector->SetParams(x + p.offset);
+
+    for (unsigned i = 0; i < p.nuisanceIndices.size(); ++i)
+        context.nuisances[i] = x[p.nuisanceIndices[i]];
+
+    double loss = 0.;
+
+    for (auto const &m: context.measurements)
+        loss += m->Eval(*context.corrector, context.nuisances);
+
+    return loss;
+}
+
+
+double MultiPeriodLossFunction::EvalPenalty(double const *x) const
+{
+    double penalty = 0.;
+
+    for (unsigned const index: nuisanceParams)
+        penalty += x[index] * x[index];
+
+    return penalty;
+}
+
+
+void MultiPeriodLossFunction::UpdateLayout()
+{
+    paramNames.clear();
+    nuisanceParams.clear();
+    gradVariations.clear();
+
+
+    // Blocks of individual periods. Shared nuisances are assigned indices relative to the start of
+    //their section, in the order of their first appearance, and are updated below.
+    std::vector<std::string> sharedNames;
+    std::map<std::string, unsigned> sharedIndices;
+    std::vector<std::vector<bool>> isShared;
+
+    for (unsigned p = 0; p < periods.size(); ++p)
+    {
+        auto &period = periods[p];
+        period.offset = paramNames.size();
+        period.numCorrParams = contexts[0][p].corrector->GetNumParams();
+
+        for (unsigned i = 0; i < period.numCorrParams; ++i)
+            paramNames.emplace_back("p" + std::to_string(i) + "_" + period.name);
+
+        period.nuisanceIndices.clear();
+        isShared.emplace_back();
+
+        for (auto const &name: period.nuisanceDefs.GetNames())
+        {
+            if (IsShared(name))
+            {
+                auto const res = sharedIndices.find(name);
+
+                if (res == sharedIndices.end())
+                {
+                    sharedIndices[name] = sharedNames.size();
+                    period.nuisanceIndices.emplace_back(sharedNames.size());
+                    sharedNames.emplace_back(name);
+                }
+                else
+                    period.nuisanceIndices.emplace_back(res->second);
+
+                isShared.back().emplace_back(true);
+            }
+            else
+            {
+                period.nuisanceIndices.emplace_back(paramNames.size());
+                nuisanceParams.emplace_back(paramNames.size());
+                paramNames.emplace_back(name + "_" + period.name);
+                isShared.back().emplace_back(false);
+            }
+        }
+
+        period.blockSize = paramNames.size() - period.offset;
+    }
+
+
+    // Section with shared nuisances
+    unsigned const sharedOffset = paramNames.size();
+    numShared = sharedNames.size();
+
+    for (auto const &name: sharedNames)
+    {
+        nuisanceParams.emplace_back(paramNames.size());
+        paramNames.emplace_back(name);
+    }
+
+    for (unsigned p = 0; p < periods.size(); ++p)
+    {
+        auto &period = periods[p];
+
+        for (unsigned i = 0; i < period.nuisanceIndices.size(); ++i)
+        {
+            if (isShared[p][i])
+                period.nuisanceIndices[i] += sharedOffset;
+        }
+
+        period.paramIndices.clear();
+
+        for (unsigned i = 0; i < period.numCorrParams; ++i)
+            period.paramIndices.emplace_back(period.offset + i);
+
+        period.paramIndices.insert(period.paramIndices.end(), period.nuisanceIndices.begin(),
+          period.nuisanceIndices.end());
+
+        for (unsigned i = 0; i < period.paramIndices.size(); ++i)
+            gradVariations.emplace_back(p, i);
+    }
+
+
+    // Buffers
+    for (auto &point: points)
+        point.resize(paramNames.size());
+
+    periodLosses.resize(periods.size());
+    stencilValues.resize(2 * gradVariations.size());
+}
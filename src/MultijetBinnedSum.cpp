@@ -1,12 +1,15 @@
 #include <MultijetBinnedSum.hpp>
 
+#include <JetCorrDefinitions.hpp>
 #include <Rebin.hpp>
 
 #include <TFile.h>
 #include <TKey.h>
+#include <TROOT.h>
 #include <TVectorD.h>
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstring>
 #include <limits>
@@ -16,8 +19,9 @@
 
 
 MultijetBinnedSum::MultijetBinnedSum(std::string const &fileName,
-  MultijetBinnedSum::Method method_, NuisanceDefinitions &nuisanceDefs):
-    method(method_)
+  MultijetBinnedSum::Method method_, NuisanceDefinitions &nuisanceDefs,
+  FlatHist2D::Storage storage):
+    method(method_), storagePrecision{0., 0.}, workerScratch(1)
 {
     std::string methodLabel;
     
@@ -98,7 +102,7 @@ MultijetBinnedSum::MultijetBinnedSum(std::string const &fileName,
         bin.ptJetSumProj->SetDirectory(nullptr);
         
         
-        for (std::string const &systName: {"L1Res", "L2Res", "JER"})
+        for (char const *systName: {"L1Res", "L2Res", "JER"})
         {
             std::string const histPrefix("RelVar_" + methodLabel + "_" + systName);
             TH1 *histUp = dynamic_cast<TH1 *>(directory->Get((histPrefix + "Up").c_str()));
@@ -127,6 +131,8 @@ MultijetBinnedSum::MultijetBinnedSum(std::string const &fileName,
     
     
     // Construct remaining fields in trigger bins
+    unsigned numCorrectionPoints = 0;
+    
     for (auto &bin: triggerBins)
     {
         // Save binning in data in a handy format
@@ -135,6 +141,11 @@ MultijetBinnedSum::MultijetBinnedSum(std::string const &fileName,
         for (int i = 1; i <= bin.ptLead->GetNbinsX() + 1; ++i)
             bin.binning.emplace_back(bin.ptLead->GetBinLowEdge(i));
         
+        bin.simBinning.reserve(bin.simBalProfile->GetNbinsX() + 1);
+        
+        for (int i = 1; i <= bin.simBalProfile->GetNbinsX() + 1; ++i)
+            bin.simBinning.emplace_back(bin.simBalProfile->GetBinLowEdge(i));
+        
         
         // Compute combined (squared) uncertainty on the balance observable in data and simulation.
         //The data profile is rebinned with the binning used for simulation. This is done assuming
@@ -153,19 +164,73 @@ MultijetBinnedSum::MultijetBinnedSum(std::string const &fileName,
         
         // Initialize recomputed mean balance observable with dummy values
         bin.recompBal.resize(bin.simBalProfile->GetNbinsX());
+        
+        
+        // Copy sums of jet projections into a dense array to allow vectorized sums over jets
+        bin.ptJetSumProjContents = std::make_shared<FlatHist2D>(*bin.ptJetSumProj);
+        bin.jetFactors.resize(bin.ptJetSumProjContents->GetNbinsY());
+        
+        auto const *ptJetAxis = bin.ptJetSumProj->GetYaxis();
+        
+        for (unsigned i = 0; i < bin.jetFactors.size(); ++i)
+            bin.ptJetCentres.emplace_back(ptJetAxis->GetBinCenter(i + 1));
+        
+        bin.correctionOffset = numCorrectionPoints;
+        numCorrectionPoints += bin.ptJetCentres.size();
     }
     
     
     // Set the range of trigger bins to include all of them
     selectedTriggerBinsBegin = 0;
     selectedTriggerBinsEnd = triggerBins.size();
+    UpdateSelection();
     
     
-    // Precompute dimensionality. It is given by binning of simulation.
-    dimensionality = 0;
+    // If a compact storage has been requested, convert the histograms of jet projections and
+    //evaluate the loss of precision. A unit correction is used for the check, which is provided by
+    //JetCorrStableLogLin with its parameter set to zero.
+    if (storage != FlatHist2D::Storage::Double)
+    {
+        JetCorrStableLogLin const unitCorrection;
+        Nuisances const zeroNuisances(nuisanceDefs);
+        
+        double const refChi2 = Eval(unitCorrection, zeroNuisances);
+        std::vector<double> refBalance;
+        
+        for (auto const &bin: triggerBins)
+            refBalance.insert(refBalance.end(), bin.recompBal.begin(), bin.recompBal.end());
+        
+        for (auto &bin: triggerBins)
+            bin.ptJetSumProjContents->SetStorage(storage);
+        
+        double const chi2 = Eval(unitCorrection, zeroNuisances);
+        unsigned i = 0;
+        
+        for (auto const &bin: triggerBins)
+        {
+            for (auto const &balance: bin.recompBal)
+            {
+                storagePrecision.maxRelErrorBalance = std::max(
+                  storagePrecision.maxRelErrorBalance,
+                  StoragePrecision::Deviation(balance, refBalance[i]));
+                ++i;
+            }
+        }
+        
+        storagePrecision.relErrorChi2 = StoragePrecision::Deviation(chi2, refChi2);
+    }
+}
+
+
+std::unique_ptr<MeasurementBase> MultijetBinnedSum::Clone() const
+{
+    auto clone = std::make_unique<MultijetBinnedSum>(*this);
+    
+    // The pool cannot be shared as it must not be used from several threads at once
+    if (threadPool)
+        clone->threadPool = std::make_shared<ThreadPool>(threadPool->GetNumWorkers());
     
-    for (auto const &bin: triggerBins)
-        dimensionality += bin.simBalProfile->GetNbinsX();
+    return clone;
 }
 
 
@@ -178,61 +243,21 @@ unsigned MultijetBinnedSum::GetDim() const
 TH1D MultijetBinnedSum::GetRecompBalance(JetCorrBase const &corrector, Nuisances const &nuisances)
   const
 {
-    // An auxiliary structure to aggregate information about a single bin. Consists of the lower
-    //bin edge, bin content, and its uncertainty.
-    using Bin = std::tuple<double, double, double>;
-    
-    
-    // Recompute mean balance observables
     UpdateBalance(corrector, nuisances);
     
     
-    // Read recomputed mean balance observables for all bins
-    std::vector<Bin> bins;
-    bins.reserve(dimensionality);
-    
-    double upperBoundary = -std::numeric_limits<double>::infinity();
-    
-    for (unsigned iTriggerBin = selectedTriggerBinsBegin; iTriggerBin < selectedTriggerBinsEnd;
-      ++iTriggerBin)
-    {
-        auto const &triggerBin = triggerBins[iTriggerBin];
-        
-        auto const &simBalProfile = triggerBin.simBalProfile;
-        
-        for (unsigned i = 0; i < triggerBin.recompBal.size(); ++i)
-            bins.emplace_back(std::make_tuple(simBalProfile->GetBinLowEdge(i + 1),
-              triggerBin.recompBal[i], std::sqrt(triggerBin.totalUnc2[i])));
-        
-        
-        double const lastEdge = simBalProfile->GetBinLowEdge(simBalProfile->GetNbinsX() + 1);
-        
-        if (lastEdge > upperBoundary)
-            upperBoundary = lastEdge;
-    }
-    
-    
-    // Different trigger bins might not have been ordered in pt. Sort the constructed list of bins.
-    std::sort(bins.begin(), bins.end(),
-      [](auto const &lhs, auto const &rhs){return (std::get<0>(lhs) < std::get<0>(rhs));});
-    
-    
-    // Construct a histogram from the collection of bins
-    std::vector<double> edges;
-    edges.reserve(bins.size() + 1);
-    
-    for (unsigned i = 0; i < bins.size(); ++i)
-        edges.emplace_back(std::get<0>(bins[i]));
-    
-    edges.emplace_back(upperBoundary);
-    
-    TH1D hist("RecompBalance", "", edges.size() - 1, edges.data());
+    // Construct a histogram with bins of all selected trigger bins, which have been ordered in
+    //the constructor since different trigger bins might not be ordered in pt
+    unsigned const numBins = recompBalOrder.size();
+    TH1D hist("RecompBalance", "", numBins, recompBalEdges.data());
     hist.SetDirectory(nullptr);
     
-    for (unsigned i = 0; i < bins.size(); ++i)
+    for (unsigned i = 0; i < numBins; ++i)
     {
-        hist.SetBinContent(i + 1, std::get<1>(bins[i]));
-        hist.SetBinError(i + 1, std::get<2>(bins[i]));
+        auto const &triggerBin = triggerBins[recompBalOrder[i].first];
+        unsigned const bin = recompBalOrder[i].second;
+        hist.SetBinContent(i + 1, triggerBin.recompBal[bin]);
+        hist.SetBinError(i + 1, std::sqrt(triggerBin.totalUnc2[bin]));
     }
     
     
@@ -240,9 +265,41 @@ TH1D MultijetBinnedSum::GetRecompBalance(JetCorrBase const &corrector, Nuisances
 }
 
 
+StoragePrecision const &MultijetBinnedSum::GetStoragePrecision() const
+{
+    return storagePrecision;
+}
+
+
 double MultijetBinnedSum::Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const
 {
     UpdateBalance(corrector, nuisances);
+    return SumChi2(nuisances);
+}
+
+
+double MultijetBinnedSum::EvalWithCorrections(JetCorrBase const &corrector,
+  Nuisances const &nuisances, double const *corrections) const
+{
+    UpdateBalance(corrector, nuisances, corrections);
+    return SumChi2(nuisances);
+}
+
+
+std::vector<double> MultijetBinnedSum::GetCorrectionPoints() const
+{
+    std::vector<double> points;
+    
+    for (auto const &triggerBin: triggerBins)
+        points.insert(points.end(), triggerBin.ptJetCentres.begin(),
+          triggerBin.ptJetCentres.end());
+    
+    return points;
+}
+
+
+double MultijetBinnedSum::SumChi2(Nuisances const &nuisances) const
+{
     double chi2 = 0.;
     
     for (unsigned iTriggerBin = selectedTriggerBinsBegin; iTriggerBin < selectedTriggerBinsEnd;
@@ -304,13 +361,23 @@ void MultijetBinnedSum::SetTriggerBinRange(unsigned begin, unsigned end)
     
     selectedTriggerBinsBegin = begin;
     selectedTriggerBinsEnd = end;
+    UpdateSelection();
+}
+
+
+void MultijetBinnedSum::SetNumThreads(unsigned numThreads)
+{
+    if (numThreads == 1)
+        threadPool.reset();
+    else
+    {
+        threadPool = std::make_shared<ThreadPool>(numThreads);
+        
+        if (threadPool->GetNumWorkers() > 1)
+            ROOT::EnableThreadSafety();
+    }
     
-    
-    // Have to recompute cached dimensionality
-    dimensionality = 0;
-    
-    for (unsigned i = selectedTriggerBinsBegin; i < selectedTriggerBinsEnd; ++i)
-        dimensionality += triggerBins[i].simBalProfile->GetNbinsX();
+    workerScratch.resize((threadPool) ? threadPool->GetNumWorkers() : 1);
 }
 
 
@@ -332,19 +399,13 @@ double MultijetBinnedSum::ComputeMPF(TriggerBin const &triggerBin, FracBin const
         
         // Sum over other jets. Consider separately the starting bin, which is only partly
         //included, and the remaining ones
-        double sumJets = 0.;
+        auto const &sumProj = *triggerBin.ptJetSumProjContents;
+        auto const &factors = triggerBin.jetFactors;
         
-        double pt = triggerBin.ptJetSumProj->GetYaxis()->GetBinCenter(ptJetStart.index);
-        double s = triggerBin.ptJetSumProj->GetBinContent(iPtLead, ptJetStart.index);
-        sumJets += (1 - corrector.Eval(pt)) * s * ptJetStart.frac;
-        
-        for (int iPtJ = ptJetStart.index + 1; iPtJ < triggerBin.ptJetSumProj->GetNbinsY() + 1;
-          ++iPtJ)
-        {
-            pt = triggerBin.ptJetSumProj->GetYaxis()->GetBinCenter(iPtJ);
-            s = triggerBin.ptJetSumProj->GetBinContent(iPtLead, iPtJ);
-            sumJets += (1 - corrector.Eval(pt)) * s;
-        }
+        double sumJets = sumProj.GetBinContent(iPtLead, ptJetStart.index) *
+          factors[ptJetStart.index - 1] * ptJetStart.frac;
+        sumJets += sumProj.Dot(iPtLead, factors.data(), ptJetStart.index + 1,
+          sumProj.GetNbinsY());
         
         
         // The first and the last bins are only partially included. Find the inclusion fraction for
@@ -386,19 +447,13 @@ double MultijetBinnedSum::ComputePtBal(TriggerBin const &triggerBin, FracBin con
         
         // Sum over other jets. Consider separately the starting bin, which is only partly
         //included, and the remaining ones
-        double sumJets = 0.;
-        
-        double pt = triggerBin.ptJetSumProj->GetYaxis()->GetBinCenter(ptJetStart.index);
-        double s = triggerBin.ptJetSumProj->GetBinContent(iPtLead, ptJetStart.index);
-        sumJets += s * corrector.Eval(pt) * ptJetStart.frac;
+        auto const &sumProj = *triggerBin.ptJetSumProjContents;
+        auto const &factors = triggerBin.jetFactors;
         
-        for (int iPtJ = ptJetStart.index + 1; iPtJ < triggerBin.ptJetSumProj->GetNbinsY() + 1;
-          ++iPtJ)
-        {
-            pt = triggerBin.ptJetSumProj->GetYaxis()->GetBinCenter(iPtJ);
-            s = triggerBin.ptJetSumProj->GetBinContent(iPtLead, iPtJ);
-            sumJets += s * corrector.Eval(pt);
-        }
+        double sumJets = sumProj.GetBinContent(iPtLead, ptJetStart.index) *
+          factors[ptJetStart.index - 1] * ptJetStart.frac;
+        sumJets += sumProj.Dot(iPtLead, factors.data(), ptJetStart.index + 1,
+          sumProj.GetNbinsY());
         
         
         // The first and the last bins are only partially included. Find the inclusion fraction for
@@ -420,7 +475,8 @@ double MultijetBinnedSum::ComputePtBal(TriggerBin const &triggerBin, FracBin con
 }
 
 
-void MultijetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances const &) const
+void MultijetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances const &,
+  double const *corrections) const
 {
     double minPtUncorr = corrector.UndoCorr(minPt);
     
@@ -434,69 +490,143 @@ void MultijetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances co
     }
     
     
-    for (unsigned iTriggerBin = selectedTriggerBinsBegin; iTriggerBin < selectedTriggerBinsEnd;
-      ++iTriggerBin)
+    // Trigger bins only write into their own buffers and can be processed in parallel
+    unsigned const numSelected = selectedTriggerBinsEnd - selectedTriggerBinsBegin;
+    
+    if (threadPool)
     {
-        auto const &triggerBin = triggerBins[iTriggerBin];
-        
-        // The binning in pt of the leading jet in the profile for simulation corresponds to
-        //corrected jets. Translate it into a binning in uncorrected pt.
-        std::vector<double> uncorrPtBinning;
-        
-        for (int i = 1; i <= triggerBin.simBalProfile->GetNbinsX() + 1; ++i)
-        {
-            double const pt = triggerBin.simBalProfile->GetBinLowEdge(i);
-            uncorrPtBinning.emplace_back(corrector.UndoCorr(pt));
-        }
-        
-        
-        // Build a map from this translated binning to the fine binning in data histograms. It
-        //accounts both for the migration in pt of the leading jet due to the jet correction and
-        //the typically larger size of bins used for computation of chi2.
-        BinMap binMap;
-        
-        try
-        {
-            binMap = mapBinning(triggerBin.binning, uncorrPtBinning);
-        }
-        catch (std::logic_error const &e)
+        threadPool->Run(numSelected,
+          [this, &corrector, minPtUncorr, corrections](unsigned task, unsigned worker)
         {
-            std::ostringstream message;
-            message << e.what() << '\n';
-            message << "MultijetBinnedSum::UpdateBalance: Failed to construct the bin mapping for "
-              "the current correction (" << corrector << ").";
-            throw std::runtime_error(message.str());
-        }
+            UpdateTriggerBin(triggerBins[selectedTriggerBinsBegin + task], corrector, minPtUncorr,
+              workerScratch[worker], corrections);
+        });
+    }
+    else
+    {
+        for (unsigned task = 0; task < numSelected; ++task)
+            UpdateTriggerBin(triggerBins[selectedTriggerBinsBegin + task], corrector, minPtUncorr,
+              workerScratch[0], corrections);
+    }
+}
+
+
+void MultijetBinnedSum::UpdateTriggerBin(TriggerBin const &triggerBin,
+  JetCorrBase const &corrector, double minPtUncorr, ScratchArena &scratch,
+  double const *corrections) const
+{
+    scratch.Reset();
+    
+    // Evaluate the correction for other jets once per trigger bin rather than for each bin in pt
+    //of the leading jet, unless it has been precomputed
+    if (corrections)
+    {
+        double const *source = corrections + triggerBin.correctionOffset;
+        std::copy(source, source + triggerBin.jetFactors.size(), triggerBin.jetFactors.begin());
+    }
+    else
+        corrector.EvalBatch(triggerBin.ptJetCentres.data(), triggerBin.jetFactors.data(),
+          triggerBin.jetFactors.size());
+    
+    if (method == Method::MPF)
+    {
+        for (auto &factor: triggerBin.jetFactors)
+            factor = 1 - factor;
+    }
+    
+    
+    // The binning in pt of the leading jet in the profile for simulation corresponds to corrected
+    //jets. Translate it into a binning in uncorrected pt.
+    unsigned const numSimBins = triggerBin.simBinning.size() - 1;
+    double *uncorrPtBinning = scratch.Allocate<double>(numSimBins + 1);
+    
+    for (unsigned i = 0; i < numSimBins + 1; ++i)
+        uncorrPtBinning[i] = corrector.UndoCorr(triggerBin.simBinning[i]);
+    
+    
+    // Build a map from this translated binning to the fine binning in data histograms. It accounts
+    //both for the migration in pt of the leading jet due to the jet correction and the typically
+    //larger size of bins used for computation of chi2. The map is indexed with the bin of the
+    //translated binning.
+    auto *binMap = scratch.Allocate<std::array<FracBin, 2>>(numSimBins + 2);
+    
+    try
+    {
+        mapBinning(triggerBin.binning.data(), triggerBin.binning.size(), uncorrPtBinning,
+          numSimBins + 1, binMap, scratch);
+    }
+    catch (std::logic_error const &e)
+    {
+        std::ostringstream message;
+        message << e.what() << '\n';
+        message << "MultijetBinnedSum::UpdateBalance: Failed to construct the bin mapping for "
+          "the current correction (" << corrector << ").";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Find bin in pt of other jets that contains minPtUncorr, and the corresponding inclusion
+    //fraction
+    auto const *axis = triggerBin.ptJetSumProj->GetYaxis();
+    unsigned const minPtBin = axis->FindFixBin(minPtUncorr);
+    double const minPtFrac = (minPtUncorr - axis->GetBinLowEdge(minPtBin)) /
+      axis->GetBinWidth(minPtBin);
+    FracBin const ptJetStart{minPtBin, 1. - minPtFrac};
+    
+    
+    // Compute mean balance with the translated binning. Under- and overflow bins in pt are
+    //included in other trigger bins and are skipped.
+    for (unsigned binIndex = 1; binIndex <= numSimBins; ++binIndex)
+    {
+        auto const &binRange = binMap[binIndex];
         
-        // Under- and overflow bins in pt are included in other trigger bins and must be dropped
-        binMap.erase(0);
-        binMap.erase(triggerBin.simBalProfile->GetNbinsX() + 1);
+        double meanBal;
         
+        if (method == Method::PtBal)
+            meanBal = ComputePtBal(triggerBin, binRange[0], binRange[1], ptJetStart, corrector);
+        else
+            meanBal = ComputeMPF(triggerBin, binRange[0], binRange[1], ptJetStart, corrector);
         
-        // Find bin in pt of other jets that contains minPtUncorr, and the corresponding inclusion
-        //fraction
-        auto const *axis = triggerBin.ptJetSumProj->GetYaxis();
-        unsigned const minPtBin = axis->FindFixBin(minPtUncorr);
-        double const minPtFrac = (minPtUncorr - axis->GetBinLowEdge(minPtBin)) /
-          axis->GetBinWidth(minPtBin);
-        FracBin const ptJetStart{minPtBin, 1. - minPtFrac};
+        triggerBin.recompBal[binIndex - 1] = meanBal;
+    }
+}
+
+
+void MultijetBinnedSum::UpdateSelection()
+{
+    // Dimensionality is given by binning of simulation
+    dimensionality = 0;
+    
+    for (unsigned i = selectedTriggerBinsBegin; i < selectedTriggerBinsEnd; ++i)
+        dimensionality += triggerBins[i].simBinning.size() - 1;
+    
+    
+    // Order bins of all selected trigger bins in pt of the leading jet
+    recompBalOrder.clear();
+    double upperBoundary = -std::numeric_limits<double>::infinity();
+    
+    for (unsigned i = selectedTriggerBinsBegin; i < selectedTriggerBinsEnd; ++i)
+    {
+        auto const &simBinning = triggerBins[i].simBinning;
         
+        for (unsigned bin = 0; bin < simBinning.size() - 1; ++bin)
+            recompBalOrder.emplace_back(i, bin);
         
-        // Compute mean balance with the translated binning
-        for (auto const &binMapPair: binMap)
-        {
-            auto const &binIndex = binMapPair.first;
-            auto const &binRange = binMapPair.second;
-            
-            double meanBal;
-            
-            if (method == Method::PtBal)
-                meanBal = ComputePtBal(triggerBin, binRange[0], binRange[1], ptJetStart, corrector);
-            else
-                meanBal = ComputeMPF(triggerBin, binRange[0], binRange[1], ptJetStart, corrector);
-            
-            triggerBin.recompBal[binIndex - 1] = meanBal;
-        }
+        upperBoundary = std::max(upperBoundary, simBinning.back());
     }
+    
+    auto const lowEdge = [this](std::pair<unsigned, unsigned> const &bin)
+    {
+        return triggerBins[bin.first].simBinning[bin.second];
+    };
+    
+    std::stable_sort(recompBalOrder.begin(), recompBalOrder.end(),
+      [&lowEdge](auto const &lhs, auto const &rhs){return (lowEdge(lhs) < lowEdge(rhs));});
+    
+    recompBalEdges.clear();
+    
+    for (auto const &bin: recompBalOrder)
+        recompBalEdges.emplace_back(lowEdge(bin));
+    
+    recompBalEdges.emplace_back(upperBoundary);
 }
-
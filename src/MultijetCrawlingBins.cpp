@@ -1,5 +1,10 @@
 #include <MultijetCrawlingBins.hpp>
 
+#include <FastMath.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <PerfCounters.hpp>
+#include <Tracer.hpp>
+
 #include <TFile.h>
 #include <TKey.h>
 #include <TVectorD.h>
@@ -15,13 +20,31 @@
 using namespace std::string_literals;
 
 
-MultijetCrawlingBins::JetCache::JetCache(std::vector<double> const &meanPtLead_,
-  std::vector<double> const &meanPtJet_, double thresholdStart_, double thresholdEnd_):
+MultijetCrawlingBins::JetCache::JetCache(std::shared_ptr<FlatHist2D const> sumProj_,
+  std::vector<double> const &meanPtLead_, std::vector<double> const &meanPtJet_,
+  double thresholdStart_, double thresholdEnd_, Method method):
+    sumProj(sumProj_),
     meanPtLead(meanPtLead_), meanPtJet(meanPtJet_),
-    thresholdStart(thresholdStart_), thresholdEnd(thresholdEnd_),
     ptLeadCorrections(meanPtLead.size(), 0.), ptJetCorrections(meanPtJet.size(), 0.),
-    jetWeights(meanPtJet.size(), 0.), firstPtJetBin(1), lastPtJetBin(jetWeights.size())
-{}
+    logCorrectedPtLead(meanPtLead.size(), 0.),
+    corrConfigId(0), revision(0),
+    ptLeadRevisions(meanPtLead.size(), 0),
+    numBlocks((meanPtJet.size() + blockSize - 1) / blockSize),
+    blockRevisions(numBlocks, 0), rowRevisions(meanPtLead.size(), 0)
+{
+    for (auto &cache: methodCaches)
+    {
+        cache.enabled = false;
+        cache.thresholdStart = thresholdStart_;
+        cache.thresholdEnd = thresholdEnd_;
+        cache.jetWeights.assign(meanPtJet.size(), 0.);
+        cache.factors.assign(meanPtJet.size(), 0.);
+        cache.firstPtJetBin = 1;
+        cache.lastPtJetBin = meanPtJet.size();
+    }
+
+    EnableMethod(method);
+}
 
 
 double MultijetCrawlingBins::JetCache::CorrectedMeanPtLead(unsigned bin) const
@@ -30,6 +53,12 @@ double MultijetCrawlingBins::JetCache::CorrectedMeanPtLead(unsigned bin) const
 }
 
 
+double MultijetCrawlingBins::JetCache::LogCorrectedMeanPtLead(unsigned bin) const
+{
+    return logCorrectedPtLead[bin - 1];
+}
+
+
 double MultijetCrawlingBins::JetCache::CorrectionPtLead(unsigned bin) const
 {
     return ptLeadCorrections[bin - 1];
@@ -42,44 +71,265 @@ double MultijetCrawlingBins::JetCache::CorrectionPtJet(unsigned bin) const
 }
 
 
-std::pair<unsigned, unsigned> MultijetCrawlingBins::JetCache::PtJetBinRange() const
+void MultijetCrawlingBins::JetCache::EnableMethod(Method method)
 {
-    return {firstPtJetBin, lastPtJetBin};
+    auto &cache = methodCaches[int(method)];
+
+    if (cache.enabled)
+        return;
+
+    cache.enabled = true;
+    cache.blockSums.assign(meanPtLead.size() * numBlocks, 0.);
+    cache.rowSums.assign(meanPtLead.size(), 0.);
+
+    // The sums for the other method might have been computed with a different kernel, which
+    //affects the rounding. Recompute everything for consistency.
+    Invalidate();
 }
 
 
-void MultijetCrawlingBins::JetCache::Update(JetCorrBase const &corrector)
+void MultijetCrawlingBins::JetCache::EvalBatch(JetCorrBase &corrector, double const *corrParams,
+  unsigned numPoints, unsigned firstBinPtLead, unsigned lastBinPtLead, Batch &batch) const
 {
-    for (unsigned i = 0; i < meanPtLead.size(); ++i)
-        ptLeadCorrections[i] = corrector.Eval(meanPtLead[i]);
-    
-    for (unsigned i = 0; i < meanPtJet.size(); ++i)
+    static PerfRegion perfRegion("MultijetCrawlingBins::JetCache::EvalBatch");
+    PerfScope perfScope(perfRegion);
+
+    unsigned const numCorrParams = corrector.GetNumParams();
+    unsigned const numBinsPtLead = meanPtLead.size();
+    unsigned const numBinsPtJet = meanPtJet.size();
+    unsigned const numRows = lastBinPtLead - firstBinPtLead + 1;
+
+    // Points that only differ in nuisances, as in a finite-difference gradient, share the
+    //computation. Find distinct corrections and the first point for each of them.
+    batch.corrIndices.resize(numPoints);
+    batch.corrPoints.clear();
+
+    for (unsigned i = 0; i < numPoints; ++i)
     {
-        ptJetCorrections[i] = corrector.Eval(meanPtJet[i]);
-        jetWeights[i] = JetWeight(meanPtJet[i] * ptJetCorrections[i]);
+        double const *params = corrParams + i * numCorrParams;
+        unsigned corr = 0;
+
+        while (corr < batch.corrPoints.size() and not std::equal(params, params + numCorrParams,
+          corrParams + batch.corrPoints[corr] * numCorrParams))
+            ++corr;
+
+        if (corr == batch.corrPoints.size())
+            batch.corrPoints.emplace_back(i);
+
+        batch.corrIndices[i] = corr;
     }
+
+    unsigned const numCorrections = batch.corrPoints.size();
+
+    // Columns of the matrix of factors are grouped by method
+    std::array<unsigned, 2> firstColumns{0, 0};
+    unsigned numColumns = 0;
+
+    for (auto const method: {Method::PtBal, Method::MPF})
+    {
+        if (methodCaches[int(method)].enabled)
+        {
+            firstColumns[int(method)] = numColumns;
+            numColumns += numCorrections;
+        }
+    }
+
+    batch.numBinsPtLead = numBinsPtLead;
+    batch.ptLeadCorrections.resize(numCorrections * numBinsPtLead);
+    batch.logCorrectedPtLead.resize(numCorrections * numBinsPtLead);
+    batch.ptJetCorrections.resize(numBinsPtJet);
+    batch.factors.resize(numBinsPtJet * numColumns);
+    batch.products.resize(numRows * numColumns);
+
+    // First bin along the second axis in which the weight is not zero for at least one column
+    unsigned firstNonZeroBin = numBinsPtJet + 1;
+
+    for (unsigned corr = 0; corr < numCorrections; ++corr)
+    {
+        corrector.SetParams(corrParams + batch.corrPoints[corr] * numCorrParams);
+
+        unsigned const offset = corr * numBinsPtLead + firstBinPtLead - 1;
+        double *ptLeadCorrections = batch.ptLeadCorrections.data() + offset;
+        double *logCorrectedPtLead = batch.logCorrectedPtLead.data() + offset;
+        corrector.EvalBatch(meanPtLead.data() + firstBinPtLead - 1, ptLeadCorrections, numRows);
+
+        for (unsigned i = 0; i < numRows; ++i)
+            logCorrectedPtLead[i] = meanPtLead[firstBinPtLead - 1 + i] * ptLeadCorrections[i];
+
+        mathLogBatch(logCorrectedPtLead, logCorrectedPtLead, numRows);
+
+        corrector.EvalBatch(meanPtJet.data(), batch.ptJetCorrections.data(), numBinsPtJet);
+
+        for (auto const method: {Method::PtBal, Method::MPF})
+        {
+            auto const &cache = methodCaches[int(method)];
+
+            if (not cache.enabled)
+                continue;
+
+            unsigned const column = firstColumns[int(method)] + corr;
+
+            for (unsigned i = 0; i < numBinsPtJet; ++i)
+            {
+                double const correction = batch.ptJetCorrections[i];
+                double const weight = JetWeight(meanPtJet[i] * correction, cache.thresholdStart,
+                  cache.thresholdEnd);
+
+                if (method == Method::PtBal)
+                    batch.factors[i * numColumns + column] = correction * weight;
+                else
+                    batch.factors[i * numColumns + column] = (1 - correction) * weight;
+
+                if (weight != 0. and i + 1 < firstNonZeroBin)
+                    firstNonZeroBin = i + 1;
+            }
+        }
+    }
+
+    // Below the first bin with a non-zero weight, all factors are exactly zero and the bins can
+    //be skipped
+    sumProj->MultiplyRows(firstBinPtLead, lastBinPtLead, batch.factors.data(), numColumns,
+      firstNonZeroBin, numBinsPtJet, batch.products.data());
+
+    // Rearrange the sums so that the values for each distinct correction are contiguous
+    for (auto const method: {Method::PtBal, Method::MPF})
+    {
+        if (not methodCaches[int(method)].enabled)
+            continue;
+
+        auto &sumsJets = batch.sumsJets[int(method)];
+        sumsJets.resize(numCorrections * numBinsPtLead);
+
+        for (unsigned corr = 0; corr < numCorrections; ++corr)
+        {
+            unsigned const column = firstColumns[int(method)] + corr;
+            unsigned const offset = corr * numBinsPtLead + firstBinPtLead - 1;
+
+            for (unsigned row = 0; row < numRows; ++row)
+                sumsJets[offset + row] = batch.products[row * numColumns + column];
+        }
+    }
+}
+
+
+std::vector<double> MultijetCrawlingBins::JetCache::GetCorrectionPoints() const
+{
+    std::vector<double> points(meanPtLead);
+    points.insert(points.end(), meanPtJet.begin(), meanPtJet.end());
+    return points;
+}
+
+
+std::pair<double, double> MultijetCrawlingBins::JetCache::GetThreshold(Method method) const
+{
+    auto const &cache = methodCaches[int(method)];
+    return {cache.thresholdStart, cache.thresholdEnd};
+}
+
+
+void MultijetCrawlingBins::JetCache::Invalidate()
+{
+    corrConfigId = 0;
+}
+
+
+double const *MultijetCrawlingBins::JetCache::MPFFactors() const
+{
+    return methodCaches[int(Method::MPF)].factors.data();
+}
+
+
+double const *MultijetCrawlingBins::JetCache::PtBalFactors() const
+{
+    return methodCaches[int(Method::PtBal)].factors.data();
+}
+
+
+std::pair<unsigned, unsigned> MultijetCrawlingBins::JetCache::PtJetBinRange(Method method) const
+{
+    auto const &cache = methodCaches[int(method)];
+    return {cache.firstPtJetBin, cache.lastPtJetBin};
+}
+
+
+unsigned long MultijetCrawlingBins::JetCache::PtLeadRevision(unsigned bin) const
+{
+    return ptLeadRevisions[bin - 1];
+}
+
+
+void MultijetCrawlingBins::JetCache::SetThreshold(Method method, double thresholdStart,
+  double thresholdEnd)
+{
+    auto &cache = methodCaches[int(method)];
+    cache.thresholdStart = thresholdStart;
+    cache.thresholdEnd = thresholdEnd;
+    Invalidate();
+}
+
+
+double MultijetCrawlingBins::JetCache::SumJets(Method method, unsigned binPtLead) const
+{
+    auto const &cache = methodCaches[int(method)];
+
+    if (not cache.enabled)
+    {
+        std::ostringstream message;
+        message << "MultijetCrawlingBins::JetCache::SumJets: Requested method has not been " <<
+          "enabled.";
+        throw std::runtime_error(message.str());
+    }
+
+    RefreshRow(binPtLead);
+    return cache.rowSums[binPtLead - 1];
+}
+
+
+void MultijetCrawlingBins::JetCache::Update(JetCorrBase const &corrector,
+  double const *corrections)
+{
+    static PerfRegion perfRegion("MultijetCrawlingBins::JetCache::Update");
+    PerfScope perfScope(perfRegion);
     
-    // Find first bin for which the weight is not zero
-    firstPtJetBin = 0;
-    
-    while (jetWeights[firstPtJetBin] == 0.)
-        ++firstPtJetBin;
-    
-    // Convert to ROOT indexing convention
-    ++firstPtJetBin;
-    
-    // The last bin in ROOT indexing convention
-    lastPtJetBin = jetWeights.size();
+    auto const &params = corrector.GetParams();
+    double minPt = 0., maxPt = std::numeric_limits<double>::infinity();
+
+    // If the correction has the same configuration as in the previous update, find the range in
+    //pt affected by the parameters that have changed
+    if (corrector.GetConfigId() == corrConfigId and params.size() == corrParams.size())
+    {
+        std::swap(minPt, maxPt);
+
+        for (unsigned i = 0; i < params.size(); ++i)
+        {
+            if (params[i] != corrParams[i])
+            {
+                auto const support = corrector.GetParamSupport(i);
+                minPt = std::min(minPt, support.first);
+                maxPt = std::max(maxPt, support.second);
+            }
+        }
+
+        // Nothing to do if no parameter has changed
+        if (minPt > maxPt)
+            return;
+    }
+
+    corrConfigId = corrector.GetConfigId();
+    corrParams = params;
+    ++revision;
+    UpdateRange(corrector, minPt, maxPt, corrections);
 }
 
 
-double MultijetCrawlingBins::JetCache::Weight(unsigned bin) const
+double MultijetCrawlingBins::JetCache::Weight(Method method, unsigned bin) const
 {
-    return jetWeights[bin - 1];
+    return methodCaches[int(method)].jetWeights[bin - 1];
 }
 
 
-double MultijetCrawlingBins::JetCache::JetWeight(double pt) const
+double MultijetCrawlingBins::JetCache::JetWeight(double pt, double thresholdStart,
+  double thresholdEnd)
 {
     // Special treatment for a sharp threshold
     if (thresholdStart == thresholdEnd)
@@ -97,18 +347,184 @@ double MultijetCrawlingBins::JetCache::JetWeight(double pt) const
     else if (x > 1.)
         return 1.;
     else
-        return -2 * std::pow(x, 3) + 3 * std::pow(x, 2);
+        return x * x * (3 - 2 * x);
+}
+
+
+void MultijetCrawlingBins::JetCache::RefreshRow(unsigned binPtLead) const
+{
+    unsigned long &rowRevision = rowRevisions[binPtLead - 1];
+
+    if (rowRevision == revision)
+        return;
+
+    auto const &ptBalCache = methodCaches[int(Method::PtBal)];
+    auto const &mpfCache = methodCaches[int(Method::MPF)];
+    bool const pair = (ptBalCache.enabled and mpfCache.enabled);
+    unsigned const offset = (binPtLead - 1) * numBlocks;
+
+    for (unsigned block = 0; block < numBlocks; ++block)
+    {
+        if (blockRevisions[block] <= rowRevision)
+            continue;
+
+        unsigned const firstBin = block * blockSize + 1;
+        unsigned const lastBin = std::min<unsigned>((block + 1) * blockSize, meanPtJet.size());
+
+        // Bins below the range with non-zero weights are skipped. Below the range for a given
+        //method, the weights are exactly zero, and thus the union of the ranges can be used when
+        //both methods are computed together.
+        if (pair)
+        {
+            unsigned const firstNonZeroBin = std::min(ptBalCache.firstPtJetBin,
+              mpfCache.firstPtJetBin);
+            auto const sums = sumProj->DotPair(binPtLead, ptBalCache.factors.data(),
+              mpfCache.factors.data(), std::max(firstBin, firstNonZeroBin), lastBin);
+            ptBalCache.blockSums[offset + block] = sums[0];
+            mpfCache.blockSums[offset + block] = sums[1];
+        }
+        else
+        {
+            for (auto const &cache: methodCaches)
+            {
+                if (cache.enabled)
+                    cache.blockSums[offset + block] = sumProj->Dot(binPtLead,
+                      cache.factors.data(), std::max(firstBin, cache.firstPtJetBin), lastBin);
+            }
+        }
+    }
+
+    // Add up contributions of all blocks in a fixed order
+    for (auto const &cache: methodCaches)
+    {
+        if (not cache.enabled)
+            continue;
+
+        double sum = 0.;
+
+        for (unsigned block = 0; block < numBlocks; ++block)
+            sum += cache.blockSums[offset + block];
+
+        cache.rowSums[binPtLead - 1] = sum;
+    }
+
+    rowRevision = revision;
+}
+
+
+void MultijetCrawlingBins::JetCache::UpdateRange(JetCorrBase const &corrector, double minPt,
+  double maxPt, double const *corrections)
+{
+    // Find ranges of typical pt along the two axes that are affected. Unless precomputed values
+    //are given, evaluate the correction for all points in them at once to allow the corrector to
+    //vectorize the computation.
+    unsigned const beginPtLead = std::lower_bound(meanPtLead.begin(), meanPtLead.end(), minPt) -
+      meanPtLead.begin();
+    unsigned const endPtLead = std::upper_bound(meanPtLead.begin(), meanPtLead.end(), maxPt) -
+      meanPtLead.begin();
+    unsigned const beginPtJet = std::lower_bound(meanPtJet.begin(), meanPtJet.end(), minPt) -
+      meanPtJet.begin();
+    unsigned const endPtJet = std::upper_bound(meanPtJet.begin(), meanPtJet.end(), maxPt) -
+      meanPtJet.begin();
+
+    if (endPtLead > beginPtLead)
+    {
+        unsigned const n = endPtLead - beginPtLead;
+        
+        if (corrections)
+            std::copy(corrections + beginPtLead, corrections + endPtLead,
+              ptLeadCorrections.begin() + beginPtLead);
+        else
+            corrector.EvalBatch(meanPtLead.data() + beginPtLead,
+              ptLeadCorrections.data() + beginPtLead, n);
+        
+        // Logarithms of corrected pt of the leading jet are needed to evaluate splines for the
+        //balance in simulation
+        for (unsigned i = beginPtLead; i < endPtLead; ++i)
+        {
+            logCorrectedPtLead[i] = meanPtLead[i] * ptLeadCorrections[i];
+            ptLeadRevisions[i] = revision;
+        }
+        
+        mathLogBatch(logCorrectedPtLead.data() + beginPtLead,
+          logCorrectedPtLead.data() + beginPtLead, n);
+    }
+    
+    if (endPtJet <= beginPtJet)
+        return;
+
+    if (corrections)
+    {
+        double const *ptJetSource = corrections + meanPtLead.size();
+        std::copy(ptJetSource + beginPtJet, ptJetSource + endPtJet,
+          ptJetCorrections.begin() + beginPtJet);
+    }
+    else
+        corrector.EvalBatch(meanPtJet.data() + beginPtJet, ptJetCorrections.data() + beginPtJet,
+          endPtJet - beginPtJet);
+    
+    auto markBlocks = [this](unsigned begin, unsigned end)
+    {
+        for (unsigned block = begin / blockSize; block * blockSize < end and block < numBlocks;
+          ++block)
+            blockRevisions[block] = revision;
+    };
+
+    markBlocks(beginPtJet, endPtJet);
+    
+    for (auto const method: {Method::PtBal, Method::MPF})
+    {
+        auto &cache = methodCaches[int(method)];
+        auto &jetWeights = cache.jetWeights;
+        auto &factors = cache.factors;
+
+        for (unsigned i = beginPtJet; i < endPtJet; ++i)
+        {
+            jetWeights[i] = JetWeight(meanPtJet[i] * ptJetCorrections[i], cache.thresholdStart,
+              cache.thresholdEnd);
+
+            if (method == Method::PtBal)
+                factors[i] = ptJetCorrections[i] * jetWeights[i];
+            else
+                factors[i] = (1 - ptJetCorrections[i]) * jetWeights[i];
+        }
+        
+        // Find first bin for which the weight is not zero
+        unsigned const prevFirstPtJetBin = cache.firstPtJetBin;
+        cache.firstPtJetBin = 0;
+        
+        while (jetWeights[cache.firstPtJetBin] == 0.)
+            ++cache.firstPtJetBin;
+        
+        // Convert to ROOT indexing convention
+        ++cache.firstPtJetBin;
+        
+        // The last bin in ROOT indexing convention
+        cache.lastPtJetBin = jetWeights.size();
+
+        // Blocks that contain the first bin with a non-zero weight are summed starting from this
+        //bin. If it has moved, the blocks that contain its old and new positions are affected.
+        if (cache.firstPtJetBin != prevFirstPtJetBin)
+        {
+            markBlocks(prevFirstPtJetBin - 1, prevFirstPtJetBin);
+            markBlocks(cache.firstPtJetBin - 1, cache.firstPtJetBin);
+        }
+    }
 }
 
 
 
 MultijetCrawlingBins::Chi2Bin::Chi2Bin(MultijetCrawlingBins::Method method, unsigned firstBin_,
   unsigned lastBin_, std::shared_ptr<TH1> ptLeadHist_, std::shared_ptr<TProfile> mpfProfile_,
-  std::shared_ptr<TH2> sumProj_, std::shared_ptr<Spline> simBalSpline_, double unc2_):
+  std::shared_ptr<SplineTable const> simBalSplines_, double unc2_):
     firstBin(firstBin_), lastBin(lastBin_),
-    ptLeadHist(ptLeadHist_), mpfProfile(mpfProfile_), sumProj(sumProj_),
-    simBalSpline(simBalSpline_), unc2(unc2_),
-    jetCache(nullptr)
+    ptLeadHist(ptLeadHist_), mpfProfile(mpfProfile_),
+    simBalSplines(simBalSplines_), unc2(unc2_),
+    jetCache(nullptr),
+    simSplineValues(simBalSplines->GetNumSplines()),
+    simSplineCache((lastBin - firstBin + 1) * simBalSplines->GetNumSplines()),
+    simSplineRevisions(lastBin - firstBin + 1, 0),
+    batchSplineValues(simSplineCache.size())
 {
     if (method == MultijetCrawlingBins::Method::PtBal)
         meanBalanceCalc = &Chi2Bin::MeanPtBal;
@@ -131,25 +547,99 @@ void MultijetCrawlingBins::Chi2Bin::AddDataSyst(unsigned nuisanceIndex, double u
 }
 
 
-void MultijetCrawlingBins::Chi2Bin::AddSimSyst(unsigned nuisanceIndex, std::shared_ptr<Spline> up,
-  std::shared_ptr<Spline> down)
+void MultijetCrawlingBins::Chi2Bin::AddChi2Batch(Method method, JetCache::Batch const &batch,
+  Nuisances const *nuisances, unsigned numPoints, double *chi2) const
 {
-    if (simVariations.count(nuisanceIndex) > 0)
+    unsigned const numSplines = simSplineValues.size();
+    double numEvents = 0.;
+
+    for (unsigned binPtLead = firstBin; binPtLead <= lastBin; ++binPtLead)
+        numEvents += ptLeadHist->GetBinContent(binPtLead);
+
+    for (unsigned corr = 0; corr < batch.corrPoints.size(); ++corr)
+    {
+        unsigned const offset = corr * batch.numBinsPtLead;
+        double const *sumsJets = batch.sumsJets[int(method)].data() + offset;
+        double const *corrections = batch.ptLeadCorrections.data() + offset;
+        double const *logCorrectedPtLead = batch.logCorrectedPtLead.data() + offset;
+
+        // Parts of the computation that do not depend on nuisances are shared by all points with
+        //this correction
+        double sumBal = 0.;
+
+        for (unsigned binPtLead = firstBin; binPtLead <= lastBin; ++binPtLead)
+        {
+            unsigned const index = binPtLead - 1;
+
+            if (method == Method::PtBal)
+                sumBal += sumsJets[index] / corrections[index];
+            else
+                sumBal += (mpfProfile->GetBinContent(binPtLead) *
+                  ptLeadHist->GetBinContent(binPtLead) - sumsJets[index]) / corrections[index];
+
+            simBalSplines->Eval(logCorrectedPtLead[index],
+              batchSplineValues.data() + (binPtLead - firstBin) * numSplines);
+        }
+
+        for (unsigned i = 0; i < numPoints; ++i)
+        {
+            if (batch.corrIndices[i] != corr)
+                continue;
+
+            double sumSimBal = 0.;
+
+            for (unsigned binPtLead = firstBin; binPtLead <= lastBin; ++binPtLead)
+                sumSimBal += CombineSimSplines(batchSplineValues.data() +
+                  (binPtLead - firstBin) * numSplines, nuisances[i]) *
+                  ptLeadHist->GetBinContent(binPtLead);
+
+            double const meanBalance = ApplyDataSysts(sumBal / numEvents, nuisances[i]);
+            chi2[i] += std::pow(meanBalance - sumSimBal / numEvents, 2) / unc2;
+        }
+    }
+}
+
+
+std::pair<unsigned, unsigned> MultijetCrawlingBins::Chi2Bin::BinRange() const
+{
+    return {firstBin, lastBin};
+}
+
+
+void MultijetCrawlingBins::Chi2Bin::SetSimSysts(std::vector<unsigned> const &nuisanceIndices)
+{
+    if (simBalSplines->GetNumSplines() != 1 + 2 * nuisanceIndices.size())
     {
         std::ostringstream message;
-        message << "MultijetCrawlingBins::Chi2Bin::AddSimSyst: Systematic variation in simulation "
-          "for the nuisance parameter with index " << nuisanceIndex << " has already been "
-          "registered.";
+        message << "MultijetCrawlingBins::Chi2Bin::SetSimSysts: Number of given systematic "
+          "variations (" << nuisanceIndices.size() << ") does not match the number of splines (" <<
+          simBalSplines->GetNumSplines() << ").";
         throw std::runtime_error(message.str());
     }
 
-    simVariations[nuisanceIndex] = std::array<std::shared_ptr<Spline>, 2>{up, down};
+    std::set<unsigned> const uniqueIndices(nuisanceIndices.begin(), nuisanceIndices.end());
+
+    if (uniqueIndices.size() != nuisanceIndices.size())
+    {
+        std::ostringstream message;
+        message << "MultijetCrawlingBins::Chi2Bin::SetSimSysts: Given indices of nuisance "
+          "parameters contain duplicates.";
+        throw std::runtime_error(message.str());
+    }
+
+    simSystIndices = nuisanceIndices;
 }
 
 
 double MultijetCrawlingBins::Chi2Bin::Chi2(Nuisances const &nuisances) const
 {
-    return std::pow(MeanBalance(nuisances) - MeanSimBalance(nuisances), 2) / unc2;
+    return Chi2(MeanBalance(nuisances), nuisances);
+}
+
+
+double MultijetCrawlingBins::Chi2Bin::Chi2(double meanBalance, Nuisances const &nuisances) const
+{
+    return std::pow(meanBalance - MeanSimBalance(nuisances), 2) / unc2;
 }
 
 
@@ -159,6 +649,30 @@ double MultijetCrawlingBins::Chi2Bin::MeanBalance(Nuisances const &nuisances) co
 }
 
 
+std::array<double, 2> MultijetCrawlingBins::Chi2Bin::MeanBalancePair(Chi2Bin const &mpfBin,
+  Nuisances const &nuisances) const
+{
+    double sumPtBal = 0., sumMPF = 0.;
+    double numEvents = 0.;
+
+    for (unsigned binPtLead = firstBin; binPtLead <= lastBin; ++binPtLead)
+    {
+        double const n = ptLeadHist->GetBinContent(binPtLead);
+        double const correction = jetCache->CorrectionPtLead(binPtLead);
+        // With both methods enabled in the cache, the two sums are computed together
+        double const sumJetsPtBal = jetCache->SumJets(Method::PtBal, binPtLead);
+        double const sumJetsMPF = jetCache->SumJets(Method::MPF, binPtLead);
+
+        sumPtBal += sumJetsPtBal / correction;
+        sumMPF += (mpfBin.mpfProfile->GetBinContent(binPtLead) * n - sumJetsMPF) / correction;
+        numEvents += n;
+    }
+
+    return {ApplyDataSysts(sumPtBal / numEvents, nuisances),
+      mpfBin.ApplyDataSysts(sumMPF / numEvents, nuisances)};
+}
+
+
 double MultijetCrawlingBins::Chi2Bin::MeanPt() const
 {
     double sumPt = 0., numEvents = 0.;
@@ -177,11 +691,23 @@ double MultijetCrawlingBins::Chi2Bin::MeanPt() const
 double MultijetCrawlingBins::Chi2Bin::MeanSimBalance(Nuisances const &nuisances) const
 {
     double sumBal = 0., numEvents = 0.;
+    unsigned const numSplines = simSplineValues.size();
     
     for (unsigned binPtLead = firstBin; binPtLead <= lastBin; ++binPtLead)
     {
+        // Reevaluate the splines only if the correction in this bin has changed
+        unsigned const index = binPtLead - firstBin;
+        double *splineValues = simSplineCache.data() + index * numSplines;
+        unsigned long const revision = jetCache->PtLeadRevision(binPtLead);
+
+        if (simSplineRevisions[index] != revision)
+        {
+            simBalSplines->Eval(jetCache->LogCorrectedMeanPtLead(binPtLead), splineValues);
+            simSplineRevisions[index] = revision;
+        }
+
         double const n = ptLeadHist->GetBinContent(binPtLead);
-        sumBal += SimBalance(jetCache->CorrectedMeanPtLead(binPtLead), nuisances) * n;
+        sumBal += CombineSimSplines(splineValues, nuisances) * n;
         numEvents += n;
     }
     
@@ -195,30 +721,19 @@ std::pair<double, double> MultijetCrawlingBins::Chi2Bin::PtRange() const
 }
 
 
-double MultijetCrawlingBins::Chi2Bin::SimBalance(double ptLead, Nuisances const &nuisances) const
+double MultijetCrawlingBins::Chi2Bin::SimBalance(double logPt, Nuisances const &nuisances) const
 {
-    double const logPt = std::log(ptLead);
-    double meanBalance = simBalSpline->Eval(logPt);
-
-
-    // Apply systematic variations
-    for (auto const &syst: simVariations)
-    {
-        // Reference up and down relative deviations for the current uncertainty
-        double const up = syst.second[0]->Eval(logPt);
-        double const down = syst.second[1]->Eval(logPt);
-
-        // Interpolate between them and apply the resulting deviation
-        meanBalance *= 1 + PointMorph::Morph(0, up, down, nuisances[syst.first]);
-    }
-
-    return meanBalance;
+    // Evaluate the nominal spline and reference up and down relative deviations for all
+    // uncertainties at once
+    simBalSplines->Eval(logPt, simSplineValues.data());
+    return CombineSimSplines(simSplineValues.data(), nuisances);
 }
 
 
 void MultijetCrawlingBins::Chi2Bin::SetJetCache(JetCache const *jetCache_)
 {
     jetCache = jetCache_;
+    std::fill(simSplineRevisions.begin(), simSplineRevisions.end(), 0);
 }
 
 
@@ -228,83 +743,371 @@ double MultijetCrawlingBins::Chi2Bin::Uncertainty() const
 }
 
 
+double MultijetCrawlingBins::Chi2Bin::ApplyDataSysts(double meanBalance,
+  Nuisances const &nuisances) const
+{
+    for (auto const &syst: dataVariations)
+    {
+        double const deviation = syst.second(nuisances[syst.first]);
+        meanBalance *= 1 + deviation;
+    }
+
+    return meanBalance;
+}
+
+
+double MultijetCrawlingBins::Chi2Bin::CombineSimSplines(double const *splineValues,
+  Nuisances const &nuisances) const
+{
+    double meanBalance = splineValues[0];
+
+    // Apply systematic variations, interpolating between the reference deviations
+    for (unsigned i = 0; i < simSystIndices.size(); ++i)
+    {
+        double const up = splineValues[1 + 2 * i];
+        double const down = splineValues[2 + 2 * i];
+        meanBalance *= 1 + PointMorph::Morph(0, up, down, nuisances[simSystIndices[i]]);
+    }
+
+    return meanBalance;
+}
+
+
 double MultijetCrawlingBins::Chi2Bin::MeanMPF(Nuisances const &nuisances) const
 {
     // Compute nominal mean MPF balance
     double sumBal = 0.;
     double numEvents = 0.;
     
-    auto const ptJetBinRange = jetCache->PtJetBinRange();
-    
     for (unsigned binPtLead = firstBin; binPtLead <= lastBin; ++binPtLead)
     {
         sumBal += mpfProfile->GetBinContent(binPtLead) * ptLeadHist->GetBinContent(binPtLead) / \
           jetCache->CorrectionPtLead(binPtLead);
         
-        double sumJets = 0.;
+        double const sumJets = -jetCache->SumJets(Method::MPF, binPtLead);
         
-        for (unsigned binPtJet = ptJetBinRange.first; binPtJet <= ptJetBinRange.second; ++binPtJet)
-            sumJets -= sumProj->GetBinContent(binPtLead, binPtJet) * \
-              (1 - jetCache->CorrectionPtJet(binPtJet)) * jetCache->Weight(binPtJet);
+        sumBal += sumJets / jetCache->CorrectionPtLead(binPtLead);
+        numEvents += ptLeadHist->GetBinContent(binPtLead);
+    }
+    
+    return ApplyDataSysts(sumBal / numEvents, nuisances);
+}
+
+
+double MultijetCrawlingBins::Chi2Bin::MeanPtBal(Nuisances const &nuisances) const
+{
+    // Compute nominal pt balance
+    double sumBal = 0.;
+    double numEvents = 0.;
+    
+    for (unsigned binPtLead = firstBin; binPtLead <= lastBin; ++binPtLead)
+    {
+        double const sumJets = jetCache->SumJets(Method::PtBal, binPtLead);
         
         sumBal += sumJets / jetCache->CorrectionPtLead(binPtLead);
         numEvents += ptLeadHist->GetBinContent(binPtLead);
     }
     
-    double meanBalance = sumBal / numEvents;
+    return ApplyDataSysts(sumBal / numEvents, nuisances);
+}
 
 
-    // Apply systematic variations
-    for (auto const &syst: dataVariations)
+
+MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
+  MultijetCrawlingBins::Method method_, NuisanceDefinitions &nuisanceDefs,
+  std::set<std::string> systToExclude, FlatHist2D::Storage storage):
+    MultijetCrawlingBins(method_)
+{
+    auto const inputFile = OpenInputFile(fileName);
+    SharedInputs const inputs(ReadSharedInputs(*inputFile, fileName));
+    Initialize(*inputFile, fileName, inputs, nuisanceDefs, systToExclude);
+    inputFile->Close();
+    
+    
+    // If a compact storage has been requested, convert the histogram of jet projections and
+    // evaluate the loss of precision
+    if (storage != FlatHist2D::Storage::Double)
+        storagePrecision = ConvertStorage({this}, *inputs.sumProjContents, storage, nuisanceDefs);
+}
+
+
+MultijetCrawlingBins::MultijetCrawlingBins(MultijetCrawlingBins const &src):
+    MeasurementBase(src),
+    method(src.method), chi2Bins(src.chi2Bins), chi2BinMask(src.chi2BinMask),
+    storagePrecision(src.storagePrecision)
+{
+    SetJetCache(std::make_shared<JetCache>(*src.jetCache));
+}
+
+
+std::unique_ptr<MeasurementBase> MultijetCrawlingBins::Clone() const
+{
+    return std::make_unique<MultijetCrawlingBins>(*this);
+}
+
+
+TGraphErrors MultijetCrawlingBins::ComputeResiduals(JetCorrBase const &corrector,
+  Nuisances const &nuisances) const
+{
+    jetCache->Update(corrector);
+    TGraphErrors graph(chi2Bins.size());
+
+    for (unsigned i = 0; i < chi2Bins.size(); ++i)
     {
-        double const deviation = syst.second(nuisances[syst.first]);
-        meanBalance *= 1 + deviation;
+        auto const &chi2Bin = chi2Bins[i];
+        double const simBalance = chi2Bin.MeanSimBalance(nuisances);
+        graph.SetPoint(i, chi2Bin.MeanPt(), chi2Bin.MeanBalance(nuisances) / simBalance - 1.);
+        graph.SetPointError(i, 0., chi2Bin.Uncertainty() / simBalance);
     }
 
-    return meanBalance;
+    return graph;
 }
 
 
-double MultijetCrawlingBins::Chi2Bin::MeanPtBal(Nuisances const &nuisances) const
+unsigned MultijetCrawlingBins::GetDim() const
 {
-    // Compute nominal pt balance
-    double sumBal = 0.;
-    double numEvents = 0.;
+    return std::count(chi2BinMask.begin(), chi2BinMask.end(), true);
+}
+
+
+StoragePrecision const &MultijetCrawlingBins::GetStoragePrecision() const
+{
+    return storagePrecision;
+}
+
+
+double MultijetCrawlingBins::Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const
+{
+    jetCache->Update(corrector);
+    return SumChi2(nuisances);
+}
+
+
+void MultijetCrawlingBins::EvalMany(JetCorrBase &corrector, double const *corrParams,
+  Nuisances const *nuisances, unsigned numPoints, double *results) const
+{
+    auto const binRange = PtLeadBinRange();
+    jetCache->EvalBatch(corrector, corrParams, numPoints, binRange.first, binRange.second, batch);
+
+    static PerfRegion perfRegion("MultijetCrawlingBins::Chi2Bin batch reductions");
+    PerfScope perfScope(perfRegion);
+    std::fill(results, results + numPoints, 0.);
+
+    for (unsigned i = 0; i < chi2Bins.size(); ++i)
+    {
+        if (chi2BinMask[i])
+            chi2Bins[i].AddChi2Batch(method, batch, nuisances, numPoints, results);
+    }
+}
+
+
+double MultijetCrawlingBins::EvalWithCorrections(JetCorrBase const &corrector,
+  Nuisances const &nuisances, double const *corrections) const
+{
+    jetCache->Update(corrector, corrections);
+    return SumChi2(nuisances);
+}
+
+
+std::vector<double> MultijetCrawlingBins::GetCorrectionPoints() const
+{
+    return jetCache->GetCorrectionPoints();
+}
+
+
+TH1D MultijetCrawlingBins::RecomputeBalanceData(JetCorrBase const &corrector,
+  Nuisances const &nuisances) const
+{
+    // Read the binning with up to L2Res correction applied
+    std::vector<double> binning;
+    binning.reserve(chi2Bins.size() + 1);
+
+    for (auto const &chi2Bin: chi2Bins)
+        binning.emplace_back(chi2Bin.PtRange().first);
+
+    binning.emplace_back(chi2Bins[chi2Bins.size() - 1].PtRange().second);
+
+
+    // Apply the given L3Res correction to take into account the migration in pt of the leading jet
+    for (auto &edge: binning)
+        edge = corrector.Apply(edge);
+
+
+    TH1D histBalance("MeanBalance", "", binning.size() - 1, binning.data());
+    histBalance.SetDirectory(nullptr);
+
+    jetCache->Update(corrector);
+
+    for (unsigned i = 0; i < chi2Bins.size(); ++i)
+    {
+        histBalance.SetBinContent(i + 1, chi2Bins[i].MeanBalance(nuisances));
+        histBalance.SetBinError(i + 1, chi2Bins[i].Uncertainty());
+    }
+
+    return histBalance;
+}
+
+
+TH1D MultijetCrawlingBins::RecomputeBalanceSim(JetCorrBase const &corrector,
+  Nuisances const &nuisances) const
+{
+    std::vector<double> binning;
+    binning.reserve(chi2Bins.size() + 1);
+
+    for (auto const &chi2Bin: chi2Bins)
+        binning.emplace_back(chi2Bin.PtRange().first);
+
+    binning.emplace_back(chi2Bins[chi2Bins.size() - 1].PtRange().second);
+
+
+    TH1D histBalance("MeanBalance", "", binning.size() - 1, binning.data());
+    histBalance.SetDirectory(nullptr);
+
+    // Update jet cache as this determines positions in pt at which the splines are evaluated
+    jetCache->Update(corrector);
+
+    for (unsigned i = 0; i < chi2Bins.size(); ++i)
+        histBalance.SetBinContent(i + 1, chi2Bins[i].MeanSimBalance(nuisances));
+
+    return histBalance;
+}
+
+
+std::pair<double, double> MultijetCrawlingBins::SetPtLeadRange(double minPt, double maxPt)
+{
+    // Construct an auxiliary vector of all boundaries between chi^2 bins. Assume that all bins are
+    // adjacent.
+    std::vector<double> edges;
+    edges.reserve(chi2Bins.size() + 1);
+    
+    for (auto const &chi2Bin: chi2Bins)
+        edges.emplace_back(chi2Bin.PtRange().first);
+    
+    edges.emplace_back(chi2Bins.back().PtRange().second);
+    
+    
+    // Find closest edges
+    unsigned iEdgeMin = std::lower_bound(edges.begin(), edges.end(), minPt) - edges.begin();
+    
+    if (iEdgeMin == edges.size())
+        --iEdgeMin;
+    else if (iEdgeMin > 0)
+    {
+        if (edges[iEdgeMin] - minPt > minPt - edges[iEdgeMin - 1])
+            --iEdgeMin;
+    }
+    
+    unsigned iEdgeMax = std::lower_bound(edges.begin(), edges.end(), maxPt) - edges.begin();
+    
+    if (iEdgeMax == edges.size())
+        --iEdgeMax;
+    else if (iEdgeMax > 0)
+    {
+        if (edges[iEdgeMax] - maxPt > maxPt - edges[iEdgeMax - 1])
+            --iEdgeMax;
+    }
+    
+    if (iEdgeMax <= iEdgeMin)
+    {
+        std::ostringstream message;
+        message << "MultijetCrawlingBins::SetPtLeadRange: Requested range is too narrow.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Mask chi^2 bins outsize of the range
+    for (unsigned i = 0; i < iEdgeMin; ++i)
+        chi2BinMask[i] = false;
+    
+    for (unsigned i = iEdgeMin; i < iEdgeMax; ++i)
+        chi2BinMask[i] = true;
+    
+    for (unsigned i = iEdgeMax; i < chi2BinMask.size(); ++i)
+        chi2BinMask[i] = false;
+    
+    
+    return {edges[iEdgeMin], edges[iEdgeMax]};
+}
+
+
+MultijetCrawlingBins::MultijetCrawlingBins(Method method_):
+    method(method_), storagePrecision{0., 0.}
+{}
+
+
+StoragePrecision MultijetCrawlingBins::ConvertStorage(
+  std::vector<MultijetCrawlingBins *> const &measurements, FlatHist2D &sumProjContents,
+  FlatHist2D::Storage storage, NuisanceDefinitions const &nuisanceDefs)
+{
+    TraceSpan span("MultijetCrawlingBins::ConvertStorage", "load");
+    std::vector<std::vector<double>> refResults;
+    double refChi2 = 0.;
+    
+    for (auto const *measurement: measurements)
+    {
+        refResults.emplace_back(measurement->EvalUnitCorrection(nuisanceDefs));
+        refChi2 += refResults.back().back();
+    }
+    
+    sumProjContents.SetStorage(storage);
     
-    auto const ptJetBinRange = jetCache->PtJetBinRange();
+    for (auto *measurement: measurements)
+        measurement->jetCache->Invalidate();
     
-    for (unsigned binPtLead = firstBin; binPtLead <= lastBin; ++binPtLead)
+    double chi2 = 0.;
+    StoragePrecision totalPrecision{0., 0.};
+    
+    for (unsigned iMeasurement = 0; iMeasurement < measurements.size(); ++iMeasurement)
     {
-        double sumJets = 0.;
+        auto const &refResult = refResults[iMeasurement];
+        auto const result = measurements[iMeasurement]->EvalUnitCorrection(nuisanceDefs);
+        auto &precision = measurements[iMeasurement]->storagePrecision;
+        precision.maxRelErrorBalance = 0.;
         
-        for (unsigned binPtJet = ptJetBinRange.first; binPtJet <= ptJetBinRange.second; ++binPtJet)
-            sumJets += sumProj->GetBinContent(binPtLead, binPtJet) * \
-              jetCache->CorrectionPtJet(binPtJet) * jetCache->Weight(binPtJet);
+        for (unsigned i = 0; i < result.size() - 1; ++i)
+            precision.maxRelErrorBalance = std::max(precision.maxRelErrorBalance,
+              StoragePrecision::Deviation(result[i], refResult[i]));
         
-        sumBal += sumJets / jetCache->CorrectionPtLead(binPtLead);
-        numEvents += ptLeadHist->GetBinContent(binPtLead);
+        precision.relErrorChi2 = StoragePrecision::Deviation(result.back(), refResult.back());
+        totalPrecision.maxRelErrorBalance = std::max(totalPrecision.maxRelErrorBalance,
+          precision.maxRelErrorBalance);
+        chi2 += result.back();
     }
     
-    double meanBalance = sumBal / numEvents;
+    totalPrecision.relErrorChi2 = StoragePrecision::Deviation(chi2, refChi2);
+    return totalPrecision;
+}
 
 
-    // Apply systematic variations
-    for (auto const &syst: dataVariations)
+std::vector<double> MultijetCrawlingBins::EvalUnitCorrection(
+  NuisanceDefinitions const &nuisanceDefs) const
+{
+    // A unit correction is provided by JetCorrStableLogLin with its parameter set to zero
+    JetCorrStableLogLin const unitCorrection;
+    Nuisances const zeroNuisances(nuisanceDefs);
+    jetCache->Update(unitCorrection);
+    
+    std::vector<double> results;
+    results.reserve(chi2Bins.size() + 1);
+    double chi2 = 0.;
+    
+    for (auto const &chi2Bin: chi2Bins)
     {
-        double const deviation = syst.second(nuisances[syst.first]);
-        meanBalance *= 1 + deviation;
+        double const balance = chi2Bin.MeanBalance(zeroNuisances);
+        results.emplace_back(balance);
+        chi2 += chi2Bin.Chi2(balance, zeroNuisances);
     }
-
-    return meanBalance;
+    
+    results.emplace_back(chi2);
+    return results;
 }
 
 
-
-MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
-  MultijetCrawlingBins::Method method_, NuisanceDefinitions &nuisanceDefs,
-  std::set<std::string> systToExclude):
-    method(method_)
+void MultijetCrawlingBins::Initialize(TFile &inputFile, std::string const &fileName,
+  SharedInputs const &inputs, NuisanceDefinitions &nuisanceDefs,
+  std::set<std::string> const &systToExclude)
 {
+    TraceSpan span("MultijetCrawlingBins::Initialize", "load");
     std::string methodLabel;
     
     if (method == Method::PtBal)
@@ -313,29 +1116,18 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
         methodLabel = "MPF";
     
     
-    std::unique_ptr<TFile> inputFile(TFile::Open(fileName.c_str()));
-    
-    if (not inputFile or inputFile->IsZombie())
-    {
-        std::ostringstream message;
-        message << "MultijetCrawlingBins::MultijetCrawlingBins: Failed to open file \"" <<
-          fileName << "\".";
-        throw std::runtime_error(message.str());
-    }
-    
-    
     // Read the jet pt threshold. It is not a free parameter and must be set to the same value as
     // used to construct the inputs. For the pt balance method, it affects the definition of the
     // balance observable in simulation (while in data it can be recomputed for any not too low
     // threshold). In the case of the MPF method, the definition of the balance observable in both
     // data and simulation is affected.
     std::unique_ptr<TVectorD> ptThreshold(dynamic_cast<TVectorD *>(
-      inputFile->Get((methodLabel + "Threshold").c_str())));
+      inputFile.Get((methodLabel + "Threshold").c_str())));
     
     if (not ptThreshold)
     {
         std::ostringstream message;
-        message << "MultijetCrawlingBins::MultijetCrawlingBins: Failed to read jet " <<
+        message << "MultijetCrawlingBins::Initialize: Failed to read jet " <<
           "pt threshold from file \"" << fileName << "\".";
         throw std::runtime_error(message.str());
     }
@@ -343,44 +1135,35 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
     if (ptThreshold->GetNoElements() != 2)
     {
         std::ostringstream message;
-        message << "MultijetCrawlingBins::MultijetCrawlingBins: Unexpected number of elements "
+        message << "MultijetCrawlingBins::Initialize: Unexpected number of elements "
           "read for jet pt threshold.";
         throw std::runtime_error(message.str());
     }
     
     
-    // Read target binning for computation of chi^2 and data histograms
-    for (auto const &name: std::initializer_list<std::string>{"Binning", "PtLead", "PtLeadProfile",
-      methodLabel + "Profile", "RelPtJetSumProj"})
+    // Read the profile with mean balance in data. Common inputs, including the target binning for
+    //the computation of chi^2, have already been read.
+    std::shared_ptr<TProfile> balProfile(dynamic_cast<TProfile *>(
+      inputFile.Get((methodLabel + "Profile").c_str())));
+    
+    if (not balProfile)
     {
-        if (not inputFile->Get(name.c_str()))
-        {
-            std::ostringstream message;
-            message << "MultijetCrawlingBins::MultijetCrawlingBins: File \"" << fileName <<
-              "\" does not contain required key \"" << name << "\".";
-            throw std::runtime_error(message.str());
-        }
+        std::ostringstream message;
+        message << "MultijetCrawlingBins::Initialize: File \"" << fileName <<
+          "\" does not contain required key \"" << methodLabel << "Profile\".";
+        throw std::runtime_error(message.str());
     }
     
-    std::unique_ptr<TVectorD> binning(dynamic_cast<TVectorD *>(inputFile->Get("Binning")));
-    
-    std::shared_ptr<TH1> ptLeadHist(dynamic_cast<TH1 *>(inputFile->Get("PtLead")));
-    std::unique_ptr<TProfile> ptLeadProfile(dynamic_cast<TProfile *>(
-      inputFile->Get("PtLeadProfile")));
-    std::shared_ptr<TProfile> balProfile(dynamic_cast<TProfile *>(
-      inputFile->Get((methodLabel + "Profile").c_str())));
-    std::shared_ptr<TH2> sumProj(dynamic_cast<TH2 *>(inputFile->Get("RelPtJetSumProj")));
-    
-    ptLeadHist->SetDirectory(nullptr);
-    ptLeadProfile->SetDirectory(nullptr);
     balProfile->SetDirectory(nullptr);
-    sumProj->SetDirectory(nullptr);
+    
+    auto const &binning = inputs.binning;
+    auto const &ptLeadHist = inputs.ptLeadHist;
     
     
     // Rebin TProfile with mean balance observable in data to the target binning.  It will be used
     // to obtain per-bin uncertainties.
-    std::unique_ptr<TH1> balProfileRebinned(balProfile->Rebin(binning->GetNoElements() - 1,
-      (balProfile->GetName() + "Rebinned"s).c_str(), binning->GetMatrixArray()));
+    std::unique_ptr<TH1> balProfileRebinned(balProfile->Rebin(binning.size() - 1,
+      (balProfile->GetName() + "Rebinned"s).c_str(), binning.data()));
     balProfileRebinned->SetDirectory(nullptr);
     
     
@@ -388,7 +1171,7 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
     // provided separately for different trigger bins.
     std::vector<std::pair<double, std::shared_ptr<Spline>>> simBalSplines;
     
-    TIter fileIter(inputFile->GetListOfKeys());
+    TIter fileIter(inputFile.GetListOfKeys());
     TKey *key;
     
     while ((key = dynamic_cast<TKey *>(fileIter())))
@@ -403,7 +1186,7 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
             if (not directory->Get(name.c_str()))
             {
                 std::ostringstream message;
-                message << "MultijetCrawlingBins::MultijetCrawlingBins: Directory \"" <<
+                message << "MultijetCrawlingBins::Initialize: Directory \"" <<
                   directory->GetName() << "\" in file \"" << fileName <<
                   "\" does not contain required key \"" << name << "\".";
                 throw std::runtime_error(message.str());
@@ -425,7 +1208,7 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
     
     std::regex dataSystRegex("RelVar_" + methodLabel + "_(.+)Up", std::regex::extended);
     std::cmatch matchResult;
-    fileIter = inputFile->GetListOfKeys();
+    fileIter = inputFile.GetListOfKeys();
 
     while ((key = dynamic_cast<TKey *>(fileIter())))
     {
@@ -438,23 +1221,23 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
             continue;
 
         std::unique_ptr<TH1> histUp(dynamic_cast<TH1 *>(key->ReadObj()));
-        std::unique_ptr<TH1> histDown(dynamic_cast<TH1 *>(inputFile->Get(
+        std::unique_ptr<TH1> histDown(dynamic_cast<TH1 *>(inputFile.Get(
           ("RelVar_" + methodLabel + "_" + systLabel + "Down").c_str())));
 
         if (not histUp or not histDown)
         {
             std::ostringstream message;
-            message << "MultijetCrawlingBins::MultijetCrawlingBins: Failed to read systematic "
+            message << "MultijetCrawlingBins::Initialize: Failed to read systematic "
               "variation \"" << systLabel << "\" for data.";
             throw std::runtime_error(message.str());
         }
 
-        int const numBins = binning->GetNoElements() - 1;
+        int const numBins = binning.size() - 1;
 
         if (histUp->GetNbinsX() != numBins or histDown->GetNbinsX() != numBins)
         {
             std::ostringstream message;
-            message << "MultijetCrawlingBins::MultijetCrawlingBins: Number of bins in histograms "
+            message << "MultijetCrawlingBins::Initialize: Number of bins in histograms "
               "that define systematic variation \"" << systLabel << "\" in data, does not agree "
               "with the given chi^2 binning.";
             throw std::runtime_error(message.str());
@@ -477,7 +1260,7 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
       simVariations;
 
     std::regex simSystRegex("RelVar_Sim" + methodLabel + "_(.+)Up", std::regex::extended);
-    fileIter = inputFile->GetListOfKeys();
+    fileIter = inputFile.GetListOfKeys();
 
     while ((key = dynamic_cast<TKey *>(fileIter())))
     {
@@ -507,7 +1290,7 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
             if (not splineUp or not splineDown)
             {
                 std::ostringstream message;
-                message << "MultijetCrawlingBins::MultijetCrawlingBins: Failed to read systematic "
+                message << "MultijetCrawlingBins::Initialize: Failed to read systematic "
                   "variation \"" << systLabel << "\" for simulation.";
                 throw std::runtime_error(message.str());
             }
@@ -530,7 +1313,31 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
           [](auto const &lhs, auto const &rhs){return (lhs.first < rhs.first);});
     }
 
-    inputFile->Close();
+    // Convert splines for each trigger bin into a table of coefficients, so that the nominal
+    // spline and all systematic variations can be evaluated together. The order of the variations
+    // in the tables follows the order of the labels in the map.
+    std::vector<std::shared_ptr<SplineTable const>> simBalTables;
+    
+    for (unsigned i = 0; i < simBalSplines.size(); ++i)
+    {
+        std::vector<std::shared_ptr<Spline>> splines{simBalSplines[i].second};
+        
+        for (auto const &syst: simVariations)
+        {
+            if (syst.second.size() != simBalSplines.size())
+            {
+                std::ostringstream message;
+                message << "MultijetCrawlingBins::Initialize: Systematic variation \"" <<
+                  syst.first << "\" in simulation is not provided for all trigger bins.";
+                throw std::runtime_error(message.str());
+            }
+            
+            splines.emplace_back(syst.second[i].second[0]);
+            splines.emplace_back(syst.second[i].second[1]);
+        }
+        
+        simBalTables.emplace_back(std::make_shared<SplineTable>(splines));
+    }
     
     
     // Find a number that is smaller than the width of any bin in pt of the leading jet in the
@@ -551,27 +1358,28 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
     if (eps <= 0.)
     {
         std::ostringstream message;
-        message << "MultijetCrawlingBins::MultijetCrawlingBins: Found bins of zero width.";
+        message << "MultijetCrawlingBins::Initialize: Found bins of zero width.";
         throw std::runtime_error(message.str());
     }
     
     
     // Construct chi^2 bins. Each one consists of one or (typically) more bins in pt of the leading
     // jet that are included in the range of a single bin in variable `binning`.
-    for (int binChi2 = 1; binChi2 < binning->GetNoElements(); ++binChi2)
+    for (unsigned binChi2 = 1; binChi2 < binning.size(); ++binChi2)
     {
-        unsigned firstBin = ptLeadHist->FindFixBin((*binning)[binChi2 - 1] + eps);
-        unsigned lastBin = ptLeadHist->FindFixBin((*binning)[binChi2] - eps);
+        unsigned firstBin = ptLeadHist->FindFixBin(binning[binChi2 - 1] + eps);
+        unsigned lastBin = ptLeadHist->FindFixBin(binning[binChi2] - eps);
         
         auto simBalSplineIt = std::lower_bound(simBalSplines.begin(), simBalSplines.end(),
-          (*binning)[binChi2 - 1] + eps,
+          binning[binChi2 - 1] + eps,
           [](auto const &lhs, double const &rhs){return (lhs.first < rhs);});
         --simBalSplineIt;
         unsigned const splineIndex = std::distance(simBalSplines.begin(), simBalSplineIt);
         
         Chi2Bin curChi2Bin(method, firstBin, lastBin, ptLeadHist,
           (method == MultijetCrawlingBins::Method::MPF) ? balProfile : nullptr,
-          sumProj, simBalSplineIt->second, std::pow(balProfileRebinned->GetBinError(binChi2), 2));
+          simBalTables[splineIndex],
+          std::pow(balProfileRebinned->GetBinError(binChi2), 2));
 
 
         // Add systematic variations for the newly constructed bin
@@ -582,12 +1390,12 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
               syst.second[0]->GetBinContent(binChi2), syst.second[1]->GetBinContent(binChi2));
         }
 
+        std::vector<unsigned> simSystIndices;
+        
         for (auto const &syst: simVariations)
-        {
-            unsigned const systIndex = nuisanceDefs.Register(syst.first);
-            auto const &splinePair = syst.second.at(splineIndex).second;
-            curChi2Bin.AddSimSyst(systIndex, splinePair[0], splinePair[1]);
-        }
+            simSystIndices.emplace_back(nuisanceDefs.Register(syst.first));
+        
+        curChi2Bin.SetSimSysts(simSystIndices);
 
 
         chi2Bins.emplace_back(curChi2Bin);
@@ -596,7 +1404,7 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
     if (chi2Bins.empty())
     {
         std::ostringstream message;
-        message << "MultijetCrawlingBins::MultijetCrawlingBins: No data read from file \"" <<
+        message << "MultijetCrawlingBins::Initialize: No data read from file \"" <<
           fileName << "\".";
         throw std::runtime_error(message.str());
     }
@@ -605,57 +1413,115 @@ MultijetCrawlingBins::MultijetCrawlingBins(std::string const &fileName,
     
     
     // Initialize the object to cache values of jet corrections
-    std::vector<double> meanPtLead;
-    meanPtLead.reserve(ptLeadHist->GetNbinsX());
+    SetJetCache(std::make_shared<JetCache>(inputs.sumProjContents, inputs.meanPtLead,
+      inputs.meanPtJet, (*ptThreshold)[0], (*ptThreshold)[1], method));
+}
+
+
+std::unique_ptr<TFile> MultijetCrawlingBins::OpenInputFile(std::string const &fileName)
+{
+    std::unique_ptr<TFile> inputFile(TFile::Open(fileName.c_str()));
     
-    for (int bin = 1; bin <= ptLeadHist->GetNbinsX(); ++bin)
+    if (not inputFile or inputFile->IsZombie())
     {
-        if (ptLeadHist->GetBinContent(bin) > 0.)
-            meanPtLead.emplace_back(ptLeadProfile->GetBinContent(bin));
-        else
-            meanPtLead.emplace_back(ptLeadProfile->GetBinCenter(bin));
+        std::ostringstream message;
+        message << "MultijetCrawlingBins::OpenInputFile: Failed to open file \"" << fileName <<
+          "\".";
+        throw std::runtime_error(message.str());
     }
     
-    std::vector<double> meanPtJet;
-    meanPtJet.reserve(sumProj->GetNbinsY());
-    
-    for (int bin = 1; bin <= sumProj->GetNbinsY(); ++bin)
-        meanPtJet.emplace_back(sumProj->GetYaxis()->GetBinCenter(bin));
-    
-    jetCache.reset(new JetCache(meanPtLead, meanPtJet, (*ptThreshold)[0], (*ptThreshold)[1]));
-    
-    for (auto &chi2Bin: chi2Bins)
-        chi2Bin.SetJetCache(jetCache.get());
+    return inputFile;
 }
 
 
-TGraphErrors MultijetCrawlingBins::ComputeResiduals(JetCorrBase const &corrector,
-  Nuisances const &nuisances) const
+std::pair<unsigned, unsigned> MultijetCrawlingBins::PtLeadBinRange() const
 {
-    jetCache->Update(corrector);
-    TGraphErrors graph(chi2Bins.size());
+    unsigned firstBin = std::numeric_limits<unsigned>::max(), lastBin = 0;
 
     for (unsigned i = 0; i < chi2Bins.size(); ++i)
     {
-        auto const &chi2Bin = chi2Bins[i];
-        double const simBalance = chi2Bin.MeanSimBalance(nuisances);
-        graph.SetPoint(i, chi2Bin.MeanPt(), chi2Bin.MeanBalance(nuisances) / simBalance - 1.);
-        graph.SetPointError(i, 0., chi2Bin.Uncertainty() / simBalance);
+        if (not chi2BinMask[i])
+            continue;
+
+        auto const range = chi2Bins[i].BinRange();
+        firstBin = std::min(firstBin, range.first);
+        lastBin = std::max(lastBin, range.second);
     }
 
-    return graph;
+    return {firstBin, lastBin};
 }
 
 
-unsigned MultijetCrawlingBins::GetDim() const
+MultijetCrawlingBins::SharedInputs MultijetCrawlingBins::ReadSharedInputs(TFile &inputFile,
+  std::string const &fileName)
 {
-    return std::count(chi2BinMask.begin(), chi2BinMask.end(), true);
+    TraceSpan span("MultijetCrawlingBins::ReadSharedInputs", "load");
+
+    // Read target binning for computation of chi^2 and data histograms
+    for (auto const &name: std::initializer_list<std::string>{"Binning", "PtLead", "PtLeadProfile",
+      "RelPtJetSumProj"})
+    {
+        if (not inputFile.Get(name.c_str()))
+        {
+            std::ostringstream message;
+            message << "MultijetCrawlingBins::ReadSharedInputs: File \"" << fileName <<
+              "\" does not contain required key \"" << name << "\".";
+            throw std::runtime_error(message.str());
+        }
+    }
+    
+    SharedInputs inputs;
+    
+    std::unique_ptr<TVectorD> binning(dynamic_cast<TVectorD *>(inputFile.Get("Binning")));
+    inputs.binning.assign(binning->GetMatrixArray(),
+      binning->GetMatrixArray() + binning->GetNoElements());
+    
+    inputs.ptLeadHist.reset(dynamic_cast<TH1 *>(inputFile.Get("PtLead")));
+    std::unique_ptr<TProfile> ptLeadProfile(dynamic_cast<TProfile *>(
+      inputFile.Get("PtLeadProfile")));
+    std::unique_ptr<TH2> sumProj(dynamic_cast<TH2 *>(inputFile.Get("RelPtJetSumProj")));
+    
+    inputs.ptLeadHist->SetDirectory(nullptr);
+    ptLeadProfile->SetDirectory(nullptr);
+    sumProj->SetDirectory(nullptr);
+    
+    inputs.sumProjContents = std::make_shared<FlatHist2D>(*sumProj);
+    
+    
+    // Typical values of pt along the axes of the histogram of jet projections
+    auto const &ptLeadHist = inputs.ptLeadHist;
+    inputs.meanPtLead.reserve(ptLeadHist->GetNbinsX());
+    
+    for (int bin = 1; bin <= ptLeadHist->GetNbinsX(); ++bin)
+    {
+        if (ptLeadHist->GetBinContent(bin) > 0.)
+            inputs.meanPtLead.emplace_back(ptLeadProfile->GetBinContent(bin));
+        else
+            inputs.meanPtLead.emplace_back(ptLeadProfile->GetBinCenter(bin));
+    }
+    
+    inputs.meanPtJet.reserve(sumProj->GetNbinsY());
+    
+    for (int bin = 1; bin <= sumProj->GetNbinsY(); ++bin)
+        inputs.meanPtJet.emplace_back(sumProj->GetYaxis()->GetBinCenter(bin));
+    
+    return inputs;
 }
 
 
-double MultijetCrawlingBins::Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const
+void MultijetCrawlingBins::SetJetCache(std::shared_ptr<JetCache> jetCache_)
 {
-    jetCache->Update(corrector);
+    jetCache = jetCache_;
+    
+    for (auto &chi2Bin: chi2Bins)
+        chi2Bin.SetJetCache(jetCache.get());
+}
+
+
+double MultijetCrawlingBins::SumChi2(Nuisances const &nuisances) const
+{
+    static PerfRegion perfRegion("MultijetCrawlingBins::Chi2Bin reductions");
+    PerfScope perfScope(perfRegion);
     double chi2 = 0.;
     
     for (unsigned i = 0; i < chi2Bins.size(); ++i)
@@ -668,116 +1534,166 @@ double MultijetCrawlingBins::Eval(JetCorrBase const &corrector, Nuisances const
 }
 
 
-TH1D MultijetCrawlingBins::RecomputeBalanceData(JetCorrBase const &corrector,
-  Nuisances const &nuisances) const
+
+MultijetCrawlingBinsJoint::MultijetCrawlingBinsJoint(std::string const &fileName,
+  NuisanceDefinitions &nuisanceDefs, std::set<std::string> systToExclude,
+  FlatHist2D::Storage storage):
+    ptBal(new MultijetCrawlingBins(Method::PtBal)), mpf(new MultijetCrawlingBins(Method::MPF)),
+    storagePrecision{0., 0.}
 {
-    // Read the binning with up to L2Res correction applied
-    std::vector<double> binning;
-    binning.reserve(chi2Bins.size() + 1);
+    // Common inputs are read only once and then shared by the two measurements
+    auto const inputFile = MultijetCrawlingBins::OpenInputFile(fileName);
+    MultijetCrawlingBins::SharedInputs const inputs(
+      MultijetCrawlingBins::ReadSharedInputs(*inputFile, fileName));
+    ptBal->Initialize(*inputFile, fileName, inputs, nuisanceDefs, systToExclude);
+    mpf->Initialize(*inputFile, fileName, inputs, nuisanceDefs, systToExclude);
+    inputFile->Close();
+    
+    // Since the chi^2 bins are constructed from the same binning, they are aligned between the
+    //two measurements. This is relied upon when they are evaluated in a single pass.
+    ShareJetCache();
+    
+    if (storage != FlatHist2D::Storage::Double)
+        storagePrecision = MultijetCrawlingBins::ConvertStorage({ptBal.get(), mpf.get()},
+          *inputs.sumProjContents, storage, nuisanceDefs);
+}
 
-    for (auto const &chi2Bin: chi2Bins)
-        binning.emplace_back(chi2Bin.PtRange().first);
 
-    binning.emplace_back(chi2Bins[chi2Bins.size() - 1].PtRange().second);
+MultijetCrawlingBinsJoint::MultijetCrawlingBinsJoint(MultijetCrawlingBinsJoint const &src):
+    MeasurementBase(src),
+    ptBal(new MultijetCrawlingBins(*src.ptBal)), mpf(new MultijetCrawlingBins(*src.mpf)),
+    storagePrecision(src.storagePrecision)
+{
+    ShareJetCache();
+}
 
 
-    // Apply the given L3Res correction to take into account the migration in pt of the leading jet
-    for (auto &edge: binning)
-        edge = corrector.Apply(edge);
+std::unique_ptr<MeasurementBase> MultijetCrawlingBinsJoint::Clone() const
+{
+    return std::make_unique<MultijetCrawlingBinsJoint>(*this);
+}
 
 
-    TH1D histBalance("MeanBalance", "", binning.size() - 1, binning.data());
-    histBalance.SetDirectory(nullptr);
+double MultijetCrawlingBinsJoint::Eval(JetCorrBase const &corrector, Nuisances const &nuisances)
+  const
+{
+    auto const chi2 = EvalMethods(corrector, nuisances);
+    return chi2[0] + chi2[1];
+}
 
-    jetCache->Update(corrector);
 
-    for (unsigned i = 0; i < chi2Bins.size(); ++i)
+std::array<double, 2> MultijetCrawlingBinsJoint::EvalMethods(JetCorrBase const &corrector,
+  Nuisances const &nuisances, double const *corrections) const
+{
+    // The cache is shared by the two measurements
+    ptBal->jetCache->Update(corrector, corrections);
+    
+    static PerfRegion perfRegion("MultijetCrawlingBinsJoint::Chi2Bin reductions");
+    PerfScope perfScope(perfRegion);
+    std::array<double, 2> chi2{0., 0.};
+    
+    for (unsigned i = 0; i < ptBal->chi2Bins.size(); ++i)
     {
-        histBalance.SetBinContent(i + 1, chi2Bins[i].MeanBalance(nuisances));
-        histBalance.SetBinError(i + 1, chi2Bins[i].Uncertainty());
+        // The masks are always identical for the two methods
+        if (not ptBal->chi2BinMask[i])
+            continue;
+        
+        auto const &ptBalBin = ptBal->chi2Bins[i];
+        auto const &mpfBin = mpf->chi2Bins[i];
+        auto const balance = ptBalBin.MeanBalancePair(mpfBin, nuisances);
+        
+        chi2[0] += ptBalBin.Chi2(balance[0], nuisances);
+        chi2[1] += mpfBin.Chi2(balance[1], nuisances);
     }
+    
+    return chi2;
+}
 
-    return histBalance;
+
+void MultijetCrawlingBinsJoint::EvalMany(JetCorrBase &corrector, double const *corrParams,
+  Nuisances const *nuisances, unsigned numPoints, double *results) const
+{
+    // The cache is shared by the two measurements and has both methods enabled. The masks are
+    //always identical for the two methods.
+    auto &batch = ptBal->batch;
+    auto const binRange = ptBal->PtLeadBinRange();
+    ptBal->jetCache->EvalBatch(corrector, corrParams, numPoints, binRange.first,
+      binRange.second, batch);
+
+    static PerfRegion perfRegion("MultijetCrawlingBinsJoint::Chi2Bin batch reductions");
+    PerfScope perfScope(perfRegion);
+    std::fill(results, results + numPoints, 0.);
+
+    for (unsigned i = 0; i < ptBal->chi2Bins.size(); ++i)
+    {
+        if (not ptBal->chi2BinMask[i])
+            continue;
+
+        ptBal->chi2Bins[i].AddChi2Batch(Method::PtBal, batch, nuisances, numPoints, results);
+        mpf->chi2Bins[i].AddChi2Batch(Method::MPF, batch, nuisances, numPoints, results);
+    }
 }
 
 
-TH1D MultijetCrawlingBins::RecomputeBalanceSim(JetCorrBase const &corrector,
-  Nuisances const &nuisances) const
+double MultijetCrawlingBinsJoint::EvalWithCorrections(JetCorrBase const &corrector,
+  Nuisances const &nuisances, double const *corrections) const
 {
-    std::vector<double> binning;
-    binning.reserve(chi2Bins.size() + 1);
+    auto const chi2 = EvalMethods(corrector, nuisances, corrections);
+    return chi2[0] + chi2[1];
+}
 
-    for (auto const &chi2Bin: chi2Bins)
-        binning.emplace_back(chi2Bin.PtRange().first);
 
-    binning.emplace_back(chi2Bins[chi2Bins.size() - 1].PtRange().second);
+std::vector<double> MultijetCrawlingBinsJoint::GetCorrectionPoints() const
+{
+    return ptBal->jetCache->GetCorrectionPoints();
+}
 
 
-    TH1D histBalance("MeanBalance", "", binning.size() - 1, binning.data());
-    histBalance.SetDirectory(nullptr);
+unsigned MultijetCrawlingBinsJoint::GetDim() const
+{
+    return ptBal->GetDim() + mpf->GetDim();
+}
 
-    // Update jet cache as this determines positions in pt at which the splines are evaluated
-    jetCache->Update(corrector);
 
-    for (unsigned i = 0; i < chi2Bins.size(); ++i)
-        histBalance.SetBinContent(i + 1, chi2Bins[i].MeanSimBalance(nuisances));
+MultijetCrawlingBins const &MultijetCrawlingBinsJoint::GetMethod(Method method) const
+{
+    if (method == Method::PtBal)
+        return *ptBal;
+    else
+        return *mpf;
+}
 
-    return histBalance;
+
+StoragePrecision const &MultijetCrawlingBinsJoint::GetStoragePrecision() const
+{
+    return storagePrecision;
 }
 
 
-std::pair<double, double> MultijetCrawlingBins::SetPtLeadRange(double minPt, double maxPt)
+std::pair<double, double> MultijetCrawlingBinsJoint::SetPtLeadRange(double minPt, double maxPt)
 {
-    // Construct an auxiliary vector of all boundaries between chi^2 bins. Assume that all bins are
-    // adjacent.
-    std::vector<double> edges;
-    edges.reserve(chi2Bins.size() + 1);
-    
-    for (auto const &chi2Bin: chi2Bins)
-        edges.emplace_back(chi2Bin.PtRange().first);
-    
-    edges.emplace_back(chi2Bins.back().PtRange().second);
-    
-    
-    // Find closest edges
-    unsigned iEdgeMin = std::lower_bound(edges.begin(), edges.end(), minPt) - edges.begin();
-    
-    if (iEdgeMin == edges.size())
-        --iEdgeMin;
-    else if (iEdgeMin > 0)
-    {
-        if (edges[iEdgeMin] - minPt > minPt - edges[iEdgeMin - 1])
-            --iEdgeMin;
-    }
-    
-    unsigned iEdgeMax = std::lower_bound(edges.begin(), edges.end(), maxPt) - edges.begin();
-    
-    if (iEdgeMax == edges.size())
-        --iEdgeMax;
-    else if (iEdgeMax > 0)
-    {
-        if (edges[iEdgeMax] - maxPt > maxPt - edges[iEdgeMax - 1])
-            --iEdgeMax;
-    }
-    
-    if (iEdgeMax <= iEdgeMin)
+    mpf->SetPtLeadRange(minPt, maxPt);
+    return ptBal->SetPtLeadRange(minPt, maxPt);
+}
+
+
+void MultijetCrawlingBinsJoint::ShareJetCache()
+{
+    if (ptBal->chi2Bins.size() != mpf->chi2Bins.size())
     {
         std::ostringstream message;
-        message << "MultijetCrawlingBins::SetPtLeadRange: Requested range is too narrow.";
+        message << "MultijetCrawlingBinsJoint::ShareJetCache: Numbers of chi^2 bins for the two " <<
+          "methods do not match.";
         throw std::runtime_error(message.str());
     }
     
+    // Each measurement has set its own threshold for both methods in its cache. Take the one for
+    //the MPF method from the second measurement.
+    auto jetCache = std::make_shared<MultijetCrawlingBins::JetCache>(*ptBal->jetCache);
+    auto const mpfThreshold = mpf->jetCache->GetThreshold(Method::MPF);
+    jetCache->SetThreshold(Method::MPF, mpfThreshold.first, mpfThreshold.second);
+    jetCache->EnableMethod(Method::MPF);
     
-    // Mask chi^2 bins outsize of the range
-    for (unsigned i = 0; i < iEdgeMin; ++i)
-        chi2BinMask[i] = false;
-    
-    for (unsigned i = iEdgeMin; i < iEdgeMax; ++i)
-        chi2BinMask[i] = true;
-    
-    for (unsigned i = iEdgeMax; i < chi2BinMask.size(); ++i)
-        chi2BinMask[i] = false;
-    
-    
-    return {edges[iEdgeMin], edges[iEdgeMax]};
+    ptBal->SetJetCache(jetCache);
+    mpf->SetJetCache(jetCache);
 }
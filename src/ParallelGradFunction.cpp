@@ -0,0 +1,171 @@
+#include <ParallelGradFunction.hpp>
+#include <Tracer.hpp>
+
+#include <TROOT.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+
+ParallelGradFunction::ParallelGradFunction(CombLossFunction const &lossFunc_,
+  unsigned numThreads):
+    lossFunc(lossFunc_),
+    relStep(std::cbrt(std::numeric_limits<double>::epsilon())), batchSize(1),
+    threadPool(numThreads)
+{
+    unsigned const numWorkers = threadPool.GetNumWorkers();
+
+    if (numWorkers > 1)
+        ROOT::EnableThreadSafety();
+
+    contexts.emplace_back(&lossFunc);
+
+    for (unsigned i = 1; i < numWorkers; ++i)
+    {
+        clones.emplace_back(lossFunc.Clone());
+        contexts.emplace_back(clones.back().get());
+    }
+
+    points.resize(numWorkers, std::vector<double>(NDim()));
+    stencilValues.resize(2 * NDim());
+}
+
+
+ROOT::Math::IMultiGenFunction *ParallelGradFunction::Clone() const
+{
+    auto *clone = new ParallelGradFunction(lossFunc, threadPool.GetNumWorkers());
+    clone->SetRelStep(relStep);
+    clone->SetBatchSize(batchSize);
+    return clone;
+}
+
+
+void ParallelGradFunction::FdF(double const *x, double &f, double *grad) const
+{
+    f = DoEval(x);
+    Gradient(x, grad);
+}
+
+
+unsigned ParallelGradFunction::GetBatchSize() const
+{
+    return batchSize;
+}
+
+
+unsigned ParallelGradFunction::GetNumThreads() const
+{
+    return threadPool.GetNumWorkers();
+}
+
+
+void ParallelGradFunction::Gradient(double const *x, double *grad) const
+{
+    TraceSpan span("Gradient", "eval");
+    unsigned const numParams = NDim();
+
+    // Evaluate the loss function at points x_i + h_i and x_i - h_i, for all parameters i, which
+    //are stored at positions 2 i and 2 i + 1 of the buffer. Each task evaluates a batch of
+    //consecutive points.
+    unsigned const numPoints = 2 * numParams;
+    unsigned const numTasks = (numPoints + batchSize - 1) / batchSize;
+
+    threadPool.Run(numTasks, [this, x, numParams, numPoints](unsigned task, unsigned worker)
+    {
+        unsigned const begin = task * batchSize;
+        unsigned const end = std::min(begin + batchSize, numPoints);
+        auto &buffer = points[worker];
+
+        for (unsigned i = begin; i < end; ++i)
+        {
+            double *point = buffer.data() + (i - begin) * numParams;
+            std::copy(x, x + numParams, point);
+
+            unsigned const param = i / 2;
+            double const step = Step(x[param]);
+            point[param] += (i % 2 == 0) ? step : -step;
+        }
+
+        if (end - begin == 1)
+            stencilValues[begin] = contexts[worker]->EvalRawInput(buffer.data());
+        else
+            contexts[worker]->EvalRawInputMany(buffer.data(), end - begin,
+              stencilValues.data() + begin);
+    });
+
+    for (unsigned param = 0; param < numParams; ++param)
+    {
+        // Use the actual distance between the points, which accounts for rounding errors
+        double const step = Step(x[param]);
+        double const width = (x[param] + step) - (x[param] - step);
+        grad[param] = (stencilValues[2 * param] - stencilValues[2 * param + 1]) / width;
+    }
+}
+
+
+unsigned int ParallelGradFunction::NDim() const
+{
+    return lossFunc.GetNumParams();
+}
+
+
+void ParallelGradFunction::SetBatchSize(unsigned batchSize_)
+{
+    if (batchSize_ == 0 or batchSize_ > CombLossFunction::maxBatchSize)
+    {
+        std::ostringstream message;
+        message << "ParallelGradFunction::SetBatchSize: Given batch size " << batchSize_ <<
+          " is outside of the allowed range [1, " << CombLossFunction::maxBatchSize << "].";
+        throw std::runtime_error(message.str());
+    }
+
+    batchSize = batchSize_;
+
+    for (auto &buffer: points)
+        buffer.resize(batchSize * NDim());
+}
+
+
+void ParallelGradFunction::SetRelStep(double relStep_)
+{
+    if (relStep_ <= 0.)
+    {
+        std::ostringstream message;
+        message << "ParallelGradFunction::SetRelStep: Given step " << relStep_ <<
+          " is not positive.";
+        throw std::runtime_error(message.str());
+    }
+
+    relStep = relStep_;
+}
+
+
+double ParallelGradFunction::DoDerivative(double const *x, unsigned int icoord) const
+{
+    auto &point = points[0];
+    std::copy(x, x + NDim(), point.begin());
+    double const step = Step(x[icoord]);
+
+    point[icoord] = x[icoord] + step;
+    double const valueUp = lossFunc.EvalRawInput(point.data());
+
+    point[icoord] = x[icoord] - step;
+    double const valueDown = lossFunc.EvalRawInput(point.data());
+
+    return (valueUp - valueDown) / ((x[icoord] + step) - (x[icoord] - step));
+}
+
+
+double ParallelGradFunction::DoEval(double const *x) const
+{
+    return lossFunc.EvalRawInput(x);
+}
+
+
+double ParallelGradFunction::Step(double x) const
+{
+    return relStep * std::max(std::abs(x), 1.);
+}
@@ -0,0 +1,165 @@
+#include <ParallelMinos.hpp>
+#include <Tracer.hpp>
+
+#include <Fit/ParameterSettings.h>
+#include <Math/Functor.h>
+#include <Minuit2/FCNAdapter.h>
+#include <Minuit2/FunctionMinimum.h>
+#include <Minuit2/MinosError.h>
+#include <Minuit2/MnMigrad.h>
+#include <Minuit2/MnMinos.h>
+#include <Minuit2/MnStrategy.h>
+#include <Minuit2/MnUserCovariance.h>
+#include <Minuit2/MnUserParameterState.h>
+#include <Minuit2/MnUserParameters.h>
+#include <TROOT.h>
+
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+
+ParallelMinos::ParallelMinos(CombLossFunction const &lossFunc_, unsigned numThreads):
+    lossFunc(lossFunc_), threadPool(numThreads)
+{
+    unsigned const numWorkers = threadPool.GetNumWorkers();
+
+    if (numWorkers > 1)
+        ROOT::EnableThreadSafety();
+
+    contexts.emplace_back(&lossFunc);
+
+    for (unsigned i = 1; i < numWorkers; ++i)
+    {
+        clones.emplace_back(lossFunc.Clone());
+        contexts.emplace_back(clones.back().get());
+    }
+}
+
+
+unsigned ParallelMinos::GetNumThreads() const
+{
+    return threadPool.GetNumWorkers();
+}
+
+
+std::vector<ParallelMinos::Interval> ParallelMinos::Run(ROOT::Math::Minimizer const &fitted)
+{
+    TraceSpan span("Minos", "fit");
+    unsigned const numParams = lossFunc.GetNumParams();
+
+    if (fitted.NDim() != numParams)
+    {
+        std::ostringstream message;
+        message << "ParallelMinos::Run: Minimizer has " << fitted.NDim() << " variables while " <<
+          "the loss function has " << numParams << " parameters.";
+        throw std::runtime_error(message.str());
+    }
+
+
+    // Reproduce the parameters of the fit, with the fitted values as the starting point
+    ROOT::Minuit2::MnUserParameters params;
+    std::vector<unsigned> freeParams;
+    double const *x = fitted.X();
+    double const *errors = fitted.Errors();
+
+    for (unsigned i = 0; i < numParams; ++i)
+    {
+        ROOT::Fit::ParameterSettings settings;
+
+        if (not fitted.GetVariableSettings(i, settings))
+        {
+            std::ostringstream message;
+            message << "ParallelMinos::Run: Failed to read settings for variable " << i << ".";
+            throw std::runtime_error(message.str());
+        }
+
+        params.Add(settings.Name(), x[i],
+          (errors and errors[i] > 0.) ? errors[i] : settings.StepSize());
+
+        if (settings.HasLowerLimit() and settings.HasUpperLimit())
+            params.SetLimits(i, settings.LowerLimit(), settings.UpperLimit());
+        else if (settings.HasLowerLimit())
+            params.SetLowerLimit(i, settings.LowerLimit());
+        else if (settings.HasUpperLimit())
+            params.SetUpperLimit(i, settings.UpperLimit());
+
+        if (settings.IsFixed())
+            params.Fix(i);
+        else
+            freeParams.emplace_back(i);
+    }
+
+
+    // Construct the minimum in the internal format of Minuit2, which is needed by the searches.
+    //Since Migrad is seeded with the fitted covariance matrix, it starts at the fitted minimum with
+    //the correct metric and stops as soon as it confirms the convergence. This is done only once
+    //and shared by all searches.
+    std::vector<Interval> intervals(numParams, Interval{0., 0., false, false});
+    ROOT::Minuit2::MnStrategy const strategy(fitted.Strategy());
+    std::unique_ptr<ROOT::Minuit2::MnUserParameterState> state;
+
+    if (fitted.CovMatrixStatus() > 0)
+    {
+        ROOT::Minuit2::MnUserCovariance covariance(freeParams.size());
+
+        for (unsigned i = 0; i < freeParams.size(); ++i)
+            for (unsigned j = i; j < freeParams.size(); ++j)
+                covariance(i, j) = fitted.CovMatrix(freeParams[i], freeParams[j]);
+
+        state = std::make_unique<ROOT::Minuit2::MnUserParameterState>(params, covariance);
+    }
+    else
+        state = std::make_unique<ROOT::Minuit2::MnUserParameterState>(params);
+
+    ROOT::Math::Functor const func(contexts[0], &CombLossFunction::EvalRawInput, numParams);
+    ROOT::Minuit2::FCNAdapter<ROOT::Math::IMultiGenFunction> const fcn(func, fitted.ErrorDef());
+    ROOT::Minuit2::MnMigrad migrad(fcn, *state, strategy);
+    ROOT::Minuit2::FunctionMinimum const minimum =
+      migrad(fitted.MaxFunctionCalls(), fitted.Tolerance());
+
+    if (not minimum.IsValid())
+        return intervals;
+
+
+    // Each task is a search on one side of one parameter. Task 2 i computes the lower error for
+    //the i-th free parameter and task 2 i + 1 the upper one. Results of different tasks are
+    //written to different fields. The searches are set up as in Minuit2Minimizer::GetMinosError.
+    threadPool.Run(2 * freeParams.size(),
+      [this, &fitted, &freeParams, &intervals, &minimum, &strategy, numParams](unsigned task,
+      unsigned worker)
+    {
+        TraceSpan taskSpan("Minos search", "fit");
+        unsigned const param = freeParams[task / 2];
+        bool const lowerSide = (task % 2 == 0);
+
+        ROOT::Math::Functor const func(contexts[worker], &CombLossFunction::EvalRawInput,
+          numParams);
+        ROOT::Minuit2::FCNAdapter<ROOT::Math::IMultiGenFunction> const fcn(func,
+          fitted.ErrorDef());
+        ROOT::Minuit2::MnMinos const minos(fcn, minimum, strategy);
+        ROOT::Minuit2::MnCross lowerCross, upperCross;
+
+        if (lowerSide)
+            lowerCross = minos.Loval(param, fitted.MaxFunctionCalls(), fitted.Tolerance());
+        else
+            upperCross = minos.Upval(param, fitted.MaxFunctionCalls(), fitted.Tolerance());
+
+        ROOT::Minuit2::MinosError const error(param, minimum.UserState().Value(param),
+          lowerCross, upperCross);
+        Interval &interval = intervals[param];
+
+        if (lowerSide)
+        {
+            interval.lower = error.Lower();
+            interval.lowerValid = error.LowerValid();
+        }
+        else
+        {
+            interval.upper = error.Upper();
+            interval.upperValid = error.UpperValid();
+        }
+    });
+
+    return intervals;
+}
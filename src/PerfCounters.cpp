@@ -0,0 +1,386 @@
+#include <PerfCounters.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+
+/// Registered regions and the description of the state of counters
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<PerfRegion *> regions;
+    std::string status = "Counting has not been enabled.";
+
+    /// Flags indicating which events could be opened
+    std::array<bool, PerfCounters::numEvents> available{};
+};
+
+
+Registry &GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+
+/**
+ * \class CounterGroup
+ * \brief Group of hardware counters for the calling thread
+ *
+ * The counters are opened on the first use in each thread. Events that cannot be opened are
+ * skipped, but the group is only usable if the number of cycles can be counted.
+ */
+class CounterGroup
+{
+public:
+    /// Number of values read from the group: time enabled, time running, and all events
+    static constexpr unsigned numValues = PerfCounters::numEvents + 2;
+
+public:
+    CounterGroup();
+    ~CounterGroup() noexcept;
+
+public:
+    /// Opens the counters if not done yet and returns true if the group can be used
+    bool Open();
+
+    /// Returns the reason why the group cannot be used
+    std::string const &GetError() const;
+
+    /// Checks whether the given event is being counted
+    bool IsAvailable(unsigned event) const;
+
+    /**
+     * \brief Reads current values
+     *
+     * The values are the time enabled, the time running, and counts for all events, with zeros
+     * for events that are not counted. Returns false in case of a failure.
+     */
+    bool Read(std::array<unsigned long, numValues> &values) const;
+
+private:
+    bool opened;
+    std::string error;
+
+    /// File descriptors for all events, -1 for events that are not counted
+    std::array<int, PerfCounters::numEvents> fds;
+
+    /// Events in the order in which they appear in the data read from the group
+    std::vector<unsigned> order;
+};
+
+
+CounterGroup::CounterGroup():
+    opened(false)
+{
+    fds.fill(-1);
+}
+
+
+CounterGroup::~CounterGroup() noexcept
+{
+#ifdef __linux__
+    for (int const fd: fds)
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+#endif
+}
+
+
+bool CounterGroup::Open()
+{
+    if (opened)
+        return (fds[0] >= 0);
+
+    opened = true;
+
+#ifdef __linux__
+    static std::array<unsigned long, PerfCounters::numEvents> const configs{
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES,
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES};
+
+    for (unsigned event = 0; event < PerfCounters::numEvents; ++event)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[event];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+          PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // Count in the calling thread on any CPU. The first event leads the group.
+        int const fd = syscall(SYS_perf_event_open, &attr, 0, -1, fds[0], 0);
+
+        if (fd < 0)
+        {
+            if (event == 0)
+            {
+                std::ostringstream message;
+                message << "perf_event_open failed: " << std::strerror(errno) <<
+                  ". Hardware counters might be unavailable in a container or restricted by "
+                  "kernel.perf_event_paranoid.";
+                error = message.str();
+                return false;
+            }
+
+            continue;
+        }
+
+        fds[event] = fd;
+        order.emplace_back(event);
+    }
+
+    return true;
+#else
+    error = "Hardware counters are only supported on Linux.";
+    return false;
+#endif
+}
+
+
+std::string const &CounterGroup::GetError() const
+{
+    return error;
+}
+
+
+bool CounterGroup::IsAvailable(unsigned event) const
+{
+    return (fds[event] >= 0);
+}
+
+
+bool CounterGroup::Read(std::array<unsigned long, numValues> &values) const
+{
+#ifdef __linux__
+    // Layout of the data: number of events, time enabled, time running, counts
+    std::array<std::uint64_t, PerfCounters::numEvents + 3> buffer;
+    ssize_t const size = read(fds[0], buffer.data(), sizeof(buffer));
+
+    if (size < ssize_t((3 + order.size()) * sizeof(std::uint64_t)))
+        return false;
+
+    values.fill(0);
+    values[0] = buffer[1];
+    values[1] = buffer[2];
+
+    for (unsigned i = 0; i < order.size(); ++i)
+        values[2 + order[i]] = buffer[3 + i];
+
+    return true;
+#else
+    (void) values;
+    return false;
+#endif
+}
+
+
+/// Returns the group of counters for the calling thread
+CounterGroup &GetThreadGroup()
+{
+    thread_local CounterGroup group;
+    return group;
+}
+
+}  // anonymous namespace
+
+
+
+std::atomic<bool> PerfCounters::enabled(false);
+
+
+bool PerfCounters::Enable()
+{
+    auto &registry = GetRegistry();
+    auto &group = GetThreadGroup();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    if (not group.Open())
+    {
+        registry.status = group.GetError();
+        enabled = false;
+        return false;
+    }
+
+    unsigned numAvailable = 0;
+
+    for (unsigned event = 0; event < numEvents; ++event)
+    {
+        registry.available[event] = group.IsAvailable(event);
+        numAvailable += registry.available[event];
+    }
+
+    std::ostringstream message;
+    message << "Counting " << numAvailable << " of " << numEvents << " hardware events.";
+    registry.status = message.str();
+    enabled = true;
+    return true;
+}
+
+
+void PerfCounters::Disable()
+{
+    enabled = false;
+}
+
+
+std::string PerfCounters::GetStatus()
+{
+    auto &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return registry.status;
+}
+
+
+std::vector<PerfCounters::RegionSummary> PerfCounters::GetSummary()
+{
+    auto &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<RegionSummary> summary;
+
+    for (auto const *region: registry.regions)
+    {
+        unsigned long const calls = region->calls;
+
+        if (calls == 0)
+            continue;
+
+        // Correct for the time during which the counters were not running because of
+        //multiplexing
+        unsigned long const timeRunning = region->timeRunning;
+        double const scale = (timeRunning > 0) ?
+          double(region->timeEnabled) / timeRunning : 1.;
+
+        RegionSummary entry{region->name, calls, {}};
+
+        for (unsigned event = 0; event < numEvents; ++event)
+            entry.counts[event] = (registry.available[event]) ?
+              region->counts[event] * scale : -1.;
+
+        summary.emplace_back(entry);
+    }
+
+    return summary;
+}
+
+
+void PerfCounters::Report(std::ostream &out)
+{
+    auto const summary = GetSummary();
+    out << "Hardware counters: " << GetStatus() << '\n';
+
+    if (summary.empty())
+        return;
+
+    // Ratio of two counts, printed only if both are available
+    auto const printRatio = [&out](double numerator, double denominator, double factor)
+    {
+        out << std::setw(14);
+
+        if (numerator >= 0. and denominator > 0.)
+            out << std::fixed << std::setprecision(3) << factor * numerator / denominator;
+        else
+            out << "n/a";
+    };
+
+    out << std::left << std::setw(44) << "Region" << std::right << std::setw(12) << "Calls" <<
+      std::setw(14) << "Cycles/call" << std::setw(14) << "IPC" << std::setw(14) <<
+      "Cache miss %" << std::setw(14) << "Branch miss %" << '\n';
+
+    for (auto const &entry: summary)
+    {
+        auto const &counts = entry.counts;
+        out << std::left << std::setw(44) << entry.name << std::right << std::setw(12) <<
+          entry.calls << std::setw(14) << std::fixed << std::setprecision(0) <<
+          counts[unsigned(Event::Cycles)] / entry.calls;
+        printRatio(counts[unsigned(Event::Instructions)], counts[unsigned(Event::Cycles)], 1.);
+        printRatio(counts[unsigned(Event::CacheMisses)],
+          counts[unsigned(Event::CacheReferences)], 100.);
+        printRatio(counts[unsigned(Event::BranchMisses)], counts[unsigned(Event::Branches)],
+          100.);
+        out << '\n';
+    }
+
+    out << std::defaultfloat;
+}
+
+
+void PerfCounters::Reset()
+{
+    auto &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    for (auto *region: registry.regions)
+    {
+        region->calls = 0;
+        region->timeEnabled = 0;
+        region->timeRunning = 0;
+
+        for (auto &count: region->counts)
+            count = 0;
+    }
+}
+
+
+
+PerfRegion::PerfRegion(std::string const &name_):
+    name(name_), calls(0), timeEnabled(0), timeRunning(0)
+{
+    for (auto &count: counts)
+        count = 0;
+
+    auto &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.regions.emplace_back(this);
+}
+
+
+
+PerfScope::PerfScope(PerfRegion &region_):
+    region(nullptr)
+{
+    if (not PerfCounters::IsEnabled())
+        return;
+
+    auto &group = GetThreadGroup();
+
+    if (group.Open() and group.Read(startValues))
+        region = &region_;
+}
+
+
+PerfScope::~PerfScope() noexcept
+{
+    if (not region)
+        return;
+
+    std::array<unsigned long, CounterGroup::numValues> endValues;
+
+    if (not GetThreadGroup().Read(endValues))
+        return;
+
+    region->calls.fetch_add(1, std::memory_order_relaxed);
+    region->timeEnabled.fetch_add(endValues[0] - startValues[0], std::memory_order_relaxed);
+    region->timeRunning.fetch_add(endValues[1] - startValues[1], std::memory_order_relaxed);
+
+    for (unsigned event = 0; event < PerfCounters::numEvents; ++event)
+        region->counts[event].fetch_add(endValues[2 + event] - startValues[2 + event],
+          std::memory_order_relaxed);
+}
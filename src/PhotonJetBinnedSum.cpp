@@ -1,12 +1,19 @@
 #include <PhotonJetBinnedSum.hpp>
 #include <Rebin.hpp>
 
+#include <TFile.h>
+#include <TH1.h>
+#include <TH2.h>
+#include <TProfile.h>
+#include <TProfile2D.h>
+#include <TROOT.h>
+#include <TVectorD.h>
+
+#include <algorithm>
 #include <cmath>
 #include <memory>
 #include <sstream>
-#include <TVectorD.h>
-
-#include <TFile.h>
+#include <stdexcept>
 
 
 PhotonJetBinnedSum::PhotonJetBinnedSum(std::string const &fileName,
@@ -32,26 +39,31 @@ PhotonJetBinnedSum::PhotonJetBinnedSum(std::string const &fileName,
         throw std::runtime_error(message.str());
     }
     
-    auto ptThreshold = dynamic_cast<TVectorD *>(inputFile->Get(("MC_MinPt" + methodLabel).c_str()));
+    std::unique_ptr<TVectorD> ptThreshold(dynamic_cast<TVectorD *>(
+      inputFile->Get(("MC_MinPt" + methodLabel).c_str())));
 
     if (not ptThreshold or ptThreshold->GetNoElements() != 1)
-     {
+    {
         std::ostringstream message;
         message << "PhotonJetBinnedSum::PhotonJetBinnedSum: Failed to read jet pt threshold " <<
-           "from file \"" << fileName << "\".";
+          "from file \"" << fileName << "\".";
         throw std::runtime_error(message.str());
-      }
+    }
+
+    jetPtMin = (*ptThreshold)[0];
 
-    jetPtMin = (*ptThreshold)[1];
-  
-    simBalProfile.reset(dynamic_cast<TProfile *>(inputFile->Get(
+    // Histograms are only needed to fill the flat arrays below
+    std::unique_ptr<TProfile> simBalProfile(dynamic_cast<TProfile *>(inputFile->Get(
       ("MC_new" + methodLabel + "_vs_ptphoton").c_str())));
-    balProfile.reset(dynamic_cast<TProfile *>(inputFile->Get(
+    std::unique_ptr<TProfile> balProfile(dynamic_cast<TProfile *>(inputFile->Get(
       ("DATA_new" + methodLabel + "_vs_ptphoton").c_str())));
-    ptPhoton.reset(dynamic_cast<TH1 *>(inputFile->Get("DATA_phopt_for_nevts")));
-    ptPhotonProfile.reset(dynamic_cast<TProfile *>(inputFile->Get("DATA_ptphoton_vs_ptphoton")));
-    ptJetSumProj.reset(dynamic_cast<TH2 *>(inputFile->Get("DATA_Skl_phopt_vs_jetpt")));
-    ptJet2DProfile.reset(dynamic_cast<TProfile2D *>(inputFile->Get("DATA_jetpt_phopt_vs_jetpt")));
+    std::unique_ptr<TH1> ptPhoton(dynamic_cast<TH1 *>(inputFile->Get("DATA_phopt_for_nevts")));
+    std::unique_ptr<TProfile> ptPhotonProfile(dynamic_cast<TProfile *>(
+      inputFile->Get("DATA_ptphoton_vs_ptphoton")));
+    std::unique_ptr<TH2> ptJetSumProj(dynamic_cast<TH2 *>(
+      inputFile->Get("DATA_Skl_phopt_vs_jetpt")));
+    std::unique_ptr<TProfile2D> ptJet2DProfile(dynamic_cast<TProfile2D *>(
+      inputFile->Get("DATA_jetpt_phopt_vs_jetpt")));
     
     
     simBalProfile->SetDirectory(nullptr);
@@ -72,190 +84,238 @@ PhotonJetBinnedSum::PhotonJetBinnedSum(std::string const &fileName,
     
     for (int i = 1; i <= simBalProfile->GetNbinsX(); ++i)
     {
+        simBal.emplace_back(simBalProfile->GetBinContent(i));
         double const unc2 = std::pow(simBalProfile->GetBinError(i), 2) +
           std::pow(balRebinned->GetBinError(i), 2);
         totalUnc2.emplace_back(unc2);
     }
     
+    recompBal.resize(simBal.size());
     
-    recompBal.resize(simBalProfile->GetNbinsX());
-    nuisanceDefs.Register("PhotonScale");
-}
-
-
-unsigned PhotonJetBinnedSum::GetDim() const
-{
-    return simBalProfile->GetNbinsX();
-}
-
-
-double PhotonJetBinnedSum::Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const
-{
-    UpdateBalance(corrector, nuisances);
-    double chi2 = 0.;
-    
-    for (int photonBinIndex = 1; photonBinIndex <= simBalProfile->GetNbinsX(); ++photonBinIndex)
-    {
-        double const meanBal = recompBal[photonBinIndex - 1];
-        double const simMeanBal = simBalProfile->GetBinContent(photonBinIndex);
-        chi2 += std::pow(meanBal - simMeanBal, 2) / totalUnc2[photonBinIndex - 1];
-    }
-    
-    return chi2;
-}
-
-
-double PhotonJetBinnedSum::ComputeMPF(FracBin const &ptPhotonStart, FracBin const &ptPhotonEnd,
-  JetCorrBase const &corrector, Nuisances const &nuisances) const
-{
-    
-    // Find the bin in jet pt that includes the value of pt that, after the current correction,
-    // would give the nominal minimal pt threshold. Compute also the fraction of this bin that
-    // should included in the sum.
-    TAxis const *ptJetAxis = ptJetSumProj->GetYaxis();
-    double const uncorrJetPtMin = corrector.UndoCorr(jetPtMin);
-    int const startBin = ptJetAxis->FindBin(uncorrJetPtMin);
-    double const fracStartBin = 1. - (uncorrJetPtMin - ptJetAxis->GetBinLowEdge(startBin)) /
-      ptJetAxis->GetBinWidth(startBin);
     
+    // Copy inputs for bins in pt of the photon that contain events into flat arrays. Empty cells
+    //do not contribute to the balance observable and are dropped.
+    for (int i = 1; i <= ptJetSumProj->GetNbinsY() + 1; ++i)
+        jetBinning.emplace_back(ptJetSumProj->GetYaxis()->GetBinLowEdge(i));
     
-    double sumBal = 0., sumWeight = 0.,  sumJets = 0.;
-    double const photonScaleFactor = 1 + photonScaleVar * nuisances["PhotonScale"];
+    std::vector<unsigned> photonBinIndices;
     
-    for (unsigned photonBinIndex = ptPhotonStart.index; photonBinIndex <= ptPhotonEnd.index;
-      ++photonBinIndex)
+    for (int photonBinIndex = 1; photonBinIndex <= balProfile->GetNbinsX(); ++photonBinIndex)
     {
         double const numEvents = ptPhoton->GetBinContent(photonBinIndex);
         
         if (numEvents == 0)
             continue;
         
-        double const meanPhotonPt =
-          ptPhotonProfile->GetBinContent(photonBinIndex) * photonScaleFactor;
+        PhotonBin bin;
+        bin.numEvents = numEvents;
+        bin.meanPhotonPt = ptPhotonProfile->GetBinContent(photonBinIndex);
+        bin.meanBal = balProfile->GetBinContent(photonBinIndex);
+        bin.firstCell = cellJetBins.size();
         
-        
-        // Recompute mean value for the MPF observable in data by summing over all jet pt bins
-        sumBal += balProfile->GetBinContent(photonBinIndex) * numEvents ;
-        sumWeight += numEvents ;
-        
-        sumJets = 0.;
-        
-        for (int jetBinIndex = startBin; jetBinIndex <= ptJetSumProj->GetNbinsY(); ++jetBinIndex)
+        for (int jetBinIndex = 1; jetBinIndex <= ptJetSumProj->GetNbinsY(); ++jetBinIndex)
         {
             double const s = ptJetSumProj->GetBinContent(photonBinIndex, jetBinIndex);
             
             if (s == 0.)
                 continue;
             
-            double const meanJetPt = ptJet2DProfile->GetBinContent(photonBinIndex, jetBinIndex);
-            
-            if (jetBinIndex == startBin)
-                sumJets -= s * (1. - corrector.Eval(meanJetPt)) * fracStartBin;
-            else
-                sumJets -= s * (1. - corrector.Eval(meanJetPt));
+            cellJetBins.emplace_back(jetBinIndex);
+            cellSumProj.emplace_back(s);
+            cellMeanJetPt.emplace_back(
+              ptJet2DProfile->GetBinContent(photonBinIndex, jetBinIndex));
         }
         
-        sumJets /= meanPhotonPt;
-        sumBal += sumJets;
+        bin.endCell = cellJetBins.size();
+        photonBins.emplace_back(bin);
+        photonBinIndices.emplace_back(photonBinIndex);
     }
     
-    return sumBal / sumWeight;
+    cellFactors.resize(cellJetBins.size());
+    
+    
+    // Build a map from the simulation (wide) binning to the fine binning used in data. Under- and
+    //overflow bins are dropped. Bins of data without events are skipped as they do not contribute.
+    std::vector<double> simPtBinning;
+    std::vector<double> dataPtBinning;
+    
+    for (int i = 1; i <= simBalProfile->GetNbinsX() + 1; ++i)
+        simPtBinning.emplace_back(simBalProfile->GetBinLowEdge(i));
+    
+    for (int i = 1; i <= balProfile->GetNbinsX() + 1; ++i)
+        dataPtBinning.emplace_back(balProfile->GetBinLowEdge(i));
+    
+    auto const binMap = mapBinning(dataPtBinning, simPtBinning);
+    
+    for (int i = 1; i <= simBalProfile->GetNbinsX(); ++i)
+    {
+        auto const &range = binMap.at(i);
+        auto const first = std::lower_bound(photonBinIndices.begin(), photonBinIndices.end(),
+          range[0].index);
+        auto const end = std::upper_bound(first, photonBinIndices.end(), range[1].index);
+        simBinRanges.push_back({unsigned(first - photonBinIndices.begin()),
+          unsigned(end - photonBinIndices.begin())});
+    }
+    
+    
+    photonScaleIndex = nuisanceDefs.Register("PhotonScale");
 }
 
 
-double PhotonJetBinnedSum::ComputePtBal(FracBin const &ptPhotonStart, FracBin const &ptPhotonEnd,
- JetCorrBase const &corrector, Nuisances const &nuisances) const
+std::unique_ptr<MeasurementBase> PhotonJetBinnedSum::Clone() const
 {
+    auto clone = std::make_unique<PhotonJetBinnedSum>(*this);
     
-    // Find the bin in jet pt that includes the value of pt that, after the current correction,
-    // would give the nominal minimal pt threshold. Compute also the fraction of this bin that
-    // should included in the sum.
-    TAxis const *ptJetAxis = ptJetSumProj->GetYaxis();
-    double const uncorrJetPtMin = corrector.UndoCorr(jetPtMin);
-    int const startBin = ptJetAxis->FindBin(uncorrJetPtMin);
-    double const fracStartBin = 1. - (uncorrJetPtMin - ptJetAxis->GetBinLowEdge(startBin)) /
-      ptJetAxis->GetBinWidth(startBin);
-    
+    // The pool cannot be shared as it must not be used from several threads at once
+    if (threadPool)
+        clone->threadPool = std::make_shared<ThreadPool>(threadPool->GetNumWorkers());
     
-    double const photonScaleFactor = 1 + photonScaleVar * nuisances["PhotonScale"];
-    
-    // Recompute mean value for the balance observable in data by summing over all jet pt bins
-    double meanBal = 0.;
-    double sumWeight = 0.;
+    return clone;
+}
+
+
+unsigned PhotonJetBinnedSum::GetDim() const
+{
+    return simBal.size();
+}
+
+
+double PhotonJetBinnedSum::Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const
+{
+    UpdateBalance(corrector, nuisances);
+    return SumChi2();
+}
+
+
+double PhotonJetBinnedSum::EvalWithCorrections(JetCorrBase const &corrector,
+  Nuisances const &nuisances, double const *corrections) const
+{
+    UpdateBalance(corrector, nuisances, corrections);
+    return SumChi2();
+}
+
+
+std::vector<double> PhotonJetBinnedSum::GetCorrectionPoints() const
+{
+    return cellMeanJetPt;
+}
+
+
+void PhotonJetBinnedSum::SetNumThreads(unsigned numThreads)
+{
+    if (numThreads == 1)
+        threadPool.reset();
+    else
+    {
+        threadPool = std::make_shared<ThreadPool>(numThreads);
+        
+        if (threadPool->GetNumWorkers() > 1)
+            ROOT::EnableThreadSafety();
+    }
+}
+
+
+double PhotonJetBinnedSum::ComputeBalance(unsigned simBin, unsigned startJetBin,
+  double fracStartBin, double photonScaleFactor) const
+{
+    auto const &range = simBinRanges[simBin];
+    double sumBal = 0., sumWeight = 0.;
     
-    for (unsigned photonBinIndex = ptPhotonStart.index; photonBinIndex <= ptPhotonEnd.index;
-      ++photonBinIndex)
+    for (unsigned photonBinIndex = range[0]; photonBinIndex < range[1]; ++photonBinIndex)
     {
-        double const numEvents = ptPhoton->GetBinContent(photonBinIndex);
+        auto const &bin = photonBins[photonBinIndex];
+        sumWeight += bin.numEvents;
         
-        if(numEvents == 0)
-            continue;
         
-        sumWeight += numEvents;
-        double meanBalInBin = 0.;
+        // Sum over jets above the threshold. Cells are sorted in jet pt, and only a fraction of
+        //the bin that contains the threshold is included.
+        unsigned cell = std::lower_bound(cellJetBins.begin() + bin.firstCell,
+          cellJetBins.begin() + bin.endCell, startJetBin) - cellJetBins.begin();
+        double sumJets = 0.;
+        
+        if (cell < bin.endCell and cellJetBins[cell] == startJetBin)
+        {
+            sumJets += cellSumProj[cell] * cellFactors[cell] * fracStartBin;
+            ++cell;
+        }
+        
+        for (; cell < bin.endCell; ++cell)
+            sumJets += cellSumProj[cell] * cellFactors[cell];
         
-        double const meanPhotonPt =
-          ptPhotonProfile->GetBinContent(photonBinIndex) * photonScaleFactor;
+        sumJets /= bin.meanPhotonPt * photonScaleFactor;
         
-        for (int jetBinIndex = startBin; jetBinIndex <= ptJetSumProj->GetNbinsY(); ++jetBinIndex)
+        
+        if (method == Method::PtBal)
+            sumBal += sumJets;
+        else
         {
-            double const s = ptJetSumProj->GetBinContent(photonBinIndex, jetBinIndex);
-            
-            if (s == 0.)
-                continue;
-            
-            double const meanJetPt = ptJet2DProfile->GetBinContent(photonBinIndex, jetBinIndex);
-            
-            if(jetBinIndex == startBin)
-                meanBalInBin += s * corrector.Eval(meanJetPt) * fracStartBin;
-            else
-                meanBalInBin += s * corrector.Eval(meanJetPt);
+            sumBal += bin.meanBal * bin.numEvents;
+            sumBal -= sumJets;
         }
-    
-        meanBalInBin /= meanPhotonPt;
-        meanBal += meanBalInBin;
     }
     
-    meanBal /= sumWeight;
-    return meanBal;
+    return sumBal / sumWeight;
 }
 
-void PhotonJetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances const &nuisances)
-  const
+
+double PhotonJetBinnedSum::SumChi2() const
 {
-    std::vector<double> simPtBinning;
-    std::vector<double> dataPtBinning;
+    double chi2 = 0.;
     
-    for (int i = 1; i <= simBalProfile->GetNbinsX() + 1; ++i)
-    {
-        double const pt = simBalProfile->GetBinLowEdge(i);
-        simPtBinning.emplace_back(pt);
-    }
+    for (unsigned i = 0; i < simBal.size(); ++i)
+        chi2 += std::pow(recompBal[i] - simBal[i], 2) / totalUnc2[i];
     
-    for (int i = 1; i <= balProfile->GetNbinsX() + 1; ++i)
+    return chi2;
+}
+
+
+void PhotonJetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances const &nuisances,
+  double const *corrections) const
+{
+    // Evaluate the correction for all cells at once, unless it has been precomputed
+    if (corrections)
+        std::copy(corrections, corrections + cellFactors.size(), cellFactors.begin());
+    else
+        corrector.EvalBatch(cellMeanJetPt.data(), cellFactors.data(), cellFactors.size());
+    
+    if (method == Method::MPF)
     {
-        double const pt = balProfile->GetBinLowEdge(i);
-        dataPtBinning.emplace_back(pt);
+        for (auto &factor: cellFactors)
+            factor = 1. - factor;
     }
     
     
-    // Build a map from the simulation (wide) binning to the fine binning used in data
-    auto binMap = mapBinning(dataPtBinning, simPtBinning);
-    binMap.erase(0);
-    binMap.erase(simBalProfile->GetNbinsX() + 1);
+    // Find the bin in jet pt that includes the value of pt that, after the current correction,
+    //would give the nominal minimal pt threshold. Compute also the fraction of this bin that
+    //should included in the sum. If the threshold is below the range of the histogram, all bins
+    //are included.
+    double const uncorrJetPtMin = corrector.UndoCorr(jetPtMin);
+    unsigned startJetBin = std::upper_bound(jetBinning.begin(), jetBinning.end(), uncorrJetPtMin) -
+      jetBinning.begin();
+    double fracStartBin = 1.;
+    
+    if (startJetBin == 0)
+        startJetBin = 1;
+    else if (startJetBin < jetBinning.size())
+        fracStartBin = 1. - (uncorrJetPtMin - jetBinning[startJetBin - 1]) /
+          (jetBinning[startJetBin] - jetBinning[startJetBin - 1]);
+    
+    
+    double const photonScaleFactor = 1 + photonScaleVar * nuisances[photonScaleIndex];
     
-    for (auto const &binMapPair: binMap)
+    if (threadPool)
     {
-        auto const &binIndex = binMapPair.first;
-        auto const &binRange = binMapPair.second;
-        
-        double meanBal;
-        
-        if (method == Method::PtBal)
-            meanBal = ComputePtBal(binRange[0], binRange[1], corrector, nuisances);
-        else
-            meanBal = ComputeMPF(binRange[0], binRange[1], corrector, nuisances);
-        
-        recompBal[binIndex - 1] = meanBal;
+        threadPool->Run(simBal.size(),
+          [this, startJetBin, fracStartBin, photonScaleFactor](unsigned simBin, unsigned)
+        {
+            recompBal[simBin] = ComputeBalance(simBin, startJetBin, fracStartBin,
+              photonScaleFactor);
+        });
+    }
+    else
+    {
+        for (unsigned simBin = 0; simBin < simBal.size(); ++simBin)
+            recompBal[simBin] = ComputeBalance(simBin, startJetBin, fracStartBin,
+              photonScaleFactor);
     }
 }
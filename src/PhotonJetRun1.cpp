@@ -56,6 +56,12 @@ PhotonJetRun1::PhotonJetRun1(std::string const &fileName, Method method,
 }
 
 
+std::unique_ptr<MeasurementBase> PhotonJetRun1::Clone() const
+{
+    return std::make_unique<PhotonJetRun1>(*this);
+}
+
+
 unsigned PhotonJetRun1::GetDim() const
 {
     return bins.size();
@@ -1,19 +1,37 @@
 #include <Rebin.hpp>
 
+#include <ScratchArena.hpp>
+
 #include <sstream>
 #include <stdexcept>
 
 
 BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &target)
+{
+    ScratchArena arena;
+    std::vector<std::array<FracBin, 2>> ranges(target.size() + 1);
+    mapBinning(source.data(), source.size(), target.data(), target.size(), ranges.data(), arena);
+    
+    BinMap binMap;
+    
+    for (unsigned targetBin = 0; targetBin < ranges.size(); ++targetBin)
+        binMap[targetBin] = ranges[targetBin];
+    
+    return binMap;
+}
+
+
+void mapBinning(double const *source, unsigned numSource, double const *target,
+  unsigned numTarget, std::array<FracBin, 2> *ranges, ScratchArena &arena)
 {
     // Verify that the full range of the target binning is containted within the range of the
     //source binning
-    if (target[0] < source[0] or target[target.size() - 1] > source[source.size() - 1])
+    if (target[0] < source[0] or target[numTarget - 1] > source[numSource - 1])
     {
         std::ostringstream message;
         message << "mapBinning: Range of target binning (" << target[0] << ", " <<
-          target[target.size() - 1] << ") is not included in the range of source binning (" <<
-          source[0] << ", " << source[source.size() - 1] << ").";
+          target[numTarget - 1] << ") is not included in the range of source binning (" <<
+          source[0] << ", " << source[numSource - 1] << ").";
         throw std::logic_error(message.str());
     }
     
@@ -22,14 +40,15 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
     //binning is represented by the index of the  bin of the source binning that contain this edge
     //and its position within that bin, which is expressed in terms of the bin width. Bins are
     //numbered by the indices of their lower boundaries. The underflow bin has index -1.
-    std::vector<FracBin> matchedEdges;
-    matchedEdges.reserve(target.size());
+    FracBin *matchedEdges = arena.Allocate<FracBin>(numTarget);
     int curSrcBin = -1;
     
-    for (auto const &x: target)
+    for (unsigned i = 0; i < numTarget; ++i)
     {
+        double const x = target[i];
+        
         // Scroll to the bin of the source binning that contains value x
-        while (curSrcBin < int(source.size()) - 1 and source[curSrcBin + 1] < x)
+        while (curSrcBin < int(numSource) - 1 and source[curSrcBin + 1] < x)
             ++curSrcBin;
         
         // Find the relative position inside the source bin. The two  special cases can only occur
@@ -39,7 +58,7 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
         
         if (curSrcBin == -1)
             relPos = 1.;
-        else if (curSrcBin == int(source.size()) - 1)
+        else if (curSrcBin == int(numSource) - 1)
             relPos = 0.;
         else
         {
@@ -48,22 +67,22 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
             relPos = (x - srcBinStart) / srcBinWidth;
         }
         
-        matchedEdges.emplace_back(FracBin{unsigned(curSrcBin), relPos});
+        matchedEdges[i] = FracBin{unsigned(curSrcBin), relPos};
     }
     
     
     // Turn the collection of matched edges into a collection of ranges of bins of the source
     //binning. Such a range is built for each target bin.
-    std::vector<FracBin> boundaries;
-    boundaries.reserve(2 * target.size() + 2);
+    FracBin *boundaries = arena.Allocate<FracBin>(2 * numTarget + 2);
+    unsigned numBoundaries = 0;
     unsigned srcBin;
     double fraction;
     
     // The underflow bin for the source binning is always included in the underflow of the target
-    boundaries.emplace_back(FracBin{unsigned(-1), 1.});
+    boundaries[numBoundaries++] = FracBin{unsigned(-1), 1.};
     
     
-    for (unsigned i = 0; i < matchedEdges.size(); ++i)
+    for (unsigned i = 0; i < numTarget; ++i)
     {
         srcBin = matchedEdges[i].index;
         double relPos = matchedEdges[i].frac;
@@ -87,7 +106,7 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
         
         fraction = relPos;
         
-        if (srcBin == boundaries[boundaries.size() - 1].index)
+        if (srcBin == boundaries[numBoundaries - 1].index)
         {
             // If this closing boundary corresponds to the same source bin as the previous
             //(opening) boundary, set its bin fraction to zero in order to simplify iterating over
@@ -95,7 +114,7 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
             fraction = 0.;
         }
         
-        boundaries.emplace_back(FracBin{srcBin, fraction});
+        boundaries[numBoundaries++] = FracBin{srcBin, fraction};
         
         
         // Now construct an opening boundary. If the relative position is 1., interpret it as a
@@ -107,7 +126,7 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
             relPos = 0.;
         }
         
-        if (i < matchedEdges.size() - 1 and matchedEdges[i + 1].index == srcBin)
+        if (i < numTarget - 1 and matchedEdges[i + 1].index == srcBin)
         {
             // There is more than one target bin edge that is included in the current source bin
             fraction = matchedEdges[i + 1].frac - relPos;
@@ -115,33 +134,26 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
         else
             fraction = 1. - relPos;
         
-        boundaries.emplace_back(FracBin{srcBin, fraction});
+        boundaries[numBoundaries++] = FracBin{srcBin, fraction};
     }
     
     
     // The last closing boundary is the overflow bin of the source binning. As done for other
     //closing boundaries, set the inclusion fraction to zero when it corresponds to the same source
     //bin as the last opening boundary.
-    srcBin = source.size() - 1;
-    fraction = (srcBin == boundaries[boundaries.size() - 1].index) ? 0. : 1.;
-    boundaries.emplace_back(FracBin{srcBin, fraction});
-    
+    srcBin = numSource - 1;
+    fraction = (srcBin == boundaries[numBoundaries - 1].index) ? 0. : 1.;
+    boundaries[numBoundaries++] = FracBin{srcBin, fraction};
     
-    // Convert the collection of constructed boundaries into a bin map. Switch to the bin numbering
-    //convention of ROOT, where the underflow bin gets an index of zero.
-    BinMap binMap;
     
-    for (unsigned targetBin = 0; targetBin < target.size() + 1; ++targetBin)
+    // Convert the collection of constructed boundaries into ranges of source bins. Switch to the
+    //bin numbering convention of ROOT, where the underflow bin gets an index of zero.
+    for (unsigned targetBin = 0; targetBin < numTarget + 1; ++targetBin)
     {
         auto const &start = boundaries[targetBin * 2];
         auto const &end = boundaries[targetBin * 2 + 1];
         
-        std::array<FracBin, 2> range;
-        range[0] = {start.index + 1, start.frac};
-        range[1] = {end.index + 1, end.frac};
-        
-        binMap[targetBin] = range;
+        ranges[targetBin][0] = {start.index + 1, start.frac};
+        ranges[targetBin][1] = {end.index + 1, end.frac};
     }
-    
-    return binMap;
 }
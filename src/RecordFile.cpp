@@ -0,0 +1,544 @@
+#include <RecordFile.hpp>
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace
+{
+
+/// Magic strings that open the data file and the index
+char const dataMagic[] = "JECFREC1";
+char const indexMagic[] = "JECFIDX1";
+
+/// Sizes of headers of the data file and the index, in bytes
+std::size_t const headerSize = 24, indexHeaderSize = 16;
+
+
+/// Appends the binary representation of the given value to the buffer
+template<typename T>
+void AppendBytes(std::string &buffer, T value)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    buffer.append(bytes, sizeof(T));
+}
+
+
+/// Decodes a value from its binary representation
+template<typename T>
+T FromBytes(char const *bytes)
+{
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+
+/// Computes CRC-32 checksum as in zlib
+std::uint32_t Crc32(char const *data, std::size_t size)
+{
+    static auto const table = []()
+    {
+        std::array<std::uint32_t, 256> table;
+
+        for (std::uint32_t n = 0; n < 256; ++n)
+        {
+            std::uint32_t c = n;
+
+            for (unsigned k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+
+            table[n] = c;
+        }
+
+        return table;
+    }();
+
+    std::uint32_t crc = 0xFFFFFFFFu;
+
+    for (std::size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+
+    return crc ^ 0xFFFFFFFFu;
+}
+
+
+/**
+ * \class Sha1
+ * \brief Computes SHA-1 digest of a stream of bytes
+ *
+ * Only used to reproduce signatures computed in Python, not for any security purpose.
+ */
+class Sha1
+{
+public:
+    Sha1();
+
+public:
+    /// Returns the digest of all data given so far
+    std::array<unsigned char, 20> Digest();
+
+    /// Adds data to the digest
+    void Update(char const *data, std::size_t size);
+
+private:
+    /// Processes a full block from the buffer
+    void ProcessBlock();
+
+    /// Rotates the given word to the left
+    static std::uint32_t RotateLeft(std::uint32_t value, unsigned shift);
+
+private:
+    std::uint32_t state[5];
+    unsigned char block[64];
+    std::size_t blockSize;
+    std::uint64_t totalSize;
+};
+
+
+Sha1::Sha1():
+    state{0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u, 0xC3D2E1F0u},
+    blockSize(0), totalSize(0)
+{}
+
+
+std::array<unsigned char, 20> Sha1::Digest()
+{
+    std::uint64_t const numBits = totalSize * 8;
+    char const padStart = char(0x80), zero = 0;
+    Update(&padStart, 1);
+
+    while (blockSize != 56)
+        Update(&zero, 1);
+
+    for (int i = 7; i >= 0; --i)
+    {
+        char const byte = char((numBits >> (8 * i)) & 0xFF);
+        Update(&byte, 1);
+    }
+
+    std::array<unsigned char, 20> digest;
+
+    for (unsigned i = 0; i < 20; ++i)
+        digest[i] = (state[i / 4] >> (24 - 8 * (i % 4))) & 0xFF;
+
+    return digest;
+}
+
+
+void Sha1::Update(char const *data, std::size_t size)
+{
+    totalSize += size;
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        block[blockSize++] = static_cast<unsigned char>(data[i]);
+
+        if (blockSize == 64)
+        {
+            ProcessBlock();
+            blockSize = 0;
+        }
+    }
+}
+
+
+void Sha1::ProcessBlock()
+{
+    std::uint32_t w[80];
+
+    for (unsigned t = 0; t < 16; ++t)
+        w[t] = (std::uint32_t(block[4 * t]) << 24) | (std::uint32_t(block[4 * t + 1]) << 16) |
+          (std::uint32_t(block[4 * t + 2]) << 8) | std::uint32_t(block[4 * t + 3]);
+
+    for (unsigned t = 16; t < 80; ++t)
+        w[t] = RotateLeft(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1);
+
+    std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    for (unsigned t = 0; t < 80; ++t)
+    {
+        std::uint32_t f, k;
+
+        if (t < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999u;
+        }
+        else if (t < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1u;
+        }
+        else if (t < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDCu;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6u;
+        }
+
+        std::uint32_t const temp = RotateLeft(a, 5) + f + e + k + w[t];
+        e = d;
+        d = c;
+        c = RotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+
+std::uint32_t Sha1::RotateLeft(std::uint32_t value, unsigned shift)
+{
+    return (value << shift) | (value >> (32 - shift));
+}
+
+
+/// Writes all given bytes; returns false in case of an error
+bool WriteAll(int fd, char const *buffer, std::size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t const numWritten = ::write(fd, buffer, size);
+
+        if (numWritten < 0 and errno == EINTR)
+            continue;
+
+        if (numWritten <= 0)
+            return false;
+
+        buffer += numWritten;
+        size -= numWritten;
+    }
+
+    return true;
+}
+
+
+/// Constructs a message for a failed system call
+std::string SystemError(std::string const &where, std::string const &what)
+{
+    std::ostringstream message;
+    message << where << ": " << what << " failed: " << std::strerror(errno) << ".";
+    return message.str();
+}
+
+}  // anonymous namespace
+
+
+
+RecordFile::RecordFile(std::string const &path_, unsigned numValues_, std::uint64_t signature_,
+  unsigned syncEvery_, double syncInterval_, unsigned indexEvery_):
+    path(path_), indexPath(path_ + ".idx"),
+    numValues(numValues_), signature(signature_),
+    syncEvery(syncEvery_), syncInterval(syncInterval_), indexEvery(indexEvery_),
+    fd(-1), numUnsynced(0), numUnindexed(0), lastSync(std::chrono::steady_clock::now())
+{
+    struct stat fileStatus;
+
+    if (stat(path.c_str(), &fileStatus) == 0)
+    {
+        Recover();
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+
+        if (fd < 0)
+            throw std::runtime_error(SystemError("RecordFile::RecordFile",
+              "Opening file \"" + path + "\""));
+    }
+    else
+    {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0)
+            throw std::runtime_error(SystemError("RecordFile::RecordFile",
+              "Creating file \"" + path + "\""));
+
+        std::string header(dataMagic, 8);
+        AppendBytes<std::uint32_t>(header, numValues);
+        AppendBytes<std::uint32_t>(header, 0);
+        AppendBytes<std::uint64_t>(header, signature);
+
+        if (not WriteAll(fd, header.data(), header.size()))
+            throw std::runtime_error(SystemError("RecordFile::RecordFile",
+              "Writing header to file \"" + path + "\""));
+
+        WriteIndex();
+    }
+}
+
+
+RecordFile::~RecordFile() noexcept
+{
+    try
+    {
+        Close();
+    }
+    catch (...)
+    {}
+}
+
+
+void RecordFile::Append(std::uint64_t key, std::vector<double> const &values)
+{
+    if (fd < 0)
+    {
+        std::ostringstream message;
+        message << "RecordFile::Append: File \"" << path << "\" has already been closed.";
+        throw std::runtime_error(message.str());
+    }
+
+    if (values.size() != numValues)
+    {
+        std::ostringstream message;
+        message << "RecordFile::Append: Record contains " << values.size() << " values while " <<
+          numValues << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+
+    std::string record;
+    record.reserve(RecordSize());
+    AppendBytes(record, key);
+
+    for (double const value: values)
+        AppendBytes(record, value);
+
+    AppendBytes<std::uint32_t>(record, Crc32(record.data(), record.size()));
+    AppendBytes<std::uint32_t>(record, 0);
+
+    if (not WriteAll(fd, record.data(), record.size()))
+        throw std::runtime_error(SystemError("RecordFile::Append",
+          "Writing to file \"" + path + "\""));
+
+    keys.emplace_back(key);
+    ++numUnsynced;
+    ++numUnindexed;
+
+    if (numUnsynced >= syncEvery or std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - lastSync).count() >= syncInterval)
+        Sync();
+
+    if (numUnindexed >= indexEvery)
+        WriteIndex();
+}
+
+
+void RecordFile::Close()
+{
+    if (fd < 0)
+        return;
+
+    WriteIndex();
+    ::close(fd);
+    fd = -1;
+}
+
+
+std::uint64_t RecordFile::GridSignature(std::vector<std::vector<double>> const &grids,
+  std::string const &definition)
+{
+    Sha1 digest;
+
+    for (auto const &grid: grids)
+    {
+        std::string bytes;
+
+        for (double const value: grid)
+            AppendBytes(bytes, value);
+
+        digest.Update(bytes.data(), bytes.size());
+    }
+
+    if (not definition.empty())
+        digest.Update(definition.data(), definition.size());
+
+    auto const digestBytes = digest.Digest();
+    return FromBytes<std::uint64_t>(reinterpret_cast<char const *>(digestBytes.data()));
+}
+
+
+std::set<std::uint64_t> RecordFile::GetCompleted() const
+{
+    return std::set<std::uint64_t>(keys.begin(), keys.end());
+}
+
+
+unsigned long RecordFile::GetNumRecords() const
+{
+    return keys.size();
+}
+
+
+std::map<std::uint64_t, std::vector<double>> RecordFile::Read()
+{
+    if (fd >= 0)
+        Sync();
+
+    std::ifstream file(path, std::ios::binary);
+    file.seekg(headerSize);
+
+    std::size_t const recordSize = RecordSize();
+    std::vector<char> record(recordSize);
+    std::map<std::uint64_t, std::vector<double>> records;
+
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        if (not file.read(record.data(), recordSize))
+        {
+            std::ostringstream message;
+            message << "RecordFile::Read: Failed to read record " << i << " from file \"" <<
+              path << "\".";
+            throw std::runtime_error(message.str());
+        }
+
+        std::vector<double> values(numValues);
+
+        for (unsigned j = 0; j < numValues; ++j)
+            values[j] = FromBytes<double>(record.data() + 8 * (j + 1));
+
+        records[FromBytes<std::uint64_t>(record.data())] = std::move(values);
+    }
+
+    return records;
+}
+
+
+std::vector<std::uint64_t> RecordFile::ReadIndex(unsigned long numRecords) const
+{
+    std::ifstream file(indexPath, std::ios::binary);
+    char header[indexHeaderSize];
+
+    if (not file.read(header, indexHeaderSize) or std::memcmp(header, indexMagic, 8) != 0)
+        return {};
+
+    auto const numIndexed = FromBytes<std::uint64_t>(header + 8);
+
+    if (numIndexed > numRecords)
+        return {};
+
+    std::vector<std::uint64_t> indexedKeys(numIndexed);
+
+    if (not file.read(reinterpret_cast<char *>(indexedKeys.data()), 8 * numIndexed))
+        return {};
+
+    return indexedKeys;
+}
+
+
+void RecordFile::Recover()
+{
+    std::ifstream file(path, std::ios::binary);
+    char header[headerSize];
+
+    if (not file.read(header, headerSize) or std::memcmp(header, dataMagic, 8) != 0)
+    {
+        std::ostringstream message;
+        message << "RecordFile::RecordFile: File \"" << path << "\" is not a valid record file.";
+        throw std::runtime_error(message.str());
+    }
+
+    if (FromBytes<std::uint32_t>(header + 8) != numValues or
+      FromBytes<std::uint64_t>(header + 16) != signature)
+    {
+        std::ostringstream message;
+        message << "RecordFile::RecordFile: File \"" << path << "\" has been written for a " <<
+          "different computation. Remove it to start anew.";
+        throw std::runtime_error(message.str());
+    }
+
+    file.seekg(0, std::ios::end);
+    std::size_t const recordSize = RecordSize();
+    unsigned long const numRecords = (std::size_t(file.tellg()) - headerSize) / recordSize;
+    keys = ReadIndex(numRecords);
+    unsigned long const numIndexed = keys.size();
+
+    // Validate records that are not covered by the index
+    file.seekg(headerSize + numIndexed * recordSize);
+    std::vector<char> record(recordSize);
+    std::size_t const payloadSize = recordSize - 8;
+
+    for (unsigned long i = numIndexed; i < numRecords; ++i)
+    {
+        if (not file.read(record.data(), recordSize) or
+          Crc32(record.data(), payloadSize) !=
+          FromBytes<std::uint32_t>(record.data() + payloadSize))
+            break;
+
+        keys.emplace_back(FromBytes<std::uint64_t>(record.data()));
+    }
+
+    file.close();
+
+    // Drop everything after the last valid record
+    if (::truncate(path.c_str(), headerSize + keys.size() * recordSize) != 0)
+        throw std::runtime_error(SystemError("RecordFile::RecordFile",
+          "Truncating file \"" + path + "\""));
+
+    numUnindexed = keys.size() - numIndexed;
+}
+
+
+std::size_t RecordFile::RecordSize() const
+{
+    return 8 * (numValues + 2);
+}
+
+
+void RecordFile::Sync()
+{
+    if (::fsync(fd) != 0)
+        throw std::runtime_error(SystemError("RecordFile::Sync",
+          "Flushing file \"" + path + "\""));
+
+    numUnsynced = 0;
+    lastSync = std::chrono::steady_clock::now();
+}
+
+
+void RecordFile::WriteIndex()
+{
+    // The data file is flushed first, so that the index never refers to records that are not on
+    //disk
+    Sync();
+
+    std::string const tmpPath = indexPath + ".tmp";
+    int const indexFd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (indexFd < 0)
+        throw std::runtime_error(SystemError("RecordFile::WriteIndex",
+          "Creating file \"" + tmpPath + "\""));
+
+    std::string buffer(indexMagic, 8);
+    AppendBytes<std::uint64_t>(buffer, keys.size());
+
+    for (auto const &key: keys)
+        AppendBytes(buffer, key);
+
+    bool const success = WriteAll(indexFd, buffer.data(), buffer.size()) and
+      ::fsync(indexFd) == 0;
+    ::close(indexFd);
+
+    if (not success or std::rename(tmpPath.c_str(), indexPath.c_str()) != 0)
+        throw std::runtime_error(SystemError("RecordFile::WriteIndex",
+          "Writing file \"" + indexPath + "\""));
+
+    numUnindexed = 0;
+}
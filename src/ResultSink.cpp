@@ -0,0 +1,361 @@
+#include <ResultSink.hpp>
+
+#include <TObjString.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+
+namespace
+{
+
+/// Total size of headers of .npy files, including the magic string, in bytes
+std::size_t const npyHeaderSize = 128;
+
+
+/// Returns the character that denotes the native byte order in NumPy type descriptions
+char byteOrderChar()
+{
+    std::uint16_t const probe = 1;
+    unsigned char firstByte;
+    std::memcpy(&firstByte, &probe, 1);
+    return (firstByte == 1) ? '<' : '>';
+}
+
+}  // anonymous namespace
+
+
+
+FitRecord::FitRecord(unsigned numParams):
+    key(0), params(numParams, 0.), errors(numParams, 0.), covariance(numParams * numParams, 0.),
+    chi2(0.), ndf(0), status(0), time(0.)
+{}
+
+
+
+std::unique_ptr<ResultSink> ResultSink::Create(std::string const &path,
+  std::vector<std::string> const &paramNames)
+{
+    std::string const rootExtension(".root");
+
+    if (path.size() > rootExtension.size() and
+      path.compare(path.size() - rootExtension.size(), rootExtension.size(), rootExtension) == 0)
+        return std::make_unique<TreeResultSink>(path, paramNames);
+    else
+        return std::make_unique<NpyResultSink>(path, paramNames);
+}
+
+
+unsigned ResultSink::GetNumParams() const
+{
+    return paramNames.size();
+}
+
+
+unsigned long ResultSink::GetNumRecords() const
+{
+    return numRecords;
+}
+
+
+void ResultSink::Write(FitRecord const &record)
+{
+    if (closed)
+    {
+        std::ostringstream message;
+        message << "ResultSink::Write: The sink has already been closed.";
+        throw std::runtime_error(message.str());
+    }
+
+    unsigned const numParams = GetNumParams();
+
+    if (record.params.size() != numParams or record.errors.size() != numParams or
+      record.covariance.size() != numParams * numParams)
+    {
+        std::ostringstream message;
+        message << "ResultSink::Write: Record with " << record.params.size() <<
+          " parameters, " << record.errors.size() << " errors, and " <<
+          record.covariance.size() << " elements of the covariance matrix does not match the " <<
+          "schema with " << numParams << " parameters.";
+        throw std::runtime_error(message.str());
+    }
+
+    WriteImpl(record);
+    ++numRecords;
+}
+
+
+ResultSink::ResultSink(std::vector<std::string> const &paramNames_):
+    paramNames(paramNames_), numRecords(0), closed(false)
+{
+    if (paramNames.empty())
+    {
+        std::ostringstream message;
+        message << "ResultSink::ResultSink: No parameters given.";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+
+NpyResultSink::NpyResultSink(std::string const &directory,
+  std::vector<std::string> const &paramNames):
+    ResultSink(paramNames), columns(NumColumns)
+{
+    if (mkdir(directory.c_str(), 0755) != 0 and errno != EEXIST)
+    {
+        std::ostringstream message;
+        message << "NpyResultSink::NpyResultSink: Failed to create directory \"" << directory <<
+          "\": " << std::strerror(errno) << ".";
+        throw std::runtime_error(message.str());
+    }
+
+    std::string const order(1, byteOrderChar());
+    unsigned const n = GetNumParams();
+
+    struct ColumnSpec
+    {
+        char const *name;
+        std::string descr;
+        std::vector<unsigned> shape;
+    };
+
+    ColumnSpec const specs[NumColumns] = {
+        {"key", order + "u8", {}},
+        {"params", order + "f8", {n}},
+        {"errors", order + "f8", {n}},
+        {"covariance", order + "f8", {n, n}},
+        {"chi2", order + "f8", {}},
+        {"ndf", order + "u4", {}},
+        {"status", order + "i4", {}},
+        {"time", order + "f8", {}}
+    };
+
+    for (unsigned i = 0; i < NumColumns; ++i)
+    {
+        auto &column = columns[i];
+        column.path = directory + "/" + specs[i].name + ".npy";
+        column.descr = specs[i].descr;
+        column.shape = specs[i].shape;
+        column.file.open(column.path, std::ios::binary | std::ios::trunc);
+
+        if (not column.file)
+        {
+            std::ostringstream message;
+            message << "NpyResultSink::NpyResultSink: Failed to open file \"" << column.path <<
+              "\" for writing.";
+            throw std::runtime_error(message.str());
+        }
+
+        WriteHeader(column);
+    }
+
+    std::ofstream namesFile(directory + "/param_names.txt");
+
+    for (auto const &name: paramNames)
+        namesFile << name << '\n';
+
+    if (not namesFile)
+    {
+        std::ostringstream message;
+        message << "NpyResultSink::NpyResultSink: Failed to write names of parameters in " <<
+          "directory \"" << directory << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+NpyResultSink::~NpyResultSink() noexcept
+{
+    try
+    {
+        Close();
+    }
+    catch (...)
+    {}
+}
+
+
+void NpyResultSink::Close()
+{
+    if (closed)
+        return;
+
+    Flush();
+
+    for (auto &column: columns)
+        column.file.close();
+
+    closed = true;
+}
+
+
+void NpyResultSink::Flush()
+{
+    if (closed)
+        return;
+
+    for (auto &column: columns)
+    {
+        auto const end = column.file.tellp();
+        WriteHeader(column);
+        column.file.seekp(end);
+        column.file.flush();
+
+        if (not column.file)
+        {
+            std::ostringstream message;
+            message << "NpyResultSink::Flush: Failed to write file \"" << column.path << "\".";
+            throw std::runtime_error(message.str());
+        }
+    }
+}
+
+
+void NpyResultSink::WriteHeader(Column &column)
+{
+    // The header is a Python literal for a dictionary, padded with spaces and terminated with a
+    //newline, as defined in version 1.0 of the format
+    std::ostringstream dict;
+    dict << "{'descr': '" << column.descr << "', 'fortran_order': False, 'shape': (" <<
+      numRecords << ",";
+
+    for (unsigned i = 0; i < column.shape.size(); ++i)
+        dict << ((i == 0) ? " " : ", ") << column.shape[i];
+
+    dict << "), }";
+
+    std::string header(dict.str());
+    std::size_t const headerLength = npyHeaderSize - 10;
+
+    if (header.size() + 1 > headerLength)
+    {
+        std::ostringstream message;
+        message << "NpyResultSink::WriteHeader: Header for file \"" << column.path <<
+          "\" does not fit into the reserved space.";
+        throw std::runtime_error(message.str());
+    }
+
+    header.resize(headerLength - 1, ' ');
+    header += '\n';
+
+    char const preamble[] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0,
+      char(headerLength & 0xFF), char(headerLength >> 8)};
+
+    column.file.seekp(0);
+    column.file.write(preamble, sizeof(preamble));
+    column.file.write(header.data(), header.size());
+}
+
+
+void NpyResultSink::WriteImpl(FitRecord const &record)
+{
+    auto writeValues = [this](ColumnIndex index, void const *data, std::size_t size)
+    {
+        columns[index].file.write(reinterpret_cast<char const *>(data), size);
+    };
+
+    std::uint32_t const ndf = record.ndf;
+    std::int32_t const status = record.status;
+
+    writeValues(Key, &record.key, sizeof(record.key));
+    writeValues(Params, record.params.data(), record.params.size() * sizeof(double));
+    writeValues(Errors, record.errors.data(), record.errors.size() * sizeof(double));
+    writeValues(Covariance, record.covariance.data(),
+      record.covariance.size() * sizeof(double));
+    writeValues(Chi2, &record.chi2, sizeof(record.chi2));
+    writeValues(NDF, &ndf, sizeof(ndf));
+    writeValues(Status, &status, sizeof(status));
+    writeValues(Time, &record.time, sizeof(record.time));
+}
+
+
+
+TreeResultSink::TreeResultSink(std::string const &fileName,
+  std::vector<std::string> const &paramNames):
+    ResultSink(paramNames),
+    file(TFile::Open(fileName.c_str(), "recreate")), tree(nullptr),
+    buffer(GetNumParams()), keyBuffer(0)
+{
+    if (not file or file->IsZombie())
+    {
+        std::ostringstream message;
+        message << "TreeResultSink::TreeResultSink: Failed to create file \"" << fileName <<
+          "\".";
+        throw std::runtime_error(message.str());
+    }
+
+    // The tree is owned by the file
+    tree = new TTree("Results", "Results of fits");
+    tree->SetDirectory(file.get());
+
+    std::string const n(std::to_string(GetNumParams()));
+    std::string const nSq(std::to_string(GetNumParams() * GetNumParams()));
+
+    tree->Branch("key", &keyBuffer, "key/l");
+    tree->Branch("params", buffer.params.data(), ("params[" + n + "]/D").c_str());
+    tree->Branch("errors", buffer.errors.data(), ("errors[" + n + "]/D").c_str());
+    tree->Branch("covariance", buffer.covariance.data(), ("covariance[" + nSq + "]/D").c_str());
+    tree->Branch("chi2", &buffer.chi2, "chi2/D");
+    tree->Branch("ndf", &buffer.ndf, "ndf/i");
+    tree->Branch("status", &buffer.status, "status/I");
+    tree->Branch("time", &buffer.time, "time/D");
+
+    for (auto const &name: paramNames)
+        tree->GetUserInfo()->Add(new TObjString(name.c_str()));
+}
+
+
+TreeResultSink::~TreeResultSink() noexcept
+{
+    try
+    {
+        Close();
+    }
+    catch (...)
+    {}
+}
+
+
+void TreeResultSink::Close()
+{
+    if (closed)
+        return;
+
+    file->cd();
+    tree->Write("", TObject::kOverwrite);
+    file->Close();
+    closed = true;
+}
+
+
+void TreeResultSink::Flush()
+{
+    if (closed)
+        return;
+
+    tree->AutoSave("SaveSelf");
+}
+
+
+void TreeResultSink::WriteImpl(FitRecord const &record)
+{
+    // Copy the values instead of assigning the vectors so that addresses of the buffers connected
+    //to the branches do not change
+    keyBuffer = record.key;
+    std::copy(record.params.begin(), record.params.end(), buffer.params.begin());
+    std::copy(record.errors.begin(), record.errors.end(), buffer.errors.begin());
+    std::copy(record.covariance.begin(), record.covariance.end(), buffer.covariance.begin());
+    buffer.chi2 = record.chi2;
+    buffer.ndf = record.ndf;
+    buffer.status = record.status;
+    buffer.time = record.time;
+
+    tree->Fill();
+}
@@ -0,0 +1,85 @@
+#include <ScratchArena.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+
+ScratchArena::ScratchArena(std::size_t initialCapacity):
+    used(0)
+{
+    if (initialCapacity > 0)
+        AddBlock(initialCapacity);
+}
+
+
+ScratchArena::ScratchArena(ScratchArena const &src):
+    ScratchArena(src.GetCapacity())
+{}
+
+
+ScratchArena &ScratchArena::operator=(ScratchArena const &)
+{
+    Reset();
+    return *this;
+}
+
+
+std::size_t ScratchArena::GetCapacity() const
+{
+    std::size_t capacity = 0;
+
+    for (auto const &block: blocks)
+        capacity += block.size;
+
+    return capacity;
+}
+
+
+void ScratchArena::Reset()
+{
+    // Merge blocks. The alignment padding of the first buffer in each block has not been
+    //accounted for, so reserve room for it.
+    if (blocks.size() > 1)
+    {
+        std::size_t const capacity = GetCapacity() + blocks.size() * alignof(std::max_align_t);
+        blocks.clear();
+        AddBlock(capacity);
+    }
+
+    used = 0;
+}
+
+
+void *ScratchArena::AllocateBytes(std::size_t size, std::size_t alignment)
+{
+    if (not blocks.empty())
+    {
+        auto const &block = blocks.back();
+        auto const address = reinterpret_cast<std::uintptr_t>(block.data.get()) + used;
+        std::size_t const padding = (alignment - address % alignment) % alignment;
+
+        if (used + padding + size <= block.size)
+        {
+            used += padding + size;
+            return block.data.get() + used - size;
+        }
+    }
+
+    // Blocks are aligned for any type
+    AddBlock(size);
+    used = size;
+    return blocks.back().data.get();
+}
+
+
+void ScratchArena::AddBlock(std::size_t minSize)
+{
+    // Grow geometrically to limit the number of blocks allocated in the first evaluation
+    std::size_t size = std::max<std::size_t>(minSize, 4096);
+
+    if (not blocks.empty())
+        size = std::max(size, 2 * blocks.back().size);
+
+    blocks.emplace_back(Block{std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+    used = 0;
+}
@@ -0,0 +1,98 @@
+#include <SplineTable.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+
+SplineTable::SplineTable(std::vector<std::shared_ptr<TSpline3>> const &splines):
+    numSplines(splines.size())
+{
+    if (numSplines == 0)
+        throw std::runtime_error("SplineTable::SplineTable: No splines given.");
+
+    // Build the union of knots of all splines
+    for (auto const &spline: splines)
+    {
+        if (spline->GetNp() < 2)
+        {
+            std::ostringstream message;
+            message << "SplineTable::SplineTable: Spline \"" << spline->GetName() <<
+              "\" contains " << spline->GetNp() << " knots while at least 2 are required.";
+            throw std::runtime_error(message.str());
+        }
+
+        for (int i = 0; i < spline->GetNp(); ++i)
+        {
+            double x, y;
+            spline->GetKnot(i, x, y);
+            knots.emplace_back(x);
+        }
+    }
+
+    std::sort(knots.begin(), knots.end());
+    knots.erase(std::unique(knots.begin(), knots.end()), knots.end());
+
+    unsigned const numIntervals = knots.size() - 1;
+
+
+    // Re-expand polynomials of the original splines about the lower boundaries of the intervals
+    coeffs.resize(numIntervals * 4 * numSplines);
+    std::vector<double> splineKnots;
+
+    for (unsigned s = 0; s < numSplines; ++s)
+    {
+        auto &spline = *splines[s];
+        int const numKnots = spline.GetNp();
+        splineKnots.resize(numKnots);
+
+        for (int i = 0; i < numKnots; ++i)
+        {
+            double y;
+            spline.GetKnot(i, splineKnots[i], y);
+        }
+
+        for (unsigned interval = 0; interval < numIntervals; ++interval)
+        {
+            // Find the segment of the original spline that contains this interval. Intervals
+            // outside of the range of the original knots are assigned to the first or last
+            // segments, which reproduces the extrapolation in TSpline3::Eval.
+            double const middle = (knots[interval] + knots[interval + 1]) / 2;
+            int segment = std::upper_bound(splineKnots.begin(), splineKnots.end(), middle) -
+              splineKnots.begin() - 1;
+            segment = std::min(std::max(segment, 0), numKnots - 2);
+
+            double x0, y, b, c, d;
+            spline.GetCoeff(segment, x0, y, b, c, d);
+            double const h = knots[interval] - x0;
+
+            double *block = coeffs.data() + interval * 4 * numSplines;
+            block[s] = y + h * (b + h * (c + h * d));
+            block[numSplines + s] = b + h * (2 * c + 3 * h * d);
+            block[2 * numSplines + s] = c + 3 * h * d;
+            block[3 * numSplines + s] = d;
+        }
+    }
+}
+
+
+void SplineTable::Eval(double x, double *values) const
+{
+    // Find the interval. Only internal knots are checked so that points outside of the range of
+    // the knots are assigned to the first or last interval.
+    unsigned const interval = std::upper_bound(knots.begin() + 1, knots.end() - 1, x) -
+      knots.begin() - 1;
+
+    double const u = x - knots[interval];
+    double const *a0 = coeffs.data() + interval * 4 * numSplines;
+    double const *a1 = a0 + numSplines, *a2 = a1 + numSplines, *a3 = a2 + numSplines;
+
+    for (unsigned s = 0; s < numSplines; ++s)
+        values[s] = a0[s] + u * (a1[s] + u * (a2[s] + u * a3[s]));
+}
+
+
+unsigned SplineTable::GetNumSplines() const
+{
+    return numSplines;
+}
@@ -0,0 +1,126 @@
+#include <ThreadPool.hpp>
+#include <Tracer.hpp>
+
+#include <algorithm>
+#include <string>
+
+
+ThreadPool::ThreadPool(unsigned numWorkers):
+    currentTask(nullptr), numTasks(0), nextTask(0), generation(0), numBusy(0), stop(false)
+{
+    if (numWorkers == 0)
+        numWorkers = std::max(std::thread::hardware_concurrency(), 1u);
+
+    threads.reserve(numWorkers - 1);
+
+    for (unsigned worker = 1; worker < numWorkers; ++worker)
+        threads.emplace_back(&ThreadPool::WorkerLoop, this, worker);
+}
+
+
+ThreadPool::~ThreadPool() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+
+    startCondition.notify_all();
+
+    for (auto &thread: threads)
+        thread.join();
+}
+
+
+unsigned ThreadPool::GetNumWorkers() const
+{
+    return threads.size() + 1;
+}
+
+
+void ThreadPool::Run(unsigned numTasks_, Task const &task)
+{
+    if (numTasks_ == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentTask = &task;
+        numTasks = numTasks_;
+        nextTask = 0;
+        error = nullptr;
+        numBusy = threads.size();
+        ++generation;
+    }
+
+    startCondition.notify_all();
+    ExecuteTasks(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this]{return (numBusy == 0);});
+    currentTask = nullptr;
+
+    if (error)
+    {
+        std::exception_ptr const curError = error;
+        error = nullptr;
+        std::rethrow_exception(curError);
+    }
+}
+
+
+void ThreadPool::ExecuteTasks(unsigned worker)
+{
+    while (true)
+    {
+        unsigned const task = nextTask.fetch_add(1);
+
+        if (task >= numTasks)
+            break;
+
+        try
+        {
+            (*currentTask)(task, worker);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (not error)
+                error = std::current_exception();
+
+            // Skip remaining tasks
+            nextTask = numTasks;
+        }
+    }
+}
+
+
+void ThreadPool::WorkerLoop(unsigned worker)
+{
+    unsigned long seenGeneration = 0;
+    Tracer::SetThreadName("Worker " + std::to_string(worker));
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startCondition.wait(lock,
+              [this, seenGeneration]{return (stop or generation != seenGeneration);});
+
+            if (stop)
+                return;
+
+            seenGeneration = generation;
+        }
+
+        ExecuteTasks(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --numBusy;
+        }
+
+        doneCondition.notify_one();
+    }
+}
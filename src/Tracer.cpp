@@ -0,0 +1,261 @@
+#include <Tracer.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+
+namespace
+{
+
+/// Span recorded in the trace
+struct Event
+{
+    std::string name, category;
+
+    /// Index of the thread in which the span was recorded
+    unsigned thread;
+
+    /// Start time and duration of the span, in microseconds
+    double start, duration;
+};
+
+
+/// State of the tracer shared among all threads
+struct TraceState
+{
+    /// Mutex that protects all other members
+    std::mutex mutex;
+
+    /// Name of the output file
+    std::string fileName;
+
+    /// Beginning of the trace
+    Tracer::Clock::time_point origin;
+
+    /// Spans recorded so far
+    std::vector<Event> events;
+
+    /// Names of tracks for threads, which persist across traces
+    std::map<unsigned, std::string> threadNames;
+
+    /// Period for sampling of evaluations of the loss function and counter of evaluations
+    std::atomic<unsigned long> evalSamplingPeriod{1};
+    std::atomic<unsigned long> evalCounter{0};
+};
+
+
+/// Returns the state of the tracer, which is constructed on the first call
+TraceState &GetState()
+{
+    static TraceState state;
+    return state;
+}
+
+
+/// Returns a small index that identifies the calling thread
+unsigned GetThreadIndex()
+{
+    static std::atomic<unsigned> nextIndex{0};
+    thread_local unsigned const index = nextIndex++;
+    return index;
+}
+
+
+/// Writes a string as a JSON literal
+void WriteJSONString(std::ostream &out, std::string const &text)
+{
+    out << '"';
+
+    for (char const c: text)
+    {
+        if (c == '"' or c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        else
+            out << c;
+    }
+
+    out << '"';
+}
+
+}  // anonymous namespace
+
+
+
+std::atomic<bool> Tracer::enabled(false);
+
+
+void Tracer::Start(std::string const &fileName, unsigned evalSamplingPeriod)
+{
+    auto &state = GetState();
+
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        if (enabled)
+        {
+            std::ostringstream message;
+            message << "Tracer::Start: Tracing into file \"" << state.fileName <<
+              "\" is already active.";
+            throw std::runtime_error(message.str());
+        }
+
+        state.fileName = fileName;
+        state.origin = Clock::now();
+        state.events.clear();
+        state.evalSamplingPeriod = std::max(evalSamplingPeriod, 1u);
+        state.evalCounter = 0;
+        enabled = true;
+    }
+
+    SetThreadName("Main");
+}
+
+
+void Tracer::Stop()
+{
+    auto &state = GetState();
+    std::vector<Event> events;
+    std::map<unsigned, std::string> threadNames;
+    std::string fileName;
+
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        if (not enabled)
+            return;
+
+        enabled = false;
+        events.swap(state.events);
+        threadNames = state.threadNames;
+        fileName = state.fileName;
+    }
+
+    std::ofstream out(fileName);
+
+    if (not out)
+    {
+        std::ostringstream message;
+        message << "Tracer::Stop: Failed to open file \"" << fileName << "\" for writing.";
+        throw std::runtime_error(message.str());
+    }
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, "
+      "\"args\": {\"name\": \"jecfit\"}}";
+
+    // Label tracks of all threads that appear in the trace
+    std::map<unsigned, bool> usedThreads;
+
+    for (auto const &event: events)
+        usedThreads[event.thread] = true;
+
+    for (auto const &entry: usedThreads)
+    {
+        unsigned const thread = entry.first;
+        auto const nameIt = threadNames.find(thread);
+        out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread <<
+          ", \"args\": {\"name\": ";
+        WriteJSONString(out, (nameIt != threadNames.end()) ?
+          nameIt->second : "Thread " + std::to_string(thread));
+        out << "}}";
+    }
+
+    out << std::fixed << std::setprecision(3);
+
+    for (auto const &event: events)
+    {
+        out << ",\n{\"name\": ";
+        WriteJSONString(out, event.name);
+        out << ", \"cat\": ";
+        WriteJSONString(out, event.category);
+        out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread << ", \"ts\": " <<
+          event.start << ", \"dur\": " << event.duration << "}";
+    }
+
+    out << "\n]}\n";
+}
+
+
+bool Tracer::SampleEval()
+{
+    if (not IsEnabled())
+        return false;
+
+    auto &state = GetState();
+    return (state.evalCounter.fetch_add(1, std::memory_order_relaxed) %
+      state.evalSamplingPeriod == 0);
+}
+
+
+void Tracer::SetThreadName(std::string const &name)
+{
+    auto &state = GetState();
+    unsigned const thread = GetThreadIndex();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.threadNames[thread] = name;
+}
+
+
+void Tracer::AddSpan(std::string const &name, std::string const &category,
+  Clock::time_point start, Clock::time_point end)
+{
+    using Microseconds = std::chrono::duration<double, std::micro>;
+
+    auto &state = GetState();
+    unsigned const thread = GetThreadIndex();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    // Tracing might have been stopped while the span was open
+    if (not enabled)
+        return;
+
+    state.events.emplace_back(Event{name, category, thread,
+      Microseconds(start - state.origin).count(), Microseconds(end - start).count()});
+}
+
+
+
+TraceSpan::TraceSpan(char const *name_, char const *category_, bool active_):
+    active(active_ and Tracer::IsEnabled())
+{
+    if (active)
+    {
+        name = name_;
+        category = category_;
+        start = Tracer::Clock::now();
+    }
+}
+
+
+TraceSpan::TraceSpan(std::string const &name_, std::string const &category_):
+    TraceSpan(name_.c_str(), category_.c_str())
+{}
+
+
+TraceSpan::~TraceSpan() noexcept
+{
+    try
+    {
+        End();
+    }
+    catch (...)
+    {}
+}
+
+
+void TraceSpan::End()
+{
+    if (not active)
+        return;
+
+    active = false;
+    Tracer::AddSpan(name, category, start, Tracer::Clock::now());
+}
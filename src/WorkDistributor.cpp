@@ -0,0 +1,243 @@
+#include <WorkDistributor.hpp>
+
+#ifdef JECFIT_MPI
+#include <mpi.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+
+#ifdef JECFIT_MPI
+namespace {
+
+/// Tags for messages exchanged between the coordinator and workers
+enum Tag: int
+{
+    /// Worker is ready for the first unit; the message contains no data
+    READY = 1,
+
+    /// Worker sends results for a unit, which is stored as the first value of the message
+    RESULT = 2,
+
+    /// Coordinator sends the index of the next unit
+    WORK = 3,
+
+    /// Coordinator tells the worker that no units are left
+    STOP = 4
+};
+
+}  // anonymous namespace
+#endif
+
+
+WorkDistributor::WorkDistributor(int *argc, char ***argv):
+    rank(0), numRanks(1), ownsMPI(false)
+{
+#ifdef JECFIT_MPI
+    int initialized;
+    MPI_Initialized(&initialized);
+
+    if (not initialized)
+    {
+        MPI_Init(argc, argv);
+        ownsMPI = true;
+    }
+
+    int rank_, numRanks_;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank_);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks_);
+    rank = rank_;
+    numRanks = numRanks_;
+#else
+    // Silence warnings about unused parameters
+    (void) argc;
+    (void) argv;
+#endif
+}
+
+
+WorkDistributor::~WorkDistributor() noexcept
+{
+#ifdef JECFIT_MPI
+    if (ownsMPI)
+        MPI_Finalize();
+#endif
+}
+
+
+unsigned WorkDistributor::GetNumRanks() const
+{
+    return numRanks;
+}
+
+
+unsigned WorkDistributor::GetRank() const
+{
+    return rank;
+}
+
+
+bool WorkDistributor::IsRoot() const
+{
+    return (rank == 0);
+}
+
+
+std::map<unsigned long, std::vector<double>> WorkDistributor::Run(
+  std::vector<unsigned long> const &units, unsigned numValues, Task const &task,
+  ResultCallback const &callback)
+{
+    if (numRanks == 1)
+        return RunSerial(units, numValues, task, callback);
+
+#ifdef JECFIT_MPI
+    try
+    {
+        if (IsRoot())
+            return RunCoordinator(units, numValues, callback);
+        else
+        {
+            RunWorker(numValues, task);
+            return {};
+        }
+    }
+    catch (std::exception const &e)
+    {
+        Abort(e.what());
+    }
+    catch (...)
+    {
+        Abort("Unknown exception.");
+    }
+#else
+    // Without MPI there is always a single rank
+    return {};
+#endif
+}
+
+
+std::map<unsigned long, std::vector<double>> WorkDistributor::RunSerial(
+  std::vector<unsigned long> const &units, unsigned numValues, Task const &task,
+  ResultCallback const &callback)
+{
+    std::map<unsigned long, std::vector<double>> results;
+
+    for (auto const &unit: units)
+    {
+        auto const unitResults = task(unit);
+        CheckNumValues(unit, unitResults, numValues);
+
+        if (callback)
+            callback(unit, unitResults);
+
+        results[unit] = unitResults;
+    }
+
+    return results;
+}
+
+
+#ifdef JECFIT_MPI
+std::map<unsigned long, std::vector<double>> WorkDistributor::RunCoordinator(
+  std::vector<unsigned long> const &units, unsigned numValues, ResultCallback const &callback)
+{
+    std::map<unsigned long, std::vector<double>> results;
+    std::vector<double> buffer(numValues + 1);
+    unsigned numActiveWorkers = numRanks - 1;
+    auto nextUnit = units.begin();
+
+    while (numActiveWorkers > 0)
+    {
+        MPI_Status status;
+        MPI_Recv(buffer.data(), buffer.size(), MPI_DOUBLE, MPI_ANY_SOURCE, MPI_ANY_TAG,
+          MPI_COMM_WORLD, &status);
+
+        if (status.MPI_TAG == RESULT)
+        {
+            unsigned long const unit = buffer[0];
+            std::vector<double> unitResults(buffer.begin() + 1, buffer.end());
+
+            if (callback)
+                callback(unit, unitResults);
+
+            results[unit] = std::move(unitResults);
+        }
+
+        if (nextUnit != units.end())
+        {
+            unsigned long const unit = *nextUnit;
+            MPI_Send(&unit, 1, MPI_UNSIGNED_LONG, status.MPI_SOURCE, WORK, MPI_COMM_WORLD);
+            ++nextUnit;
+        }
+        else
+        {
+            MPI_Send(nullptr, 0, MPI_UNSIGNED_LONG, status.MPI_SOURCE, STOP, MPI_COMM_WORLD);
+            --numActiveWorkers;
+        }
+    }
+
+    return results;
+}
+
+
+void WorkDistributor::RunWorker(unsigned numValues, Task const &task)
+{
+    MPI_Send(nullptr, 0, MPI_DOUBLE, 0, READY, MPI_COMM_WORLD);
+    std::vector<double> buffer(numValues + 1);
+
+    while (true)
+    {
+        unsigned long unit;
+        MPI_Status status;
+        MPI_Recv(&unit, 1, MPI_UNSIGNED_LONG, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+
+        if (status.MPI_TAG == STOP)
+            break;
+
+        try
+        {
+            auto const unitResults = task(unit);
+            CheckNumValues(unit, unitResults, numValues);
+
+            // Indices of units are stored as doubles, which is exact up to 2^53
+            buffer[0] = unit;
+            std::copy(unitResults.begin(), unitResults.end(), buffer.begin() + 1);
+        }
+        catch (std::exception const &e)
+        {
+            std::ostringstream message;
+            message << "Failed to process unit " << unit << ": " << e.what();
+            Abort(message.str());
+        }
+
+        MPI_Send(buffer.data(), buffer.size(), MPI_DOUBLE, 0, RESULT, MPI_COMM_WORLD);
+    }
+}
+
+
+void WorkDistributor::Abort(std::string const &message) const
+{
+    std::cerr << "Rank " << rank << ": " << message << " Aborting all ranks." << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+
+    // MPI_Abort is not guaranteed to terminate the calling process
+    std::abort();
+}
+#endif
+
+
+void WorkDistributor::CheckNumValues(unsigned long unit, std::vector<double> const &results,
+  unsigned numValues)
+{
+    if (results.size() != numValues)
+    {
+        std::ostringstream message;
+        message << "WorkDistributor::CheckNumValues: Task has returned " << results.size() <<
+          " values for unit " << unit << " while " << numValues << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+}
@@ -50,6 +50,12 @@ ZJetRun1::ZJetRun1(std::string const &fileName, Method method)
 }
 
 
+std::unique_ptr<MeasurementBase> ZJetRun1::Clone() const
+{
+    return std::make_unique<ZJetRun1>(*this);
+}
+
+
 unsigned ZJetRun1::GetDim() const
 {
     return bins.size();
@@ -68,3 +74,27 @@ double ZJetRun1::Eval(JetCorrBase const &corrector, Nuisances const &) const
     
     return chi2;
 }
+
+
+double ZJetRun1::EvalWithCorrections(JetCorrBase const &, Nuisances const &,
+  double const *corrections) const
+{
+    double chi2 = 0.;
+    
+    for (unsigned i = 0; i < bins.size(); ++i)
+        chi2 += std::pow(bins[i].balanceRatio - 1 / corrections[i], 2) / bins[i].unc2;
+    
+    return chi2;
+}
+
+
+std::vector<double> ZJetRun1::GetCorrectionPoints() const
+{
+    std::vector<double> points;
+    points.reserve(bins.size());
+    
+    for (auto const &bin: bins)
+        points.emplace_back(bin.ptZ);
+    
+    return points;
+}
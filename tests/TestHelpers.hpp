@@ -0,0 +1,504 @@
+/**
+ * \file TestHelpers.hpp
+ *
+ * Synthetic measurements and input files shared among unit tests and the benchmark. All
+ * definitions are placed in this header so that every test remains an executable built from a
+ * single source file. Inputs are generated with a given random number generator, and a generator
+ * with a fixed seed gives reproducible files.
+ */
+
+#pragma once
+
+#include <FitBase.hpp>
+#include <Nuisances.hpp>
+
+#include <TFile.h>
+#include <TH1D.h>
+#include <TH2.h>
+#include <TProfile.h>
+#include <TProfile2D.h>
+#include <TSpline.h>
+#include <TVectorD.h>
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * \class ToyMeasurement
+ * \brief Synthetic measurement
+ *
+ * Computes chi^2 = sum_i (corr(pt_i) * (1 + sum_k s_k * n_k) - target_i)^2 / sigma^2, where n_k
+ * are nuisance parameters and s_k are their fixed relative effects. The evaluation keeps a
+ * mutable buffer, as real measurements do, so that sharing an object between threads would lead
+ * to wrong results. Optionally, the measurement requests its points from the shared table of
+ * corrections of the loss function.
+ */
+class ToyMeasurement: public MeasurementBase
+{
+public:
+    /**
+     * \brief Constructor
+     *
+     * \param nuisanceDefs  Definitions in which nuisance parameters are registered.
+     * \param pts  Values of pt at which the correction is evaluated.
+     * \param targets  Target values for the corrected response, one per point.
+     * \param sigma  Uncertainty in each point.
+     * \param systs  Names of nuisance parameters and their relative effects.
+     * \param useCorrectionTable  Whether the correction points are exposed through
+     *     GetCorrectionPoints.
+     */
+    ToyMeasurement(NuisanceDefinitions &nuisanceDefs, std::vector<double> const &pts,
+      std::vector<double> const &targets, double sigma,
+      std::vector<std::pair<std::string, double>> const &systs = {},
+      bool useCorrectionTable = false);
+
+public:
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    virtual std::vector<double> GetCorrectionPoints() const override;
+    virtual unsigned GetDim() const override;
+    virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const override;
+    virtual double EvalWithCorrections(JetCorrBase const &corrector, Nuisances const &nuisances,
+      double const *corrections) const override;
+
+    /// Number of values of the correction evaluated in method Eval
+    mutable unsigned numOwnEvals;
+
+private:
+    /// Computes chi^2 from the given corrections
+    double Chi2(Nuisances const &nuisances, double const *corrections) const;
+
+private:
+    std::vector<double> pts, targets;
+    double sigma;
+
+    /// Indices of nuisance parameters and their relative effects
+    std::vector<std::pair<unsigned, double>> nuisanceEffects;
+
+    bool useCorrectionTable;
+    mutable std::vector<double> corrections;
+};
+
+
+/**
+ * \struct CrawlingBinsSpec
+ * \brief Layout of synthetic inputs for MultijetCrawlingBins
+ *
+ * Chi^2 bins are 100 GeV wide and start from 100 GeV. Bins in pt of other jets start from 10 GeV
+ * and extend 100 GeV beyond the last chi^2 bin. Trigger bins split the range of chi^2 bins into
+ * equal parts.
+ */
+struct CrawlingBinsSpec
+{
+    /// Number of chi^2 bins
+    unsigned numChi2Bins = 8;
+
+    /// Number of bins in pt of the leading jet in each chi^2 bin
+    unsigned numDataBinsPerChi2Bin = 5;
+
+    /// Number of bins in pt of other jets
+    unsigned numJetBins = 100;
+
+    /// Number of trigger bins
+    unsigned numTriggers = 2;
+
+    /// Labels of methods for which inputs are written
+    std::vector<std::string> methods{"PtBal", "MPF"};
+
+    /// Names of systematic variations in data and in simulation
+    std::vector<std::string> dataSysts, simSysts;
+
+    /// Probability for a bin in pt of the leading jet to be empty
+    double emptyFraction = 0.;
+};
+
+
+/// Returns a random number uniformly distributed in the range [min, max)
+inline double Uniform(std::mt19937 &generator, double min, double max)
+{
+    return std::uniform_real_distribution<double>(min, max)(generator);
+}
+
+
+/**
+ * \brief Writes a random spline in log(pt) into the current directory
+ *
+ * The nodes are placed at pt = 50 GeV * 1.5^i, and the last one is not below maxPt.
+ */
+inline void WriteSpline(std::string const &name, std::mt19937 &generator, double min, double max,
+  double maxPt)
+{
+    std::vector<double> logPt, values;
+
+    for (double pt = 50.; pt < 1.5 * maxPt; pt *= 1.5)
+    {
+        logPt.emplace_back(std::log(pt));
+        values.emplace_back(Uniform(generator, min, max));
+    }
+
+    TSpline3 spline("", logPt.data(), values.data(), logPt.size());
+    spline.Write(name.c_str());
+}
+
+
+/// Writes a file with random inputs for MultijetCrawlingBins with the given layout
+inline void WriteCrawlingBinsInputs(std::string const &fileName, CrawlingBinsSpec const &spec,
+  std::mt19937 &generator)
+{
+    TFile file(fileName.c_str(), "recreate");
+
+    int const numDataBins = spec.numDataBinsPerChi2Bin * spec.numChi2Bins;
+    double const minPtLead = 100., maxPtLead = minPtLead + 100. * spec.numChi2Bins;
+
+    TVectorD binning(spec.numChi2Bins + 1);
+
+    for (int i = 0; i < binning.GetNoElements(); ++i)
+        binning[i] = minPtLead + 100. * i;
+
+    binning.Write("Binning");
+
+    TH1D ptLead("PtLead", "", numDataBins, minPtLead, maxPtLead);
+    TProfile ptLeadProfile("PtLeadProfile", "", numDataBins, minPtLead, maxPtLead);
+    TH2D sumProj("RelPtJetSumProj", "", numDataBins, minPtLead, maxPtLead, spec.numJetBins, 10.,
+      maxPtLead + 100.);
+
+    for (int bin = 1; bin <= numDataBins; ++bin)
+    {
+        double const pt = ptLead.GetBinCenter(bin);
+
+        if (Uniform(generator, 0., 1.) >= spec.emptyFraction)
+            ptLead.SetBinContent(bin, 1e4 / bin * Uniform(generator, 0.5, 1.5));
+
+        ptLeadProfile.Fill(pt + Uniform(generator, -5., 5.), 1.);
+
+        for (unsigned jetBin = 1; jetBin <= spec.numJetBins; ++jetBin)
+            sumProj.SetBinContent(bin, jetBin,
+              -1e3 / (jetBin + bin) * Uniform(generator, 0.8, 1.2));
+    }
+
+    ptLead.Write();
+    ptLeadProfile.Write();
+    sumProj.Write();
+
+    for (auto const &method: spec.methods)
+    {
+        TVectorD threshold(2);
+        threshold[0] = 20. + Uniform(generator, -3., 3.);
+        threshold[1] = 30. + Uniform(generator, -3., 3.);
+        threshold.Write((method + "Threshold").c_str());
+
+        TProfile balProfile((method + "Profile").c_str(), "", numDataBins, minPtLead, maxPtLead);
+
+        for (int bin = 1; bin <= numDataBins; ++bin)
+            for (int i = 0; i < 2; ++i)
+                balProfile.Fill(balProfile.GetBinCenter(bin), Uniform(generator, 0.95, 1.03));
+
+        balProfile.Write();
+
+        for (auto const &syst: spec.dataSysts)
+        {
+            std::string const prefix("RelVar_" + method + "_" + syst);
+            TH1D histUp((prefix + "Up").c_str(), "", spec.numChi2Bins, binning.GetMatrixArray());
+            TH1D histDown((prefix + "Down").c_str(), "", spec.numChi2Bins,
+              binning.GetMatrixArray());
+
+            for (unsigned bin = 1; bin <= spec.numChi2Bins; ++bin)
+            {
+                histUp.SetBinContent(bin, Uniform(generator, 0., 0.02));
+                histDown.SetBinContent(bin, -Uniform(generator, 0., 0.02));
+            }
+
+            histUp.Write();
+            histDown.Write();
+        }
+    }
+
+    double const triggerWidth = (maxPtLead - minPtLead) / spec.numTriggers;
+
+    for (unsigned trigger = 0; trigger < spec.numTriggers; ++trigger)
+    {
+        file.mkdir(("Trigger" + std::to_string(trigger)).c_str())->cd();
+        TVectorD range(2);
+        range[0] = minPtLead + triggerWidth * trigger;
+        range[1] = range[0] + triggerWidth;
+        range.Write("Range");
+
+        for (auto const &method: spec.methods)
+        {
+            WriteSpline("Sim" + method, generator, 0.97, 1.01, 2 * maxPtLead);
+
+            for (auto const &syst: spec.simSysts)
+            {
+                std::string const prefix("RelVar_Sim" + method + "_" + syst);
+                WriteSpline(prefix + "Up", generator, 0., 0.01, 2 * maxPtLead);
+                WriteSpline(prefix + "Down", generator, -0.01, 0., 2 * maxPtLead);
+            }
+        }
+
+        file.cd();
+    }
+
+    file.Close();
+}
+
+
+/**
+ * \brief Writes a file with random inputs for MultijetBinnedSum
+ *
+ * There are three trigger bins, which are not ordered in pt. Some bins in pt of the leading jet
+ * are empty. A systematic variation is included in all trigger bins.
+ */
+inline void WriteBinnedSumInputs(std::string const &fileName, std::mt19937 &generator)
+{
+    TFile file(fileName.c_str(), "recreate");
+
+    TVectorD threshold(1);
+    threshold[0] = 15. + Uniform(generator, -2., 2.);
+    threshold.Write("MinPtPtBal");
+    threshold.Write("MinPtMPF");
+
+    int const numDataBins = 60, numSimBins = 4, numJetBins = 100;
+
+    for (int trigger = 0; trigger < 3; ++trigger)
+    {
+        file.mkdir(("TriggerBin" + std::to_string(trigger)).c_str())->cd();
+
+        // Data binning extends beyond the binning in simulation so that it includes the latter
+        //after a moderate jet correction is undone. Edges of the two binnings are aligned. The
+        //binning in simulation is given by an array of edges, as expected when the profile is
+        //rebinned.
+        double const minPtSim = (trigger == 0) ? 500. : ((trigger == 1) ? 100. : 300.);
+        double const minPtData = minPtSim - 50., maxPtData = minPtSim + 250.;
+        std::vector<double> simBinning;
+
+        for (int i = 0; i <= numSimBins; ++i)
+            simBinning.emplace_back(minPtSim + 50. * i);
+
+        TProfile simPtBal("SimPtBalProfile", "", numSimBins, simBinning.data());
+        TProfile simMPF("SimMPFProfile", "", numSimBins, simBinning.data());
+
+        for (int bin = 1; bin <= numSimBins; ++bin)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                simPtBal.Fill(simPtBal.GetBinCenter(bin), Uniform(generator, -0.05, 0.05));
+                simMPF.Fill(simMPF.GetBinCenter(bin), Uniform(generator, 0.95, 1.03));
+            }
+        }
+
+        TH1D ptLead("PtLead", "", numDataBins, minPtData, maxPtData);
+        TProfile ptLeadProfile("PtLeadProfile", "", numDataBins, minPtData, maxPtData);
+        TProfile ptBalProfile("PtBalProfile", "", numDataBins, minPtData, maxPtData);
+        TProfile mpfProfile("MPFProfile", "", numDataBins, minPtData, maxPtData);
+        TH2D sumProj("PtJetSumProj", "", numDataBins, minPtData, maxPtData, numJetBins, 10.,
+          1010.);
+
+        for (int bin = 1; bin <= numDataBins; ++bin)
+        {
+            double const pt = ptLead.GetBinCenter(bin);
+
+            if (Uniform(generator, 0., 1.) > 0.1)
+                ptLead.SetBinContent(bin, std::round(1e4 / bin * Uniform(generator, 0.5, 1.5)));
+
+            ptLeadProfile.Fill(pt + Uniform(generator, -3., 3.), 1.);
+
+            for (int i = 0; i < 2; ++i)
+            {
+                ptBalProfile.Fill(pt, Uniform(generator, -0.05, 0.05));
+                mpfProfile.Fill(pt, Uniform(generator, 0.95, 1.03));
+            }
+
+            for (int jetBin = 1; jetBin <= numJetBins; ++jetBin)
+                sumProj.SetBinContent(bin, jetBin,
+                  -1e3 / (jetBin + bin) * Uniform(generator, 0.8, 1.2));
+        }
+
+        simPtBal.Write();
+        simMPF.Write();
+        ptLead.Write();
+        ptLeadProfile.Write();
+        ptBalProfile.Write();
+        mpfProfile.Write();
+        sumProj.Write();
+
+        for (std::string const method: {"PtBal", "MPF"})
+        {
+            TH1D histUp(("RelVar_" + method + "_JERUp").c_str(), "", numSimBins,
+              simBinning.data());
+            TH1D histDown(("RelVar_" + method + "_JERDown").c_str(), "", numSimBins,
+              simBinning.data());
+
+            for (int bin = 1; bin <= numSimBins; ++bin)
+            {
+                histUp.SetBinContent(bin, Uniform(generator, 0., 0.02));
+                histDown.SetBinContent(bin, -Uniform(generator, 0., 0.02));
+            }
+
+            histUp.Write();
+            histDown.Write();
+        }
+
+        file.cd();
+    }
+
+    file.Close();
+}
+
+
+/**
+ * \brief Writes a file with random inputs for PhotonJetBinnedSum
+ *
+ * Some photon bins and some cells of the jet pt sums are empty.
+ */
+inline void WritePhotonJetInputs(std::string const &fileName, std::mt19937 &generator)
+{
+    TFile file(fileName.c_str(), "recreate");
+
+    int const numDataBins = 30, numJetBins = 50;
+    double const minPtPhoton = 40., maxPtPhoton = 700.;
+
+    TVectorD threshold(1);
+    threshold[0] = 27. + Uniform(generator, -5., 5.);
+    threshold.Write("MC_MinPtBal");
+    threshold.Write("MC_MinPtMPF");
+
+    // Simulation uses coarser binning given by an array of edges, which are aligned with the
+    //binning in data
+    std::vector<double> simBinning;
+
+    for (int i = 0; i <= numDataBins; i += 3)
+        simBinning.emplace_back(minPtPhoton + (maxPtPhoton - minPtPhoton) / numDataBins * i);
+
+    TProfile simBal("MC_newBal_vs_ptphoton", "", simBinning.size() - 1, simBinning.data());
+    TProfile simMPF("MC_newMPF_vs_ptphoton", "", simBinning.size() - 1, simBinning.data());
+
+    for (int bin = 1; bin <= simBal.GetNbinsX(); ++bin)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            simBal.Fill(simBal.GetBinCenter(bin), Uniform(generator, 0.93, 0.99));
+            simMPF.Fill(simMPF.GetBinCenter(bin), Uniform(generator, 0.96, 1.02));
+        }
+    }
+
+    TProfile bal("DATA_newBal_vs_ptphoton", "", numDataBins, minPtPhoton, maxPtPhoton);
+    TProfile mpf("DATA_newMPF_vs_ptphoton", "", numDataBins, minPtPhoton, maxPtPhoton);
+    TH1D ptPhoton("DATA_phopt_for_nevts", "", numDataBins, minPtPhoton, maxPtPhoton);
+    TProfile ptPhotonProfile("DATA_ptphoton_vs_ptphoton", "", numDataBins, minPtPhoton,
+      maxPtPhoton);
+    TH2D sumProj("DATA_Skl_phopt_vs_jetpt", "", numDataBins, minPtPhoton, maxPtPhoton,
+      numJetBins, 5., 1005.);
+    TProfile2D jetPtProfile("DATA_jetpt_phopt_vs_jetpt", "", numDataBins, minPtPhoton,
+      maxPtPhoton, numJetBins, 5., 1005.);
+
+    for (int bin = 1; bin <= numDataBins; ++bin)
+    {
+        double const pt = ptPhoton.GetBinCenter(bin);
+
+        for (int i = 0; i < 2; ++i)
+        {
+            bal.Fill(pt, Uniform(generator, 0.93, 0.99));
+            mpf.Fill(pt, Uniform(generator, 0.96, 1.02));
+        }
+
+        ptPhotonProfile.Fill(pt + Uniform(generator, -3., 3.), 1.);
+
+        if (Uniform(generator, 0., 1.) > 0.1)
+            ptPhoton.SetBinContent(bin, std::round(1e4 / bin * Uniform(generator, 0.5, 1.5)));
+
+        for (int jetBin = 1; jetBin <= numJetBins; ++jetBin)
+        {
+            if (Uniform(generator, 0., 1.) < 0.2)
+                continue;
+
+            sumProj.SetBinContent(bin, jetBin, 50. / jetBin * Uniform(generator, -1., 1.));
+            double const jetPt = sumProj.GetYaxis()->GetBinCenter(jetBin);
+            jetPtProfile.Fill(pt, jetPt, jetPt + Uniform(generator, -3., 3.));
+        }
+    }
+
+    file.Write();
+    file.Close();
+}
+
+
+/// Returns points min, min * ratio, min * ratio^2, and so on, which are smaller than max
+inline std::vector<double> GeometricPoints(double min, double max, double ratio)
+{
+    std::vector<double> pts;
+
+    for (double pt = min; pt < max; pt *= ratio)
+        pts.emplace_back(pt);
+
+    return pts;
+}
+
+
+inline ToyMeasurement::ToyMeasurement(NuisanceDefinitions &nuisanceDefs,
+  std::vector<double> const &pts_, std::vector<double> const &targets_, double sigma_,
+  std::vector<std::pair<std::string, double>> const &systs, bool useCorrectionTable_):
+    numOwnEvals(0),
+    pts(pts_), targets(targets_), sigma(sigma_),
+    useCorrectionTable(useCorrectionTable_),
+    corrections(pts.size())
+{
+    for (auto const &syst: systs)
+        nuisanceEffects.emplace_back(nuisanceDefs.Register(syst.first), syst.second);
+}
+
+
+inline std::unique_ptr<MeasurementBase> ToyMeasurement::Clone() const
+{
+    return std::make_unique<ToyMeasurement>(*this);
+}
+
+
+inline std::vector<double> ToyMeasurement::GetCorrectionPoints() const
+{
+    if (useCorrectionTable)
+        return pts;
+    else
+        return {};
+}
+
+
+inline unsigned ToyMeasurement::GetDim() const
+{
+    return pts.size();
+}
+
+
+inline double ToyMeasurement::Eval(JetCorrBase const &corrector, Nuisances const &nuisances)
+  const
+{
+    corrector.EvalBatch(pts.data(), corrections.data(), pts.size());
+    numOwnEvals += pts.size();
+    return Chi2(nuisances, corrections.data());
+}
+
+
+inline double ToyMeasurement::EvalWithCorrections(JetCorrBase const &,
+  Nuisances const &nuisances, double const *corrections_) const
+{
+    return Chi2(nuisances, corrections_);
+}
+
+
+inline double ToyMeasurement::Chi2(Nuisances const &nuisances, double const *corrections_) const
+{
+    double scale = 1.;
+
+    for (auto const &effect: nuisanceEffects)
+        scale += effect.second * nuisances[effect.first];
+
+    double chi2 = 0.;
+
+    for (unsigned i = 0; i < pts.size(); ++i)
+        chi2 += std::pow((corrections_[i] * scale - targets[i]) / sigma, 2);
+
+    return chi2;
+}
@@ -0,0 +1,246 @@
+/**
+ * A unit test to check that evaluation of the loss function does not allocate heap memory.
+ *
+ * Global operators new are replaced to count allocations while the counting is enabled. The loss
+ * function is evaluated at several points to let scratch buffers grow to the needed size, and then
+ * it is evaluated at the same points again, during which no allocations are allowed. Small input
+ * files for MultijetBinnedSum, MultijetCrawlingBins, and PhotonJetBinnedSum are generated on the
+ * fly.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrConstraint.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <MultijetBinnedSum.hpp>
+#include <MultijetCrawlingBins.hpp>
+#include <PhotonJetBinnedSum.hpp>
+#include <ScratchArena.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+/// Flag indicating that allocations must be counted
+atomic<bool> countAllocations(false);
+
+/// Number of allocations made while the counting was enabled
+atomic<unsigned long> numAllocations(0);
+
+
+void *operator new(size_t size)
+{
+    if (countAllocations)
+        ++numAllocations;
+
+    if (void *p = malloc(size > 0 ? size : 1))
+        return p;
+
+    throw bad_alloc();
+}
+
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/**
+ * Evaluates the loss function at the given points twice to warm it up, and then once again
+ * counting heap allocations. Returns the number of allocations.
+ */
+unsigned long CountAllocations(CombLossFunction const &lossFunc,
+  vector<vector<double>> const &points)
+{
+    for (int i = 0; i < 2; ++i)
+        for (auto const &x: points)
+            lossFunc.EvalRawInput(x.data());
+
+    numAllocations = 0;
+    countAllocations = true;
+
+    for (auto const &x: points)
+        lossFunc.EvalRawInput(x.data());
+
+    countAllocations = false;
+    return numAllocations;
+}
+
+
+/**
+ * Checks that the loss function with the given measurement and its copy can be evaluated without
+ * allocations
+ *
+ * The loss function uses JetCorrStd2P. Its two parameters are varied on a grid, and all nuisances
+ * are set to values proportional to the first parameter.
+ */
+bool CheckMeasurement(MeasurementBase const &measurement, NuisanceDefinitions const &nuisanceDefs)
+{
+    CombLossFunction lossFunc(make_unique<JetCorrStd2P>(), nuisanceDefs);
+    lossFunc.AddMeasurement(&measurement);
+    unsigned const numParams = lossFunc.GetNumParams();
+    vector<vector<double>> points;
+
+    for (double const p0: {-1e-2, 0., 1e-2})
+    {
+        for (double const p1: {-1e-2, 0., 1e-2})
+        {
+            vector<double> point(numParams, p0 * 100.);
+            point[0] = p0;
+            point[1] = p1;
+            points.emplace_back(point);
+        }
+    }
+
+    bool pass = (CountAllocations(lossFunc, points) == 0);
+
+    // Evaluation of a copy must not allocate either
+    auto const clone = lossFunc.Clone();
+    pass &= (CountAllocations(*clone, points) == 0);
+
+    return pass;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+
+    cout << "Scratch arena reuses memory after warm-up:\n";
+    ScratchArena arena;
+
+    auto fillArena = [&arena]()
+    {
+        bool aligned = true;
+
+        for (unsigned n = 1; n < 2000; n *= 3)
+        {
+            auto const *c = arena.Allocate<char>(n);
+            auto const *d = arena.Allocate<double>(n);
+            aligned &= (c != nullptr and reinterpret_cast<uintptr_t>(d) % alignof(double) == 0);
+        }
+
+        arena.Reset();
+        return aligned;
+    };
+
+    status = fillArena();
+    status &= fillArena();
+    numAllocations = 0;
+    countAllocations = true;
+    status &= fillArena();
+    countAllocations = false;
+    status &= (numAllocations == 0);
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Loss function with a constraint:\n";
+    NuisanceDefinitions constraintNuisanceDefs;
+    JetCorrConstraint constraint(208., 1., 0.01);
+    constraintNuisanceDefs.Register("constraint");
+
+    CombLossFunction constraintLossFunc(make_unique<JetCorrStd2P>(), constraintNuisanceDefs);
+    constraintLossFunc.AddMeasurement(&constraint);
+
+    status = (CountAllocations(constraintLossFunc, {{0., 0., 0.}, {1e-2, -1e-2, 0.5}}) == 0);
+    printResult(status);
+    failure |= not status;
+
+
+    string const inputFile("test_allocations_input.root");
+    mt19937 generator(1);
+    WriteBinnedSumInputs(inputFile, generator);
+
+    for (auto const &method: {MultijetBinnedSum::Method::PtBal, MultijetBinnedSum::Method::MPF})
+    {
+        cout << "MultijetBinnedSum with " <<
+          ((method == MultijetBinnedSum::Method::PtBal) ? "pt balance" : "MPF") << ":\n";
+
+        NuisanceDefinitions nuisanceDefs;
+        MultijetBinnedSum measurement(inputFile, method, nuisanceDefs);
+        status = CheckMeasurement(measurement, nuisanceDefs);
+        printResult(status);
+        failure |= not status;
+    }
+
+    CrawlingBinsSpec crawlingBinsSpec;
+    crawlingBinsSpec.dataSysts = {"JER"};
+    WriteCrawlingBinsInputs(inputFile, crawlingBinsSpec, generator);
+
+    for (auto const &method: {MultijetCrawlingBins::Method::PtBal,
+      MultijetCrawlingBins::Method::MPF})
+    {
+        cout << "MultijetCrawlingBins with " <<
+          ((method == MultijetCrawlingBins::Method::PtBal) ? "pt balance" : "MPF") << ":\n";
+
+        NuisanceDefinitions nuisanceDefs;
+        MultijetCrawlingBins measurement(inputFile, method, nuisanceDefs);
+        status = CheckMeasurement(measurement, nuisanceDefs);
+        printResult(status);
+        failure |= not status;
+    }
+
+    WritePhotonJetInputs(inputFile, generator);
+
+    for (auto const &method: {PhotonJetBinnedSum::Method::PtBal, PhotonJetBinnedSum::Method::MPF})
+    {
+        cout << "PhotonJetBinnedSum with " <<
+          ((method == PhotonJetBinnedSum::Method::PtBal) ? "pt balance" : "MPF") << ":\n";
+
+        NuisanceDefinitions nuisanceDefs;
+        PhotonJetBinnedSum measurement(inputFile, method, nuisanceDefs);
+        status = CheckMeasurement(measurement, nuisanceDefs);
+        printResult(status);
+        failure |= not status;
+    }
+
+    remove(inputFile.c_str());
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,219 @@
+/**
+ * A unit test for the batched evaluation of the loss function.
+ *
+ * The multijet measurement with crawling bins is evaluated with CombLossFunction::EvalRawInputMany
+ * at points arranged as in a central-difference gradient, with systematic variations in data and
+ * simulation. The results are compared with the evaluation at individual points. Different storage
+ * modes for the jet projections and the joint measurement are checked. Values of chi^2 for the joint
+ * measurement must also agree with ones for separate measurements with the two methods built from
+ * the same inputs, including after a restriction of the range in pt of the leading jet. A small
+ * input file is generated on the fly.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <MultijetCrawlingBins.hpp>
+#include <Nuisances.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/**
+ * Compares batched and individual evaluation of the loss function with the given measurement
+ *
+ * The points include shifts of all parameters in both directions, repeated points, and points
+ * that only differ in nuisances. Their number exceeds CombLossFunction::maxBatchSize so that
+ * several batches, including an incomplete one, are processed.
+ */
+bool CheckBatchEval(MeasurementBase const &measurement, NuisanceDefinitions const &nuisanceDefs)
+{
+    CombLossFunction lossFunc(make_unique<JetCorrBSpline>(20., 1000., 10), nuisanceDefs);
+    lossFunc.AddMeasurement(&measurement);
+
+    unsigned const numParams = lossFunc.GetNumParams();
+    vector<double> basePoint(numParams);
+
+    for (unsigned i = 0; i < numParams; ++i)
+        basePoint[i] = 0.01 * std::sin(i + 1.);
+
+    vector<double> points(basePoint);
+
+    for (unsigned i = 0; i < numParams; ++i)
+    {
+        for (double const step: {1e-3, -1e-3})
+        {
+            points.insert(points.end(), basePoint.begin(), basePoint.end());
+            points[points.size() - numParams + i] += step;
+        }
+    }
+
+    points.insert(points.end(), basePoint.begin(), basePoint.end());
+    unsigned const numPoints = points.size() / numParams;
+
+    vector<double> results(numPoints);
+    lossFunc.EvalRawInputMany(points.data(), numPoints, results.data());
+    double maxDeviation = 0.;
+    bool pass = true;
+
+    for (unsigned i = 0; i < numPoints; ++i)
+    {
+        double const ref = lossFunc.EvalRawInput(points.data() + i * numParams);
+        pass &= std::isfinite(results[i]);
+        maxDeviation = max(maxDeviation, std::abs(results[i] / ref - 1.));
+    }
+
+    cout << "  " << numParams << " parameters, " << numPoints << " points, maximal relative "
+      "deviation: " << maxDeviation << '\n';
+    return (pass and maxDeviation < 1e-10);
+}
+
+
+/**
+ * Compares chi^2 of the joint measurement with chi^2 of separate measurements for the two methods
+ *
+ * The comparison is done at random points in the space of parameters of the jet correction and
+ * nuisances. Nuisances of the separate measurements take the values of parameters with the same
+ * names in the joint measurement.
+ */
+bool CheckJointAgreement(MultijetCrawlingBinsJoint const &joint,
+  NuisanceDefinitions const &jointNuisanceDefs, MultijetCrawlingBins const &ptBal,
+  NuisanceDefinitions const &ptBalNuisanceDefs, MultijetCrawlingBins const &mpf,
+  NuisanceDefinitions const &mpfNuisanceDefs, mt19937 &generator)
+{
+    JetCorrStd2P corrector;
+    Nuisances jointNuisances(jointNuisanceDefs), ptBalNuisances(ptBalNuisanceDefs),
+      mpfNuisances(mpfNuisanceDefs);
+    double maxDeviation = 0.;
+
+    for (unsigned trial = 0; trial < 10; ++trial)
+    {
+        double const corrParams[] = {Uniform(generator, -0.03, 0.03),
+          Uniform(generator, -0.03, 0.03)};
+        corrector.SetParams(corrParams);
+
+        // The first points are evaluated with all nuisances at zero
+        if (trial >= 3)
+        {
+            for (unsigned i = 0; i < jointNuisances.GetNumParams(); ++i)
+                jointNuisances[i] = Uniform(generator, -1., 1.);
+        }
+
+        for (auto *nuisances: {&ptBalNuisances, &mpfNuisances})
+        {
+            for (auto const &name: nuisances->GetDefinitions().GetNames())
+                (*nuisances)[name] = jointNuisances[name];
+        }
+
+        auto const chi2 = joint.EvalMethods(corrector, jointNuisances);
+        double const refChi2[] = {ptBal.Eval(corrector, ptBalNuisances),
+          mpf.Eval(corrector, mpfNuisances)};
+
+        for (unsigned i = 0; i < 2; ++i)
+            maxDeviation = max(maxDeviation, std::abs(chi2[i] / refChi2[i] - 1.));
+
+        maxDeviation = max(maxDeviation,
+          std::abs(joint.Eval(corrector, jointNuisances) / (refChi2[0] + refChi2[1]) - 1.));
+    }
+
+    cout << "  Maximal relative deviation: " << maxDeviation << '\n';
+    return (maxDeviation < 1e-12);
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    string const inputFile("test_batchEval_input.root");
+    CrawlingBinsSpec spec;
+    spec.dataSysts = {"JER"};
+    spec.simSysts = {"ISR"};
+    mt19937 generator(1);
+    WriteCrawlingBinsInputs(inputFile, spec, generator);
+
+
+    cout << "MultijetCrawlingBins with pt balance:\n";
+    NuisanceDefinitions ptBalNuisanceDefs;
+    MultijetCrawlingBins ptBal(inputFile, MultijetCrawlingBins::Method::PtBal,
+      ptBalNuisanceDefs);
+    status = CheckBatchEval(ptBal, ptBalNuisanceDefs);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "MultijetCrawlingBins with MPF and single-precision storage:\n";
+    NuisanceDefinitions mpfNuisanceDefs;
+    MultijetCrawlingBins mpf(inputFile, MultijetCrawlingBins::Method::MPF, mpfNuisanceDefs, {},
+      FlatHist2D::Storage::ScaledFloat);
+    status = CheckBatchEval(mpf, mpfNuisanceDefs);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "MultijetCrawlingBinsJoint:\n";
+    NuisanceDefinitions jointNuisanceDefs;
+    MultijetCrawlingBinsJoint joint(inputFile, jointNuisanceDefs, {},
+      FlatHist2D::Storage::Float);
+    status = CheckBatchEval(joint, jointNuisanceDefs);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "MultijetCrawlingBinsJoint vs separate measurements:\n";
+    NuisanceDefinitions refJointNuisanceDefs, refPtBalNuisanceDefs, refMPFNuisanceDefs;
+    MultijetCrawlingBinsJoint refJoint(inputFile, refJointNuisanceDefs);
+    MultijetCrawlingBins refPtBal(inputFile, MultijetCrawlingBins::Method::PtBal,
+      refPtBalNuisanceDefs);
+    MultijetCrawlingBins refMPF(inputFile, MultijetCrawlingBins::Method::MPF,
+      refMPFNuisanceDefs);
+    status = CheckJointAgreement(refJoint, refJointNuisanceDefs, refPtBal, refPtBalNuisanceDefs,
+      refMPF, refMPFNuisanceDefs, generator);
+
+    auto const ptLeadRange = refJoint.SetPtLeadRange(250., 650.);
+    status &= (refPtBal.SetPtLeadRange(250., 650.) == ptLeadRange);
+    status &= (refMPF.SetPtLeadRange(250., 650.) == ptLeadRange);
+    status &= CheckJointAgreement(refJoint, refJointNuisanceDefs, refPtBal, refPtBalNuisanceDefs,
+      refMPF, refMPFNuisanceDefs, generator);
+    printResult(status);
+    failure |= not status;
+
+    remove(inputFile.c_str());
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,166 @@
+/**
+ * A unit test for the parallel processing of trigger bins in MultijetBinnedSum.
+ *
+ * Random inputs with three trigger bins are generated on the fly. Measurements processing trigger
+ * bins with different numbers of threads, including more threads than trigger bins, are evaluated
+ * at random points in the space of parameters of the jet correction and nuisances. Values of chi^2
+ * and recomputed mean balance must be bitwise identical to those obtained in a single thread. The
+ * same is checked for the loss function, which evaluates the correction with the shared table,
+ * for its numerical gradient, and for copies of the measurements.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <MultijetBinnedSum.hpp>
+#include <Nuisances.hpp>
+#include <ParallelGradFunction.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <TH1D.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Checks if contents of all bins of the two histograms, including under- and overflows, match
+bool Identical(TH1D const &hist, TH1D const &refHist)
+{
+    if (hist.GetNbinsX() != refHist.GetNbinsX())
+        return false;
+
+    for (int bin = 0; bin <= hist.GetNbinsX() + 1; ++bin)
+    {
+        if (hist.GetBinContent(bin) != refHist.GetBinContent(bin))
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Evaluates the measurement and its single-threaded reference at random points and checks that
+ * all results are bitwise identical
+ */
+bool CheckIdentical(MultijetBinnedSum const &measurement, MultijetBinnedSum const &refMeasurement,
+  NuisanceDefinitions const &nuisanceDefs, mt19937 &generator)
+{
+    JetCorrStd2P corrector;
+    Nuisances nuisances(nuisanceDefs);
+
+    CombLossFunction lossFunc(make_unique<JetCorrStd2P>(), nuisanceDefs);
+    lossFunc.AddMeasurement(&measurement);
+    CombLossFunction refLossFunc(make_unique<JetCorrStd2P>(), nuisanceDefs);
+    refLossFunc.AddMeasurement(&refMeasurement);
+    ParallelGradFunction gradFunc(lossFunc, 1), refGradFunc(refLossFunc, 1);
+
+    unsigned const numParams = lossFunc.GetNumParams();
+    unsigned const numCorrParams = corrector.GetNumParams();
+    bool pass = true;
+
+    for (unsigned trial = 0; trial < 20; ++trial)
+    {
+        vector<double> x(numParams);
+
+        for (unsigned i = 0; i < numCorrParams; ++i)
+            x[i] = Uniform(generator, -0.03, 0.03);
+
+        for (unsigned i = numCorrParams; i < numParams; ++i)
+            x[i] = Uniform(generator, -1., 1.);
+
+        corrector.SetParams(x.data());
+        nuisances.SetValues(x.data() + numCorrParams);
+
+        double const chi2 = measurement.Eval(corrector, nuisances);
+        pass &= (chi2 == refMeasurement.Eval(corrector, nuisances));
+        pass &= Identical(measurement.GetRecompBalance(corrector, nuisances),
+          refMeasurement.GetRecompBalance(corrector, nuisances));
+        pass &= (lossFunc.EvalRawInput(x.data()) == refLossFunc.EvalRawInput(x.data()));
+
+        vector<double> grad(numParams), refGrad(numParams);
+        gradFunc.Gradient(x.data(), grad.data());
+        refGradFunc.Gradient(x.data(), refGrad.data());
+        pass &= (grad == refGrad);
+    }
+
+    return pass;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    string const fileName("test_binnedSumThreads_inputs.root");
+    vector<unsigned> const seeds{1, 2, 3};
+
+    for (auto const method: {MultijetBinnedSum::Method::PtBal, MultijetBinnedSum::Method::MPF})
+    {
+        bool const isPtBal = (method == MultijetBinnedSum::Method::PtBal);
+
+        for (unsigned const numThreads: {2u, 3u, 8u})
+        {
+            cout << "MultijetBinnedSum with " << (isPtBal ? "PtBal" : "MPF") << " and " <<
+              numThreads << " threads:\n";
+            status = true;
+
+            for (unsigned const seed: seeds)
+            {
+                mt19937 generator(seed);
+                WriteBinnedSumInputs(fileName, generator);
+
+                NuisanceDefinitions nuisanceDefs;
+                MultijetBinnedSum refMeasurement(fileName, method, nuisanceDefs);
+                MultijetBinnedSum measurement(fileName, method, nuisanceDefs);
+                measurement.SetNumThreads(numThreads);
+
+                status &= CheckIdentical(measurement, refMeasurement, nuisanceDefs, generator);
+
+                // A copy has its own pool of threads
+                auto const clone = measurement.Clone();
+                status &= CheckIdentical(dynamic_cast<MultijetBinnedSum const &>(*clone),
+                  refMeasurement, nuisanceDefs, generator);
+            }
+
+            printResult(status);
+            failure |= not status;
+        }
+    }
+
+    remove(fileName.c_str());
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
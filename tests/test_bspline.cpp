@@ -0,0 +1,190 @@
+/**
+ * A unit test for the B-spline correction and the incremental update of cached jet corrections.
+ *
+ * Properties of JetCorrBSpline are checked first: the basis functions sum up to unity, the
+ * batched evaluation agrees with the scalar one, and a variation of a parameter only affects the
+ * correction within the range reported by GetParamSupport. Then the multijet measurement with
+ * crawling bins is evaluated at a sequence of points as done in the computation of a numeric
+ * gradient, in which the cached values are updated incrementally. The results must be bitwise
+ * identical to those obtained with a full update. A small input file is generated on the fly.
+ */
+
+#include <JetCorrDefinitions.hpp>
+#include <MultijetCrawlingBins.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/**
+ * Evaluates the given measurement at a sequence of points as in a central-difference gradient and
+ * compares the results with evaluations from scratch
+ */
+bool CheckIncrementalUpdate(MeasurementBase const &measurement, Nuisances const &nuisances)
+{
+    JetCorrBSpline corrector(20., 1000., 10);
+    vector<double> basePoint(corrector.GetNumParams());
+
+    for (unsigned i = 0; i < basePoint.size(); ++i)
+        basePoint[i] = 0.01 * std::sin(i + 1.);
+
+    vector<vector<double>> points{basePoint};
+
+    for (unsigned i = 0; i < basePoint.size(); ++i)
+    {
+        for (double const step: {1e-4, -1e-4})
+        {
+            points.emplace_back(basePoint);
+            points.back()[i] += step;
+        }
+    }
+
+    points.emplace_back(basePoint);
+    bool pass = true;
+
+    for (auto const &point: points)
+    {
+        corrector.SetParams(point);
+        double const chi2 = measurement.Eval(corrector, nuisances);
+
+        // A new correction object has a different configuration identifier, which forces a full
+        //update of the cache
+        JetCorrBSpline freshCorrector(20., 1000., 10);
+        freshCorrector.SetParams(point);
+        double const refChi2 = measurement.Clone()->Eval(freshCorrector, nuisances);
+
+        pass &= (chi2 == refChi2 and std::isfinite(chi2));
+    }
+
+    return pass;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    JetCorrBSpline bspline(15., 3000., 12);
+    vector<double> ptValues;
+
+    for (double pt = 5.; pt < 1e4; pt *= 1.05)
+        ptValues.emplace_back(pt);
+
+
+    cout << "Basis functions sum up to unity:\n";
+    bspline.SetParams(vector<double>(bspline.GetNumParams(), 0.02));
+    status = true;
+
+    for (double const pt: ptValues)
+        status &= (std::abs(bspline.Eval(pt) - 1.02) < 1e-12);
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Batched evaluation agrees with scalar one:\n";
+    vector<double> params(bspline.GetNumParams());
+
+    for (unsigned i = 0; i < params.size(); ++i)
+        params[i] = 0.01 * std::cos(2. * i);
+
+    bspline.SetParams(params);
+    vector<double> corrections(ptValues.size());
+    bspline.EvalBatch(ptValues.data(), corrections.data(), ptValues.size());
+    status = true;
+
+    for (unsigned i = 0; i < ptValues.size(); ++i)
+        status &= (std::abs(corrections[i] - bspline.Eval(ptValues[i])) < 1e-14);
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Parameters only affect the correction within their supports:\n";
+    status = true;
+
+    for (unsigned iParam = 0; iParam < params.size(); ++iParam)
+    {
+        auto const support = bspline.GetParamSupport(iParam);
+        auto variedParams = params;
+        variedParams[iParam] += 0.1;
+        JetCorrBSpline varied(bspline);
+        varied.SetParams(variedParams);
+        bool changedInside = false;
+
+        for (double const pt: ptValues)
+        {
+            bool const inside = (pt >= support.first and pt <= support.second);
+            bool const changed = (varied.Eval(pt) != bspline.Eval(pt));
+            changedInside |= (inside and changed);
+            status &= (inside or not changed);
+        }
+
+        status &= changedInside;
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    string const inputFile("test_bspline_input.root");
+    CrawlingBinsSpec spec;
+    spec.numTriggers = 1;
+    mt19937 generator(1);
+    WriteCrawlingBinsInputs(inputFile, spec, generator);
+
+    cout << "Incremental update in MultijetCrawlingBins:\n";
+    NuisanceDefinitions nuisanceDefs;
+    MultijetCrawlingBins measurement(inputFile, MultijetCrawlingBins::Method::PtBal,
+      nuisanceDefs);
+    Nuisances nuisances(nuisanceDefs);
+    status = CheckIncrementalUpdate(measurement, nuisances);
+    printResult(status);
+    failure |= not status;
+
+    cout << "Incremental update in MultijetCrawlingBinsJoint:\n";
+    NuisanceDefinitions jointNuisanceDefs;
+    MultijetCrawlingBinsJoint jointMeasurement(inputFile, jointNuisanceDefs);
+    Nuisances jointNuisances(jointNuisanceDefs);
+    status = CheckIncrementalUpdate(jointMeasurement, jointNuisances);
+    printResult(status);
+    failure |= not status;
+
+    remove(inputFile.c_str());
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
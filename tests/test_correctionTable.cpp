@@ -0,0 +1,164 @@
+/**
+ * A unit test for the shared evaluation of the jet correction.
+ *
+ * Checks that CorrectionTable merges duplicate points, that its values agree with a direct
+ * evaluation of the correction, and that incremental updates give the same values as full ones.
+ * Then two synthetic measurements with overlapping points are combined in CombLossFunction, and
+ * the loss function computed with the shared table is compared with the sum of deviations
+ * computed by the measurements on their own.
+ */
+
+#include <CorrectionTable.hpp>
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <Nuisances.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    vector<double> ptsA = GeometricPoints(20., 2000., 1.1);
+    vector<double> ptsB;
+
+    // The second set repeats every other point of the first one and adds some new points
+    for (unsigned i = 0; i < ptsA.size(); i += 2)
+        ptsB.emplace_back(ptsA[i]);
+
+    for (double pt = 25.; pt < 1000.; pt *= 1.3)
+        ptsB.emplace_back(pt);
+
+
+    cout << "Points are merged and values agree with direct evaluation:\n";
+    JetCorrBSpline corrector(15., 3000., 12);
+    vector<double> params(corrector.GetNumParams());
+
+    for (unsigned i = 0; i < params.size(); ++i)
+        params[i] = 0.01 * sin(i + 1.);
+
+    corrector.SetParams(params);
+
+    CorrectionTable table;
+    unsigned const setA = table.AddPoints(ptsA);
+    unsigned const setB = table.AddPoints(ptsB);
+    table.AddPoints({});
+    table.Update(corrector);
+
+    status = (table.GetNumPoints() == ptsA.size() + ptsB.size() and
+      table.GetNumDistinctPoints() < table.GetNumPoints());
+
+    for (auto const &set: {make_pair(setA, &ptsA), make_pair(setB, &ptsB)})
+    {
+        double const *values = table.GetCorrections(set.first);
+
+        for (unsigned i = 0; i < set.second->size(); ++i)
+            status &= (abs(values[i] - corrector.Eval((*set.second)[i])) < 1e-14);
+    }
+
+    cout << "  " << table.GetNumPoints() << " points, " << table.GetNumDistinctPoints() <<
+      " distinct\n";
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Incremental updates agree with full ones:\n";
+    status = true;
+
+    for (unsigned i = 0; i < params.size(); ++i)
+    {
+        auto variedParams = params;
+        variedParams[i] += 0.05;
+        corrector.SetParams(variedParams);
+        table.Update(corrector);
+
+        // A new correction object has a different configuration identifier, which forces a full
+        //update
+        JetCorrBSpline freshCorrector(15., 3000., 12);
+        freshCorrector.SetParams(variedParams);
+        CorrectionTable freshTable;
+        freshTable.AddPoints(ptsA);
+        freshTable.AddPoints(ptsB);
+        freshTable.Update(freshCorrector);
+
+        for (unsigned set: {setA, setB})
+        {
+            unsigned const size = (set == setA) ? ptsA.size() : ptsB.size();
+
+            for (unsigned j = 0; j < size; ++j)
+                status &= (table.GetCorrections(set)[j] == freshTable.GetCorrections(set)[j]);
+        }
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Loss function with shared corrections:\n";
+    NuisanceDefinitions nuisanceDefs;
+
+    // The measurements compute chi^2 = sum_i (corr(pt_i) - 1)^2 / sigma^2 and request their
+    //points from the shared table
+    ToyMeasurement measurementA(nuisanceDefs, ptsA, vector<double>(ptsA.size(), 1.), 0.01, {},
+      true);
+    ToyMeasurement measurementB(nuisanceDefs, ptsB, vector<double>(ptsB.size(), 1.), 0.01, {},
+      true);
+    CombLossFunction lossFunc(make_unique<JetCorrBSpline>(15., 3000., 12), nuisanceDefs);
+    lossFunc.AddMeasurement(&measurementA);
+    lossFunc.AddMeasurement(&measurementB);
+
+    Nuisances nuisances(nuisanceDefs);
+    corrector.SetParams(params);
+    double const loss = lossFunc.EvalRawInput(params.data());
+    double const refLoss = measurementA.Eval(corrector, nuisances) +
+      measurementB.Eval(corrector, nuisances);
+
+    // The measurements have only evaluated the correction in the computation of the reference
+    status = (measurementA.numOwnEvals == ptsA.size() and
+      measurementB.numOwnEvals == ptsB.size() and abs(loss / refLoss - 1.) < 1e-14 and
+      lossFunc.GetCorrectionTable().GetNumDistinctPoints() == table.GetNumDistinctPoints());
+
+    // The same holds for a copy of the loss function
+    auto const clone = lossFunc.Clone();
+    status &= (abs(clone->EvalRawInput(params.data()) / refLoss - 1.) < 1e-14);
+
+    cout << "  " << loss << " vs " << refLoss << '\n';
+    printResult(status);
+    failure |= not status;
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,316 @@
+/**
+ * A differential test of measurements against their frozen reference implementations.
+ *
+ * Implementations of MultijetCrawlingBins, MultijetBinnedSum, and PhotonJetBinnedSum from the main
+ * library are compared with copies of these classes in directory reference. The copies are taken
+ * from the baseline version of the library, together with the utilities for rebinning and
+ * morphing that they use, and are kept unchanged when the library is optimized. Inputs are
+ * generated randomly on the fly for several seeds with the writers from TestHelpers.hpp, and both
+ * implementations are evaluated at random points in the space of parameters of the jet correction
+ * and nuisances. Values of chi^2, recomputed mean balance in individual bins (for measurements
+ * that provide them), and gradients of the loss function must agree within tight tolerances.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <MultijetBinnedSum.hpp>
+#include <MultijetCrawlingBins.hpp>
+#include <Nuisances.hpp>
+#include <ParallelGradFunction.hpp>
+#include <PhotonJetBinnedSum.hpp>
+
+#include "reference/MultijetBinnedSum.hpp"
+#include "reference/MultijetCrawlingBins.hpp"
+#include "reference/PhotonJetBinnedSum.hpp"
+#include "TestHelpers.hpp"
+
+#include <TH1.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+/// Relative tolerance for values of chi^2 and mean balance
+double const relTolerance = 1e-10;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Computes the deviation of a value from the reference, normalized to the relative tolerance
+double RelDeviation(double value, double reference)
+{
+    if (value == reference)
+        return 0.;
+    else if (not std::isfinite(value) or not std::isfinite(reference))
+        return numeric_limits<double>::infinity();
+    else
+        return abs(value - reference) / (relTolerance * abs(reference));
+}
+
+
+/**
+ * \struct Deviations
+ * \brief Maximal deviations from the reference found in a comparison
+ *
+ * The deviations are normalized to the respective tolerances, so that values above unity signal a
+ * failure.
+ */
+struct Deviations
+{
+    double chi2 = 0., balance = 0., gradient = 0.;
+};
+
+
+/// Returns contents of all bins of the given histogram, without under- and overflows
+vector<double> BinContents(TH1 const &hist)
+{
+    vector<double> contents;
+
+    for (int bin = 1; bin <= hist.GetNbinsX(); ++bin)
+        contents.emplace_back(hist.GetBinContent(bin));
+
+    return contents;
+}
+
+
+/**
+ * \brief Compares a measurement with its reference implementation at random points
+ *
+ * The given function computes the mean balance in all bins of a measurement. It should return an
+ * empty vector if the measurement does not provide it. Gradients are computed with central finite
+ * differences, and they are only sensitive to differences in the loss function at the level of
+ * relTolerance * loss / step. This is accounted for in the normalization of their deviations.
+ */
+template<typename Measurement, typename RefMeasurement, typename BalanceFunc>
+Deviations Compare(Measurement const &measurement, RefMeasurement const &refMeasurement,
+  NuisanceDefinitions const &nuisanceDefs, mt19937 &generator, BalanceFunc balanceFunc)
+{
+    JetCorrStd2P corrector;
+    Nuisances nuisances(nuisanceDefs);
+
+    CombLossFunction lossFunc(make_unique<JetCorrStd2P>(), nuisanceDefs);
+    lossFunc.AddMeasurement(&measurement);
+    CombLossFunction refLossFunc(make_unique<JetCorrStd2P>(), nuisanceDefs);
+    refLossFunc.AddMeasurement(&refMeasurement);
+
+    ParallelGradFunction gradFunc(lossFunc, 1), refGradFunc(refLossFunc, 1);
+    unsigned const numParams = gradFunc.NDim();
+    double const step = std::cbrt(numeric_limits<double>::epsilon());
+
+    Deviations deviations;
+
+    for (int trial = 0; trial < 10; ++trial)
+    {
+        vector<double> x(numParams);
+
+        for (unsigned i = 0; i < corrector.GetNumParams(); ++i)
+            x[i] = Uniform(generator, -0.03, 0.03);
+
+        for (unsigned i = corrector.GetNumParams(); i < numParams; ++i)
+            x[i] = Uniform(generator, -1., 1.);
+
+        corrector.SetParams(x.data());
+        nuisances.SetValues(x.data() + corrector.GetNumParams());
+
+
+        double const chi2 = measurement.Eval(corrector, nuisances);
+        double const refChi2 = refMeasurement.Eval(corrector, nuisances);
+        deviations.chi2 = max(deviations.chi2, RelDeviation(chi2, refChi2));
+
+
+        auto const balance = balanceFunc(measurement, corrector, nuisances);
+        auto const refBalance = balanceFunc(refMeasurement, corrector, nuisances);
+
+        if (balance.size() != refBalance.size())
+            deviations.balance = numeric_limits<double>::infinity();
+        else
+        {
+            for (unsigned i = 0; i < balance.size(); ++i)
+                deviations.balance = max(deviations.balance,
+                  RelDeviation(balance[i], refBalance[i]));
+        }
+
+
+        vector<double> grad(numParams), refGrad(numParams);
+        double loss, refLoss;
+        gradFunc.FdF(x.data(), loss, grad.data());
+        refGradFunc.FdF(x.data(), refLoss, refGrad.data());
+
+        for (unsigned i = 0; i < numParams; ++i)
+        {
+            double const tolerance = relTolerance * abs(refGrad[i]) +
+              4 * relTolerance * abs(refLoss) / (step * max(abs(x[i]), 1.));
+            double const deviation = abs(grad[i] - refGrad[i]) / tolerance;
+            deviations.gradient = max(deviations.gradient,
+              std::isfinite(deviation) ? deviation : numeric_limits<double>::infinity());
+        }
+    }
+
+    return deviations;
+}
+
+
+/// Prints maximal deviations and checks that they are within tolerances
+bool CheckDeviations(Deviations const &deviations)
+{
+    cout << "  Maximal deviations relative to tolerances: chi^2 " << deviations.chi2 <<
+      ", balance " << deviations.balance << ", gradient " << deviations.gradient << '\n';
+    return (deviations.chi2 <= 1. and deviations.balance <= 1. and deviations.gradient <= 1.);
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    string const fileName("test_differential_inputs.root");
+    vector<unsigned> const seeds{1, 2, 3};
+
+    auto const noBalance = [](auto const &, JetCorrBase const &, Nuisances const &)
+    {
+        return vector<double>();
+    };
+
+
+    // Some bins in pt of the leading jet are empty, and a systematic variation is included both
+    //in data and in simulation
+    CrawlingBinsSpec crawlingBinsSpec;
+    crawlingBinsSpec.dataSysts = {"L1Res"};
+    crawlingBinsSpec.simSysts = {"JER"};
+    crawlingBinsSpec.emptyFraction = 0.1;
+
+    for (auto const method: {MultijetCrawlingBins::Method::PtBal,
+      MultijetCrawlingBins::Method::MPF})
+    {
+        bool const isPtBal = (method == MultijetCrawlingBins::Method::PtBal);
+        cout << "MultijetCrawlingBins with " << (isPtBal ? "PtBal" : "MPF") << ":\n";
+        status = true;
+
+        for (unsigned const seed: seeds)
+        {
+            mt19937 generator(seed);
+            WriteCrawlingBinsInputs(fileName, crawlingBinsSpec, generator);
+
+            NuisanceDefinitions nuisanceDefs, refNuisanceDefs;
+            MultijetCrawlingBins measurement(fileName, method, nuisanceDefs);
+            reference::MultijetCrawlingBins refMeasurement(fileName,
+              isPtBal ? reference::MultijetCrawlingBins::Method::PtBal :
+              reference::MultijetCrawlingBins::Method::MPF,
+              refNuisanceDefs);
+            status &= (nuisanceDefs == refNuisanceDefs and
+              measurement.GetDim() == refMeasurement.GetDim());
+
+            auto const balanceFunc = [](auto const &m, JetCorrBase const &corrector,
+              Nuisances const &nuisances)
+            {
+                return BinContents(m.RecomputeBalanceData(corrector, nuisances));
+            };
+
+            status &= CheckDeviations(Compare(measurement, refMeasurement, nuisanceDefs,
+              generator, balanceFunc));
+        }
+
+        printResult(status);
+        failure |= not status;
+    }
+
+
+    for (auto const method: {MultijetBinnedSum::Method::PtBal, MultijetBinnedSum::Method::MPF})
+    {
+        bool const isPtBal = (method == MultijetBinnedSum::Method::PtBal);
+        cout << "MultijetBinnedSum with " << (isPtBal ? "PtBal" : "MPF") << ":\n";
+        status = true;
+
+        for (unsigned const seed: seeds)
+        {
+            mt19937 generator(seed);
+            WriteBinnedSumInputs(fileName, generator);
+
+            NuisanceDefinitions nuisanceDefs, refNuisanceDefs;
+            MultijetBinnedSum measurement(fileName, method, nuisanceDefs);
+            reference::MultijetBinnedSum refMeasurement(fileName,
+              isPtBal ? reference::MultijetBinnedSum::Method::PtBal :
+              reference::MultijetBinnedSum::Method::MPF,
+              refNuisanceDefs);
+            status &= (nuisanceDefs == refNuisanceDefs and
+              measurement.GetDim() == refMeasurement.GetDim());
+
+            auto const balanceFunc = [](auto const &m, JetCorrBase const &corrector,
+              Nuisances const &nuisances)
+            {
+                return BinContents(m.GetRecompBalance(corrector, nuisances));
+            };
+
+            status &= CheckDeviations(Compare(measurement, refMeasurement, nuisanceDefs,
+              generator, balanceFunc));
+        }
+
+        printResult(status);
+        failure |= not status;
+    }
+
+
+    for (auto const method: {PhotonJetBinnedSum::Method::PtBal, PhotonJetBinnedSum::Method::MPF})
+    {
+        bool const isPtBal = (method == PhotonJetBinnedSum::Method::PtBal);
+        cout << "PhotonJetBinnedSum with " << (isPtBal ? "PtBal" : "MPF") << ":\n";
+        status = true;
+
+        for (unsigned const seed: seeds)
+        {
+            mt19937 generator(seed);
+            WritePhotonJetInputs(fileName, generator);
+
+            NuisanceDefinitions nuisanceDefs, refNuisanceDefs;
+            PhotonJetBinnedSum measurement(fileName, method, nuisanceDefs);
+            reference::PhotonJetBinnedSum refMeasurement(fileName,
+              isPtBal ? reference::PhotonJetBinnedSum::Method::PtBal :
+              reference::PhotonJetBinnedSum::Method::MPF,
+              refNuisanceDefs);
+            status &= (nuisanceDefs == refNuisanceDefs and
+              measurement.GetDim() == refMeasurement.GetDim());
+
+            status &= CheckDeviations(Compare(measurement, refMeasurement, nuisanceDefs,
+              generator, noBalance));
+        }
+
+        printResult(status);
+        failure |= not status;
+    }
+
+
+    std::remove(fileName.c_str());
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,305 @@
+/**
+ * A unit test for the fast approximations of elementary functions.
+ *
+ * The approximations are compared against references computed with extended precision, and the
+ * error bounds documented in FastMath.hpp are checked. Batched evaluation of jet corrections,
+ * including in place, is compared with the scalar one. The test also estimates the effect of the
+ * approximations on a chi^2 built from a typical parameterization of the jet correction.
+ */
+
+#include <FastMath.hpp>
+#include <JetCorrDefinitions.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/**
+ * Checks the logarithm against the documented bound on the absolute error
+ *
+ * Arguments are sampled uniformly in the logarithmic scale over almost the full range of normal
+ * numbers, as well as uniformly close to 1, where the result is small.
+ */
+bool checkLog(mt19937 &generator)
+{
+    uniform_real_distribution<double> logDistr(-700., 700.), linDistr(0.5, 2.);
+    double maxDeviation = 0.;
+
+    for (unsigned i = 0; i < 1000000; ++i)
+    {
+        double const x = (i % 2 == 0) ? exp(logDistr(generator)) : linDistr(generator);
+        long double const ref = logl(x);
+        double const deviation = double(abs(fastLog(x) - ref) / max(1.L, abs(ref)));
+        maxDeviation = max(maxDeviation, deviation);
+    }
+
+    cout << "  Maximal deviation: " << maxDeviation << '\n';
+    return (maxDeviation < 2.5e-16);
+}
+
+
+/// Checks the exponential function against the documented bound on the relative error
+bool checkExp(mt19937 &generator)
+{
+    uniform_real_distribution<double> distr(-708., 709.), narrowDistr(-1., 1.);
+    double maxDeviation = 0.;
+
+    for (unsigned i = 0; i < 1000000; ++i)
+    {
+        double const x = (i % 2 == 0) ? distr(generator) : narrowDistr(generator);
+        long double const ref = expl(x);
+        maxDeviation = max(maxDeviation, double(abs(fastExp(x) - ref) / ref));
+    }
+
+    cout << "  Maximal relative deviation: " << maxDeviation << '\n';
+    return (maxDeviation < 3e-16);
+}
+
+
+/**
+ * Checks the power function for arguments typical for jet corrections
+ *
+ * The bound on the relative error accounts for the propagation of the error in the logarithm.
+ */
+bool checkPow(mt19937 &generator)
+{
+    uniform_real_distribution<double> ptDistr(log(10.), log(7000.)), exponentDistr(-2., 2.);
+    double maxExcess = 0.;
+
+    for (unsigned i = 0; i < 1000000; ++i)
+    {
+        double const x = exp(ptDistr(generator));
+        double const y = exponentDistr(generator);
+        long double const ref = powl(x, y);
+        double const deviation = double(abs(fastExp(y * fastLog(x)) - ref) / ref);
+        double const bound = 3e-16 + 2.5e-16 * abs(y * log(x));
+        maxExcess = max(maxExcess, deviation / bound);
+    }
+
+    cout << "  Maximal ratio of deviation to bound: " << maxExcess << '\n';
+    return (maxExcess < 1.);
+}
+
+
+/**
+ * Checks batched functions
+ *
+ * Results must agree exactly with the scalar versions, also when computed in place. Arguments
+ * outside of the domains of the approximations must be handled correctly.
+ */
+bool checkBatch(mt19937 &generator)
+{
+    uniform_real_distribution<double> distr(-5., 10.);
+    unsigned const n = 300;
+    vector<double> x(n);
+
+    for (auto &value: x)
+        value = exp(distr(generator));
+
+    // Special values at positions that fall into different chunks
+    x[3] = 0.;
+    x[70] = numeric_limits<double>::infinity();
+    x[150] = numeric_limits<double>::denorm_min();
+    x[299] = 1e300;
+
+    vector<double> expArgs(x);
+    expArgs[5] = -800.;
+    expArgs[100] = -numeric_limits<double>::infinity();
+
+    bool pass = true;
+    vector<double> result(n), inPlace;
+
+    mathLogBatch(x.data(), result.data(), n);
+    inPlace = x;
+    mathLogBatch(inPlace.data(), inPlace.data(), n);
+
+    for (unsigned i = 0; i < n; ++i)
+        pass &= (result[i] == mathLog(x[i]) and inPlace[i] == result[i]);
+
+    pass &= (result[3] == -numeric_limits<double>::infinity());
+    pass &= (abs(result[150] - log(x[150])) < 1e-12);
+
+    mathExpBatch(expArgs.data(), result.data(), n);
+    inPlace = expArgs;
+    mathExpBatch(inPlace.data(), inPlace.data(), n);
+
+    for (unsigned i = 0; i < n; ++i)
+        pass &= (result[i] == mathExp(expArgs[i]) and inPlace[i] == result[i]);
+
+    pass &= (result[70] == numeric_limits<double>::infinity() and result[100] == 0.);
+
+    mathPowBatch(x.data(), -0.3, result.data(), n);
+    inPlace = x;
+    mathPowBatch(inPlace.data(), -0.3, inPlace.data(), n);
+
+    for (unsigned i = 0; i < n; ++i)
+        pass &= (result[i] == mathPow(x[i], -0.3) and inPlace[i] == result[i]);
+
+    pass &= (result[3] == numeric_limits<double>::infinity() and result[70] == 0.);
+
+    return pass;
+}
+
+
+/**
+ * Checks batched evaluation of the jet corrections that use the batched functions
+ *
+ * Results of JetCorrStd2P and JetCorrStd3P must agree with the scalar evaluation. The corrections
+ * are also computed in place, i.e. with the same array given for pt and the output, which must
+ * give identical results. The number of points spans several chunks used internally.
+ */
+bool checkJetCorrBatch(mt19937 &generator)
+{
+    uniform_real_distribution<double> distr(log(10.), log(5000.));
+    unsigned const n = 300;
+    vector<double> pts(n);
+
+    for (auto &pt: pts)
+        pt = exp(distr(generator));
+
+    JetCorrStd2P corr2P;
+    corr2P.SetParams({0.02, -0.01});
+    JetCorrStd3P corr3P;
+    corr3P.SetParams({0.02, -0.01, 0.5});
+    bool pass = true;
+
+    for (JetCorrBase const *corrector: {static_cast<JetCorrBase const *>(&corr2P),
+      static_cast<JetCorrBase const *>(&corr3P)})
+    {
+        vector<double> corrections(n), inPlace(pts);
+        corrector->EvalBatch(pts.data(), corrections.data(), n);
+        corrector->EvalBatch(inPlace.data(), inPlace.data(), n);
+
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double const ref = corrector->Eval(pts[i]);
+            pass &= (abs(corrections[i] / ref - 1.) < 1e-14 and inPlace[i] == corrections[i]);
+        }
+    }
+
+    return pass;
+}
+
+
+/**
+ * Estimates the effect on the chi^2
+ *
+ * Pseudo-measurements of the jet correction are generated from the parameterization
+ * 1 + a + b pt^c + (d + e log(pt)) / pt with an uncertainty of 0.1%, and the chi^2 is computed for
+ * shifted parameters with approximate and standard functions.
+ */
+bool checkChi2(mt19937 &generator)
+{
+    uniform_real_distribution<double> ptDistr(log(15.), log(4000.)), paramDistr(-0.02, 0.02);
+    normal_distribution<double> noise(0., 1e-3);
+
+    auto corr = [](double pt, double const *p, bool fast)
+    {
+        double const logPt = (fast) ? fastLog(pt) : log(pt);
+        double const power = (fast) ? fastExp(p[2] * logPt) : pow(pt, p[2]);
+        return 1. + p[0] + p[1] * power + (p[3] + p[4] * logPt) / pt;
+    };
+
+    double const trueParams[] = {0.01, -0.2, -0.3, 0.5, 0.2};
+    vector<double> pts(1000), targets(pts.size());
+
+    for (unsigned i = 0; i < pts.size(); ++i)
+    {
+        pts[i] = exp(ptDistr(generator));
+        targets[i] = corr(pts[i], trueParams, false) * (1. + noise(generator));
+    }
+
+    double maxDeviation = 0.;
+
+    for (unsigned trial = 0; trial < 100; ++trial)
+    {
+        double params[5];
+
+        for (unsigned i = 0; i < 5; ++i)
+            params[i] = trueParams[i] + paramDistr(generator) * abs(trueParams[i]);
+
+        double chi2Ref = 0., chi2Fast = 0.;
+
+        for (unsigned i = 0; i < pts.size(); ++i)
+        {
+            double const sigma = 1e-3 * targets[i];
+            chi2Ref += pow((corr(pts[i], params, false) - targets[i]) / sigma, 2);
+            chi2Fast += pow((corr(pts[i], params, true) - targets[i]) / sigma, 2);
+        }
+
+        maxDeviation = max(maxDeviation, abs(chi2Fast - chi2Ref) / chi2Ref);
+    }
+
+    cout << "  Maximal relative deviation in chi^2: " << maxDeviation << '\n';
+    return (maxDeviation < 1e-10);
+}
+
+
+int main()
+{
+    bool failure = false;
+    mt19937 generator(1234);
+
+    cout << "Library built with fast math: " << ((isFastMathEnabled()) ? "yes" : "no") << '\n';
+
+    cout << "\nLogarithm:\n";
+    bool status = checkLog(generator);
+    printResult(status);
+    failure |= not status;
+
+    cout << "Exponential function:\n";
+    status = checkExp(generator);
+    printResult(status);
+    failure |= not status;
+
+    cout << "Power function:\n";
+    status = checkPow(generator);
+    printResult(status);
+    failure |= not status;
+
+    cout << "Batched functions:\n";
+    status = checkBatch(generator);
+    printResult(status);
+    failure |= not status;
+
+    cout << "Batched jet corrections:\n";
+    status = checkJetCorrBatch(generator);
+    printResult(status);
+    failure |= not status;
+
+    cout << "Effect on chi^2:\n";
+    status = checkChi2(generator);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
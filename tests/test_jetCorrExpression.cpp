@@ -0,0 +1,170 @@
+/**
+ * A unit test for jet corrections defined by formulas.
+ *
+ * Corrections constructed with JetCorrExpression are compared to hand-coded functions and to a
+ * standard functional form. The batched evaluation is compared to the scalar one, and the
+ * symbolic derivatives with respect to the parameters are compared to finite differences.
+ */
+
+#include <JetCorrDefinitions.hpp>
+#include <JetCorrExpression.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Checks if the construction of a correction from the given formula throws an exception
+bool Throws(string const &formula, vector<string> const &paramNames = {})
+{
+    try
+    {
+        if (paramNames.empty())
+            JetCorrExpression corr(formula);
+        else
+            JetCorrExpression corr(formula, paramNames);
+    }
+    catch (runtime_error const &)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    vector<double> ptValues;
+
+    for (double pt = 10.; pt < 5000.; pt *= 1.17)
+        ptValues.emplace_back(pt);
+
+
+    cout << "Log-linear correction with automatically identified parameters:\n";
+    JetCorrExpression logLin("1 + a + b * x");
+    logLin.SetParams({0.01, -0.02});
+    status = (logLin.GetParamNames() == vector<string>{"a", "b"});
+
+    for (double const pt: ptValues)
+        status &= (std::abs(logLin.Eval(pt) - (1.01 - 0.02 * std::log(pt))) < 1e-14);
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Agreement with JetCorrStableLogLin:\n";
+    JetCorrExpression stableLogLin("1 + a * log(pt / 15) + a * ((pt / 15)^-1 - 1)");
+    JetCorrStableLogLin reference(15.);
+    stableLogLin.SetParams({0.03});
+    reference.SetParams({0.03});
+    status = true;
+
+    for (double const pt: ptValues)
+        status &= (std::abs(stableLogLin.Eval(pt) / reference.Eval(pt) - 1) < 1e-14);
+
+    printResult(status);
+    failure |= not status;
+
+
+    string const formula(
+      "exp(-a * x) + b^2 * sqrt(pt) / (1 + c * x^3) + pow(pt, c) * log(pt + b^2)");
+    JetCorrExpression corr(formula, {"a", "b", "c"});
+    vector<double> const params{0.1, -0.3, 0.05};
+    corr.SetParams(params);
+
+
+    cout << "Batched evaluation agrees with scalar one:\n";
+    vector<double> corrections(ptValues.size());
+    corr.EvalBatch(ptValues.data(), corrections.data(), ptValues.size());
+    status = true;
+
+    for (unsigned i = 0; i < ptValues.size(); ++i)
+        status &= (std::abs(corrections[i] / corr.Eval(ptValues[i]) - 1) < 1e-14);
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Derivatives agree with finite differences:\n";
+    status = true;
+
+    for (unsigned iParam = 0; iParam < params.size(); ++iParam)
+    {
+        vector<double> derivatives(ptValues.size());
+        corr.EvalParamDerivativeBatch(iParam, ptValues.data(), derivatives.data(),
+          ptValues.size());
+        double const step = 1e-6;
+
+        for (unsigned i = 0; i < ptValues.size(); ++i)
+        {
+            auto shiftedParams = params;
+            shiftedParams[iParam] += step;
+            corr.SetParams(shiftedParams);
+            double const up = corr.Eval(ptValues[i]);
+            shiftedParams[iParam] -= 2 * step;
+            corr.SetParams(shiftedParams);
+            double const down = corr.Eval(ptValues[i]);
+            corr.SetParams(params);
+
+            double const numeric = (up - down) / (2 * step);
+            double const symbolic = corr.EvalParamDerivative(iParam, ptValues[i]);
+            status &= (std::abs(symbolic - numeric) < 1e-6 * (1 + std::abs(numeric)));
+            status &= (derivatives[i] == symbolic or
+              std::abs(derivatives[i] / symbolic - 1) < 1e-14);
+        }
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Constant subexpressions are folded:\n";
+    JetCorrExpression folded("2^3 * a + 0 * b + log(1)", {"a", "b"});
+    folded.SetParams({0.5, 7.});
+    status = (folded.Eval(100.) == 4. and folded.EvalParamDerivative(0, 100.) == 8. and
+      folded.EvalParamDerivative(1, 100.) == 0.);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Invalid formulas are rejected:\n";
+    status = (Throws("1 + (a") and Throws("1 + a b") and Throws("foo(x)") and
+      Throws("1 + a * x", {"b"}) and Throws("1 + x", {"x"}) and not Throws("1 + a", {"a", "b"}));
+    printResult(status);
+    failure |= not status;
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,312 @@
+/**
+ * A unit test for vectorized numerical kernels.
+ * 
+ * Results of kernels for all instruction sets supported by the CPU are compared against the scalar
+ * reference implementation.
+ */
+
+#include <Kernels.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+    
+    cout << endl;
+}
+
+
+/**
+ * Checks the dot product for the given instruction set against the scalar implementation
+ * 
+ * Arrays of many different lengths are tried in order to exercise the handling of tails. Offsets
+ * of the starting positions check unaligned access. The tolerance is set relative to the sum of
+ * absolute values of the products since the order of the summation differs between the
+ * implementations.
+ */
+bool checkDotProduct(SimdLevel level, mt19937 &generator)
+{
+    uniform_real_distribution<double> distr(-1., 1.);
+    double maxDeviation = 0.;
+    
+    for (unsigned n = 0; n <= 150; ++n)
+    {
+        for (unsigned offset = 0; offset < 3; ++offset)
+        {
+            vector<double> a(n + offset), b(n + offset);
+            
+            for (unsigned i = 0; i < a.size(); ++i)
+            {
+                a[i] = distr(generator);
+                b[i] = distr(generator);
+            }
+            
+            double const ref = dotProduct(SimdLevel::Scalar, a.data() + offset,
+              b.data() + offset, n);
+            double const res = dotProduct(level, a.data() + offset, b.data() + offset, n);
+            
+            double scale = 0.;
+            
+            for (unsigned i = offset; i < a.size(); ++i)
+                scale += abs(a[i] * b[i]);
+            
+            if (scale > 0.)
+                maxDeviation = max(maxDeviation, abs(res - ref) / scale);
+            else if (res != 0.)
+                maxDeviation = numeric_limits<double>::infinity();
+        }
+    }
+    
+    cout << "  Maximal relative deviation: " << maxDeviation << '\n';
+    return (maxDeviation < 1e-14);
+}
+
+
+/**
+ * Checks the compensated dot product for the given instruction set
+ * 
+ * The reference is computed with extended precision. A product of a float and a double is not
+ * exact in double precision, but its rounding error is below the machine epsilon times the
+ * magnitude of the product. Thanks to the compensated summation, the error in the sum does not
+ * grow with the number of terms, and the total deviation is compared with the machine epsilon
+ * times the sum of absolute values of the products.
+ */
+bool checkDotProductCompensated(SimdLevel level, mt19937 &generator)
+{
+    uniform_real_distribution<double> distr(-1., 1.);
+    double maxDeviation = 0.;
+    
+    for (unsigned n = 0; n <= 150; ++n)
+    {
+        for (unsigned offset = 0; offset < 3; ++offset)
+        {
+            vector<float> a(n + offset);
+            vector<double> b(n + offset);
+            
+            for (unsigned i = 0; i < a.size(); ++i)
+            {
+                // Mix very different scales to make the summation challenging
+                a[i] = distr(generator) * ((i % 3 == 0) ? 1e6 : 1.);
+                b[i] = distr(generator);
+            }
+            
+            long double ref = 0.;
+            double scale = 0.;
+            
+            for (unsigned i = offset; i < a.size(); ++i)
+            {
+                ref += (long double)(a[i]) * b[i];
+                scale += abs(a[i] * b[i]);
+            }
+            
+            double const res = dotProductCompensated(level, a.data() + offset, b.data() + offset,
+              n);
+            
+            if (scale > 0.)
+                maxDeviation = max(maxDeviation, double(abs(res - ref) / scale));
+            else if (res != 0.)
+                maxDeviation = numeric_limits<double>::infinity();
+        }
+    }
+    
+    cout << "  Maximal relative deviation: " << maxDeviation << '\n';
+    return (maxDeviation < 1e-15);
+}
+
+
+/**
+ * Checks the paired dot products for the given instruction set
+ *
+ * Each of the two results of the plain kernel is compared against the scalar dot product, and the
+ * results of the compensated kernel are compared against references computed with extended
+ * precision, as in the checks for the unpaired kernels.
+ */
+bool checkDotProductPair(SimdLevel level, mt19937 &generator)
+{
+    uniform_real_distribution<double> distr(-1., 1.);
+    double maxDeviation = 0., maxDeviationCompensated = 0.;
+
+    auto updateDeviation = [](double &maxDev, double res, double ref, double scale)
+    {
+        if (scale > 0.)
+            maxDev = max(maxDev, abs(res - ref) / scale);
+        else if (res != 0.)
+            maxDev = numeric_limits<double>::infinity();
+    };
+
+    for (unsigned n = 0; n <= 150; ++n)
+    {
+        for (unsigned offset = 0; offset < 3; ++offset)
+        {
+            vector<double> a(n + offset), b1(n + offset), b2(n + offset);
+            vector<float> aCompact(n + offset);
+
+            for (unsigned i = 0; i < a.size(); ++i)
+            {
+                a[i] = distr(generator);
+                b1[i] = distr(generator);
+                b2[i] = distr(generator);
+                aCompact[i] = distr(generator) * ((i % 3 == 0) ? 1e6 : 1.);
+            }
+
+            auto const res = dotProductPair(level, a.data() + offset, b1.data() + offset,
+              b2.data() + offset, n);
+            auto const resCompensated = dotProductCompensatedPair(level, aCompact.data() + offset,
+              b1.data() + offset, b2.data() + offset, n);
+
+            for (unsigned k = 0; k < 2; ++k)
+            {
+                vector<double> const &b = (k == 0) ? b1 : b2;
+                double const ref = dotProduct(SimdLevel::Scalar, a.data() + offset,
+                  b.data() + offset, n);
+                long double refCompensated = 0.;
+                double scale = 0., scaleCompensated = 0.;
+
+                for (unsigned i = offset; i < a.size(); ++i)
+                {
+                    scale += abs(a[i] * b[i]);
+                    refCompensated += (long double)(aCompact[i]) * b[i];
+                    scaleCompensated += abs(aCompact[i] * b[i]);
+                }
+
+                updateDeviation(maxDeviation, res[k], ref, scale);
+                updateDeviation(maxDeviationCompensated, resCompensated[k],
+                  double(refCompensated), scaleCompensated);
+            }
+        }
+    }
+
+    cout << "  Maximal relative deviation: " << maxDeviation << ", compensated: " <<
+      maxDeviationCompensated << '\n';
+    return (maxDeviation < 1e-14 and maxDeviationCompensated < 1e-15);
+}
+
+
+/**
+ * Checks the matrix product for the given instruction set against a naive implementation
+ *
+ * Shapes are chosen to exercise partial tiles of rows and columns, and the first matrix is stored
+ * with a stride larger than the number of its columns. Both double- and single-precision first
+ * matrices are tried.
+ */
+bool checkMatrixProduct(SimdLevel level, mt19937 &generator)
+{
+    uniform_real_distribution<double> distr(-1., 1.);
+    double maxDeviation = 0.;
+
+    for (unsigned m: {1u, 3u, 4u, 9u, 17u})
+    {
+        for (unsigned n: {0u, 1u, 7u, 40u})
+        {
+            for (unsigned k: {1u, 3u, 8u, 11u, 16u})
+            {
+                unsigned const lda = n + 2;
+                vector<double> a(m * lda), b(n * k), c(m * k), cCompact(m * k);
+                vector<float> aCompact(a.size());
+
+                for (unsigned i = 0; i < a.size(); ++i)
+                {
+                    aCompact[i] = distr(generator);
+                    a[i] = aCompact[i];
+                }
+
+                for (auto &value: b)
+                    value = distr(generator);
+
+                matrixProduct(level, a.data(), lda, b.data(), c.data(), m, n, k);
+                matrixProduct(level, aCompact.data(), lda, b.data(), cCompact.data(), m, n, k);
+
+                for (unsigned i = 0; i < m; ++i)
+                    for (unsigned j = 0; j < k; ++j)
+                    {
+                        double ref = 0., scale = 0.;
+
+                        for (unsigned l = 0; l < n; ++l)
+                        {
+                            ref += a[i * lda + l] * b[l * k + j];
+                            scale += abs(a[i * lda + l] * b[l * k + j]);
+                        }
+
+                        for (double const res: {c[i * k + j], cCompact[i * k + j]})
+                        {
+                            if (scale > 0.)
+                                maxDeviation = max(maxDeviation, abs(res - ref) / scale);
+                            else if (res != 0.)
+                                maxDeviation = numeric_limits<double>::infinity();
+                        }
+                    }
+            }
+        }
+    }
+
+    cout << "  Maximal relative deviation: " << maxDeviation << '\n';
+    return (maxDeviation < 1e-14);
+}
+
+
+int main()
+{
+    bool failure = false;
+    mt19937 generator(1234);
+    
+    cout << "Detected instruction set: " << simdLevelName(detectSimdLevel()) << '\n';
+    cout << "Instruction set in use: " << simdLevelName(getSimdLevel()) << '\n';
+    
+    for (auto const level: {SimdLevel::Scalar, SimdLevel::AVX2, SimdLevel::AVX512})
+    {
+        cout << "\nDot product with " << simdLevelName(level) << " kernel:\n";
+        
+        if (not isSimdLevelSupported(level))
+        {
+            cout << "  Not supported by the CPU. Skipping.\n";
+            continue;
+        }
+        
+        bool status = checkDotProduct(level, generator);
+        printResult(status);
+        failure |= not status;
+        
+        cout << "Compensated dot product with " << simdLevelName(level) << " kernel:\n";
+        status = checkDotProductCompensated(level, generator);
+        printResult(status);
+        failure |= not status;
+        
+        cout << "Paired dot products with " << simdLevelName(level) << " kernel:\n";
+        status = checkDotProductPair(level, generator);
+        printResult(status);
+        failure |= not status;
+        
+        cout << "Matrix product with " << simdLevelName(level) << " kernel:\n";
+        status = checkMatrixProduct(level, generator);
+        printResult(status);
+        failure |= not status;
+    }
+    
+    
+    cout << endl;
+    
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,335 @@
+/**
+ * A unit test for the simultaneous fit in several data-taking periods.
+ *
+ * Synthetic measurements in three periods are combined, with one nuisance shared among all
+ * periods and one specific to each period. The layout of parameters and the value of the loss
+ * function are checked against separate loss functions for individual periods. The gradient and
+ * the covariance matrix, which exploit the block structure of the problem, are compared with
+ * computations that treat all parameters as a dense problem. Clones of the loss function are
+ * evaluated concurrently with the original.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrExpression.hpp>
+#include <MultiPeriodLossFunction.hpp>
+#include <Nuisances.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+using namespace std;
+
+
+/**
+ * Creates a synthetic measurement for a single period
+ *
+ * The measurement depends on a nuisance shared among periods and a nuisance specific to the
+ * period. Targets are constructed from a correction 1 + a + b * log(pt) and a scale factor, with a
+ * small perturbation added.
+ */
+unique_ptr<ToyMeasurement> CreateMeasurement(NuisanceDefinitions &nuisanceDefs, double a,
+  double b, double scale)
+{
+    auto const pts = GeometricPoints(20., 2000., 1.2);
+    vector<double> targets;
+
+    for (auto const &pt: pts)
+        targets.emplace_back((1. + a + b * std::log(pt)) * scale + 0.002 * std::sin(pt));
+
+    return make_unique<ToyMeasurement>(nuisanceDefs, pts, targets, 0.01,
+      vector<pair<string, double>>{{"JER", 0.02}, {"Purity", 0.01}});
+}
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Inverts a matrix with Gauss-Jordan elimination with full pivoting of rows
+vector<double> Invert(vector<double> matrix, unsigned n)
+{
+    vector<double> inverse(n * n, 0.);
+
+    for (unsigned i = 0; i < n; ++i)
+        inverse[i * n + i] = 1.;
+
+    for (unsigned col = 0; col < n; ++col)
+    {
+        unsigned pivot = col;
+
+        for (unsigned row = col + 1; row < n; ++row)
+            if (abs(matrix[row * n + col]) > abs(matrix[pivot * n + col]))
+                pivot = row;
+
+        for (unsigned k = 0; k < n; ++k)
+        {
+            swap(matrix[col * n + k], matrix[pivot * n + k]);
+            swap(inverse[col * n + k], inverse[pivot * n + k]);
+        }
+
+        double const diag = matrix[col * n + col];
+
+        for (unsigned k = 0; k < n; ++k)
+        {
+            matrix[col * n + k] /= diag;
+            inverse[col * n + k] /= diag;
+        }
+
+        for (unsigned row = 0; row < n; ++row)
+        {
+            if (row == col)
+                continue;
+
+            double const factor = matrix[row * n + col];
+
+            for (unsigned k = 0; k < n; ++k)
+            {
+                matrix[row * n + k] -= factor * matrix[col * n + k];
+                inverse[row * n + k] -= factor * inverse[col * n + k];
+            }
+        }
+    }
+
+    return inverse;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    vector<string> const periodNames{"BCD", "EF1", "F2GH"};
+
+    // Point at which the loss function is evaluated. It contains parameters of the correction and
+    //the specific nuisance for each period, followed by the shared nuisance. The targets in
+    //the measurements are constructed to be close to this point, so that the Hessian is
+    //positive-definite there.
+    unsigned const numParams = 3 * periodNames.size() + 1;
+    vector<double> x(numParams);
+
+    for (unsigned i = 0; i < numParams; ++i)
+        x[i] = 0.05 * std::cos(1. + i);
+
+    vector<NuisanceDefinitions> nuisanceDefs(periodNames.size());
+    vector<unique_ptr<ToyMeasurement>> measurements;
+
+    for (unsigned p = 0; p < periodNames.size(); ++p)
+    {
+        double const scale = 1. + 0.02 * x[numParams - 1] + 0.01 * x[3 * p + 2];
+        measurements.emplace_back(CreateMeasurement(nuisanceDefs[p], x[3 * p], x[3 * p + 1],
+          scale));
+    }
+
+    auto const createLossFunc = [&](unsigned numThreads)
+    {
+        auto lossFunc = make_unique<MultiPeriodLossFunction>(vector<string>{"JE.*"},
+          numThreads);
+
+        for (unsigned p = 0; p < periodNames.size(); ++p)
+            lossFunc->AddPeriod(periodNames[p], make_unique<JetCorrExpression>("1 + a + b * x"),
+              nuisanceDefs[p], {measurements[p].get()});
+
+        return lossFunc;
+    };
+
+    auto lossFunc = createLossFunc(1);
+
+
+    cout << "Layout of parameters:\n";
+    vector<string> names;
+
+    for (unsigned i = 0; i < numParams; ++i)
+        names.emplace_back(lossFunc->GetParamName(i));
+
+    status = (lossFunc->NDim() == numParams);
+    status &= (names == vector<string>{"p0_BCD", "p1_BCD", "Purity_BCD", "p0_EF1", "p1_EF1",
+      "Purity_EF1", "p0_F2GH", "p1_F2GH", "Purity_F2GH", "JER"});
+    status &= (lossFunc->GetPeriodOffset(1) == 3 and lossFunc->IsShared("JER") and
+      not lossFunc->IsShared("Purity"));
+    status &= (lossFunc->GetNDF() == 3 * measurements[0]->GetDim() - numParams);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Loss function against separate periods:\n";
+    double refLoss = x[numParams - 1] * x[numParams - 1];
+
+    for (unsigned p = 0; p < periodNames.size(); ++p)
+    {
+        CombLossFunction periodLossFunc(make_unique<JetCorrExpression>("1 + a + b * x"),
+          nuisanceDefs[p]);
+        periodLossFunc.AddMeasurement(measurements[p].get());
+
+        // Parameters of the correction and the nuisances in the order of nuisanceDefs[p]
+        unsigned const offset = 3 * p;
+        vector<double> const point{x[offset], x[offset + 1], x[numParams - 1], x[offset + 2]};
+
+        // Remove the penalty for the shared nuisance, which is only counted once
+        refLoss += periodLossFunc.Eval(point) - x[numParams - 1] * x[numParams - 1];
+    }
+
+    double const loss = lossFunc->EvalRawInput(x.data());
+    cout << "  " << loss << " vs " << refLoss << '\n';
+    status = (abs(loss / refLoss - 1) < 1e-12);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Block-sparse gradient against dense finite differences:\n";
+    vector<double> grad(numParams);
+    lossFunc->Gradient(x.data(), grad.data());
+    status = true;
+
+    for (unsigned i = 0; i < numParams; ++i)
+    {
+        double const refGrad = lossFunc->Derivative(x.data(), i);
+        status &= (abs(grad[i] - refGrad) < 1e-5 * (1. + abs(refGrad)));
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Gradient with 3 threads against single thread:\n";
+    auto parallelLossFunc = createLossFunc(3);
+    vector<double> parallelGrad(numParams);
+    status = (parallelLossFunc->GetNumThreads() == 3);
+
+    for (unsigned trial = 0; trial < 20; ++trial)
+    {
+        vector<double> point(x);
+
+        for (auto &value: point)
+            value += 1e-3 * trial;
+
+        lossFunc->Gradient(point.data(), grad.data());
+        parallelLossFunc->Gradient(point.data(), parallelGrad.data());
+        status &= (grad == parallelGrad);
+        status &= (lossFunc->EvalRawInput(point.data()) ==
+          parallelLossFunc->EvalRawInput(point.data()));
+    }
+
+    unique_ptr<ROOT::Math::IMultiGenFunction> clone(parallelLossFunc->Clone());
+    status &= ((*clone)(x.data()) == lossFunc->EvalRawInput(x.data()));
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Clones evaluated concurrently:\n";
+
+    // The synthetic measurement uses a mutable buffer, so clones that shared measurements with the
+    //original would produce garbage when evaluated at the same time
+    unsigned const numClones = 4, numTrials = 200;
+    vector<unique_ptr<ROOT::Math::IMultiGenFunction>> clones;
+    vector<vector<double>> cloneLosses(numClones, vector<double>(numTrials));
+
+    for (unsigned i = 0; i < numClones; ++i)
+        clones.emplace_back(lossFunc->Clone());
+
+    auto const trialPoint = [&x](unsigned trial)
+    {
+        vector<double> point(x);
+
+        for (auto &value: point)
+            value += 1e-4 * trial;
+
+        return point;
+    };
+
+    vector<thread> threads;
+
+    for (unsigned i = 0; i < numClones; ++i)
+        threads.emplace_back([&, i]()
+        {
+            for (unsigned trial = 0; trial < numTrials; ++trial)
+                cloneLosses[i][trial] = (*clones[i])(trialPoint(trial).data());
+        });
+
+    // The original is evaluated at the same time as its clones
+    vector<double> refLosses(numTrials);
+
+    for (unsigned trial = 0; trial < numTrials; ++trial)
+        refLosses[trial] = lossFunc->EvalRawInput(trialPoint(trial).data());
+
+    for (auto &t: threads)
+        t.join();
+
+    status = true;
+
+    for (auto const &losses: cloneLosses)
+        status &= (losses == refLosses);
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Block-structured covariance against dense inversion:\n";
+    auto const covariance = parallelLossFunc->ComputeCovariance(x.data());
+
+    // Dense Hessian of the full loss function computed from its gradient
+    vector<double> hessian(numParams * numParams);
+    double const step = 1e-4;
+
+    for (unsigned j = 0; j < numParams; ++j)
+    {
+        vector<double> up(x), down(x), gradUp(numParams), gradDown(numParams);
+        up[j] += step;
+        down[j] -= step;
+        lossFunc->Gradient(up.data(), gradUp.data());
+        lossFunc->Gradient(down.data(), gradDown.data());
+
+        for (unsigned i = 0; i < numParams; ++i)
+            hessian[i * numParams + j] = (gradUp[i] - gradDown[i]) / (2 * step);
+    }
+
+    auto const refCovariance = Invert(hessian, numParams);
+    double maxDeviation = 0.;
+    status = true;
+
+    for (unsigned i = 0; i < numParams; ++i)
+        for (unsigned j = 0; j < numParams; ++j)
+        {
+            double const scale = sqrt(refCovariance[i * numParams + i] *
+              refCovariance[j * numParams + j]);
+            maxDeviation = max(maxDeviation,
+              abs(covariance[i * numParams + j] - 2 * refCovariance[i * numParams + j]) / scale);
+            status &= (covariance[i * numParams + j] == covariance[j * numParams + i]);
+        }
+
+    cout << "  Maximal deviation relative to uncertainties: " << maxDeviation << '\n';
+    status &= (maxDeviation < 1e-4);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
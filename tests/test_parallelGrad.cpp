@@ -0,0 +1,185 @@
+/**
+ * A unit test for the parallel computation of the gradient of the loss function.
+ *
+ * A synthetic measurement with a known analytic gradient is used. The numerical gradient computed
+ * with several threads is compared with the analytic one and with the gradient computed with a
+ * single thread and with the gradient computed by evaluating the loss function in batches.
+ * Propagation of exceptions from worker threads is also checked.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <Nuisances.hpp>
+#include <ParallelGradFunction.hpp>
+#include <ThreadPool.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+
+using namespace std;
+
+
+/**
+ * Analytic gradient of the loss function with respect to the parameter of JetCorrStableLogLin and
+ * the nuisance parameter, for the measurement constructed in main
+ */
+vector<double> Gradient(vector<double> const &pts, double sigma, double systEffect, double param,
+  double nuisance)
+{
+    // JetCorrStableLogLin with ptMin = 15 is 1 + p * (log(pt / 15) + 15 / pt - 1)
+    double const scale = 1. + systEffect * nuisance;
+    vector<double> grad(2, 0.);
+
+    for (auto const &pt: pts)
+    {
+        double const shape = log(pt / 15.) + 15. / pt - 1.;
+        double const corr = 1. + param * shape;
+        double const residual = (corr * scale - 1.) / sigma;
+
+        grad[0] += 2 * residual * shape * scale / sigma;
+        grad[1] += 2 * residual * corr * systEffect / sigma;
+    }
+
+    // Contribution from the penalty term for the nuisance parameter
+    grad[1] += 2 * nuisance;
+
+    return grad;
+}
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+int main()
+{
+    bool failure = false;
+
+    // The measurement computes chi^2 = sum_i (corr(pt_i) * (1 + s * n) - 1)^2 / sigma^2
+    auto const pts = GeometricPoints(20., 2000., 1.1);
+    double const sigma = 0.01, systEffect = 0.02;
+    NuisanceDefinitions nuisanceDefs;
+    ToyMeasurement measurement(nuisanceDefs, pts, vector<double>(pts.size(), 1.), sigma,
+      {{"toy", systEffect}});
+    CombLossFunction lossFunc(make_unique<JetCorrStableLogLin>(), nuisanceDefs);
+    lossFunc.AddMeasurement(&measurement);
+
+    double const x[] = {0.02, -0.7};
+    auto const refGrad = Gradient(pts, sigma, systEffect, x[0], x[1]);
+
+
+    cout << "Numerical gradient with 4 threads against analytic one:\n";
+    ParallelGradFunction parallelFunc(lossFunc, 4);
+    double grad[2];
+    parallelFunc.Gradient(x, grad);
+    double maxDeviation = 0.;
+
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        cout << "  " << grad[i] << " vs " << refGrad[i] << '\n';
+        maxDeviation = max(maxDeviation, abs(grad[i] / refGrad[i] - 1));
+    }
+
+    bool status = (parallelFunc.GetNumThreads() == 4 and maxDeviation < 1e-6);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Gradient with 4 threads against single thread:\n";
+    ParallelGradFunction serialFunc(lossFunc, 1);
+    double serialGrad[2];
+    status = true;
+
+    // Repeat the computation to make sure the contexts are reused correctly
+    for (unsigned trial = 0; trial < 100; ++trial)
+    {
+        double const point[] = {x[0] + 1e-3 * trial, x[1] + 1e-2 * trial};
+        parallelFunc.Gradient(point, grad);
+        serialFunc.Gradient(point, serialGrad);
+        status &= (grad[0] == serialGrad[0] and grad[1] == serialGrad[1]);
+    }
+
+    unique_ptr<ROOT::Math::IMultiGenFunction> clone(parallelFunc.Clone());
+    status &= ((*clone)(x) == lossFunc.EvalRawInput(x));
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Gradient evaluated in batches against unbatched one:\n";
+    ParallelGradFunction batchFunc(lossFunc, 2);
+
+    // The stencil contains four points, so that the last batch is incomplete
+    batchFunc.SetBatchSize(3);
+    double batchGrad[2];
+    batchFunc.Gradient(x, batchGrad);
+    serialFunc.Gradient(x, serialGrad);
+    status = (batchFunc.GetBatchSize() == 3 and batchGrad[0] == serialGrad[0] and
+      batchGrad[1] == serialGrad[1]);
+
+    try
+    {
+        batchFunc.SetBatchSize(CombLossFunction::maxBatchSize + 1);
+        status = false;
+    }
+    catch (runtime_error const &)
+    {}
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Propagation of exceptions from worker threads:\n";
+    ThreadPool threadPool(4);
+    status = false;
+
+    try
+    {
+        threadPool.Run(100, [](unsigned task, unsigned)
+        {
+            if (task == 57)
+                throw runtime_error("Task 57 failed.");
+        });
+    }
+    catch (runtime_error const &e)
+    {
+        status = (string(e.what()) == "Task 57 failed.");
+    }
+
+    // The pool must remain usable after an exception
+    vector<unsigned> counts(1000, 0);
+    threadPool.Run(counts.size(), [&counts](unsigned task, unsigned){++counts[task];});
+
+    for (auto const &count: counts)
+        status &= (count == 1);
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,138 @@
+/**
+ * A unit test for the parallel computation of MINOS errors.
+ *
+ * A synthetic measurement in which the jet correction is multiplied by a factor depending on a
+ * nuisance parameter is fitted. Since the loss function is not quadratic in the parameters, the
+ * MINOS errors for the parameter of the correction are asymmetric, by about 4%. Errors computed
+ * with several threads are compared with the ones computed with a single thread and with the ones
+ * found by Minuit2 sequentially. A small tolerance is used, which bounds the difference from the
+ * latter.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <Nuisances.hpp>
+#include <ParallelMinos.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <Math/Functor.h>
+#include <Minuit2/Minuit2Minimizer.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    // The measurement computes chi^2 = sum_i (corr(pt_i) * (1 + s * n) - target_i)^2 / sigma^2.
+    //The targets are chosen so that the fitted parameters are away from zero.
+    auto const pts = GeometricPoints(20., 2000., 1.5);
+    vector<double> targets;
+
+    for (auto const &pt: pts)
+        targets.emplace_back(1.02 + 0.01 * log(pt / 15.));
+
+    NuisanceDefinitions nuisanceDefs;
+    ToyMeasurement measurement(nuisanceDefs, pts, targets, 0.05, {{"toy", 0.2}});
+    CombLossFunction lossFunc(make_unique<JetCorrStableLogLin>(), nuisanceDefs);
+    lossFunc.AddMeasurement(&measurement);
+    unsigned const numParams = lossFunc.GetNumParams();
+
+    ROOT::Minuit2::Minuit2Minimizer minimizer;
+    ROOT::Math::Functor func(&lossFunc, &CombLossFunction::EvalRawInput, numParams);
+    minimizer.SetFunction(func);
+    minimizer.SetStrategy(1);
+    minimizer.SetErrorDef(1.);
+    minimizer.SetTolerance(1e-4);
+    minimizer.SetPrintLevel(0);
+    minimizer.SetVariable(0, "p0", 0., 1e-2);
+    minimizer.SetVariableLimits(0, -1., 1.);
+    minimizer.SetVariable(1, "toy", 0., 1.);
+    minimizer.SetVariableLimits(1, -5., 5.);
+    minimizer.Minimize();
+
+
+    cout << "Errors are asymmetric and agree between one and several threads:\n";
+    auto const serialIntervals = ParallelMinos(lossFunc, 1).Run(minimizer);
+    ParallelMinos parallelMinos(lossFunc, 3);
+    auto const intervals = parallelMinos.Run(minimizer);
+
+    status = (intervals.size() == numParams and parallelMinos.GetNumThreads() == 3);
+
+    for (unsigned i = 0; i < intervals.size() and status; ++i)
+    {
+        auto const &interval = intervals[i];
+        auto const &serialInterval = serialIntervals[i];
+        cout << "  " << minimizer.VariableName(i) << ": " << interval.lower << " +" <<
+          interval.upper << '\n';
+
+        status &= (interval.lowerValid and interval.upperValid and interval.lower < 0. and
+          interval.upper > 0.);
+
+        // The profiled loss function is visibly asymmetric only for the parameter of the jet
+        //correction
+        if (i == 0)
+            status &= (abs(interval.upper + interval.lower) > 1e-2 * interval.upper);
+
+        status &= (abs(interval.lower / serialInterval.lower - 1.) < 1e-6 and
+          abs(interval.upper / serialInterval.upper - 1.) < 1e-6);
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Errors agree with sequential computation by Minuit2:\n";
+    status = true;
+
+    for (unsigned i = 0; i < numParams; ++i)
+    {
+        double errLow, errUp;
+        status &= minimizer.GetMinosError(i, errLow, errUp);
+
+        // Both computations start from the same minimum. Crossings are found with the same
+        //relative tolerance, which thus bounds the difference.
+        double const tolerance = minimizer.Tolerance();
+        cout << "  " << minimizer.VariableName(i) << ": " << errLow << " +" << errUp << '\n';
+        status &= (abs(intervals[i].lower / errLow - 1.) < tolerance and
+          abs(intervals[i].upper / errUp - 1.) < tolerance);
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
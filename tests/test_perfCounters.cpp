@@ -0,0 +1,138 @@
+/**
+ * A unit test for hardware performance counters.
+ *
+ * Hardware counters are often unavailable, for instance, in containers. In that case the test
+ * checks that counting stays disabled and instrumented regions are not recorded. Otherwise, a
+ * region is executed in several threads, and the aggregated counts are checked for consistency.
+ */
+
+#include <PerfCounters.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Performs some computation in an instrumented region
+double Work(unsigned n)
+{
+    static PerfRegion region("Work");
+    PerfScope scope(region);
+    double sum = 0.;
+
+    for (unsigned i = 0; i < n; ++i)
+        sum += std::sqrt(double(i));
+
+    return sum;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    double sum = 0.;
+
+
+    cout << "Regions are not recorded while counting is disabled:\n";
+    sum += Work(1000);
+    status = PerfCounters::GetSummary().empty();
+    printResult(status);
+    failure |= not status;
+
+
+    bool const enabled = PerfCounters::Enable();
+    cout << PerfCounters::GetStatus() << '\n';
+
+    if (not enabled)
+    {
+        cout << "Counting stays disabled when counters are not available:\n";
+        sum += Work(1000);
+        status = (not PerfCounters::IsEnabled() and PerfCounters::GetSummary().empty());
+        printResult(status);
+        failure |= not status;
+    }
+    else
+    {
+        cout << "Counts aggregated over threads:\n";
+        vector<thread> threads;
+
+        for (unsigned i = 0; i < 4; ++i)
+            threads.emplace_back([&sum, i]()
+            {
+                double localSum = 0.;
+
+                for (unsigned j = 0; j < 25; ++j)
+                    localSum += Work(10000);
+
+                if (i == 0)
+                    sum += localSum;
+            });
+
+        for (auto &t: threads)
+            t.join();
+
+        auto const summary = PerfCounters::GetSummary();
+        status = (summary.size() == 1 and summary[0].name == "Work" and summary[0].calls == 100);
+
+        if (status)
+        {
+            auto const &counts = summary[0].counts;
+            status &= (counts[unsigned(PerfCounters::Event::Cycles)] > 0.);
+
+            // Every iteration of the loop needs at least a few instructions
+            double const instructions = counts[unsigned(PerfCounters::Event::Instructions)];
+            status &= (instructions < 0. or instructions > 100 * 10000);
+
+            double const branches = counts[unsigned(PerfCounters::Event::Branches)];
+            double const branchMisses = counts[unsigned(PerfCounters::Event::BranchMisses)];
+            status &= (branches < 0. or branchMisses <= branches);
+        }
+
+        PerfCounters::Report(cout);
+        printResult(status);
+        failure |= not status;
+
+
+        cout << "Reset and disabling:\n";
+        PerfCounters::Reset();
+        status = PerfCounters::GetSummary().empty();
+        PerfCounters::Disable();
+        sum += Work(1000);
+        status &= PerfCounters::GetSummary().empty();
+        printResult(status);
+        failure |= not status;
+    }
+
+
+    // Use the result of the computation so that it is not optimized away
+    cout << "\nChecksum: " << sum << '\n';
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,105 @@
+/**
+ * A unit test for the photon+jet measurement.
+ *
+ * PhotonJetBinnedSum is evaluated at a number of points in the space of parameters of the jet
+ * correction and the photon scale nuisance. Results obtained with several threads and with a
+ * cloned measurement must be bitwise identical to the single-threaded evaluation. A small random
+ * input file, in which some photon bins and some cells of the jet pt sums are empty, is generated
+ * on the fly.
+ */
+
+#include <JetCorrDefinitions.hpp>
+#include <PhotonJetBinnedSum.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/**
+ * Evaluates the given measurements at a number of points and checks that the results are bitwise
+ * identical
+ */
+bool CheckAgreement(MeasurementBase const &reference, MeasurementBase const &measurement,
+  NuisanceDefinitions const &nuisanceDefs)
+{
+    JetCorrStd2P corrector;
+    Nuisances nuisances(nuisanceDefs);
+    bool pass = true;
+
+    for (int i = 0; i < 10; ++i)
+    {
+        corrector.SetParams({0.02 * std::sin(i), 0.01 * std::cos(3. * i)});
+        nuisances["PhotonScale"] = 0.3 * i - 1.5;
+        pass &= (reference.Eval(corrector, nuisances) == measurement.Eval(corrector, nuisances));
+    }
+
+    return pass;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    string const fileName("test_photonJet_inputs.root");
+    mt19937 generator(1);
+    WritePhotonJetInputs(fileName, generator);
+
+
+    for (auto const method: {PhotonJetBinnedSum::Method::PtBal, PhotonJetBinnedSum::Method::MPF})
+    {
+        string const label((method == PhotonJetBinnedSum::Method::PtBal) ? "PtBal" : "MPF");
+        NuisanceDefinitions nuisanceDefs;
+        PhotonJetBinnedSum serial(fileName, method, nuisanceDefs);
+        PhotonJetBinnedSum parallel(fileName, method, nuisanceDefs);
+        parallel.SetNumThreads(4);
+
+        cout << "Evaluation with 4 threads agrees with single thread for " << label << ":\n";
+        status = CheckAgreement(serial, parallel, nuisanceDefs);
+        printResult(status);
+        failure |= not status;
+
+        cout << "Cloned measurement agrees with original for " << label << ":\n";
+        auto const clone = parallel.Clone();
+        status = CheckAgreement(serial, *clone, nuisanceDefs);
+        printResult(status);
+        failure |= not status;
+    }
+
+
+    std::remove(fileName.c_str());
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,201 @@
+/**
+ * A unit test for the append-only record files.
+ *
+ * Records are written with RecordFile, and the file is reopened to check that they are read back,
+ * also when the index is outdated. A partly written record and a record with a damaged checksum at
+ * the end of the file must be discarded. Reopening with a different signature must fail. The
+ * signature of a fixed grid is compared with the value computed by function grid_signature from
+ * python/records.py, which shares the format.
+ */
+
+#include <RecordFile.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Values stored in the record with the given key
+vector<double> RecordValues(uint64_t key)
+{
+    return {double(key), 0.5 * key, -1. / (key + 1)};
+}
+
+
+/// Checks that the file contains exactly the records with keys below the given number
+bool CheckRecords(RecordFile &records, uint64_t numRecords)
+{
+    auto const values = records.Read();
+
+    if (records.GetNumRecords() != numRecords or values.size() != numRecords)
+        return false;
+
+    for (uint64_t key = 0; key < numRecords; ++key)
+    {
+        auto const res = values.find(key);
+
+        if (res == values.end() or res->second != RecordValues(key))
+            return false;
+    }
+
+    return true;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    string const path("test_recordFile.rec");
+    unsigned const numValues = 3;
+
+    // Reference value computed with
+    //grid_signature([0.1, 0.2, 0.3], [-1., 2.], definition={'a': 1})
+    cout << "Signature agrees with Python version:\n";
+    uint64_t const signature = RecordFile::GridSignature({{0.1, 0.2, 0.3}, {-1., 2.}},
+      "{\"a\": 1}");
+    status = (signature == 595628370550121692ull);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Records are read back after reopening:\n";
+    remove(path.c_str());
+
+    {
+        // The index is updated every four records, so the last ones are validated on opening
+        RecordFile records(path, numValues, signature, 100, 10., 4);
+
+        for (uint64_t key = 0; key < 10; ++key)
+            records.Append(key, RecordValues(key));
+
+        status = CheckRecords(records, 10);
+    }
+
+    {
+        RecordFile records(path, numValues, signature);
+        status &= CheckRecords(records, 10);
+
+        for (uint64_t key = 10; key < 12; ++key)
+            records.Append(key, RecordValues(key));
+    }
+
+    {
+        RecordFile records(path, numValues, signature);
+        status &= CheckRecords(records, 12);
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Damaged records are discarded:\n";
+
+    {
+        // Partly written record
+        ofstream file(path, ios::binary | ios::app);
+        file.write("abcdefghij", 10);
+    }
+
+    {
+        RecordFile records(path, numValues, signature);
+        status = CheckRecords(records, 12);
+        records.Append(12, RecordValues(12));
+    }
+
+    {
+        // Flip a bit in the last value of the last record
+        fstream file(path, ios::binary | ios::in | ios::out);
+        file.seekp(-9, ios::end);
+        char byte;
+        file.read(&byte, 1);
+        byte ^= 1;
+        file.seekp(-9, ios::end);
+        file.write(&byte, 1);
+    }
+
+    {
+        // The index written on closing covers the last record. Remove it to force validation.
+        remove((path + ".idx").c_str());
+        RecordFile records(path, numValues, signature);
+        status &= CheckRecords(records, 12);
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Files for a different computation are rejected:\n";
+
+    for (auto const &[otherNumValues, otherSignature]:
+      {pair<unsigned, uint64_t>{numValues, signature + 1}, {numValues + 1, signature}})
+    {
+        status = false;
+
+        try
+        {
+            RecordFile records(path, otherNumValues, otherSignature);
+        }
+        catch (runtime_error const &)
+        {
+            status = true;
+        }
+
+        printResult(status);
+        failure |= not status;
+    }
+
+
+    cout << "Records with a wrong number of values are rejected:\n";
+    status = false;
+
+    try
+    {
+        RecordFile records(path, numValues, signature);
+        records.Append(100, {1.});
+    }
+    catch (runtime_error const &)
+    {
+        status = true;
+    }
+
+    printResult(status);
+    failure |= not status;
+
+    remove(path.c_str());
+    remove((path + ".idx").c_str());
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,201 @@
+/**
+ * A unit test for the storage of fit results in NumPy format.
+ *
+ * Records are written with NpyResultSink, and the produced files are read back and checked against
+ * the written values. The header of each file must report the number of records written before the
+ * last flush.
+ */
+
+#include <ResultSink.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Reads a file in NumPy format, returning its header and data
+pair<string, vector<char>> ReadNpy(string const &path)
+{
+    ifstream file(path, ios::binary);
+    vector<char> const contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    if (contents.size() < 10 or memcmp(contents.data(), "\x93NUMPY", 6) != 0)
+        return {"", {}};
+
+    size_t const headerLength = (unsigned char)(contents[8]) +
+      256 * (unsigned char)(contents[9]);
+
+    if (contents.size() < 10 + headerLength)
+        return {"", {}};
+
+    return {string(contents.data() + 10, headerLength),
+      vector<char>(contents.begin() + 10 + headerLength, contents.end())};
+}
+
+
+/// Checks that the header of a NumPy file reports the given shape
+bool CheckShape(string const &header, string const &shape)
+{
+    return (header.find("'shape': " + shape + ",") != string::npos and header.back() == '\n' and
+      (header.size() + 10) % 64 == 0);
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    string const directory("test_resultSink_output");
+    unsigned const numParams = 3, numRecords = 20;
+
+    NpyResultSink sink(directory, {"p0", "p1", "nuisance"});
+    FitRecord record(numParams);
+
+    auto fillRecord = [&record](unsigned i)
+    {
+        record.key = 10 * i;
+
+        for (unsigned j = 0; j < numParams; ++j)
+        {
+            record.params[j] = i + 0.1 * j;
+            record.errors[j] = 0.01 * j;
+        }
+
+        for (unsigned j = 0; j < numParams * numParams; ++j)
+            record.covariance[j] = 100. * i + j;
+
+        record.chi2 = 0.5 * i;
+        record.ndf = i;
+        record.status = -int(i);
+        record.time = 1e-3 * i;
+    };
+
+
+    cout << "Header is updated at a flush:\n";
+
+    for (unsigned i = 0; i < numRecords / 2; ++i)
+    {
+        fillRecord(i);
+        sink.Write(record);
+    }
+
+    sink.Flush();
+    status = CheckShape(ReadNpy(directory + "/chi2.npy").first, "(10,)");
+    status &= CheckShape(ReadNpy(directory + "/covariance.npy").first, "(10, 3, 3)");
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Records with a wrong number of parameters are rejected:\n";
+    status = false;
+
+    try
+    {
+        sink.Write(FitRecord(numParams + 1));
+    }
+    catch (runtime_error const &)
+    {
+        status = true;
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "All records are read back after closing:\n";
+
+    for (unsigned i = numRecords / 2; i < numRecords; ++i)
+    {
+        fillRecord(i);
+        sink.Write(record);
+    }
+
+    sink.Close();
+
+    auto const keys = ReadNpy(directory + "/key.npy");
+    auto const params = ReadNpy(directory + "/params.npy");
+    auto const covariance = ReadNpy(directory + "/covariance.npy");
+    auto const ndf = ReadNpy(directory + "/ndf.npy");
+    auto const statuses = ReadNpy(directory + "/status.npy");
+
+    status = CheckShape(keys.first, "(20,)") and CheckShape(params.first, "(20, 3)") and
+      CheckShape(covariance.first, "(20, 3, 3)");
+    status &= (keys.second.size() == numRecords * sizeof(uint64_t) and
+      params.second.size() == numRecords * numParams * sizeof(double) and
+      covariance.second.size() == numRecords * numParams * numParams * sizeof(double) and
+      ndf.second.size() == numRecords * sizeof(uint32_t) and
+      statuses.second.size() == numRecords * sizeof(int32_t));
+
+    if (status)
+    {
+        for (unsigned i = 0; i < numRecords; ++i)
+        {
+            fillRecord(i);
+            uint64_t key;
+            double p[numParams], cov[numParams * numParams];
+            uint32_t n;
+            int32_t s;
+            memcpy(&key, keys.second.data() + i * sizeof(key), sizeof(key));
+            memcpy(p, params.second.data() + i * sizeof(p), sizeof(p));
+            memcpy(cov, covariance.second.data() + i * sizeof(cov), sizeof(cov));
+            memcpy(&n, ndf.second.data() + i * sizeof(n), sizeof(n));
+            memcpy(&s, statuses.second.data() + i * sizeof(s), sizeof(s));
+
+            status &= (key == record.key and n == record.ndf and s == record.status and
+              memcmp(p, record.params.data(), sizeof(p)) == 0 and
+              memcmp(cov, record.covariance.data(), sizeof(cov)) == 0);
+        }
+    }
+
+    ifstream namesFile(directory + "/param_names.txt");
+    stringstream names;
+    names << namesFile.rdbuf();
+    status &= (names.str() == "p0\np1\nnuisance\n");
+
+    printResult(status);
+    failure |= not status;
+
+
+    for (string const name: {"key", "params", "errors", "covariance", "chi2", "ndf", "status",
+      "time"})
+        remove((directory + "/" + name + ".npy").c_str());
+
+    remove((directory + "/param_names.txt").c_str());
+    remove(directory.c_str());
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
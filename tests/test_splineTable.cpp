@@ -0,0 +1,135 @@
+/**
+ * A unit test for class SplineTable.
+ *
+ * Splines defined on different grids of knots are combined into a table, which is then evaluated
+ * inside and outside of the range of the knots. The results are compared with TSpline3::Eval.
+ */
+
+#include <SplineTable.hpp>
+
+#include <TSpline.h>
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Constructs a spline through random points at the given knots
+shared_ptr<TSpline3> buildSpline(vector<double> const &knots, mt19937 &generator)
+{
+    uniform_real_distribution<double> distr(-1., 1.);
+    vector<double> values(knots.size());
+
+    for (auto &value: values)
+        value = distr(generator);
+
+    return make_shared<TSpline3>("", knots.data(), values.data(), knots.size());
+}
+
+
+/**
+ * Compares the table with the original splines
+ *
+ * The splines are evaluated at random points and at all knots. The points cover an extended range
+ * to check the extrapolation.
+ */
+bool checkTable(vector<shared_ptr<TSpline3>> const &splines, double minX, double maxX,
+  mt19937 &generator)
+{
+    SplineTable const table(splines);
+
+    if (table.GetNumSplines() != splines.size())
+        return false;
+
+    vector<double> points;
+    uniform_real_distribution<double> distr(minX, maxX);
+
+    for (unsigned i = 0; i < 10000; ++i)
+        points.emplace_back(distr(generator));
+
+    for (auto const &spline: splines)
+        for (int i = 0; i < spline->GetNp(); ++i)
+        {
+            double x, y;
+            spline->GetKnot(i, x, y);
+            points.emplace_back(x);
+        }
+
+    vector<double> values(splines.size());
+    double maxDeviation = 0.;
+
+    for (double const x: points)
+    {
+        table.Eval(x, values.data());
+
+        for (unsigned s = 0; s < splines.size(); ++s)
+        {
+            double const ref = splines[s]->Eval(x);
+            maxDeviation = max(maxDeviation, abs(values[s] - ref) / max(1., abs(ref)));
+        }
+    }
+
+    cout << "  Maximal deviation: " << maxDeviation << '\n';
+    return (maxDeviation < 1e-12);
+}
+
+
+int main()
+{
+    bool failure = false;
+    mt19937 generator(1234);
+
+
+    cout << "Splines with identical knots:\n";
+    vector<double> const commonKnots{3., 3.5, 4., 4.5, 5., 6., 7., 8.};
+    vector<shared_ptr<TSpline3>> splines;
+
+    for (unsigned i = 0; i < 9; ++i)
+        splines.emplace_back(buildSpline(commonKnots, generator));
+
+    bool status = checkTable(splines, 2., 9., generator);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Splines with different knots:\n";
+    splines.clear();
+    splines.emplace_back(buildSpline(commonKnots, generator));
+    splines.emplace_back(buildSpline({3.2, 3.9, 4.7, 5.1, 6.6, 7.3}, generator));
+    splines.emplace_back(buildSpline({2.5, 4.1, 8.5}, generator));
+    splines.emplace_back(buildSpline({4., 4.2}, generator));
+
+    status = checkTable(splines, 1., 10., generator);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,135 @@
+/**
+ * A unit test for the telemetry of the minimization.
+ *
+ * A quadratic function is minimized with Minuit2 while progress is reported with MinuitTelemetry.
+ * Without rate limiting, every iteration must produce a record, while with a long interval only
+ * the first one is written. The structure of the records and the final state are checked.
+ */
+
+#include <MinuitTelemetry.hpp>
+
+#include <Math/Functor.h>
+#include <Minuit2/Minuit2Minimizer.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Function to be minimized, with the minimum at (0.4, -0.2)
+double Quadratic(double const *x)
+{
+    return (x[0] - 1.) * (x[0] - 1.) + 2. * (x[1] + 0.5) * (x[1] + 0.5) +
+      (x[0] - x[1]) * (x[0] - x[1]);
+}
+
+
+/// Minimizes the quadratic function with telemetry and returns the records
+vector<string> RunFit(string const &fileName, double minInterval)
+{
+    std::remove(fileName.c_str());
+
+    ROOT::Math::Functor func(&Quadratic, 2);
+
+    MinuitTelemetry telemetry(fileName, minInterval, "test \"fit\"");
+    ROOT::Minuit2::Minuit2Minimizer minimizer;
+    minimizer.SetFunction(func);
+    minimizer.SetPrintLevel(0);
+    minimizer.SetTraceObject(telemetry);
+    minimizer.SetVariable(0, "a", 5., 0.1);
+    minimizer.SetVariable(1, "b", -5., 0.1);
+    minimizer.Minimize();
+    telemetry.Finish(minimizer);
+
+    ifstream file(fileName);
+    vector<string> records;
+    string line;
+
+    while (getline(file, line))
+        records.emplace_back(line);
+
+    std::remove(fileName.c_str());
+    return records;
+}
+
+
+/// Checks whether the given record is of the given type
+bool IsEvent(string const &record, string const &event)
+{
+    return (record.compare(0, 13 + event.size(), "{\"event\": \"" + event + "\"") == 0);
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    string const fileName("test_telemetry.jsonl");
+
+
+    cout << "Records without rate limiting:\n";
+    auto const records = RunFit(fileName, 0.);
+    status = (records.size() >= 4);
+    status &= (IsEvent(records.front(), "start") and IsEvent(records.back(), "end"));
+    status &= (records.front().find("\"names\": [\"a\", \"b\"]") != string::npos);
+
+    for (unsigned i = 1; i + 1 < records.size(); ++i)
+    {
+        status &= IsEvent(records[i], "iteration");
+        status &= (records[i].find("\"fval\": ") != string::npos);
+        status &= (records[i].find("\"edm\": ") != string::npos);
+        status &= (records[i].find("\"nfcn\": ") != string::npos);
+        status &= (records[i].find("\"params\": [") != string::npos);
+    }
+
+    for (auto const &record: records)
+    {
+        status &= (record.find("\"label\": \"test \\\"fit\\\"\"") != string::npos);
+        status &= (record.find("\"elapsed\": ") != string::npos);
+        status &= (record.back() == '}');
+    }
+
+    status &= (records.back().find("\"status\": 0") != string::npos);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Records with rate limiting:\n";
+    auto const limitedRecords = RunFit(fileName, 1e3);
+    status = (limitedRecords.size() == 3);
+    status &= IsEvent(limitedRecords[1], "iteration");
+    printResult(status);
+    failure |= not status;
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
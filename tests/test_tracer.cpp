@@ -0,0 +1,145 @@
+/**
+ * A unit test for the tracing of the computation.
+ *
+ * Spans are recorded in the main thread and in workers of a thread pool, some of them sampled.
+ * The resulting file in the Chrome trace-event format is checked for the expected numbers of
+ * spans, labels of thread tracks, and escaping of names. Spans created while tracing is not active
+ * must not be recorded.
+ */
+
+#include <ThreadPool.hpp>
+#include <Tracer.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+/// Counts non-overlapping occurrences of a substring
+unsigned CountOccurrences(string const &text, string const &pattern)
+{
+    unsigned count = 0;
+
+    for (auto pos = text.find(pattern); pos != string::npos;
+      pos = text.find(pattern, pos + pattern.size()))
+        ++count;
+
+    return count;
+}
+
+
+int main()
+{
+    bool failure = false;
+    bool status;
+
+    string const fileName("test_tracer.json");
+    ThreadPool threadPool(3);
+
+    {
+        TraceSpan span("Untraced");
+    }
+
+    Tracer::Start(fileName, 4);
+
+
+    cout << "Starting a second trace fails:\n";
+    status = false;
+
+    try
+    {
+        Tracer::Start("other.json");
+    }
+    catch (runtime_error const &)
+    {
+        status = true;
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    {
+        TraceSpan span("Outer \"span\"\\", "test");
+
+        // 40 sampled spans in total, of which one in four is recorded
+        threadPool.Run(40, [](unsigned, unsigned)
+        {
+            TraceSpan sampledSpan("Sampled", "test", Tracer::SampleEval());
+            TraceSpan taskSpan("Task", "test");
+        });
+
+        TraceSpan explicitSpan("Explicit");
+        explicitSpan.End();
+        explicitSpan.End();
+    }
+
+    Tracer::Stop();
+
+    {
+        TraceSpan span("Untraced");
+    }
+
+    Tracer::Stop();
+
+    ifstream file(fileName);
+    ostringstream buffer;
+    buffer << file.rdbuf();
+    string const trace(buffer.str());
+
+
+    cout << "Numbers of spans:\n";
+    status = (CountOccurrences(trace, "\"ph\": \"X\"") == 1 + 10 + 40 + 1);
+    status &= (CountOccurrences(trace, "\"name\": \"Sampled\"") == 10);
+    status &= (CountOccurrences(trace, "\"name\": \"Task\"") == 40);
+    status &= (CountOccurrences(trace, "\"name\": \"Explicit\"") == 1);
+    status &= (CountOccurrences(trace, "Untraced") == 0);
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Labels of threads and escaping of names:\n";
+    status = (CountOccurrences(trace, "\"args\": {\"name\": \"Main\"}") == 1);
+    status &= (trace.find("\"name\": \"Outer \\\"span\\\"\\\\\"") != string::npos);
+    status &= (trace.rfind("]}") != string::npos);
+
+    // Workers may be labelled only if they have executed some tasks
+    for (unsigned i = 1; i < threadPool.GetNumWorkers(); ++i)
+        status &= (CountOccurrences(trace, "\"Worker " + to_string(i) + "\"") <= 1);
+
+    printResult(status);
+    failure |= not status;
+
+
+    std::remove(fileName.c_str());
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}
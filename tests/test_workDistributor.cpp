@@ -0,0 +1,107 @@
+/**
+ * A unit test for the distribution of work units among MPI ranks.
+ *
+ * When the library is built with MPI support, run it with several ranks, e.g.
+ *   mpirun -np 4 test_workDistributor
+ * Without MPI, all units are processed sequentially. The time needed to process a unit varies
+ * strongly, which exercises the dynamic scheduling.
+ */
+
+#include <WorkDistributor.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\033[1;32mTest passed.\033[0m";
+    else
+        cout << "\033[1;31mTest failed.\033[0m";
+
+    cout << endl;
+}
+
+
+int main(int argc, char **argv)
+{
+    WorkDistributor distributor(&argc, &argv);
+
+    // Process every other unit out of the first 200 and skip the rest. Units with indices
+    //divisible by 7 take much longer than the others.
+    vector<unsigned long> units;
+
+    for (unsigned long unit = 0; unit < 200; unit += 2)
+        units.emplace_back(unit);
+
+    unsigned numCallbacks = 0;
+    auto const results = distributor.Run(units, 2,
+      [&distributor](unsigned long unit)
+      {
+          this_thread::sleep_for(chrono::milliseconds((unit % 7 == 0) ? 20 : 1));
+          return vector<double>{sqrt(double(unit)), double(distributor.GetRank())};
+      },
+      [&numCallbacks](unsigned long, vector<double> const &){++numCallbacks;});
+
+    if (not distributor.IsRoot())
+        return EXIT_SUCCESS;
+
+
+    bool failure = false;
+
+    cout << "Results for all units with " << distributor.GetNumRanks() << " ranks:\n";
+    bool status = (results.size() == units.size() and numCallbacks == units.size());
+    set<unsigned> ranksUsed;
+
+    for (auto const &unit: units)
+    {
+        auto const res = results.find(unit);
+
+        if (res == results.end() or res->second[0] != sqrt(double(unit)))
+        {
+            status = false;
+            break;
+        }
+
+        ranksUsed.insert(res->second[1]);
+    }
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << "Participation of ranks:\n";
+
+    // With several ranks the coordinator does not process units itself, and every worker must
+    //have received some units
+    if (distributor.GetNumRanks() == 1)
+        status = (ranksUsed == set<unsigned>{0});
+    else
+        status = (ranksUsed.size() == distributor.GetNumRanks() - 1 and
+          ranksUsed.count(0) == 0);
+
+    printResult(status);
+    failure |= not status;
+
+
+    cout << endl;
+
+    if (not failure)
+    {
+        cout << "\033[1;32mAll tests passed.\033[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\033[1;31mSome tests failed.\033[0m\n";
+        return EXIT_FAILURE;
+    }
+}